@@ -3,62 +3,244 @@
 
 #if SKYLARK_HAVE_OPENMP
 
+#include <omp.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include "../../utility/aligned_buffer.hpp"
+
 namespace skylark {
 namespace algorithms {
 
 namespace internal {
 
-template<typename T1, typename T2, typename T3>
-inline void jstep(const int *colptr, const int *rowind, const T1 *vals,
-    T2 *B, T3 *X, int k, T3 *xvals, int i) {
+/// Number of step indices a thread draws at once, ahead of the steps.
+const int asy_index_block = 4096;
+
+/**
+ * Distance between consecutive rows of the row-major copies of multiple
+ * right-hand sides: k rounded up so that no row straddles a cache line
+ * (a power of two below a line, a multiple of the line above it). With up
+ * to a line worth of right-hand sides an update touches a single line.
+ */
+template<typename T>
+inline int asy_row_stride(int k) {
+    const int line = 64 / sizeof(T);
+    if (k >= line)
+        return (k + line - 1) / line * line;
+    int stride = 1;
+    while (stride < k)
+        stride *= 2;
+    return stride;
+}
+
+/** Inverse of the diagonal of A (zero for empty columns). */
+template<typename IT, typename T1>
+inline void asy_inverse_diagonal(int n, const IT *colptr, const IT *rowind,
+    const T1 *vals, std::vector<double>& dinv) {
+
+    dinv.assign(n, 0.0);
+
+#   pragma omp parallel for
+    for(int i = 0; i < n; i++) {
+        if (colptr[i] == colptr[i + 1])
+            continue;
+        double diag = 1.0;
+        for(IT j = colptr[i]; j < colptr[i + 1]; j++)
+            if (rowind[j] == i)
+                diag = vals[j];
+        dinv[i] = 1.0 / diag;
+    }
+}
+
+/**
+ * Entries of X are read and written by all threads at once. In the single
+ * right-hand side step every access goes through an atomic (relaxed) read
+ * or write; these compile to plain loads and stores of aligned scalars.
+ */
+template<typename T>
+inline T asy_read(const T *p) {
+    T v;
+#   pragma omp atomic read
+    v = *p;
+    return v;
+}
+
+template<typename T>
+inline void asy_write(T *p, T v) {
+#   pragma omp atomic write
+    *p = v;
+}
 
-    double diag = 1.0, v;
+/**
+ * One step on coordinate i, single right-hand side. The new value is
+ * written with an atomic store, not an atomic update: a racing step on the
+ * same coordinate may be overwritten, which the asynchronous model
+ * tolerates, but no read-modify-write is locked.
+ *
+ * Returns the residual at i seen by the step (before the update).
+ */
+template<typename IT, typename T1, typename T2, typename T3>
+inline T3 jstep1(const IT *colptr, const IT *rowind, const T1 *vals,
+    const double *dinv, const T2 *b, T3 *x, int i) {
+
+    if (colptr[i] == colptr[i+1])
+        return T3(0);
+
+    T3 v = b[i];
+    for(IT j = colptr[i]; j < colptr[i + 1]; j++)
+        v -= vals[j] * asy_read(x + rowind[j]);
+
+    asy_write(x + i, asy_read(x + i) + v * dinv[i]);
+
+    return v;
+}
+
+/**
+ * One step on coordinate i, k right-hand sides held row-major with row
+ * stride ks (see asy_row_stride). The rows of X that are read and the row
+ * that is written are contiguous, and are accessed with plain (vector)
+ * loads and stores, not per-entry atomics, which would keep every row
+ * loop scalar. A row read while another thread writes it may mix old and
+ * new entries, and racing steps on the same coordinate may overwrite each
+ * other; the asynchronous model tolerates both. When KS is not 0 it is
+ * the row stride, and whole rows, padding included (which stays zero),
+ * are processed with a compile-time trip count.
+ *
+ * If ressqr is not NULL the squares of the residuals seen by the step are
+ * added to it (ks entries).
+ */
+template<int KS, typename IT, typename T1, typename T2, typename T3>
+inline void jstep(const IT *colptr, const IT *rowind, const T1 *vals,
+    const double *dinv, const T2 *B, T3 *X, int k, int ks, T3 *xvals,
+    double *ressqr, int i) {
+
+    if (KS != 0)
+        k = ks = KS;
 
     if (colptr[i] == colptr[i+1])
         return;
 
+    const T2 *bi = B + i * ks;
     for(int r = 0; r < k; r++)
-        xvals[r] = B[i * k + r];
+        xvals[r] = bi[r];
 
-    for(int j = colptr[i]; j < colptr[i + 1]; j++) {
-        if (rowind[j] == i)
-            diag = vals[j];
-        v = vals[j];
-        double *xx = X + rowind[j] * k;
+    for(IT j = colptr[i]; j < colptr[i + 1]; j++) {
+        T3 v = vals[j];
+        const T3 *xx = X + rowind[j] * ks;
         for (int r = 0; r < k; r++)
             xvals[r] -= v * xx[r];
     }
 
-    for(int r = 0; r < k; r++) {
-        int idx = i * k + r;
-        v = xvals[r] / diag;
-#       pragma omp atomic
-        X[idx] += v;
-    }
+    if (ressqr != NULL)
+        for(int r = 0; r < k; r++)
+            ressqr[r] += xvals[r] * xvals[r];
+
+    T3 d = dinv[i];
+    T3 *xi = X + i * ks;
+    for(int r = 0; r < k; r++)
+        xi[r] += d * xvals[r];
 }
 
-template<typename T1, typename T2, typename T3>
-inline void jstep1(const int *colptr, const int *rowind, const T1 *vals,
-    T2 *b, T3 *x, int i) {
+/** Steps on the coordinates idxs[0, count). */
+template<int KS, typename IT, typename T1, typename T2, typename T3>
+inline void jsteps(const IT *colptr, const IT *rowind, const T1 *vals,
+    const double *dinv, const T2 *B, T3 *X, int k, int ks, T3 *xvals,
+    double *ressqr, const int *idxs, int count) {
 
-    double diag = 1.0, v;
+    for(int c = 0; c < count; c++)
+        jstep<KS>(colptr, rowind, vals, dinv, B, X, k, ks, xvals, ressqr,
+            idxs[c]);
+}
 
-    if (colptr[i] == colptr[i+1])
-        return;
+/**
+ * Runs sweeps * n randomized steps with all threads. Each thread draws its
+ * coordinates, uniformly and independently, from its own generator (seeded
+ * from the context) in blocks of asy_index_block, so drawing is a small
+ * fraction of the cost of a step.
+ *
+ * If ressqr is not NULL, it is set to an estimate of the squared residual
+ * norm of each of the k columns, at no extra read: every step computes
+ * the residual at its coordinate anyway, and since coordinates are drawn
+ * uniformly n / steps times the sum of their squares estimates the squared
+ * norm. The residuals are seen while X still changes, so for a converging
+ * iteration the estimate lags behind (errs on the large side); ask for it
+ * on a single sweep to keep it current.
+ */
+template<typename IT, typename T1, typename T2, typename T3>
+inline void asy_sweeps(int n, const IT *colptr, const IT *rowind,
+    const T1 *vals, const double *dinv, const T2 *B, T3 *X, int k, int ks,
+    int sweeps, base::context_t& context, double *ressqr = NULL) {
+
+    int nthreads = omp_get_max_threads();
+    std::vector<int> seeds(nthreads);
+    for(int t = 0; t < nthreads; t++)
+        seeds[t] = context.random_int();
+
+    size_t steps = static_cast<size_t>(sweeps) * n;
+
+    if (ressqr != NULL)
+        std::fill(ressqr, ressqr + k, 0.0);
+
+#   pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        size_t mysteps = steps / nt + (static_cast<size_t>(t) < steps % nt);
+
+        boost::random::mt19937 gen(seeds[t]);
+        boost::random::uniform_int_distribution<int> distribution(0, n - 1);
+        std::vector<int> idxs(asy_index_block);
+        std::vector<T3> xvals(ks);
+        std::vector<double> myressqr(ressqr != NULL ? ks : 0, 0.0);
+        double *rs = ressqr != NULL ? myressqr.data() : NULL;
+
+        for(size_t s = 0; s < mysteps; s += asy_index_block) {
+            int count = static_cast<int>(
+                std::min<size_t>(asy_index_block, mysteps - s));
+            for(int c = 0; c < count; c++)
+                idxs[c] = distribution(gen);
+
+            const int *ic = idxs.data();
+            T3 *xv = xvals.data();
+            if (k == 1 && rs != NULL)
+                for(int c = 0; c < count; c++) {
+                    T3 v = jstep1(colptr, rowind, vals, dinv, B, X, ic[c]);
+                    rs[0] += v * v;
+                }
+            else if (k == 1)
+                for(int c = 0; c < count; c++)
+                    jstep1(colptr, rowind, vals, dinv, B, X, ic[c]);
+            else if (ks == 2)
+                jsteps<2>(colptr, rowind, vals, dinv, B, X, k, ks, xv, rs,
+                    ic, count);
+            else if (ks == 4)
+                jsteps<4>(colptr, rowind, vals, dinv, B, X, k, ks, xv, rs,
+                    ic, count);
+            else if (ks == 8)
+                jsteps<8>(colptr, rowind, vals, dinv, B, X, k, ks, xv, rs,
+                    ic, count);
+            else
+                jsteps<0>(colptr, rowind, vals, dinv, B, X, k, ks, xv, rs,
+                    ic, count);
+        }
 
-    v = b[i];
-    for(int j = colptr[i]; j < colptr[i + 1]; j++) {
-        if (rowind[j] == i)
-            diag = vals[j];
-        v -= vals[j] * x[rowind[j]];
+        if (rs != NULL) {
+#           pragma omp critical
+            for(int r = 0; r < k; r++)
+                ressqr[r] += rs[r];
+        }
     }
 
-    v /= diag;
-#   pragma omp atomic
-    x[i] += v;
+    if (ressqr != NULL && steps > 0)
+        for(int r = 0; r < k; r++)
+            ressqr[r] *= static_cast<double>(n) / steps;
 }
 
-
 } // namespace internal
 
 /**
@@ -90,21 +272,27 @@ int AsyRGS(const base::sparse_matrix_t<T1>& A, const elem::Matrix<T2>& B,
 
     int n = A.height();   // We assume A is square. TODO assert it.
 
-    const int *colptr = A.indptr();
-    const int *rowind = A.indices();
+    typedef typename base::sparse_matrix_t<T1>::index_type index_type;
+    const index_type *colptr = A.indptr();
+    const index_type *rowind = A.indices();
     const T1 *vals = A.locked_values();
 
-    typedef boost::random::uniform_int_distribution<int> dtype;
-    dtype distribution(0, n-1);
+    std::vector<double> dinv;
+    internal::asy_inverse_diagonal(n, colptr, rowind, vals, dinv);
 
     if (B.Width() == 1) {
-       int j;
 
        double nrmb = base::Nrm2(B);
 
        const T2 *Bd = B.LockedBuffer();
        T3 *Xd = X.Buffer();
 
+       // With a tolerance, the last sweep of every block also estimates
+       // the residual (see asy_sweeps); it is computed exactly only once
+       // the estimate says convergence.
+       int monitored = params.tolerance > 0 ? 1 : 0;
+       double estsqr;
+
        int sweeps_left = params.sweeps_lim;
        int done_sweeps = 0;
        while (sweeps_left > 0) {
@@ -112,28 +300,34 @@ int AsyRGS(const base::sparse_matrix_t<T1>& A, const elem::Matrix<T2>& B,
            int sweeps = params.syn_sweeps > 0 ?
                std::min(params.syn_sweeps, sweeps_left) : sweeps_left;
 
-           utility::random_samples_array_t<dtype> stepidxs =
-               context.allocate_random_samples_array(sweeps * n, distribution);
-
-#          pragma omp parallel for default(shared) private(j)
-           for(j = 0; j < sweeps * n ; j++)
-               internal::jstep1(colptr, rowind, vals, Bd, Xd, stepidxs[j]);
+           if (sweeps > monitored)
+               internal::asy_sweeps(n, colptr, rowind, vals, dinv.data(),
+                   Bd, Xd, 1, 1, sweeps - monitored, context);
+           if (monitored)
+               internal::asy_sweeps(n, colptr, rowind, vals, dinv.data(),
+                   Bd, Xd, 1, 1, 1, context, &estsqr);
 
            sweeps_left -= sweeps;
            done_sweeps += sweeps;
 
            if (params.tolerance > 0) {
-               elem::Matrix<double> R(B);
-               base::Gemv(elem::ADJOINT, -1.0, A, X, 1.0, R);
-               double res = base::Nrm2(R);
+               double res = sqrt(estsqr);
+               bool exact = res < nrmb * params.tolerance;
+               if (exact) {
+                   elem::Matrix<double> R(B);
+                   base::Gemv(elem::ADJOINT, -1.0, A, X, 1.0, R);
+                   res = base::Nrm2(R);
+               }
                double relres = res / nrmb;
 
                if (log_lev2)
                    params.log_stream << "AsyRGS: Sweeps = " << done_sweeps
                                      << ", Relres = "
-                                     << boost::format("%.2e") % relres << std::endl;
+                                     << boost::format("%.2e") % relres
+                                     << (exact ? "" : " (estimated)")
+                                     << std::endl;
 
-               if(res < nrmb * params.tolerance) {
+               if(exact && res < nrmb * params.tolerance) {
                    if (log_lev1)
                        params.log_stream << "AsyRGS: Convergence!" << std::endl;
                    ret = -1;
@@ -142,18 +336,26 @@ int AsyRGS(const base::sparse_matrix_t<T1>& A, const elem::Matrix<T2>& B,
            }
        }
      } else {
-        int j;
+
+        // Row-major copies of B and X, rows padded to asy_row_stride, that
+        // are also seen as the k x n (column-major) matrices BT and XT.
+        int k = B.Width();
+        int ks = internal::asy_row_stride<T3>(k);
+
+        utility::aligned_buffer_t<T2> Bbuf(static_cast<size_t>(ks) * n);
+        utility::aligned_buffer_t<T3> Xbuf(static_cast<size_t>(ks) * n);
+        std::fill(Bbuf.data(), Bbuf.data() + Bbuf.size(), T2(0));
+        std::fill(Xbuf.data(), Xbuf.data() + Xbuf.size(), T3(0));
 
         elem::Matrix<T2> BT;
+        BT.Attach(k, n, Bbuf.data(), ks);
         elem::Transpose(B, BT);
         elem::Matrix<T3> XT;
+        XT.Attach(k, n, Xbuf.data(), ks);
         elem::Transpose(X, XT);
 
-        const T2 *Bd = BT.LockedBuffer();
-        T3 *Xd = XT.Buffer();
-
-        int k = B.Width();
-        T3 d[k];
+        const T2 *Bd = Bbuf.data();
+        T3 *Xd = Xbuf.data();
 
         typedef elem::Matrix<T2> rhs_type;
         typedef utility::elem_extender_t<
@@ -170,6 +372,11 @@ int AsyRGS(const base::sparse_matrix_t<T1>& A, const elem::Matrix<T2>& B,
         total_nrmb = sqrt(total_nrmb);
         scalar_cont_type ressqr(nrmb);
 
+        // Residual estimates from the last sweep of every block, as for a
+        // single right-hand side.
+        int monitored = params.tolerance > 0 ? 1 : 0;
+        std::vector<double> estsqr(k);
+
         int sweeps_left = params.sweeps_lim;
         int done_sweeps = 0;
         while (sweeps_left > 0) {
@@ -177,28 +384,38 @@ int AsyRGS(const base::sparse_matrix_t<T1>& A, const elem::Matrix<T2>& B,
             int sweeps = params.syn_sweeps > 0 ?
                 std::min(params.syn_sweeps, sweeps_left) : sweeps_left;
 
-            utility::random_samples_array_t<dtype> stepidxs =
-                context.allocate_random_samples_array(sweeps * n, distribution);
-
-#           pragma omp parallel for default(shared) private(j, d)
-            for(j = 0; j < sweeps * n ; j++)
-                internal::jstep(colptr, rowind, vals, Bd, Xd, k, d, stepidxs[j]);
+            if (sweeps > monitored)
+                internal::asy_sweeps(n, colptr, rowind, vals, dinv.data(),
+                    Bd, Xd, k, ks, sweeps - monitored, context);
+            if (monitored)
+                internal::asy_sweeps(n, colptr, rowind, vals, dinv.data(),
+                    Bd, Xd, k, ks, 1, context, estsqr.data());
 
            sweeps_left -= sweeps;
            done_sweeps += sweeps;
 
            if (params.tolerance > 0) {
 
-               elem::Matrix<double> RT(BT);
-               base::Gemm(elem::NORMAL, elem::NORMAL, -1.0, XT, A, 1.0, RT);
-               base::RowDot(RT, RT, ressqr);
-
                int convg = 0;
                for(int i = 0; i < k; i++) {
+                   ressqr[i] = estsqr[i];
                    if (sqrt(ressqr[i]) < (params.tolerance*nrmb[i]))
                        convg++;
                }
 
+               bool exact = convg == k;
+               if (exact) {
+                   elem::Matrix<double> RT(BT);
+                   base::Gemm(elem::NORMAL, elem::NORMAL, -1.0, XT, A, 1.0, RT);
+                   base::RowDot(RT, RT, ressqr);
+
+                   convg = 0;
+                   for(int i = 0; i < k; i++) {
+                       if (sqrt(ressqr[i]) < (params.tolerance*nrmb[i]))
+                           convg++;
+                   }
+               }
+
                if (log_lev2) {
                    double total_ressqr = 0.0;
                    for(int i = 0; i < k; i++)
@@ -207,6 +424,7 @@ int AsyRGS(const base::sparse_matrix_t<T1>& A, const elem::Matrix<T2>& B,
                    params.log_stream << "AsyRGS: Sweeps = " << done_sweeps
                                      << ", Relres = "
                                      << boost::format("%.2e") % relres
+                                     << (exact ? "" : " (estimated)")
                                      << ", " << convg << " rhs converged" << std::endl;
                }
 
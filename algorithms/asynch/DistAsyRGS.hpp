@@ -0,0 +1,269 @@
+#ifndef SKYLARK_DIST_ASYRGS_HPP
+#define SKYLARK_DIST_ASYRGS_HPP
+
+#if SKYLARK_HAVE_OPENMP
+
+#include <cmath>
+#include <vector>
+
+#include <boost/mpi.hpp>
+
+#include "AsyRGS.hpp"
+#include "../../base/dist_sparse_matrix.hpp"
+#include "../../utility/aligned_buffer.hpp"
+
+namespace skylark {
+namespace algorithms {
+
+namespace internal {
+
+/**
+ * Ghost rows of a block distributed AsyRGS, kept current by their owners
+ * with one-sided puts into a window over them. Every rank opens a passive
+ * target epoch on all others once; after each local sweep it puts its
+ * boundary rows straight into the ghost rows of the ranks that need them,
+ * and flushes. Nobody waits for anybody: a rank reads whatever values the
+ * owners last put, which is what the asynchronous method expects.
+ */
+template<typename T, typename MT>
+struct asy_ghost_window_t {
+
+    asy_ghost_window_t(const base::dist_sparse_matrix_t<MT>& A, T *X,
+        int k, int ks) : _A(A), _X(X), _k(k), _ks(ks),
+                         _sendbuf(A.send_rows().size() * ks) {
+
+        // A rank without ghost rows exposes an empty window.
+        int nloc = A.local_width();
+        size_t nghosts = A.ghosts().size();
+        MPI_Win_create(nghosts > 0 ? X + nloc * ks : NULL,
+            nghosts * ks * sizeof(T), sizeof(T),
+            MPI_INFO_NULL, A.comm(), &_win);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, _win);
+    }
+
+    ~asy_ghost_window_t() {
+        MPI_Win_unlock_all(_win);
+        MPI_Win_free(&_win);
+    }
+
+    /** Puts the boundary rows to the ranks holding them as ghosts. */
+    void push() {
+        const std::vector<int>& rows = _A.send_rows();
+        const std::vector<int>& counts = _A.send_counts();
+        const std::vector<int>& displs = _A.send_displs();
+        const std::vector<int>& remote = _A.remote_ghost_displs();
+
+        for(size_t t = 0; t < rows.size(); t++)
+            std::copy(_X + rows[t] * _ks, _X + rows[t] * _ks + _k,
+                _sendbuf.data() + t * _ks);
+
+        for(size_t q = 0; q < counts.size(); q++)
+            if (counts[q] > 0)
+                MPI_Put(_sendbuf.data() + displs[q] * _ks, counts[q] * _ks,
+                    boost::mpi::get_mpi_datatype<T>(), q,
+                    remote[q] * _ks, counts[q] * _ks,
+                    boost::mpi::get_mpi_datatype<T>(), _win);
+
+        MPI_Win_flush_all(_win);
+        MPI_Win_sync(_win);
+    }
+
+    /** Makes the puts of all ranks so far visible (collective). */
+    void synchronize() {
+        MPI_Win_flush_all(_win);
+        MPI_Barrier(_A.comm());
+        MPI_Win_sync(_win);
+    }
+
+private:
+    const base::dist_sparse_matrix_t<MT>& _A;
+    T *_X;
+    const int _k, _ks;
+    utility::aligned_buffer_t<T> _sendbuf;
+    MPI_Win _win;
+};
+
+} // namespace internal
+
+/**
+ * Asynchronous Randomized Gauss-Seidel for solving A * X = B, with A
+ * distributed by blocks of rows over MPI ranks (see
+ * base::dist_sparse_matrix_t) and B, X distributed [VC, STAR].
+ *
+ * Each rank runs the shared-memory AsyRGS steps on its own rows, with its
+ * threads, reading the rows owned by other ranks from ghost copies. After
+ * every local sweep the rank pushes its boundary rows into the ghost copies
+ * of its neighbors with MPI-3 one-sided puts (passive target), so there is
+ * no barrier between sweeps and ranks drift apart as they please.
+ * When params.tolerance > 0 the residual estimates of the ranks are summed
+ * every params.syn_sweeps sweeps, and only once they indicate convergence
+ * do the ranks synchronize to check it exactly.
+ *
+ * Returns like the local AsyRGS. Plugs in as asy_precond_t, hence into
+ * AsyFCG.
+ *
+ * @param A input matrix.
+ * @param B right hand side.
+ * @param X output - must be preallocated. The content is used as initial X.
+ */
+template<typename T>
+int AsyRGS(const base::dist_sparse_matrix_t<T>& A,
+    const elem::DistMatrix<T, elem::VC, elem::STAR>& B,
+    elem::DistMatrix<T, elem::VC, elem::STAR>& X, base::context_t& context,
+    asy_iter_params_t params = asy_iter_params_t()) {
+
+    int ret = -6;
+
+    const boost::mpi::communicator& comm = A.comm();
+
+    bool log_lev1 = params.am_i_printing && params.log_level >= 1;
+    bool log_lev2 = params.am_i_printing && params.log_level >= 2;
+
+    typedef typename base::dist_sparse_matrix_t<T>::index_type index_type;
+    const index_type *colptr = A.local().indptr();
+    const index_type *rowind = A.local_indices();
+    const T *vals = A.local().locked_values();
+
+    int nloc = A.local_width();
+    int nghosts = A.ghosts().size();
+    int k = B.Width();
+    int ks = k == 1 ? 1 : internal::asy_row_stride<T>(k);
+
+    std::vector<double> dinv;
+    internal::asy_inverse_diagonal(nloc, colptr, rowind, vals, dinv);
+
+    // Owned rows of B and X, then the ghost rows of X, row-major. A rank
+    // may own no rows (and hold no ghosts): its buffers are then empty,
+    // it takes no steps, but it joins all the collectives below.
+    utility::aligned_buffer_t<T> Bbuf(static_cast<size_t>(ks) * nloc);
+    utility::aligned_buffer_t<T> Xbuf(
+        static_cast<size_t>(ks) * (nloc + nghosts));
+    std::fill(Bbuf.data(), Bbuf.data() + Bbuf.size(), T(0));
+    std::fill(Xbuf.data(), Xbuf.data() + Xbuf.size(), T(0));
+    A.to_blocks(B, Bbuf.data(), ks);
+    A.to_blocks(X, Xbuf.data(), ks);
+    A.exchange_ghosts(Xbuf.data(), k, ks);
+
+    const T *Bd = Bbuf.data();
+    T *Xd = Xbuf.data();
+
+    std::vector<double> nrmb(k, 0.0);
+    double total_nrmb = 0.0;
+    if (params.tolerance > 0) {
+        std::vector<double> local(k, 0.0);
+        for(int j = 0; j < nloc; j++)
+            for(int r = 0; r < k; r++)
+                local[r] += Bd[j * ks + r] * Bd[j * ks + r];
+        boost::mpi::all_reduce(comm, &local[0], k, &nrmb[0],
+            std::plus<double>());
+        for(int r = 0; r < k; r++) {
+            total_nrmb += nrmb[r];
+            nrmb[r] = std::sqrt(nrmb[r]);
+        }
+        total_nrmb = std::sqrt(total_nrmb);
+    }
+
+    // Every rank draws its own steps (shared seed, offset by the rank; the
+    // offset wraps around in unsigned arithmetic).
+    unsigned int seed = static_cast<unsigned int>(context.random_int());
+    unsigned int rank = static_cast<unsigned int>(comm.rank());
+    base::context_t local_context(static_cast<int>(seed + rank));
+
+    {
+        internal::asy_ghost_window_t<T, T> window(A, Xd, k, ks);
+
+        std::vector<double> local(k, 0.0), ressqr(k);
+
+        int sweeps_left = params.sweeps_lim;
+        int done_sweeps = 0;
+        while (sweeps_left > 0) {
+
+            int sweeps = params.syn_sweeps > 0 ?
+                std::min(params.syn_sweeps, sweeps_left) : sweeps_left;
+
+            // With a tolerance, the last sweep also estimates the residual
+            // of the local rows (see asy_sweeps).
+            for(int s = 0; s < sweeps; s++) {
+                bool monitored = params.tolerance > 0 && s == sweeps - 1;
+                if (nloc > 0)
+                    internal::asy_sweeps(nloc, colptr, rowind, vals,
+                        dinv.data(), Bd, Xd, k, ks, 1, local_context,
+                        monitored ? &local[0] : NULL);
+                window.push();
+            }
+
+            sweeps_left -= sweeps;
+            done_sweeps += sweeps;
+
+            if (params.tolerance > 0) {
+                boost::mpi::all_reduce(comm, &local[0], k, &ressqr[0],
+                    std::plus<double>());
+
+                int convg = 0;
+                for(int r = 0; r < k; r++)
+                    if (std::sqrt(ressqr[r]) < params.tolerance * nrmb[r])
+                        convg++;
+
+                // Only an estimate that says convergence is checked exactly.
+                bool exact = convg == k;
+                if (exact) {
+                    window.synchronize();
+
+                    std::fill(local.begin(), local.end(), 0.0);
+                    std::vector<T> res(k);
+                    for(int j = 0; j < nloc; j++) {
+                        for(int r = 0; r < k; r++)
+                            res[r] = Bd[j * ks + r];
+                        for(index_type l = colptr[j]; l < colptr[j + 1]; l++)
+                            for(int r = 0; r < k; r++)
+                                res[r] -= vals[l] * Xd[rowind[l] * ks + r];
+                        for(int r = 0; r < k; r++)
+                            local[r] += res[r] * res[r];
+                    }
+                    boost::mpi::all_reduce(comm, &local[0], k, &ressqr[0],
+                        std::plus<double>());
+
+                    convg = 0;
+                    for(int r = 0; r < k; r++)
+                        if (std::sqrt(ressqr[r]) < params.tolerance * nrmb[r])
+                            convg++;
+                }
+
+                double total_ressqr = 0.0;
+                for(int r = 0; r < k; r++)
+                    total_ressqr += ressqr[r];
+
+                if (log_lev2)
+                    params.log_stream << "AsyRGS: Sweeps = " << done_sweeps
+                                      << ", Relres = "
+                                      << boost::format("%.2e") %
+                        (std::sqrt(total_ressqr) / total_nrmb)
+                                      << (exact ? "" : " (estimated)")
+                                      << ", " << convg << " rhs converged"
+                                      << std::endl;
+
+                if (convg == k) {
+                    ret = -1;
+                    break;
+                }
+            }
+        }
+    }
+
+    A.from_blocks(Xd, ks, X);
+
+    if (ret == -1) {
+        if (log_lev1)
+            params.log_stream << "AsyRGS: Convergence!" << std::endl;
+    } else if (log_lev1)
+        params.log_stream << "AsyRGS: No convergence within iteration limit."
+                          << std::endl;
+
+    return ret;
+}
+
+} } // namespace skylark::algorithms
+
+#endif  // if SKYLARK_HAVE_OPENMP
+
+#endif // SKYLARK_DIST_ASYRGS_HPP
@@ -3,6 +3,7 @@
 
 #include "asy_iter_params.hpp"
 #include "AsyRGS.hpp"
+#include "DistAsyRGS.hpp"
 #include "precond.hpp"
 #include "AsyFCG.hpp"
 
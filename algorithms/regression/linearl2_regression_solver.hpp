@@ -22,6 +22,10 @@ struct ne_l2_solver_tag : l2_solver_tag {};
 /// Tag for using SVD to solve L2 linear regression problems.
 struct svd_l2_solver_tag : l2_solver_tag {};
 
+/// Tag for using a communication-avoiding tree QR (TSQR) of row blocks
+/// that stay on their ranks to solve L2 linear regression problems.
+struct tsqr_l2_solver_tag : l2_solver_tag {};
+
 /**
  * Tag for using an iterative method to solve L2 linear regression.
  *
@@ -1,13 +1,19 @@
 #ifndef SKYLARK_SKETCHED_REGRESSION_SOLVER_ELEMENTAL_HPP
 #define SKYLARK_SKETCHED_REGRESSION_SOLVER_ELEMENTAL_HPP
 
+#include <algorithm>
+
 #include <boost/mpi.hpp>
 #include <elemental.hpp>
 
 #include "../../base/context.hpp"
+#include "../../base/exception.hpp"
+#include "../../base/QR.hpp"
 #include "regression_problem.hpp"
+#include "linearl2_regression_solver.hpp"
 #include "../../sketch/sketch.hpp"
 #include "../../utility/typer.hpp"
+#include "../../utility/get_communicator.hpp"
 
 namespace skylark {
 namespace algorithms {
@@ -215,6 +221,124 @@ public:
     }
 };
 
+/**
+ * Sketch-and-solve for tall [VC/VR, STAR] least-squares problems that never
+ * gathers the sketch: every rank sketches its own rows with its own
+ * independent transform of the full sketch size (so the sketch is block
+ * diagonal and, each block being a subspace embedding of the rows of its
+ * rank, so is the whole), and the stacked sketched blocks are factored with
+ * the butterfly TSQR of base::qr::tsqr_t. Only n x n blocks travel, in
+ * log P rounds, and Q^T S b goes through the same tree when solving.
+ *
+ * Ranks with no more rows than the sketch size use their rows as they are.
+ *
+ * The sketch types are spelled through typer_t, like in the generic local
+ * sketch specialization, so that this one is the more specialized of the two.
+ */
+template <typename ValueType, elem::Distribution VD,
+          template <typename, typename> class TransformType>
+class sketched_regression_solver_t<
+    regression_problem_t<elem::DistMatrix<ValueType, VD, elem::STAR>,
+                         linear_tag, l2_tag, no_reg_tag>,
+    elem::DistMatrix<ValueType, VD, elem::STAR>,
+    elem::DistMatrix<ValueType, elem::STAR, elem::STAR>,
+    linear_tag,
+    elem::Matrix<typename utility::typer_t<
+        elem::DistMatrix<ValueType, VD, elem::STAR> >::value_type>,
+    elem::Matrix<typename utility::typer_t<
+        elem::DistMatrix<ValueType, VD, elem::STAR> >::value_type>,
+    TransformType,
+    tsqr_l2_solver_tag> {
+
+public:
+
+    typedef ValueType value_type;
+
+    typedef elem::Matrix<value_type> sketch_type;
+    typedef elem::Matrix<value_type> sketch_rhs_type;
+    typedef elem::DistMatrix<value_type, VD, elem::STAR> matrix_type;
+    typedef elem::DistMatrix<value_type, VD, elem::STAR> rhs_type;
+    typedef elem::DistMatrix<value_type, elem::STAR, elem::STAR> sol_type;
+
+    typedef regression_problem_t<matrix_type,
+                                 linear_tag, l2_tag, no_reg_tag> problem_type;
+
+private:
+    typedef typename TransformType<sketch_type, sketch_type>::data_type
+    transform_data_type;
+
+    const int _n;
+    int _local_height;
+    int _local_sketch_size;
+    transform_data_type *_sketch;
+    base::qr::tsqr_t<value_type> _tsqr;
+
+    /** Sketches the local rows of a matrix distributed like the input. */
+    void sketch_local(const sketch_type& A, sketch_type& SA) const {
+        if (_sketch == nullptr) {
+            SA = A;
+            return;
+        }
+
+        TransformType<sketch_type, sketch_type> S(*_sketch);
+        SA.Resize(_local_sketch_size, A.Width());
+        S.apply(A, SA, sketch::columnwise_tag());
+    }
+
+public:
+    sketched_regression_solver_t(const problem_type& problem, int sketch_size,
+        base::context_t& context) :
+        _n(problem.n), _sketch(nullptr),
+        _tsqr(utility::get_communicator(problem.input_matrix)) {
+
+        const matrix_type& A = problem.input_matrix;
+        boost::mpi::communicator comm = utility::get_communicator(A);
+
+        _local_height = A.LocalHeight();
+        _local_sketch_size = std::min(sketch_size, _local_height);
+
+        // Each rank draws from its own stream, keyed by a shared seed
+        // offset by the rank (the counter of a context is only an int).
+        // The offset wraps around in unsigned arithmetic.
+        unsigned int seed = static_cast<unsigned int>(context.random_int());
+        if (_local_sketch_size < _local_height) {
+            unsigned int rank = static_cast<unsigned int>(comm.rank());
+            base::context_t local_context(static_cast<int>(seed + rank));
+            _sketch = new transform_data_type(_local_height,
+                _local_sketch_size, local_context);
+        }
+
+        sketch_type SA;
+        sketch_local(A.LockedMatrix(), SA);
+        _tsqr.factor(SA);
+    }
+
+    ~sketched_regression_solver_t() {
+        delete _sketch;
+    }
+
+    void solve(const rhs_type& b, sol_type& x) {
+        solve_mulitple(b, x);
+    }
+
+    void solve_mulitple(const rhs_type& B, sol_type& X) {
+        if (B.LocalHeight() != _local_height)
+            SKYLARK_THROW_EXCEPTION (
+                base::nla_exception()
+                  << base::error_msg(
+                      "Right-hand side must be distributed like the input"));
+
+        sketch_type SB, C;
+        sketch_local(B.LockedMatrix(), SB);
+        _tsqr.apply_adjoint_Q(SB, C);
+        elem::Trsm(elem::LEFT, elem::UPPER, elem::NORMAL, elem::NON_UNIT,
+            value_type(1), _tsqr.R(), C, true);
+
+        X.Resize(_n, B.Width());
+        X.Matrix() = C;
+    }
+};
+
 } } // namespace skylark::algorithms
 
 #endif // SKYLARK_SKETCHED_REGRESSION_SOLVER_ELEMENTAL_HPP
@@ -199,8 +199,9 @@ inline void Gemm(elem::Orientation oA, elem::Orientation oB,
     T beta, elem::Matrix<T>& C) {
     // TODO verify sizes etc.
 
-    const int* indptr = B.indptr();
-    const int* indices = B.indices();
+    typedef typename sparse_matrix_t<T>::index_type index_type;
+    const index_type* indptr = B.indptr();
+    const index_type* indices = B.indices();
     const T *values = B.locked_values();
 
     int k = A.Width();
@@ -216,95 +217,43 @@ inline void Gemm(elem::Orientation oA, elem::Orientation oB,
     if (oA == elem::ADJOINT || oB == elem::ADJOINT)
         SKYLARK_THROW_EXCEPTION(base::unsupported_base_operation());
 
-    // NN
-    if (oA == elem::NORMAL && oB == elem::NORMAL) {
+    elem::Scal(beta, C);
 
-        elem::Scal(beta, C);
+    const T *a = A.LockedBuffer();
+    int lda = A.LDim();
 
-        elem::Matrix<T> Ac;
-        elem::Matrix<T> Cc;
+    T *c = C.Buffer();
+    int ldc = C.LDim();
 
-#       if SKYLARK_HAVE_OPENMP
-#       pragma omp parallel for private(Cc, Ac)
-#       endif
-        for(int col = 0; col < n; col++) {
-            elem::View(Cc, C, 0, col, m, 1);
-            for (int j = indptr[col]; j < indptr[col + 1]; j++) {
-                int row = indices[j];
-                T val = values[j];
-                elem::LockedView(Ac, A, 0, row, m, 1);
-                elem::Axpy(alpha * val, Ac, Cc);
-            }
-        }
-    }
+    // NN
+    if (oA == elem::NORMAL && oB == elem::NORMAL)
+        detail::dense_sparse_gemm_nn(m, n, alpha, a, lda,
+            indptr, indices, values, c, ldc);
 
     // NT
-    if (oA == elem::NORMAL && oB == elem::TRANSPOSE) {
-
-        elem::Scal(beta, C);
-
-        elem::Matrix<T> Ac;
-        elem::Matrix<T> Cc;
-
-        // Now, we simply think of B has being in CSR mode...
-        int row = 0;
-        for(int row = 0; row < n; row++) {
-            elem::LockedView(Ac, A, 0, row, m, 1);
-#           if SKYLARK_HAVE_OPENMP
-#           pragma omp parallel for private(Cc)
-#           endif
-            for (int j = indptr[row]; j < indptr[row + 1]; j++) {
-                int col = indices[j];
-                T val = values[j];
-                elem::View(Cc, C, 0, col, m, 1);
-                elem::Axpy(alpha * val, Ac, Cc);
-            }
-        }
-    }
-
-
-    // TN - TODO: Not tested!
-    if (oA == elem::TRANSPOSE && oB == elem::NORMAL) {
-        double *c = C.Buffer();
-        int ldc = C.LDim();
-
-        const double *a = A.LockedBuffer();
-        int lda = A.LDim();
-
-#       if SKYLARK_HAVE_OPENMP
-#       pragma omp parallel for collapse(2)
-#       endif
-        for (int j = 0; j < n; j++)
-            for(int row = 0; row < k; row++) {
-                c[j * ldc + row] *= beta;
-                 for (int l = indptr[j]; l < indptr[j + 1]; l++) {
-                     int rr = indices[l];
-                     T val = values[l];
-                     c[j * ldc + row] += val * a[j * lda + rr];
-                 }
-            }
-    }
-
-    // TT - TODO: Not tested!
-    if (oA == elem::TRANSPOSE && oB == elem::TRANSPOSE) {
-        elem::Scal(beta, C);
-
-        double *c = C.Buffer();
-        int ldc = C.LDim();
-
-        const double *a = A.LockedBuffer();
-        int lda = A.LDim();
+    if (oA == elem::NORMAL && oB == elem::TRANSPOSE)
+        detail::dense_sparse_gemm_nt(m, n, alpha, a, lda,
+            indptr, indices, values, c, ldc);
+
+    // TN
+    if (oA == elem::TRANSPOSE && oB == elem::NORMAL)
+        detail::dense_sparse_gemm_tn(k, n, alpha, a, lda,
+            indptr, indices, values, c, ldc);
+
+    // TT
+    if (oA == elem::TRANSPOSE && oB == elem::TRANSPOSE)
+        detail::dense_sparse_gemm_tt(k, n, alpha, a, lda,
+            indptr, indices, values, c, ldc);
+}
 
-#       if SKYLARK_HAVE_OPENMP
-#       pragma omp parallel for
-#       endif
-        for(int row = 0; row < k; row++)
-            for(int rb = 0; rb < n; rb++)
-                for (int l = indptr[rb]; l < indptr[rb + 1]; l++) {
-                    int col = indices[l];
-                    c[col * ldc + row] += values[l] * a[row * lda + rb];
-                }
-    }
+template<typename T>
+inline void Gemm(elem::Orientation oA, elem::Orientation oB,
+    T alpha, const elem::Matrix<T>& A, const sparse_matrix_t<T>& B,
+    elem::Matrix<T>& C) {
+    int C_height = (oA == elem::NORMAL ? A.Height() : A.Width());
+    int C_width = (oB == elem::NORMAL ? B.width() : B.height());
+    elem::Zeros(C, C_height, C_width);
+    base::Gemm(oA, oB, alpha, A, B, T(0), C);
 }
 
 template<typename T>
@@ -313,9 +262,10 @@ inline void Gemm(elem::Orientation oA, elem::Orientation oB,
     T beta, elem::Matrix<T>& C) {
     // TODO verify sizes etc.
 
-    const int* indptr = A.indptr();
-    const int* indices = A.indices();
-    const double *values = A.locked_values();
+    typedef typename sparse_matrix_t<T>::index_type index_type;
+    const index_type* indptr = A.indptr();
+    const index_type* indices = A.indices();
+    const T *values = A.locked_values();
 
     int k = A.width();
     int n = B.Width();
@@ -332,22 +282,23 @@ inline void Gemm(elem::Orientation oA, elem::Orientation oB,
 
         elem::Scal(beta, C);
 
-        double *c = C.Buffer();
+        T *c = C.Buffer();
         int ldc = C.LDim();
 
-        const double *b = B.LockedBuffer();
+        const T *b = B.LockedBuffer();
         int ldb = B.LDim();
 
 #       if SKYLARK_HAVE_OPENMP
 #       pragma omp parallel for
 #       endif
         for(int i = 0; i < n; i++)
-            for(int col = 0; col < k; col++)
-                 for (int j = indptr[col]; j < indptr[col + 1]; j++) {
-                     int row = indices[j];
-                     T val = values[j];
-                     c[i * ldc + row] += alpha * val * b[i * ldb + col];
-                 }
+            for(int col = 0; col < k; col++) {
+                T bv = alpha * b[i * ldb + col];
+                if (bv == T(0))
+                    continue;
+                for (index_type j = indptr[col]; j < indptr[col + 1]; j++)
+                    c[i * ldc + indices[j]] += values[j] * bv;
+            }
     }
 
     // NT
@@ -365,8 +316,8 @@ inline void Gemm(elem::Orientation oA, elem::Orientation oB,
 #           if SKYLARK_HAVE_OPENMP
 #           pragma omp parallel for private(Cr)
 #           endif
-            for (int j = indptr[col]; j < indptr[col + 1]; j++) {
-                int row = indices[j];
+            for (index_type j = indptr[col]; j < indptr[col + 1]; j++) {
+                index_type row = indices[j];
                 T val = values[j];
                 elem::View(Cr, C, row, 0, 1, m);
                 elem::Axpy(alpha * val, BTr, Cr);
@@ -374,34 +325,44 @@ inline void Gemm(elem::Orientation oA, elem::Orientation oB,
         }
     }
 
-    // TN - TODO: Not tested!
+    // TN
     if (oA == elem::TRANSPOSE && oB == elem::NORMAL) {
-        double *c = C.Buffer();
+        T *c = C.Buffer();
         int ldc = C.LDim();
 
-        const double *b = B.LockedBuffer();
+        const T *b = B.LockedBuffer();
         int ldb = B.LDim();
 
+        // Each entry of C is a sparse dot product; split the sum into
+        // independent chains so the gathers can be overlapped.
 #       if SKYLARK_HAVE_OPENMP
 #       pragma omp parallel for collapse(2)
 #       endif
         for (int j = 0; j < n; j++)
             for(int row = 0; row < k; row++) {
-                c[j * ldc + row] *= beta;
-                 for (int l = indptr[row]; l < indptr[row + 1]; l++) {
-                     int col = indices[l];
-                     T val = values[l];
-                     c[j * ldc + row] += val * b[j * ldb + col];
-                 }
+                const T *bj = b + j * ldb;
+                index_type l = indptr[row];
+                index_type end = indptr[row + 1];
+                T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+                for (; l + 3 < end; l += 4) {
+                    s0 += values[l]     * bj[indices[l]];
+                    s1 += values[l + 1] * bj[indices[l + 1]];
+                    s2 += values[l + 2] * bj[indices[l + 2]];
+                    s3 += values[l + 3] * bj[indices[l + 3]];
+                }
+                for (; l < end; l++)
+                    s0 += values[l] * bj[indices[l]];
+                c[j * ldc + row] = beta * c[j * ldc + row] +
+                    alpha * ((s0 + s1) + (s2 + s3));
             }
     }
 
     // AN - TODO: Not tested!
     if (oA == elem::ADJOINT && oB == elem::NORMAL) {
-        double *c = C.Buffer();
+        T *c = C.Buffer();
         int ldc = C.LDim();
 
-        const double *b = B.LockedBuffer();
+        const T *b = B.LockedBuffer();
         int ldb = B.LDim();
 
 #       if SKYLARK_HAVE_OPENMP
@@ -409,12 +370,10 @@ inline void Gemm(elem::Orientation oA, elem::Orientation oB,
 #       endif
         for (int j = 0; j < n; j++)
             for(int row = 0; row < k; row++) {
-                c[j * ldc + row] *= beta;
-                 for (int l = indptr[row]; l < indptr[row + 1]; l++) {
-                     int col = indices[l];
-                     T val = elem::Conj(values[l]);
-                     c[j * ldc + row] += val * b[j * ldb + col];
-                 }
+                T s = 0;
+                for (index_type l = indptr[row]; l < indptr[row + 1]; l++)
+                    s += elem::Conj(values[l]) * b[j * ldb + indices[l]];
+                c[j * ldc + row] = beta * c[j * ldc + row] + alpha * s;
             }
     }
 
@@ -433,8 +392,8 @@ inline void Gemm(elem::Orientation oA, elem::Orientation oB,
 #       endif
         for(int row = 0; row < k; row++) {
             elem::View(Cr, C, row, 0, 1, m);
-            for (int l = indptr[row]; l < indptr[row + 1]; l++) {
-                int col = indices[l];
+            for (index_type l = indptr[row]; l < indptr[row + 1]; l++) {
+                index_type col = indices[l];
                 T val = values[l];
                 elem::LockedView(Bc, B, 0, col, m, 1);
                 elem::Transpose(Bc, BTr, oB == elem::ADJOINT);
@@ -457,8 +416,8 @@ inline void Gemm(elem::Orientation oA, elem::Orientation oB,
 #       endif
         for(int row = 0; row < k; row++) {
             elem::View(Cr, C, row, 0, 1, m);
-            for (int l = indptr[row]; l < indptr[row + 1]; l++) {
-                int col = indices[l];
+            for (index_type l = indptr[row]; l < indptr[row + 1]; l++) {
+                index_type col = indices[l];
                 T val = elem::Conj(values[l]);
                 elem::LockedView(Bc, B, 0, col, m, 1);
                 elem::Transpose(Bc, BTr, oB == elem::ADJOINT);
@@ -478,6 +437,81 @@ inline void Gemm(elem::Orientation oA, elem::Orientation oB,
     base::Gemm(oA, oB, alpha, A, B, T(0), C);
 }
 
+/**
+ * Gemm with a CSR view of a sparse matrix on the left: C = alpha * A * B +
+ * beta * C. Rows of C are owned by a single thread (no scatter, no races)
+ * and four right-hand sides are processed per non-zero, so every gathered
+ * row of B is reused from registers.
+ */
+template<typename T>
+inline void Gemm(elem::Orientation oA, elem::Orientation oB,
+    T alpha, const sparse_csr_view_t<T>& A, const elem::Matrix<T>& B,
+    T beta, elem::Matrix<T>& C) {
+
+    if (oA != elem::NORMAL || oB != elem::NORMAL)
+        SKYLARK_THROW_EXCEPTION(base::unsupported_base_operation());
+
+    typedef typename sparse_csr_view_t<T>::index_type index_type;
+    const index_type* indptr = A.indptr();
+    const index_type* indices = A.indices();
+    const T *values = A.locked_values();
+
+    int m = A.height();
+    int n = B.Width();
+
+    T *c = C.Buffer();
+    int ldc = C.LDim();
+
+    const T *b = B.LockedBuffer();
+    int ldb = B.LDim();
+
+    int n4 = n - n % 4;
+
+#   if SKYLARK_HAVE_OPENMP
+#   pragma omp parallel for schedule(dynamic, 64)
+#   endif
+    for(int row = 0; row < m; row++) {
+        index_type start = indptr[row];
+        index_type end = indptr[row + 1];
+
+        for(int j = 0; j < n4; j += 4) {
+            const T *b0 = b + j * ldb;
+            const T *b1 = b0 + ldb;
+            const T *b2 = b1 + ldb;
+            const T *b3 = b2 + ldb;
+            T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+            for(index_type l = start; l < end; l++) {
+                index_type col = indices[l];
+                T v = values[l];
+                s0 += v * b0[col];
+                s1 += v * b1[col];
+                s2 += v * b2[col];
+                s3 += v * b3[col];
+            }
+            c[j * ldc + row] = beta * c[j * ldc + row] + alpha * s0;
+            c[(j + 1) * ldc + row] = beta * c[(j + 1) * ldc + row] + alpha * s1;
+            c[(j + 2) * ldc + row] = beta * c[(j + 2) * ldc + row] + alpha * s2;
+            c[(j + 3) * ldc + row] = beta * c[(j + 3) * ldc + row] + alpha * s3;
+        }
+
+        for(int j = n4; j < n; j++) {
+            const T *bj = b + j * ldb;
+            T s = 0;
+            for(index_type l = start; l < end; l++)
+                s += values[l] * bj[indices[l]];
+            c[j * ldc + row] = beta * c[j * ldc + row] + alpha * s;
+        }
+    }
+}
+
+template<typename T>
+inline void Gemm(elem::Orientation oA, elem::Orientation oB,
+    T alpha, const sparse_csr_view_t<T>& A, const elem::Matrix<T>& B,
+    elem::Matrix<T>& C) {
+    elem::Zeros(C, A.height(), B.Width());
+    base::Gemm(oA, oB, alpha, A, B, T(0), C);
+}
+
 #if SKYLARK_HAVE_COMBBLAS
 /**
  * Mixed GEMM for Elemental and CombBLAS matrices. For a distributed Elemental
@@ -6,12 +6,253 @@
 #include <CommGrid.h>
 #endif
 
+#include <algorithm>
+#include <vector>
+
+#if SKYLARK_HAVE_OPENMP
+#include <omp.h>
+#endif
+
 #include "../utility/external/view.hpp"
 #include "../utility/external/combblas_comm_grid.hpp"
 #include "../utility/external/elemental_comm_grid.hpp"
 
 namespace skylark { namespace base { namespace detail {
 
+/**
+ * Local kernels for C += alpha * op(A) * op(B), A dense (column-major) and
+ * B sparse (CSC). They are register blocked: four non-zeros of B are
+ * applied per pass over a strip of C (NN, NT, TT), or four columns of A are
+ * reduced per non-zero (TN), so each load of A or C is reused from
+ * registers. The inner loops are unit stride and vectorize. Every thread
+ * owns disjoint parts of C, so the scatter cases (NT, TT) need no atomics
+ * and no per-row parallel regions.
+ */
+
+/// Rows of C (or columns of A) handled together by a thread.
+inline int dense_sparse_gemm_tile(int m) {
+#   if SKYLARK_HAVE_OPENMP
+    int nthreads = omp_get_max_threads();
+#   else
+    int nthreads = 1;
+#   endif
+    int tile = (m + nthreads - 1) / nthreads;
+    tile = (tile + 7) / 8 * 8;
+    return std::max(64, std::min(512, tile));
+}
+
+/// NN: C (m x n) += alpha * A (m x k) * B (k x n). Threads own columns of C.
+template<typename index_type, typename T>
+inline void dense_sparse_gemm_nn(int m, int n, T alpha,
+    const T *a, int lda,
+    const index_type *indptr, const index_type *indices, const T *values,
+    T *c, int ldc) {
+
+    const int tile = 512;
+
+#   if SKYLARK_HAVE_OPENMP
+#   pragma omp parallel for schedule(dynamic, 16)
+#   endif
+    for(int col = 0; col < n; col++) {
+        index_type start = indptr[col];
+        index_type end = indptr[col + 1];
+
+        for(int i0 = 0; i0 < m; i0 += tile) {
+            int len = std::min(tile, m - i0);
+            T *ci = c + col * ldc + i0;
+
+            index_type l = start;
+            for(; l + 3 < end; l += 4) {
+                const T *a0 = a + indices[l] * lda + i0;
+                const T *a1 = a + indices[l + 1] * lda + i0;
+                const T *a2 = a + indices[l + 2] * lda + i0;
+                const T *a3 = a + indices[l + 3] * lda + i0;
+                T v0 = alpha * values[l];
+                T v1 = alpha * values[l + 1];
+                T v2 = alpha * values[l + 2];
+                T v3 = alpha * values[l + 3];
+                for(int i = 0; i < len; i++)
+                    ci[i] += v0 * a0[i] + v1 * a1[i] + v2 * a2[i] + v3 * a3[i];
+            }
+
+            for(; l < end; l++) {
+                const T *a0 = a + indices[l] * lda + i0;
+                T v0 = alpha * values[l];
+                for(int i = 0; i < len; i++)
+                    ci[i] += v0 * a0[i];
+            }
+        }
+    }
+}
+
+/// NT: C (m x p) += alpha * A (m x k) * B^T, B is p x k. Threads own strips
+/// of rows of C; every column of A is loaded once per four non-zeros.
+template<typename index_type, typename T>
+inline void dense_sparse_gemm_nt(int m, int k, T alpha,
+    const T *a, int lda,
+    const index_type *indptr, const index_type *indices, const T *values,
+    T *c, int ldc) {
+
+    const int tile = dense_sparse_gemm_tile(m);
+    const int ntiles = (m + tile - 1) / tile;
+
+#   if SKYLARK_HAVE_OPENMP
+#   pragma omp parallel for schedule(static)
+#   endif
+    for(int t = 0; t < ntiles; t++) {
+        int i0 = t * tile;
+        int len = std::min(tile, m - i0);
+
+        for(int col = 0; col < k; col++) {
+            const T *ai = a + col * lda + i0;
+            index_type l = indptr[col];
+            index_type end = indptr[col + 1];
+
+            for(; l + 3 < end; l += 4) {
+                T *c0 = c + indices[l] * ldc + i0;
+                T *c1 = c + indices[l + 1] * ldc + i0;
+                T *c2 = c + indices[l + 2] * ldc + i0;
+                T *c3 = c + indices[l + 3] * ldc + i0;
+                T v0 = alpha * values[l];
+                T v1 = alpha * values[l + 1];
+                T v2 = alpha * values[l + 2];
+                T v3 = alpha * values[l + 3];
+                for(int i = 0; i < len; i++) {
+                    T x = ai[i];
+                    c0[i] += v0 * x;
+                    c1[i] += v1 * x;
+                    c2[i] += v2 * x;
+                    c3[i] += v3 * x;
+                }
+            }
+
+            for(; l < end; l++) {
+                T *c0 = c + indices[l] * ldc + i0;
+                T v0 = alpha * values[l];
+                for(int i = 0; i < len; i++)
+                    c0[i] += v0 * ai[i];
+            }
+        }
+    }
+}
+
+/// TN: C (k x n) += alpha * A^T * B, A is m x k, B is m x n. Each entry of
+/// C is a sparse dot product; four columns of A share every non-zero.
+template<typename index_type, typename T>
+inline void dense_sparse_gemm_tn(int k, int n, T alpha,
+    const T *a, int lda,
+    const index_type *indptr, const index_type *indices, const T *values,
+    T *c, int ldc) {
+
+    const int nblocks = (k + 3) / 4;
+
+    // Blocks of columns of A outermost, so that the four columns being
+    // gathered stay in cache while all columns of B go by.
+#   if SKYLARK_HAVE_OPENMP
+#   pragma omp parallel for collapse(2) schedule(static)
+#   endif
+    for(int rb = 0; rb < nblocks; rb++)
+        for(int col = 0; col < n; col++) {
+            index_type start = indptr[col];
+            index_type end = indptr[col + 1];
+            int r = 4 * rb;
+            T *cr = c + col * ldc + r;
+
+            if (r + 3 < k) {
+                const T *a0 = a + r * lda;
+                const T *a1 = a0 + lda;
+                const T *a2 = a1 + lda;
+                const T *a3 = a2 + lda;
+                T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+                for(index_type l = start; l < end; l++) {
+                    index_type row = indices[l];
+                    T v = values[l];
+                    s0 += v * a0[row];
+                    s1 += v * a1[row];
+                    s2 += v * a2[row];
+                    s3 += v * a3[row];
+                }
+                cr[0] += alpha * s0;
+                cr[1] += alpha * s1;
+                cr[2] += alpha * s2;
+                cr[3] += alpha * s3;
+            } else {
+                for(int j = 0; r + j < k; j++) {
+                    const T *aj = a + (r + j) * lda;
+                    T s = 0;
+                    for(index_type l = start; l < end; l++)
+                        s += values[l] * aj[indices[l]];
+                    cr[j] += alpha * s;
+                }
+            }
+        }
+}
+
+/// TT: C (k x p) += alpha * A^T * B^T, A is m x k, B is p x m. Threads own
+/// strips of rows of C (columns of A); the strided row of A matching each
+/// column of B is packed once and reused by four non-zeros at a time.
+template<typename index_type, typename T>
+inline void dense_sparse_gemm_tt(int k, int m, T alpha,
+    const T *a, int lda,
+    const index_type *indptr, const index_type *indices, const T *values,
+    T *c, int ldc) {
+
+    const int tile = dense_sparse_gemm_tile(k);
+    const int ntiles = (k + tile - 1) / tile;
+
+#   if SKYLARK_HAVE_OPENMP
+#   pragma omp parallel
+#   endif
+    {
+        std::vector<T> packed(tile);
+        T *x = packed.data();
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp for schedule(static)
+#       endif
+        for(int t = 0; t < ntiles; t++) {
+            int r0 = t * tile;
+            int len = std::min(tile, k - r0);
+
+            for(int col = 0; col < m; col++) {
+                index_type l = indptr[col];
+                index_type end = indptr[col + 1];
+                if (l == end)
+                    continue;
+
+                const T *ar = a + r0 * lda + col;
+                for(int i = 0; i < len; i++)
+                    x[i] = alpha * ar[i * lda];
+
+                for(; l + 3 < end; l += 4) {
+                    T *c0 = c + indices[l] * ldc + r0;
+                    T *c1 = c + indices[l + 1] * ldc + r0;
+                    T *c2 = c + indices[l + 2] * ldc + r0;
+                    T *c3 = c + indices[l + 3] * ldc + r0;
+                    T v0 = values[l];
+                    T v1 = values[l + 1];
+                    T v2 = values[l + 2];
+                    T v3 = values[l + 3];
+                    for(int i = 0; i < len; i++) {
+                        T xi = x[i];
+                        c0[i] += v0 * xi;
+                        c1[i] += v1 * xi;
+                        c2[i] += v2 * xi;
+                        c3[i] += v3 * xi;
+                    }
+                }
+
+                for(; l < end; l++) {
+                    T *c0 = c + indices[l] * ldc + r0;
+                    T v0 = values[l];
+                    for(int i = 0; i < len; i++)
+                        c0[i] += v0 * x[i];
+                }
+            }
+        }
+    }
+}
+
 #if SKYLARK_HAVE_COMBBLAS
 
 /// only compute local product:
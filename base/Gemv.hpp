@@ -107,11 +107,12 @@ inline void Gemv(elem::Orientation oA,
     T beta, elem::Matrix<T>& y) {
     // TODO verify sizes etc.
 
-    const int* indptr = A.indptr();
-    const int* indices = A.indices();
-    const double *values = A.locked_values();
-    double *yd = y.Buffer();
-    const double *xd = x.LockedBuffer();
+    typedef typename sparse_matrix_t<T>::index_type index_type;
+    const index_type* indptr = A.indptr();
+    const index_type* indices = A.indices();
+    const T *values = A.locked_values();
+    T *yd = y.Buffer();
+    const T *xd = x.LockedBuffer();
 
     int n = A.width();
 
@@ -123,8 +124,8 @@ inline void Gemv(elem::Orientation oA,
 #       endif
         for(int col = 0; col < n; col++) {
             T xv = alpha * xd[col];
-            for (int j = indptr[col]; j < indptr[col + 1]; j++) {
-                     int row = indices[j];
+            for (index_type j = indptr[col]; j < indptr[col + 1]; j++) {
+                     index_type row = indices[j];
                      T val = values[j];
                      yd[row] += val * xv;
                  }
@@ -136,9 +137,9 @@ inline void Gemv(elem::Orientation oA,
 #       pragma omp parallel for
 #       endif
         for(int col = 0; col < n; col++) {
-            double yv = beta * yd[col];
-            for (int j = indptr[col]; j < indptr[col + 1]; j++) {
-                     int row = indices[j];
+            T yv = beta * yd[col];
+            for (index_type j = indptr[col]; j < indptr[col + 1]; j++) {
+                     index_type row = indices[j];
                      T val = values[j];
                      yv += alpha * val * xd[row];
                  }
@@ -1,6 +1,9 @@
 #ifndef SKYLARK_QR_HPP
 #define SKYLARK_QR_HPP
 
+#include <algorithm>
+#include <vector>
+#include <boost/mpi.hpp>
 #include <elemental.hpp>
 
 
@@ -35,6 +38,209 @@ void Explicit(elem::DistMatrix<T, elem::VR, elem::STAR>& A) {
     elem::qr::ExplicitTS(A, R);
 }
 
+/**
+ * Communication-avoiding QR (TSQR) of a tall matrix whose rows are split in
+ * blocks of arbitrary heights among the ranks of a communicator.
+ *
+ * Every rank factors its block locally; the n x n triangular factors are
+ * then combined along a butterfly. At each of the log P levels partners
+ * swap their R and both factor the stacked pair (lower rank on top), so
+ * they agree on the result and no final broadcast is needed. When P is not
+ * a power of two, the excess ranks first fold their R into a partner and
+ * receive the final one back at the end.
+ *
+ * Q is never formed: the Householder factors of the local block and of
+ * every level are kept, and Q^H B is applied by sending B through the same
+ * butterfly, n rows per message.
+ */
+template<typename T>
+class tsqr_t {
+
+public:
+
+    typedef T value_type;
+
+    tsqr_t(const boost::mpi::communicator& comm) :
+        _comm(comm), _n(0) {
+
+        _pow2 = 1;
+        while (2 * _pow2 <= _comm.size())
+            _pow2 *= 2;
+    }
+
+    /**
+     * Factors the matrix whose local rows are A. All ranks must pass
+     * blocks of the same width; heights may differ (and be zero).
+     */
+    void factor(const elem::Matrix<T>& A) {
+        _n = A.Width();
+        _local = A;
+        _levels.clear();
+
+        elem::Matrix<T> R;
+        if (_local.Height() > 0)
+            elem::QR(_local, _local_t);
+        upper(_local, R);
+
+        const int rank = _comm.rank();
+        if (rank >= _pow2) {
+            send(R, rank - _pow2);
+            recv(R, _n, rank - _pow2);
+        } else {
+            if (rank + _pow2 < _comm.size()) {
+                elem::Matrix<T> Rx;
+                recv(Rx, _n, rank + _pow2);
+                combine(R, Rx, true);
+            }
+
+            for(int l = 1; l < _pow2; l *= 2) {
+                elem::Matrix<T> Rx;
+                exchange(R, Rx, rank ^ l);
+                combine(R, Rx, rank < (rank ^ l));
+            }
+
+            if (rank + _pow2 < _comm.size())
+                send(R, rank + _pow2);
+        }
+
+        _R = R;
+    }
+
+    /** The n x n triangular factor, identical on all ranks. */
+    const elem::Matrix<T>& R() const { return _R; }
+
+    /**
+     * Sets C to the first n rows of Q^H B, where B holds the local rows of
+     * the right-hand sides (distributed like the factored matrix). C is
+     * identical on all ranks.
+     */
+    void apply_adjoint_Q(const elem::Matrix<T>& B, elem::Matrix<T>& C) const {
+        elem::Matrix<T> W(B);
+        if (W.Height() > 0)
+            elem::qr::ApplyQ(elem::LEFT, elem::ADJOINT, _local, _local_t, W);
+        top_rows(W, C);
+
+        const int rank = _comm.rank();
+        if (rank >= _pow2) {
+            send(C, rank - _pow2);
+            recv(C, B.Width(), rank - _pow2);
+            return;
+        }
+
+        typename std::vector<level_t>::const_iterator level = _levels.begin();
+        if (rank + _pow2 < _comm.size()) {
+            elem::Matrix<T> Cx;
+            recv(Cx, B.Width(), rank + _pow2);
+            apply_level(*level++, C, Cx);
+        }
+
+        for(int l = 1; l < _pow2; l *= 2) {
+            elem::Matrix<T> Cx;
+            exchange(C, Cx, rank ^ l);
+            apply_level(*level++, C, Cx);
+        }
+
+        if (rank + _pow2 < _comm.size())
+            send(C, rank + _pow2);
+    }
+
+private:
+
+    /** Householder factors of one stacked pair. */
+    struct level_t {
+        elem::Matrix<T> QR, t;
+        bool own_on_top;
+    };
+
+    boost::mpi::communicator _comm;
+    int _pow2;
+    int _n;
+    elem::Matrix<T> _local, _local_t, _R;
+    std::vector<level_t> _levels;
+
+    /** Copies the upper trapezoid of the first n rows of A into R (n x n). */
+    void upper(const elem::Matrix<T>& A, elem::Matrix<T>& R) const {
+        elem::Zeros(R, _n, _n);
+        int h = std::min(A.Height(), _n);
+        for(int j = 0; j < _n; j++)
+            for(int i = 0; i <= std::min(j, h - 1); i++)
+                R.Set(i, j, A.Get(i, j));
+    }
+
+    /** Copies the first n rows of W into C, padding with zeros. */
+    void top_rows(const elem::Matrix<T>& W, elem::Matrix<T>& C) const {
+        elem::Zeros(C, _n, W.Width());
+        int h = std::min(W.Height(), _n);
+        for(int j = 0; j < W.Width(); j++)
+            for(int i = 0; i < h; i++)
+                C.Set(i, j, W.Get(i, j));
+    }
+
+    void stack(const elem::Matrix<T>& top, const elem::Matrix<T>& bottom,
+        elem::Matrix<T>& S) const {
+        int k = top.Width();
+        S.Resize(2 * _n, k);
+        for(int j = 0; j < k; j++)
+            for(int i = 0; i < _n; i++) {
+                S.Set(i, j, top.Get(i, j));
+                S.Set(_n + i, j, bottom.Get(i, j));
+            }
+    }
+
+    /** Replaces R by the R of [R; Rx] (or [Rx; R]), recording the level. */
+    void combine(elem::Matrix<T>& R, const elem::Matrix<T>& Rx,
+        bool own_on_top) {
+        _levels.push_back(level_t());
+        level_t& level = _levels.back();
+        level.own_on_top = own_on_top;
+        if (own_on_top)
+            stack(R, Rx, level.QR);
+        else
+            stack(Rx, R, level.QR);
+        elem::QR(level.QR, level.t);
+        upper(level.QR, R);
+    }
+
+    void apply_level(const level_t& level, elem::Matrix<T>& C,
+        const elem::Matrix<T>& Cx) const {
+        elem::Matrix<T> S;
+        if (level.own_on_top)
+            stack(C, Cx, S);
+        else
+            stack(Cx, C, S);
+        elem::qr::ApplyQ(elem::LEFT, elem::ADJOINT, level.QR, level.t, S);
+        top_rows(S, C);
+    }
+
+    // Messages are always n x k blocks, sent from contiguous copies.
+
+    void send(const elem::Matrix<T>& M, int dest) const {
+        elem::Matrix<T> P(M);
+        MPI_Send(P.Buffer(), P.Height() * P.Width(),
+            boost::mpi::get_mpi_datatype<T>(), dest, 0, _comm);
+    }
+
+    void recv(elem::Matrix<T>& M, int k, int source) const {
+        M.Empty();
+        M.Resize(_n, k);
+        MPI_Recv(M.Buffer(), _n * k,
+            boost::mpi::get_mpi_datatype<T>(), source, 0, _comm,
+            MPI_STATUS_IGNORE);
+    }
+
+    void exchange(const elem::Matrix<T>& M, elem::Matrix<T>& Mx,
+        int partner) const {
+        elem::Matrix<T> P(M);
+        Mx.Empty();
+        Mx.Resize(_n, M.Width());
+        MPI_Sendrecv(P.Buffer(), P.Height() * P.Width(),
+            boost::mpi::get_mpi_datatype<T>(), partner, 0,
+            Mx.Buffer(), Mx.Height() * Mx.Width(),
+            boost::mpi::get_mpi_datatype<T>(), partner, 0,
+            _comm, MPI_STATUS_IGNORE);
+    }
+};
+
 } } } // namespace skylark::base::qr
 
 #endif // SKYLARK_QR_HPP
@@ -11,6 +11,7 @@
 
 #include "exception.hpp"
 #include "sparse_matrix.hpp"
+#include "dist_sparse_matrix.hpp"
 #include "computed_matrix.hpp"
 #include "graph_adapters.hpp"
 #include "basic.hpp"
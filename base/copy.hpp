@@ -20,11 +20,12 @@ inline void DenseCopy(const sparse_matrix_t<T>& A, elem::Matrix<T>& B) {
 
     elem::Zero(B);
 
-    const int *indptr = A.indptr();
-    const int *indices = A.indices();
-    const double *values = A.locked_values();
+    typedef typename sparse_matrix_t<T>::index_type index_type;
+    const index_type *indptr = A.indptr();
+    const index_type *indices = A.indices();
+    const T *values = A.locked_values();
     for(int col = 0; col < A.width(); col++)
-        for(int idx = indptr[col]; idx < indptr[col + 1]; idx++)
+        for(index_type idx = indptr[col]; idx < indptr[col + 1]; idx++)
             B.Set(indices[idx], col, values[idx]);
 }
 
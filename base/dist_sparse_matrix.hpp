@@ -0,0 +1,407 @@
+#ifndef SKYLARK_DIST_SPARSE_MATRIX_HPP
+#define SKYLARK_DIST_SPARSE_MATRIX_HPP
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+#include <boost/mpi.hpp>
+#include <elemental.hpp>
+
+#include "exception.hpp"
+#include "sparse_matrix.hpp"
+
+namespace skylark { namespace base {
+
+/**
+ * Square sparse matrix distributed by blocks: rank r owns the rows (and
+ * columns) [starts()[r], starts()[r + 1]) and holds the matching columns of
+ * A as a local CSC matrix with global row indices. For a symmetric A, as in
+ * the Laplacian systems this is meant for, the columns are the rows.
+ *
+ * Only the columns of the owned block are stored, so products are formed
+ * with A^T (as the solvers on local sparse matrices do), and need the
+ * entries of the vector at the rows touched by the block. The ones owned
+ * by other ranks (ghosts) are listed at construction, together with the
+ * owned entries every other rank needs, so that exchanging them afterwards
+ * only moves those.
+ *
+ * The local matrix is referred to, not copied, and has to outlive this.
+ */
+template<typename ValueType=double>
+struct dist_sparse_matrix_t {
+
+    typedef sparse_index_t index_type;
+    typedef ValueType value_type;
+
+    /**
+     * Collective: all ranks of comm pass their local block. Blocks follow
+     * rank order.
+     *
+     * @param comm communicator over which A is distributed.
+     * @param local n x (owned columns) matrix, with global row indices.
+     */
+    dist_sparse_matrix_t(const boost::mpi::communicator& comm,
+        const sparse_matrix_t<value_type>& local) :
+        _comm(comm), _local(local) {
+
+        std::vector<int> widths;
+        boost::mpi::all_gather(_comm, _local.width(), widths);
+        _starts.assign(1, 0);
+        for(size_t r = 0; r < widths.size(); r++)
+            _starts.push_back(_starts.back() + widths[r]);
+        _n = _starts.back();
+
+        if (_local.height() != _n)
+            SKYLARK_THROW_EXCEPTION (
+                base::nla_exception()
+                  << base::error_msg(
+                      "Local blocks must be n x (owned columns)"));
+
+        _build_halo();
+    }
+
+    int height() const { return _n; }
+    int width() const { return _n; }
+
+    const boost::mpi::communicator& comm() const { return _comm; }
+
+    /** Local block, with global row indices. */
+    const sparse_matrix_t<value_type>& local() const { return _local; }
+
+    const std::vector<int>& starts() const { return _starts; }
+
+    int first() const { return _starts[_comm.rank()]; }
+
+    int local_width() const { return _local.width(); }
+
+    /** Rank owning row i. */
+    int owner(int i) const {
+        return std::upper_bound(_starts.begin(), _starts.end(), i)
+            - _starts.begin() - 1;
+    }
+
+    /**
+     * Row indices of the local block renumbered locally: owned rows are
+     * 0 .. local_width() - 1, ghosts follow in the order of ghosts().
+     */
+    const index_type *local_indices() const { return &_lindices[0]; }
+
+    /** Global indices of the ghosts, sorted (so grouped by owner). */
+    const std::vector<int>& ghosts() const { return _ghosts; }
+
+    /** Ghosts owned by rank q are ghosts()[ghost_displs()[q] ...]. */
+    const std::vector<int>& ghost_counts() const { return _ghost_counts; }
+    const std::vector<int>& ghost_displs() const { return _ghost_displs; }
+
+    /** Owned rows (local numbers) that rank q holds as ghosts. */
+    const std::vector<int>& send_rows() const { return _send_rows; }
+    const std::vector<int>& send_counts() const { return _send_counts; }
+    const std::vector<int>& send_displs() const { return _send_displs; }
+
+    /** Where the ghosts sent to rank q start in q's ghost list. */
+    const std::vector<int>& remote_ghost_displs() const {
+        return _remote_ghost_displs;
+    }
+
+    /**
+     * Collective: fills the ghost rows of X, row-major with row stride ks
+     * (owned rows first, then ghosts; k entries per row), from their owners.
+     */
+    template<typename T>
+    void exchange_ghosts(T *X, int k, int ks) const {
+        int P = _comm.size();
+        int nloc = local_width();
+
+        std::vector<T> sendbuf(_send_rows.size() * k);
+        for(size_t t = 0; t < _send_rows.size(); t++)
+            std::copy(X + _send_rows[t] * ks, X + _send_rows[t] * ks + k,
+                sendbuf.begin() + t * k);
+
+        std::vector<T> recvbuf(_ghosts.size() * k);
+        std::vector<int> scounts(P), sdispls(P), rcounts(P), rdispls(P);
+        for(int q = 0; q < P; q++) {
+            scounts[q] = _send_counts[q] * k;
+            sdispls[q] = _send_displs[q] * k;
+            rcounts[q] = _ghost_counts[q] * k;
+            rdispls[q] = _ghost_displs[q] * k;
+        }
+
+        MPI_Alltoallv(sendbuf.empty() ? NULL : &sendbuf[0],
+            &scounts[0], &sdispls[0], boost::mpi::get_mpi_datatype<T>(),
+            recvbuf.empty() ? NULL : &recvbuf[0],
+            &rcounts[0], &rdispls[0], boost::mpi::get_mpi_datatype<T>(),
+            _comm);
+
+        for(size_t g = 0; g < _ghosts.size(); g++)
+            std::copy(recvbuf.begin() + g * k, recvbuf.begin() + (g + 1) * k,
+                X + (nloc + g) * ks);
+    }
+
+    /**
+     * Collective: copies the owned rows of the [VC, STAR] matrix X into
+     * rows, row-major with row stride ks.
+     */
+    template<typename T>
+    void to_blocks(const elem::DistMatrix<T, elem::VC, elem::STAR>& X,
+        T *rows, int ks) const {
+        int P = _comm.size();
+        int k = X.Width();
+        const elem::Matrix<T>& XL = X.LockedMatrix();
+
+        std::vector<int> scounts(P, 0);
+        for(int iLoc = 0; iLoc < X.LocalHeight(); iLoc++)
+            scounts[owner(X.ColShift() + iLoc * X.ColStride())]++;
+
+        std::vector<int> sdispls(P + 1, 0);
+        for(int q = 0; q < P; q++)
+            sdispls[q + 1] = sdispls[q] + scounts[q];
+
+        std::vector<int> sidx(sdispls[P]);
+        std::vector<T> svals(sdispls[P] * k);
+        std::vector<int> pos(sdispls.begin(), sdispls.end() - 1);
+        for(int iLoc = 0; iLoc < X.LocalHeight(); iLoc++) {
+            int i = X.ColShift() + iLoc * X.ColStride();
+            int p = pos[owner(i)]++;
+            sidx[p] = i;
+            for(int r = 0; r < k; r++)
+                svals[p * k + r] = XL.Get(iLoc, r);
+        }
+
+        std::vector<int> ridx;
+        std::vector<T> rbuf;
+        _route(sidx, svals, k, scounts, ridx, rbuf);
+
+        int first = this->first();
+        for(size_t t = 0; t < ridx.size(); t++)
+            std::copy(rbuf.begin() + t * k, rbuf.begin() + (t + 1) * k,
+                rows + (ridx[t] - first) * ks);
+    }
+
+    /**
+     * Collective: copies rows (owned rows, row-major with row stride ks)
+     * into X, which must already be n x k and [VC, STAR] on a grid over the
+     * same processes as comm().
+     */
+    template<typename T>
+    void from_blocks(const T *rows, int ks,
+        elem::DistMatrix<T, elem::VC, elem::STAR>& X) const {
+        int P = _comm.size();
+        int k = X.Width();
+        int first = this->first();
+        int nloc = local_width();
+
+        // Row i of a [VC, STAR] matrix lives on VC rank (i + align) % P.
+        std::vector<int> vcrank;
+        boost::mpi::all_gather(_comm, X.Grid().VCRank(), vcrank);
+        std::vector<int> map(P);
+        for(int r = 0; r < P; r++)
+            map[vcrank[r]] = r;
+
+        std::vector<int> dest(nloc), scounts(P, 0);
+        for(int j = 0; j < nloc; j++) {
+            dest[j] = map[(first + j + X.ColAlign()) % X.ColStride()];
+            scounts[dest[j]]++;
+        }
+
+        std::vector<int> sdispls(P + 1, 0);
+        for(int q = 0; q < P; q++)
+            sdispls[q + 1] = sdispls[q] + scounts[q];
+
+        std::vector<int> sidx(nloc);
+        std::vector<T> svals(nloc * k);
+        std::vector<int> pos(sdispls.begin(), sdispls.end() - 1);
+        for(int j = 0; j < nloc; j++) {
+            int p = pos[dest[j]]++;
+            sidx[p] = first + j;
+            std::copy(rows + j * ks, rows + j * ks + k, svals.begin() + p * k);
+        }
+
+        std::vector<int> ridx;
+        std::vector<T> rbuf;
+        _route(sidx, svals, k, scounts, ridx, rbuf);
+
+        elem::Matrix<T>& XL = X.Matrix();
+        for(size_t t = 0; t < ridx.size(); t++) {
+            int iLoc = (ridx[t] - X.ColShift()) / X.ColStride();
+            for(int r = 0; r < k; r++)
+                XL.Set(iLoc, r, rbuf[t * k + r]);
+        }
+    }
+
+private:
+    boost::mpi::communicator _comm;
+    const sparse_matrix_t<value_type>& _local;
+    int _n;
+    std::vector<int> _starts;
+
+    std::vector<index_type> _lindices;
+    std::vector<int> _ghosts, _ghost_counts, _ghost_displs;
+    std::vector<int> _send_rows, _send_counts, _send_displs;
+    std::vector<int> _remote_ghost_displs;
+
+    void _build_halo() {
+        int P = _comm.size();
+        int first = this->first();
+        int nloc = local_width();
+        const index_type *indices = _local.indices();
+        index_type nnz = _local.nonzeros();
+
+        for(index_type l = 0; l < nnz; l++) {
+            int i = indices[l];
+            if (i < first || i >= first + nloc)
+                _ghosts.push_back(i);
+        }
+        std::sort(_ghosts.begin(), _ghosts.end());
+        _ghosts.erase(std::unique(_ghosts.begin(), _ghosts.end()),
+            _ghosts.end());
+
+        _lindices.resize(std::max<index_type>(nnz, 1));
+        for(index_type l = 0; l < nnz; l++) {
+            int i = indices[l];
+            if (i >= first && i < first + nloc)
+                _lindices[l] = i - first;
+            else
+                _lindices[l] = nloc + (std::lower_bound(_ghosts.begin(),
+                        _ghosts.end(), i) - _ghosts.begin());
+        }
+
+        _ghost_counts.assign(P, 0);
+        for(size_t g = 0; g < _ghosts.size(); g++)
+            _ghost_counts[owner(_ghosts[g])]++;
+        _ghost_displs.assign(P, 0);
+        for(int q = 1; q < P; q++)
+            _ghost_displs[q] = _ghost_displs[q - 1] + _ghost_counts[q - 1];
+
+        // Tell the owners which of their rows are needed here, and where
+        // they go in the ghost list.
+        _send_counts.resize(P);
+        MPI_Alltoall(&_ghost_counts[0], 1, MPI_INT,
+            &_send_counts[0], 1, MPI_INT, _comm);
+        _remote_ghost_displs.resize(P);
+        MPI_Alltoall(&_ghost_displs[0], 1, MPI_INT,
+            &_remote_ghost_displs[0], 1, MPI_INT, _comm);
+
+        _send_displs.assign(P, 0);
+        for(int q = 1; q < P; q++)
+            _send_displs[q] = _send_displs[q - 1] + _send_counts[q - 1];
+
+        _send_rows.resize(_send_displs[P - 1] + _send_counts[P - 1]);
+        MPI_Alltoallv(_ghosts.empty() ? NULL : &_ghosts[0],
+            &_ghost_counts[0], &_ghost_displs[0], MPI_INT,
+            _send_rows.empty() ? NULL : &_send_rows[0],
+            &_send_counts[0], &_send_displs[0], MPI_INT, _comm);
+        for(size_t t = 0; t < _send_rows.size(); t++)
+            _send_rows[t] -= first;
+    }
+
+    /** Sends rows (index, k values) grouped by destination. */
+    template<typename T>
+    void _route(const std::vector<int>& sidx, const std::vector<T>& svals,
+        int k, const std::vector<int>& scounts,
+        std::vector<int>& ridx, std::vector<T>& rvals) const {
+        int P = _comm.size();
+
+        std::vector<int> rcounts(P);
+        MPI_Alltoall(const_cast<int *>(&scounts[0]), 1, MPI_INT,
+            &rcounts[0], 1, MPI_INT, _comm);
+
+        std::vector<int> sdispls(P, 0), rdispls(P, 0);
+        for(int q = 1; q < P; q++) {
+            sdispls[q] = sdispls[q - 1] + scounts[q - 1];
+            rdispls[q] = rdispls[q - 1] + rcounts[q - 1];
+        }
+        int nrecv = rdispls[P - 1] + rcounts[P - 1];
+
+        ridx.resize(nrecv);
+        MPI_Alltoallv(sidx.empty() ? NULL : const_cast<int *>(&sidx[0]),
+            const_cast<int *>(&scounts[0]), &sdispls[0], MPI_INT,
+            ridx.empty() ? NULL : &ridx[0], &rcounts[0], &rdispls[0], MPI_INT,
+            _comm);
+
+        std::vector<int> svcounts(P), svdispls(P), rvcounts(P), rvdispls(P);
+        for(int q = 0; q < P; q++) {
+            svcounts[q] = scounts[q] * k;
+            svdispls[q] = sdispls[q] * k;
+            rvcounts[q] = rcounts[q] * k;
+            rvdispls[q] = rdispls[q] * k;
+        }
+
+        rvals.resize(nrecv * k);
+        MPI_Alltoallv(svals.empty() ? NULL : const_cast<T *>(&svals[0]),
+            &svcounts[0], &svdispls[0], boost::mpi::get_mpi_datatype<T>(),
+            rvals.empty() ? NULL : &rvals[0],
+            &rvcounts[0], &rvdispls[0], boost::mpi::get_mpi_datatype<T>(),
+            _comm);
+    }
+};
+
+template<typename T>
+int Height(const dist_sparse_matrix_t<T>& A) {
+    return A.height();
+}
+
+template<typename T>
+int Width(const dist_sparse_matrix_t<T>& A) {
+    return A.width();
+}
+
+/**
+ * Y = alpha * A^T * X + beta * Y, with A distributed by blocks and X, Y
+ * [VC, STAR]. Only the (conjugate) transpose is supported, since only the
+ * columns of the owned block are stored.
+ */
+template<typename T>
+inline void Gemm(elem::Orientation oA, elem::Orientation oB,
+    T alpha, const dist_sparse_matrix_t<T>& A,
+    const elem::DistMatrix<T, elem::VC, elem::STAR>& X,
+    T beta, elem::DistMatrix<T, elem::VC, elem::STAR>& Y) {
+
+    if (oA == elem::ADJOINT && std::is_same<T, elem::Base<T> >::value)
+        oA = elem::TRANSPOSE;
+
+    if (oA != elem::TRANSPOSE || oB != elem::NORMAL)
+        SKYLARK_THROW_EXCEPTION(base::unsupported_base_operation());
+
+    typedef typename dist_sparse_matrix_t<T>::index_type index_type;
+    const index_type *indptr = A.local().indptr();
+    const index_type *lindices = A.local_indices();
+    const T *values = A.local().locked_values();
+
+    int k = X.Width();
+    int nloc = A.local_width();
+
+    std::vector<T> xrows((nloc + A.ghosts().size()) * k);
+    std::vector<T> yrows(nloc * k, T(0));
+    A.to_blocks(X, xrows.empty() ? NULL : &xrows[0], k);
+    A.exchange_ghosts(xrows.empty() ? NULL : &xrows[0], k, k);
+    if (beta != T(0))
+        A.to_blocks(Y, yrows.empty() ? NULL : &yrows[0], k);
+
+    for(int j = 0; j < nloc; j++) {
+        T *y = &yrows[j * k];
+        for(int r = 0; r < k; r++)
+            y[r] *= beta;
+        for(index_type l = indptr[j]; l < indptr[j + 1]; l++) {
+            T v = alpha * values[l];
+            const T *x = &xrows[lindices[l] * k];
+            for(int r = 0; r < k; r++)
+                y[r] += v * x[r];
+        }
+    }
+
+    A.from_blocks(yrows.empty() ? NULL : &yrows[0], k, Y);
+}
+
+template<typename T>
+inline void Gemm(elem::Orientation oA, elem::Orientation oB,
+    T alpha, const dist_sparse_matrix_t<T>& A,
+    const elem::DistMatrix<T, elem::VC, elem::STAR>& X,
+    elem::DistMatrix<T, elem::VC, elem::STAR>& Y) {
+    Y.Resize(A.width(), X.Width());
+    base::Gemm(oA, oB, alpha, A, X, T(0), Y);
+}
+
+} } // namespace skylark::base
+
+#endif // SKYLARK_DIST_SPARSE_MATRIX_HPP
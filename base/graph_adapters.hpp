@@ -5,6 +5,8 @@ namespace skylark { namespace base {
 
 struct unweighted_local_graph_adapter_t {
 
+    typedef sparse_index_t index_type;
+
     template<typename T>
     unweighted_local_graph_adapter_t(const sparse_matrix_t<T>& A)
         : _indptr(A.indptr()), _indices(A.indices()),
@@ -13,15 +15,17 @@ struct unweighted_local_graph_adapter_t {
     }
 
     int num_vertices() const { return _num_vertices; }
-    int num_edges() const { return _num_edges; }
+    index_type num_edges() const { return _num_edges; }
     int degree(int vertex) const { return _indptr[vertex+1] - _indptr[vertex]; }
-    const int *adjanct(int vertex) const { return _indices + _indptr[vertex]; }
+    const index_type *adjanct(int vertex) const {
+        return _indices + _indptr[vertex];
+    }
 
 private:
-    const int *_indptr;
-    const int *_indices;
+    const index_type *_indptr;
+    const index_type *_indices;
     int _num_vertices;
-    int _num_edges;
+    index_type _num_edges;
 };
 
 } } // namespace skylark::base
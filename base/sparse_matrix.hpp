@@ -3,23 +3,39 @@
 
 #include <set>
 #include <vector>
+#include <algorithm>
+#include <stdint.h>
 #include <boost/tuple/tuple.hpp>
 #include <boost/unordered_map.hpp>
 
+#include "config.h"
+
 namespace skylark { namespace base {
 
+/**
+ * Index type used for the structure of local sparse matrices. 64-bit indices
+ * are enabled at configure time (USE_64BIT_SPARSE_INDEX) and allow more than
+ * 2^31 non-zeros.
+ */
+#if SKYLARK_SPARSE_64BIT_INDEX
+typedef int64_t sparse_index_t;
+#else
+typedef int sparse_index_t;
+#endif
+
 /**
  *  This implements a very crude CSC sparse matrix container only intended to
  *  hold local sparse matrices.
  *
- *  Row indices are not sorted.
+ *  Row indices are not sorted, unless sorted() returns true (see
+ *  sort_indices()).
  *  Structure is always constants, and can only be attached by Attached.
  *  Values of non-zeros can be modified.
  */
 template<typename ValueType=double>
 struct sparse_matrix_t {
 
-    typedef int index_type;
+    typedef sparse_index_t index_type;
     typedef ValueType value_type;
 
     typedef boost::tuple<index_type, index_type, value_type> coord_tuple_t;
@@ -27,7 +43,8 @@ struct sparse_matrix_t {
 
     sparse_matrix_t()
         : _ownindptr(false), _ownindices(false), _ownvalues(false),
-          _dirty_struct(false), _height(0), _width(0), _nnz(0),
+          _dirty_struct(false), _sorted(false),
+          _height(0), _width(0), _nnz(0),
           _indptr(nullptr), _indices(nullptr), _values(nullptr)
     {}
 
@@ -35,7 +52,7 @@ struct sparse_matrix_t {
     sparse_matrix_t(sparse_matrix_t<ValueType>&& A) :
         _ownindptr(A._ownindptr), _ownindices(A._ownindices),
         _ownvalues(A._ownvalues), _dirty_struct(A._dirty_struct),
-        _height(A._height), _width(A._width), _nnz(A._nnz),
+        _sorted(A._sorted), _height(A._height), _width(A._width), _nnz(A._nnz),
         _indptr(A._indptr), _indices(A._indices), _values(A._values)
     {
         A._ownindptr = false;
@@ -50,6 +67,11 @@ struct sparse_matrix_t {
     bool struct_updated() const { return _dirty_struct; }
     void reset_update_flag()    { _dirty_struct = false; }
 
+    /**
+     * Whether row indices are sorted (increasing) within each column.
+     */
+    bool sorted() const { return _sorted; }
+
     /**
      * Copy data to external buffers.
      */
@@ -65,20 +87,40 @@ struct sparse_matrix_t {
         }
     }
 
+    /**
+     * Hand the buffers over to the caller, who then has to free them
+     * (delete[]). The matrix keeps referring to them, without owning them.
+     * Nothing is released, and false returned, unless all three buffers are
+     * owned by the matrix.
+     */
+    bool release(const index_type **indptr, const index_type **indices,
+        value_type **values) {
+        if (!(_ownindptr && _ownindices && _ownvalues))
+            return false;
+
+        *indptr = _indptr;
+        *indices = _indices;
+        *values = _values;
+        _ownindptr = _ownindices = _ownvalues = false;
+        return true;
+    }
+
     /**
      * Attach new structure and values.
      */
-    void attach(const index_type *indptr, const index_type *indices, double *values,
-        int nnz, int n_rows, int n_cols, bool _own = false) {
+    void attach(const index_type *indptr, const index_type *indices,
+        value_type *values, index_type nnz, int n_rows, int n_cols,
+        bool _own = false) {
         attach(indptr, indices, values, nnz, n_rows, n_cols, _own, _own, _own);
     }
 
     /**
      * Attach new structure and values.
+     * @param sorted caller guarantees row indices are sorted in each column.
      */
-    void attach(const index_type *indptr, const index_type *indices, double *values,
-        int nnz, int n_rows, int n_cols,
-        bool ownindptr, bool ownindices, bool ownvalues) {
+    void attach(const index_type *indptr, const index_type *indices,
+        value_type *values, index_type nnz, int n_rows, int n_cols,
+        bool ownindptr, bool ownindices, bool ownvalues, bool sorted = false) {
         _free_data();
 
         _indptr = indptr;
@@ -92,9 +134,95 @@ struct sparse_matrix_t {
         _ownindices = ownindices;
         _ownvalues = ownvalues;
 
+        _sorted = sorted;
         _dirty_struct = true;
     }
 
+    /**
+     * Attach structure given with a different index type. The structure is
+     * converted (copied) to index_type, values are attached as given.
+     */
+    template<typename IdxType>
+    void attach(const IdxType *indptr, const IdxType *indices,
+        value_type *values, index_type nnz, int n_rows, int n_cols,
+        bool _own = false) {
+
+        index_type *cindptr = new index_type[n_cols + 1];
+        index_type *cindices = new index_type[nnz];
+        for(int i = 0; i <= n_cols; ++i)
+            cindptr[i] = static_cast<index_type>(indptr[i]);
+        for(index_type i = 0; i < nnz; ++i)
+            cindices[i] = static_cast<index_type>(indices[i]);
+        if (_own) {
+            delete[] indptr;
+            delete[] indices;
+        }
+
+        attach(cindptr, cindices, values, nnz, n_rows, n_cols,
+            true, true, _own);
+    }
+
+    /**
+     * Sort row indices (and values) within each column. Structure that is
+     * not owned by the matrix is copied first, so attached buffers are
+     * never modified.
+     */
+    void sort_indices() {
+        if (_sorted)
+            return;
+
+        index_type *indices = const_cast<index_type *>(_indices);
+        value_type *values = _values;
+        if (!_ownindices) {
+            indices = new index_type[_nnz];
+            std::copy(_indices, _indices + _nnz, indices);
+            _indices = indices;
+            _ownindices = true;
+        }
+        if (!_ownvalues && _values != nullptr) {
+            values = new value_type[_nnz];
+            std::copy(_values, _values + _nnz, values);
+            _values = values;
+            _ownvalues = true;
+        }
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel
+#       endif
+        {
+            std::vector<std::pair<index_type, value_type> > buf;
+
+#           if SKYLARK_HAVE_OPENMP
+#           pragma omp for schedule(dynamic, 64)
+#           endif
+            for(int col = 0; col < _width; col++) {
+                index_type start = _indptr[col];
+                index_type end = _indptr[col + 1];
+
+                bool ordered = true;
+                for(index_type l = start + 1; l < end && ordered; l++)
+                    ordered = indices[l - 1] <= indices[l];
+                if (ordered)
+                    continue;
+
+                if (values == nullptr) {
+                    std::sort(indices + start, indices + end);
+                    continue;
+                }
+
+                buf.resize(end - start);
+                for(index_type l = start; l < end; l++)
+                    buf[l - start] = std::make_pair(indices[l], values[l]);
+                std::sort(buf.begin(), buf.end(), &sparse_matrix_t::_cmp_first);
+                for(index_type l = start; l < end; l++) {
+                    indices[l] = buf[l - start].first;
+                    values[l] = buf[l - start].second;
+                }
+            }
+        }
+
+        _sorted = true;
+    }
 
     // attaching a coordinate structure facilitates going from distributed
     // input to local output.
@@ -102,11 +230,12 @@ struct sparse_matrix_t {
 
         sort(coords.begin(), coords.end(), &sparse_matrix_t::_sort_coords);
 
-        n_cols = std::max(n_cols, boost::get<1>(coords.back()) + 1);
+        n_cols = std::max(n_cols,
+            static_cast<int>(boost::get<1>(coords.back()) + 1));
         index_type *indptr = new index_type[n_cols + 1];
 
         // Count non-zeros
-        int nnz = 0;
+        index_type nnz = 0;
         for(size_t i = 0; i < coords.size(); ++i) {
             nnz++;
             index_type cur_row = boost::get<0>(coords[i]);
@@ -144,13 +273,15 @@ struct sparse_matrix_t {
             indices[nnz - 1] = cur_row;
             values[nnz - 1] = cur_val;
 
-            n_rows = std::max(cur_row + 1, n_rows);
+            n_rows = std::max(static_cast<int>(cur_row + 1), n_rows);
         }
 
         for(; indptr_idx < n_cols; ++indptr_idx)
             indptr[indptr_idx + 1] = nnz;
 
-        attach(indptr, indices, values, nnz, n_rows, n_cols, true);
+        // coordinates were sorted, so rows are sorted within columns.
+        attach(indptr, indices, values, nnz, n_rows, n_cols,
+            true, true, true, true);
     }
 
     int height() const {
@@ -161,7 +292,7 @@ struct sparse_matrix_t {
         return _width;
     }
 
-    int nonzeros() const {
+    index_type nonzeros() const {
         return _nnz;
     }
 
@@ -184,26 +315,35 @@ struct sparse_matrix_t {
     bool operator==(const sparse_matrix_t &rhs) const {
 
         // column pointer arrays have to be exactly the same
-        if (std::vector<int>(_indptr, _indptr+_width) !=
-            std::vector<int>(rhs._indptr, rhs._indptr + rhs._width))
+        if (std::vector<index_type>(_indptr, _indptr+_width) !=
+            std::vector<index_type>(rhs._indptr, rhs._indptr + rhs._width))
             return false;
 
-        // check more carefully for unordered row indices
-        const int* indptr  = _indptr;
-        const int* indices = _indices;
-        const double* values = _values;
+        const index_type* indptr  = _indptr;
+        const index_type* indices = _indices;
+        const value_type* values = _values;
 
-        const int* indices_rhs   = rhs.indices();
-        const double* values_rhs = rhs.locked_values();
+        const index_type* indices_rhs   = rhs.indices();
+        const value_type* values_rhs = rhs.locked_values();
+
+        // sorted structure can be compared directly
+        if (_sorted && rhs._sorted) {
+            for(index_type idx = 0; idx < _indptr[_width]; idx++)
+                if (indices[idx] != indices_rhs[idx] ||
+                    values[idx] != values_rhs[idx])
+                    return false;
+            return true;
+        }
 
+        // check more carefully for unordered row indices
         for(int col = 0; col < width(); col++) {
 
-            boost::unordered_map<int, double> col_values;
+            boost::unordered_map<index_type, value_type> col_values;
 
-            for(int idx = indptr[col]; idx < indptr[col + 1]; idx++)
+            for(index_type idx = indptr[col]; idx < indptr[col + 1]; idx++)
                 col_values.insert(std::make_pair(indices[idx], values[idx]));
 
-            for(int idx = indptr[col]; idx < indptr[col + 1]; idx++) {
+            for(index_type idx = indptr[col]; idx < indptr[col + 1]; idx++) {
                 if(col_values[indices_rhs[idx]] != values_rhs[idx])
                     return false;
             }
@@ -218,10 +358,11 @@ private:
     bool _ownvalues;
 
     bool _dirty_struct;
+    bool _sorted;
 
     int _height;
     int _width;
-    int _nnz;
+    index_type _nnz;
 
     const index_type* _indptr;
     const index_type* _indices;
@@ -240,6 +381,11 @@ private:
             delete[] _values;
     }
 
+    static bool _cmp_first(const std::pair<index_type, value_type>& lhs,
+        const std::pair<index_type, value_type>& rhs) {
+        return lhs.first < rhs.first;
+    }
+
     static bool _sort_coords(coord_tuple_t lhs, coord_tuple_t rhs) {
         if(boost::get<1>(lhs) != boost::get<1>(rhs))
             return boost::get<1>(lhs) < boost::get<1>(rhs);
@@ -250,23 +396,25 @@ private:
 
 template<typename T>
 void Transpose(const sparse_matrix_t<T>& A, sparse_matrix_t<T>& B) {
-    const int* aindptr = A.indptr();
-    const int* aindices = A.indices();
-    const double* avalues = A.locked_values();
+    typedef typename sparse_matrix_t<T>::index_type index_type;
+
+    const index_type* aindptr = A.indptr();
+    const index_type* aindices = A.indices();
+    const T* avalues = A.locked_values();
 
     int m = A.width();
     int n = A.height();
-    int nnz = A.nonzeros();
+    index_type nnz = A.nonzeros();
 
-    int *indptr = new int[n + 1];
-    int *indices = new int[nnz];
-    double *values = new double[nnz];
+    index_type *indptr = new index_type[n + 1];
+    index_type *indices = new index_type[nnz];
+    T *values = new T[nnz];
 
     // Count nonzeros in each row
-    int *nzrow = new int[n];
+    index_type *nzrow = new index_type[n];
     std::fill(nzrow, nzrow + n, 0);
     for(int col = 0; col < m; col++)
-        for(int idx = aindptr[col]; idx < aindptr[col + 1]; idx++)
+        for(index_type idx = aindptr[col]; idx < aindptr[col + 1]; idx++)
             nzrow[aindices[idx]]++;
 
     // Set indptr
@@ -277,9 +425,9 @@ void Transpose(const sparse_matrix_t<T>& A, sparse_matrix_t<T>& B) {
     // Fill values
     std::fill(nzrow, nzrow + n, 0);
     for(int col = 0; col < m; col++)
-        for(int idx = aindptr[col]; idx < aindptr[col + 1]; idx++) {
-            int row = aindices[idx];
-            double val = avalues[idx];
+        for(index_type idx = aindptr[col]; idx < aindptr[col + 1]; idx++) {
+            index_type row = aindices[idx];
+            T val = avalues[idx];
             indices[indptr[row] + nzrow[row]] = col;
             values[indptr[row] + nzrow[row]] = val;
             nzrow[row]++;
@@ -287,9 +435,45 @@ void Transpose(const sparse_matrix_t<T>& A, sparse_matrix_t<T>& B) {
 
     delete[] nzrow;
 
-    B.attach(indptr, indices, values, nnz, m, n, true);
+    // Columns are visited in order, so the result is always sorted.
+    B.attach(indptr, indices, values, nnz, m, n, true, true, true, true);
 }
 
+/**
+ * Compressed sparse row companion of a sparse_matrix_t. It is built once
+ * from the CSC matrix (rows and columns come out sorted) and is used by
+ * kernels that need row access, e.g. race-free sparse-dense Gemm.
+ */
+template<typename ValueType=double>
+struct sparse_csr_view_t {
+
+    typedef sparse_index_t index_type;
+    typedef ValueType value_type;
+
+    sparse_csr_view_t(const sparse_matrix_t<ValueType>& A) {
+        // CSR of A has exactly the arrays of CSC of A^T.
+        Transpose(A, _AT);
+    }
+
+    int height() const { return _AT.width(); }
+    int width() const { return _AT.height(); }
+    index_type nonzeros() const { return _AT.nonzeros(); }
+
+    /** Row pointers (height() + 1 entries) */
+    const index_type* indptr() const { return _AT.indptr(); }
+
+    /** Column indices, sorted within each row */
+    const index_type* indices() const { return _AT.indices(); }
+
+    const value_type* locked_values() const { return _AT.locked_values(); }
+
+private:
+    sparse_matrix_t<ValueType> _AT;
+
+    sparse_csr_view_t(const sparse_csr_view_t&);
+    void operator=(const sparse_csr_view_t&);
+};
+
 } }
 
 #endif
@@ -34,19 +34,20 @@ const elem::Matrix<T> RowView(const elem::Matrix<T>& B, int i, int height) {
 template<typename T>
 inline
 void ColumnView(sparse_matrix_t<T>& A, sparse_matrix_t<T>& B, int j, int width) {
-    const int *bindptr = B.indptr();
-    const int *bindices = B.indices();
-    double *bvalues = B.values();
+    typedef typename sparse_matrix_t<T>::index_type index_type;
+    const index_type *bindptr = B.indptr();
+    const index_type *bindices = B.indices();
+    T *bvalues = B.values();
 
-    int start = bindptr[j];
-    int *indptr = new int[width + 1];
+    index_type start = bindptr[j];
+    index_type *indptr = new index_type[width + 1];
     for (int i = 0; i <= width; i++)
         indptr[i] = bindptr[j + i] - start;
-    const int *indices = bindices + start;
-    double *values = bvalues + start;
+    const index_type *indices = bindices + start;
+    T *values = bvalues + start;
 
     A.attach(indptr, indices, values, indptr[width], A.height(), width,
-        true, false, false);
+        true, false, false, B.sorted());
 }
 
 template<typename T>
@@ -16,102 +16,6 @@ namespace skyml = skylark::ml;
 namespace skyutil = skylark::utility;
 
 
-struct simple_unweighted_graph_t {
-
-
-    simple_unweighted_graph_t(const std::string &gf);
-
-    ~simple_unweighted_graph_t() {
-        delete[] _out;
-    }
-
-    int num_vertices() const { return _num_vertices; }
-    int num_edges() const { return _num_edges; }
-    int degree(int vertex) const { return _nodepairs.at(vertex).first; }
-    const int *adjanct(int vertex) const { return _nodepairs.at(vertex).second; }
-
-private:
-    typedef std::pair<int, int *> nodepair_t;
-
-    std::unordered_map<int, nodepair_t> _nodepairs;
-    int *_out;
-    int _num_vertices;
-    int _num_edges;
-};
-
-
-simple_unweighted_graph_t::simple_unweighted_graph_t(const std::string &gf) {
-
-    std::ifstream in(gf);
-    std::string line, token;
-
-    _num_edges = 0;
-    while(true) {
-        getline(in, line);
-        if (in.eof())
-            break;
-        if (line[0] == '#')
-            continue;
-
-        std::istringstream tokenstream(line);
-        tokenstream >> token;
-        int i = atoi(token.c_str());
-        tokenstream >> token;
-        int j = atoi(token.c_str());
-
-        if (i == j)
-            continue;
-
-        _nodepairs[i].first++;
-        _nodepairs[j].first++;
-        _num_edges += 2;
-    }
-
-    _num_vertices = _nodepairs.size();
-
-    std::cout << "Finished first pass. Vertices = " << _num_vertices
-              << " Edges = " << _num_edges << std::endl;
-    _out = new int[_num_edges];
-
-    // Set pointers and zero degrees.
-    int count = 0;
-    for(auto it = _nodepairs.begin(); it != _nodepairs.end(); it++) {
-        int nodeid = it->first;
-        int deg = it->second.first;
-        _nodepairs[nodeid] = nodepair_t(0, _out + count);
-        count += deg;
-    }
-
-    // Second pass
-    in.clear();
-    in.seekg(0, std::ios::beg);
-    while(!in.eof()) {
-        getline(in, line);
-        if (line[0] == '#')
-            continue;
-
-        std::istringstream tokenstream(line);
-        tokenstream >> token;
-        int i = atoi(token.c_str());
-        tokenstream >> token;
-        int j = atoi(token.c_str());
-
-        if (i == j)
-            continue;
-
-        nodepair_t &npi = _nodepairs[i];
-        npi.second[npi.first] = j;
-        npi.first++;
-
-        nodepair_t &npj = _nodepairs[j];
-        npj.second[npj.first] = i;
-        npj.first++;
-    }
-
-    std::cout << "Finished reading... ";
-    in.close();
-}
-
 int main(int argc, char** argv) {
 
     elem::Initialize(argc, argv);
@@ -121,7 +25,7 @@ int main(int argc, char** argv) {
     // Parse options
     double gamma, alpha, epsilon;
     bool recursive, interactive;
-    std::string graphfile, indexfile;
+    std::string graphfile, indexfile, cachefile;
     std::vector<std::string> seedss;
     std::vector<int> seeds;
     bpo::options_description
@@ -130,7 +34,12 @@ int main(int argc, char** argv) {
         ("help,h", "produce a help message")
         ("graphfile,g",
             bpo::value<std::string>(&graphfile),
-            "File holding the graph. REQUIRED.")
+            "File holding the graph: an edge list, or a cache written with "
+            "--cachefile. REQUIRED.")
+        ("cachefile,c",
+            bpo::value<std::string>(&cachefile)->default_value(""),
+            "Write the graph to this binary cache file, for fast reloading. "
+            "OPTIONAL.")
         ("indexfile,d",
             bpo::value<std::string>(&indexfile)->default_value(""),
             "Index files mapping node-ids to strings. OPTIONAL.")
@@ -185,9 +94,19 @@ int main(int argc, char** argv) {
     std::cout << "Reading the adjacency matrix... " << std::endl;
     std::cout.flush();
     timer.restart();
-    simple_unweighted_graph_t G(graphfile);
+    skyml::csr_graph_t<> G(graphfile);
+    std::cout << "Vertices = " << G.num_vertices()
+              << " Edges = " << G.num_edges() << ", ";
     std::cout <<"took " << boost::format("%.2e") % timer.elapsed() << " sec\n";
 
+    if (!cachefile.empty()) {
+        std::cout << "Writing graph cache... ";
+        std::cout.flush();
+        timer.restart();
+        G.save(cachefile);
+        std::cout <<"took " << boost::format("%.2e") % timer.elapsed() << " sec\n";
+    }
+
     bool use_index = !indexfile.empty();
     std::unordered_map<int, std::string> id_to_name_map;
     std::unordered_map<std::string, int> name_to_id_map;
@@ -259,19 +178,31 @@ int main(int argc, char** argv) {
                     seeds.push_back(atoi(it->c_str()));
         }
 
+        // Seeds are given by their labels in the graph file.
+        std::vector<int> seedv;
+        for(auto it = seeds.begin(); it != seeds.end(); it++) {
+            int v = G.vertex(*it);
+            if (v == -1)
+                std::cout << "Seed " << *it << " is not in the graph."
+                          << std::endl;
+            else
+                seedv.push_back(v);
+        }
+        if (seedv.empty())
+            continue;
 
         timer.restart();
         std::vector<int> cluster;
-        double cond = skyml::FindLocalCluster(G, seeds, cluster,
+        double cond = skyml::FindLocalCluster(G, seedv, cluster,
             alpha, gamma, epsilon, recursive);
         std::cout <<"Analysis complete! Took "
                   << boost::format("%.2e") % timer.elapsed() << " sec\n";
         std::cout << "Cluster found:" << std::endl;
         for (auto it = cluster.begin(); it != cluster.end(); it++)
             if (use_index)
-                std::cout << id_to_name_map[*it] << std::endl;
+                std::cout << id_to_name_map[G.label(*it)] << std::endl;
             else
-                std::cout << *it << " ";
+                std::cout << G.label(*it) << " ";
         if (!use_index)
             std::cout << std::endl;
         std::cout << "Conductivity = " << cond << std::endl;
@@ -0,0 +1,187 @@
+/**
+ * Throughput of the local dense-times-sparse Gemm (elem::Matrix times
+ * base::sparse_matrix_t) for all four orientations, the kernel behind sparse
+ * sketches and BlockADMM on sparse data.
+ *
+ * Each orientation is timed for base::Gemm, for a reference SpMM that
+ * applies one non-zero at a time (the usual CSC kernel), and for a BLAS
+ * Gemm on the densified sparse matrix. Rates are effective GFLOP/s, i.e.
+ * 2 * nnz * (dense dimension) / time for all three, so they can be put side
+ * by side with the SpMM throughput reported by vendor libraries.
+ *
+ * Usage: sparse_gemm [m] [k] [n] [density] [repeats]
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <elemental.hpp>
+#include <boost/mpi.hpp>
+#include <boost/format.hpp>
+#include <skylark.hpp>
+
+/*******************************************/
+namespace bmpi =  boost::mpi;
+namespace skybase = skylark::base;
+/*******************************************/
+
+typedef skybase::sparse_matrix_t<double> sparse_type;
+typedef sparse_type::index_type index_type;
+
+struct csc_t {
+    std::vector<index_type> indptr, indices;
+    std::vector<double> values;
+};
+
+/** Random height x width CSC matrix with the given density. */
+void random_sparse(int height, int width, double density, std::mt19937& gen,
+    csc_t& B, sparse_type& S) {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::uniform_real_distribution<double> v(-1.0, 1.0);
+
+    B.indptr.assign(1, 0);
+    B.indices.clear();
+    B.values.clear();
+    for(int j = 0; j < width; j++) {
+        for(int i = 0; i < height; i++)
+            if (u(gen) < density) {
+                B.indices.push_back(i);
+                B.values.push_back(v(gen));
+            }
+        B.indptr.push_back(B.indices.size());
+    }
+
+    S.attach(B.indptr.data(), B.indices.data(), B.values.data(),
+        B.indices.size(), height, width);
+}
+
+void densify(int height, int width, const csc_t& B, elem::Matrix<double>& D) {
+    elem::Zeros(D, height, width);
+    for(int j = 0; j < width; j++)
+        for(index_type l = B.indptr[j]; l < B.indptr[j + 1]; l++)
+            D.Set(B.indices[l], j, B.values[l]);
+}
+
+/** C += A * op(B), or A^T * op(B), one non-zero of B at a time. */
+void reference_spmm(elem::Orientation oA, elem::Orientation oB,
+    const elem::Matrix<double>& A, int width, const csc_t& B,
+    elem::Matrix<double>& C) {
+    const double *a = A.LockedBuffer();
+    int lda = A.LDim();
+    double *c = C.Buffer();
+    int ldc = C.LDim();
+    int d = oA == elem::NORMAL ? A.Height() : A.Width();
+
+    // Strips of rows of C, so that threads do not race on the scatter.
+    const int strip = 256;
+
+#   if SKYLARK_HAVE_OPENMP
+#   pragma omp parallel for
+#   endif
+    for(int t0 = 0; t0 < d; t0 += strip) {
+        int t1 = std::min(d, t0 + strip);
+        for(int j = 0; j < width; j++)
+            for(index_type l = B.indptr[j]; l < B.indptr[j + 1]; l++) {
+                int i = B.indices[l];
+                int ac = oB == elem::NORMAL ? i : j;
+                int cc = oB == elem::NORMAL ? j : i;
+                double val = B.values[l];
+                for(int t = t0; t < t1; t++)
+                    c[cc * ldc + t] += val * (oA == elem::NORMAL ?
+                        a[ac * lda + t] : a[t * lda + ac]);
+            }
+    }
+}
+
+int main(int argc, char** argv) {
+
+    elem::Initialize(argc, argv);
+
+    bmpi::communicator world;
+
+    int m = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int k = argc > 2 ? std::atoi(argv[2]) : 20000;
+    int n = argc > 3 ? std::atoi(argv[3]) : 2000;
+    double density = argc > 4 ? std::atof(argv[4]) : 0.001;
+    int repeats = argc > 5 ? std::atoi(argv[5]) : 5;
+
+    if (world.rank() == 0)
+        std::cout << "m = " << m << ", k = " << k << ", n = " << n
+                  << ", density = " << density << std::endl;
+
+    std::mt19937 gen(23234);
+    std::uniform_real_distribution<double> v(-1.0, 1.0);
+
+    // A is m x k for NN / NT and k x m for TN / TT, so that the sparse
+    // matrix is always k x n (or n x k) and the dense dimension is m.
+    const char *names[] = {"NN", "NT", "TN", "TT"};
+    elem::Orientation oAs[] = {elem::NORMAL, elem::NORMAL,
+                               elem::TRANSPOSE, elem::TRANSPOSE};
+    elem::Orientation oBs[] = {elem::NORMAL, elem::TRANSPOSE,
+                               elem::NORMAL, elem::TRANSPOSE};
+
+    for(int o = 0; o < 4; o++) {
+        elem::Orientation oA = oAs[o], oB = oBs[o];
+
+        elem::Matrix<double> A;
+        if (oA == elem::NORMAL)
+            A.Resize(m, k);
+        else
+            A.Resize(k, m);
+        for(int j = 0; j < A.Width(); j++)
+            for(int i = 0; i < A.Height(); i++)
+                A.Set(i, j, v(gen));
+
+        int bh = oB == elem::NORMAL ? k : n;
+        int bw = oB == elem::NORMAL ? n : k;
+        csc_t B;
+        sparse_type S;
+        random_sparse(bh, bw, density, gen, B, S);
+
+        elem::Matrix<double> D;
+        densify(bh, bw, B, D);
+
+        double flops = 2.0 * B.indices.size() * m;
+
+        elem::Matrix<double> C, Cr, Cd;
+        elem::Zeros(Cr, m, n);
+        elem::Zeros(Cd, m, n);
+
+        boost::mpi::timer timer;
+        double tsk = 0, tref = 0, tblas = 0;
+        for(int r = 0; r < repeats; r++) {
+            timer.restart();
+            skybase::Gemm(oA, oB, 1.0, A, S, C);
+            tsk += timer.elapsed();
+
+            elem::Zeros(Cr, m, n);
+            timer.restart();
+            reference_spmm(oA, oB, A, bw, B, Cr);
+            tref += timer.elapsed();
+
+            timer.restart();
+            elem::Gemm(oA, oB, 1.0, A, D, 0.0, Cd);
+            tblas += timer.elapsed();
+        }
+
+        elem::Axpy(-1.0, C, Cr);
+        double err = elem::FrobeniusNorm(Cr) / elem::FrobeniusNorm(Cd);
+
+        if (world.rank() == 0)
+            std::cout << names[o] << ":"
+                      << "\tGemm " << boost::format("%.2f") %
+                (flops * repeats / tsk * 1e-9) << " GFLOP/s"
+                      << "\tper-nonzero " << boost::format("%.2f") %
+                (flops * repeats / tref * 1e-9) << " GFLOP/s"
+                      << "\tdense BLAS " << boost::format("%.2f") %
+                (flops * repeats / tblas * 1e-9) << " GFLOP/s"
+                      << "\t(rel. error " << boost::format("%.1e") % err << ")"
+                      << std::endl;
+    }
+
+    elem::Finalize();
+    return 0;
+}
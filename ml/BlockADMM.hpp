@@ -4,7 +4,9 @@
 #include <elemental.hpp>
 #include <skylark.hpp>
 #include <cmath>
+#include <string>
 #include <boost/mpi.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #ifdef SKYLARK_HAVE_OPENMP
 #include <omp.h>
@@ -12,6 +14,7 @@
 
 #include "../utility/timer.hpp"
 #include "hilbert.hpp"
+#include "example_chunks.hpp"
 
 // Columns are examples, rows are features
 typedef elem::DistMatrix<double, elem::STAR, elem::VC> DistInputMatrixType;
@@ -73,6 +76,7 @@ public:
     void set_maxiter(double MAXITER) { this->MAXITER = MAXITER; }
     void set_tol(double TOL) { this->TOL = TOL; }
     void set_cache_transform(bool CacheTransforms) {this->CacheTransforms = CacheTransforms;}
+    void set_scratch_directory(const std::string& ScratchDirectory) {this->ScratchDirectory = ScratchDirectory;}
 
     ~BlockADMMSolver();
 
@@ -83,6 +87,13 @@ public:
         LocalMatrixType& Y, T& Xv, LocalMatrixType& Yv,
         const boost::mpi::communicator& comm);
 
+    // Streaming training: X is read chunk by chunk, and the transforms are
+    // either recomputed in every pass or (with cache_transform) spilled
+    // once to a memory-mapped scratch file in the scratch directory.
+    skylark::ml::model_t<T, LocalMatrixType>* train(
+        example_chunks_t<T>& chunks, T& Xv, LocalMatrixType& Yv,
+        const boost::mpi::communicator& comm);
+
     int get_numfeatures() {return NumFeatures;}
 
     feature_transform_array_t& get_feature_maps() {return featureMaps;}
@@ -107,8 +118,51 @@ private:
     double TOL;
 
     bool CacheTransforms;
+    std::string ScratchDirectory;
+
+    void ApplyFeatureMap(int j, const T& X, LocalMatrixType& z, int d) const;
 };
 
+/**
+ * Rows [start, start + count) of the input, as a dense matrix. This is the
+ * "feature map" of partition j in the linear case.
+ */
+inline void GetRows(const LocalMatrixType& X, int start, int count,
+    LocalMatrixType& Z) {
+    LocalMatrixType view;
+    elem::LockedView(view, X, start, 0, count, X.Width());
+    Z = view;
+}
+
+inline void GetRows(const sparse_matrix_t& X, int start, int count,
+    LocalMatrixType& Z) {
+    elem::Zeros(Z, count, X.width());
+
+    const sparse_matrix_t::index_type* indptr = X.indptr();
+    const sparse_matrix_t::index_type* indices = X.indices();
+    const double* values = X.locked_values();
+    for(int col = 0; col < X.width(); col++)
+        for(sparse_matrix_t::index_type idx = indptr[col];
+            idx < indptr[col + 1]; idx++) {
+            int row = indices[idx] - start;
+            if (row >= 0 && row < count)
+                Z.Set(row, col, values[idx]);
+        }
+}
+
+template <class T>
+void BlockADMMSolver<T>::ApplyFeatureMap(int j, const T& X,
+    LocalMatrixType& z, int d) const {
+    int sj = finishes[j] - starts[j] + 1;
+
+    if (featureMaps.size() > 0) {
+        featureMaps[j]->apply(X, z, skylark::sketch::columnwise_tag());
+        if (ScaleFeatureMaps)
+            elem::Scal(sqrt(double(sj) / d), z);
+    } else
+        GetRows(X, starts[j], sj, z);
+}
+
 template <class T>
 void BlockADMMSolver<T>::InitializeFactorizationCache() {
     Cache = new LocalMatrixType* [NumFeaturePartitions];
@@ -580,4 +634,353 @@ skylark::ml::model_t<T, LocalMatrixType>* BlockADMMSolver<T>::train(T& X, LocalM
 }
 
 
+/**
+ * Streaming variant of train(). Only one chunk of X, and the per-example ADMM
+ * state (a few k x ni matrices), is in memory at a time.
+ *
+ * The iterates are the same as in the in-memory solver, reorganized so that
+ * each iteration makes two passes over the chunks:
+ *
+ *   1. rhs_j = Z_j * dsum' / (n + 1), summed over the chunks;
+ *   2. sum_o = sum_j Wi[J]' * Z_j (and the loss output Wbar' * Z),
+ *      which needs the new Wi, hence the second pass.
+ *
+ * ZtObar_ij[J] = Z_j * Z_j' * Wi[J] is not accumulated: since Cache[j] is
+ * inv(Z_j * Z_j' + I) and Wi[J] = Cache[j] * rhs_j, it equals rhs_j - Wi[J].
+ *
+ * Z_j for a chunk is recomputed from the chunk in each pass, or, if
+ * transforms are cached, computed once and spilled to a memory-mapped
+ * scratch file (D x ni doubles per rank), from which the kernel pages it
+ * in and out as needed.
+ */
+template <class T>
+skylark::ml::model_t<T, LocalMatrixType>* BlockADMMSolver<T>::train(
+    example_chunks_t<T>& chunks, T& Xv, LocalMatrixType& Yv,
+    const boost::mpi::communicator& comm) {
+
+       int rank = comm.rank();
+       int size = comm.size();
+
+       int P = size;
+
+       int ni = chunks.width();
+       int d = chunks.height();
+       LocalMatrixType& Y = chunks.labels();
+       int targets = GetNumTargets(comm, Y);
+
+       skylark::ml::model_t<T, LocalMatrixType>* model =
+           new skylark::ml::model_t<T, LocalMatrixType>(featureMaps,
+               ScaleFeatureMaps, NumFeatures, targets);
+
+       elem::Matrix<double> Wbar;
+       elem::View(Wbar, model->get_coef());
+
+       int k = Wbar.Width();
+       int D = NumFeatures;
+       int Dk = D*k;
+
+       LocalMatrixType O(k, ni);
+       elem::MakeZeros(O);
+
+       LocalMatrixType Obar(k, ni);
+       elem::MakeZeros(Obar);
+
+       LocalMatrixType nu(k, ni);
+       elem::MakeZeros(nu);
+
+       LocalMatrixType W, mu, Wi, mu_ij, ZtObar_ij, Rhs;
+
+       if(rank==0) {
+           elem::Zeros(W,  D, k);
+           elem::Zeros(mu, D, k);
+       }
+       elem::Zeros(Wi, D, k);
+       elem::Zeros(mu_ij, D, k);
+       elem::Zeros(ZtObar_ij, D, k);
+       elem::Zeros(Rhs, D, k);
+
+       int iter = 0;
+
+       double localloss, totalloss, accuracy, obj;
+
+       boost::mpi::timer timer;
+
+       LocalMatrixType sum_o, del_o, dsum, wbar_output;
+       elem::Zeros(del_o, k, ni);
+       LocalMatrixType Yp(Yv.Height(), k);
+       LocalMatrixType Yp_labels(Yv.Height(), 1);
+
+       SKYLARK_TIMER_INITIALIZE(ITERATIONS_PROFILE);
+       SKYLARK_TIMER_INITIALIZE(COMMUNICATION_PROFILE);
+       SKYLARK_TIMER_INITIALIZE(READ_PROFILE);
+       SKYLARK_TIMER_INITIALIZE(TRANSFORM_PROFILE);
+       SKYLARK_TIMER_INITIALIZE(PROXLOSS_PROFILE);
+       SKYLARK_TIMER_INITIALIZE(BARRIER_PROFILE);
+       SKYLARK_TIMER_INITIALIZE(PREDICTION_PROFILE);
+
+       // Spilled transforms: chunk c starts at D * chunk_start(c), and in it
+       // partition j is the sj x chunk_width(c) block at starts[j] * width.
+       boost::scoped_ptr< skylark::utility::scratch_file_t<double> > spill;
+       if (CacheTransforms)
+           spill.reset(new skylark::utility::scratch_file_t<double>(
+                   ScratchDirectory, size_t(D) * ni));
+
+       T Xc;
+
+       // Setup pass: factorization cache, and the spilled transforms.
+       SKYLARK_TIMER_RESTART(TRANSFORM_PROFILE);
+       for(int j = 0; j < NumFeaturePartitions; j++)
+           elem::MakeZeros(*Cache[j]);
+
+       for(int c = 0; c < chunks.num_chunks(); c++) {
+           int nc = chunks.chunk_width(c);
+
+           SKYLARK_TIMER_RESTART(READ_PROFILE);
+           chunks.read(c, Xc);
+           SKYLARK_TIMER_ACCUMULATE(READ_PROFILE);
+
+   #       ifdef SKYLARK_HAVE_OPENMP
+   #       pragma omp parallel for if(NumThreads > 1) num_threads(NumThreads)
+   #       endif
+           for(int j = 0; j < NumFeaturePartitions; j++) {
+               int sj = finishes[j] - starts[j] + 1;
+
+               elem::Matrix<double> z(sj, nc);
+               ApplyFeatureMap(j, Xc, z, d);
+               elem::Gemm(elem::NORMAL, elem::TRANSPOSE, 1.0, z, z, 1.0,
+                   *Cache[j]);
+
+               if (spill) {
+                   double *dst = spill->data() +
+                       size_t(D) * chunks.chunk_start(c) + size_t(starts[j]) * nc;
+                   for(int i = 0; i < nc; i++)
+                       std::copy(z.LockedBuffer(0, i),
+                           z.LockedBuffer(0, i) + sj, dst + size_t(i) * sj);
+               }
+           }
+       }
+
+       for(int j = 0; j < NumFeaturePartitions; j++) {
+           int sj = finishes[j] - starts[j] + 1;
+           elem::Matrix<double> Ones;
+           elem::Ones(Ones, sj, 1);
+           Cache[j]->UpdateDiagonal(Ones);
+           elem::Inverse(*Cache[j]);
+       }
+       SKYLARK_TIMER_ACCUMULATE(TRANSFORM_PROFILE);
+
+       while(iter<MAXITER) {
+
+           SKYLARK_TIMER_RESTART(ITERATIONS_PROFILE);
+
+           iter++;
+
+           SKYLARK_TIMER_RESTART(COMMUNICATION_PROFILE);
+           broadcast(comm, Wbar.Buffer(), Dk, 0);
+           SKYLARK_TIMER_ACCUMULATE(COMMUNICATION_PROFILE)
+
+           // mu_ij = mu_ij - Wbar
+           elem::Axpy(-1.0, Wbar, mu_ij);
+
+           // Obar = Obar - nu
+           elem::Axpy(-1.0, nu, Obar);
+
+           SKYLARK_TIMER_RESTART(PROXLOSS_PROFILE);
+           loss->proxoperator(Obar, 1.0/RHO, Y, O);
+           SKYLARK_TIMER_ACCUMULATE(PROXLOSS_PROFILE);
+
+           if(rank==0) {
+               regularizer->proxoperator(Wbar, lambda/RHO, mu, W);
+           }
+
+           // dsum = del_o + (n+1) * nu
+           dsum = del_o;
+           elem::Axpy(NumFeaturePartitions + 1.0, nu, dsum);
+
+           elem::MakeZeros(Rhs);
+           elem::Zeros(sum_o, k, ni);
+           elem::Zeros(wbar_output, k, ni);
+
+           SKYLARK_TIMER_RESTART(TRANSFORM_PROFILE);
+
+           for(int pass = 0; pass < 2; pass++) {
+               for(int c = 0; c < chunks.num_chunks(); c++) {
+                   int cstart = chunks.chunk_start(c);
+                   int nc = chunks.chunk_width(c);
+
+                   if (spill) {
+                       if (c + 1 < chunks.num_chunks())
+                           spill->prefetch(
+                               size_t(D) * chunks.chunk_start(c + 1),
+                               size_t(D) * chunks.chunk_width(c + 1));
+                   } else {
+                       SKYLARK_TIMER_RESTART(READ_PROFILE);
+                       chunks.read(c, Xc);
+                       SKYLARK_TIMER_ACCUMULATE(READ_PROFILE);
+                   }
+
+                   LocalMatrixType dsum_c, sum_o_c, wbar_output_c;
+                   elem::LockedView(dsum_c, dsum, 0, cstart, k, nc);
+                   elem::View(sum_o_c, sum_o, 0, cstart, k, nc);
+                   elem::View(wbar_output_c, wbar_output, 0, cstart, k, nc);
+
+   #               ifdef SKYLARK_HAVE_OPENMP
+   #               pragma omp parallel for if(NumThreads > 1) num_threads(NumThreads)
+   #               endif
+                   for(int j = 0; j < NumFeaturePartitions; j++) {
+                       int start = starts[j];
+                       int sj = finishes[j] - start + 1;
+
+                       elem::Matrix<double> z;
+                       if (spill)
+                           z.LockedAttach(sj, nc, spill->data() +
+                               size_t(D) * cstart + size_t(start) * nc, sj);
+                       else {
+                           z.Resize(sj, nc);
+                           ApplyFeatureMap(j, Xc, z, d);
+                       }
+
+                       elem::Matrix<double> tmp;
+                       if (pass == 0) {
+                           // Rhs[J,:] += z * dsum' / (n+1)
+                           elem::View(tmp, Rhs, start, 0, sj, k);
+                           elem::Gemm(elem::NORMAL, elem::TRANSPOSE,
+                               1.0/(NumFeaturePartitions + 1.0), z, dsum_c,
+                               1.0, tmp);
+                       } else {
+                           // o = (z' * Wi[J,:])', and the same with Wbar
+                           elem::Matrix<double> o(k, nc), wo(k, nc);
+                           elem::LockedView(tmp, Wi, start, 0, sj, k);
+                           elem::Gemm(elem::TRANSPOSE, elem::NORMAL, 1.0, tmp, z,
+                               0.0, o);
+                           elem::LockedView(tmp, Wbar, start, 0, sj, k);
+                           elem::Gemm(elem::TRANSPOSE, elem::NORMAL, 1.0, tmp, z,
+                               0.0, wo);
+
+   #                       ifdef SKYLARK_HAVE_OPENMP
+   #                       pragma omp critical
+   #                       endif
+                           {
+                               elem::Axpy(1.0, o, sum_o_c);
+                               elem::Axpy(1.0, wo, wbar_output_c);
+                           }
+                       }
+                   }
+               }
+
+               if (pass > 0)
+                   break;
+
+   #           ifdef SKYLARK_HAVE_OPENMP
+   #           pragma omp parallel for if(NumThreads > 1) num_threads(NumThreads)
+   #           endif
+               for(int j = 0; j < NumFeaturePartitions; j++) {
+                   int start = starts[j];
+                   int sj = finishes[j] - start + 1;
+
+                   elem::Matrix<double> rhs, tmp, wi;
+                   elem::View(rhs, Rhs, start, 0, sj, k);
+
+                   // rhs = rhs + Wbar[J,:] - mu_ij[J,:] + ZtObar_ij[J,:]
+                   elem::LockedView(tmp, Wbar, start, 0, sj, k);
+                   elem::Axpy(+1.0, tmp, rhs);
+                   elem::View(tmp, mu_ij, start, 0, sj, k);
+                   elem::Axpy(-1.0, tmp, rhs);
+                   elem::View(tmp, ZtObar_ij, start, 0, sj, k);
+                   elem::Axpy(+1.0, tmp, rhs);
+
+                   // Wi[J,:] = Cache[j]*rhs
+                   elem::View(wi, Wi, start, 0, sj, k);
+                   elem::Gemm(elem::NORMAL, elem::NORMAL, 1.0, *Cache[j], rhs,
+                       0.0, wi);
+
+                   // ZtObar_ij[J,:] = rhs - Wi[J,:]
+                   elem::View(tmp, ZtObar_ij, start, 0, sj, k);
+                   elem::MakeZeros(tmp);
+                   elem::Axpy(+1.0, rhs, tmp);
+                   elem::Axpy(-1.0, wi, tmp);
+
+                   // mu_ij[J,:] = mu_ij[J,:] + Wi[J,:]
+                   elem::View(tmp, mu_ij, start, 0, sj, k);
+                   elem::Axpy(+1.0, wi, tmp);
+               }
+           }
+
+           SKYLARK_TIMER_ACCUMULATE(TRANSFORM_PROFILE);
+
+           elem::Scal(-1.0, sum_o);
+           elem::Axpy(+1.0, O, sum_o); // sum_o = O.Matrix - sum_o
+           del_o = sum_o;
+
+           SKYLARK_TIMER_RESTART(PREDICTION_PROFILE);
+           if (skylark::base::Width(Xv) > 0) {
+               elem::MakeZeros(Yp);
+               elem::MakeZeros(Yp_labels);
+               model->predict(Xv, Yp_labels, Yp, NumThreads);
+               accuracy = model->evaluate(Yv, Yp, comm);
+           }
+           SKYLARK_TIMER_ACCUMULATE(PREDICTION_PROFILE);
+
+           localloss = loss->evaluate(wbar_output, Y);
+
+           SKYLARK_TIMER_RESTART(COMMUNICATION_PROFILE);
+           reduce(comm, localloss, totalloss, std::plus<double>(), 0);
+           SKYLARK_TIMER_ACCUMULATE(COMMUNICATION_PROFILE);
+
+           if(rank == 0) {
+               obj = totalloss + lambda*regularizer->evaluate(Wbar);
+               if (skylark::base::Width(Xv) <=0) {
+                   std::cout << "iteration " << iter << " objective " << obj << " time " << timer.elapsed() << " seconds" << std::endl;
+               }
+               else {
+                   std::cout << "iteration " << iter << " objective " << obj << " accuracy " << accuracy << " time " << timer.elapsed() << " seconds" << std::endl;
+               }
+           }
+
+           elem::Copy(O, Obar);
+           elem::Scal(1.0/(NumFeaturePartitions+1.0), sum_o);
+           elem::Axpy(-1.0, sum_o, Obar);
+
+           elem::Axpy(+1.0, O, nu);
+           elem::Axpy(-1.0, Obar, nu);
+
+           //Wbar = comm.reduce(Wi)
+           SKYLARK_TIMER_RESTART(COMMUNICATION_PROFILE);
+           boost::mpi::reduce (comm,
+                                   Wi.LockedBuffer(),
+                                   Wi.MemorySize(),
+                                   Wbar.Buffer(),
+                                   std::plus<double>(),
+                                   0);
+           SKYLARK_TIMER_ACCUMULATE(COMMUNICATION_PROFILE);
+
+           if(rank==0) {
+               //Wbar = (Wisum + W)/(P+1)
+               elem::Axpy(1.0, W, Wbar);
+               elem::Scal(1.0/(P+1), Wbar);
+
+               // mu = mu + W - Wbar;
+               elem::Axpy(+1.0, W, mu);
+               elem::Axpy(-1.0, Wbar, mu);
+           }
+
+           SKYLARK_TIMER_RESTART(BARRIER_PROFILE);
+           comm.barrier();
+           SKYLARK_TIMER_ACCUMULATE(BARRIER_PROFILE);
+
+           SKYLARK_TIMER_ACCUMULATE(ITERATIONS_PROFILE);
+       }
+
+       SKYLARK_TIMER_PRINT(ITERATIONS_PROFILE, comm);
+       SKYLARK_TIMER_PRINT(COMMUNICATION_PROFILE, comm);
+       SKYLARK_TIMER_PRINT(READ_PROFILE, comm);
+       SKYLARK_TIMER_PRINT(TRANSFORM_PROFILE, comm);
+       SKYLARK_TIMER_PRINT(PROXLOSS_PROFILE, comm);
+       SKYLARK_TIMER_PRINT(BARRIER_PROFILE, comm);
+       SKYLARK_TIMER_PRINT(PREDICTION_PROFILE, comm);
+
+       return model;
+}
+
+
 #endif /* SKYLARK_BLOCKADDM_HPP */
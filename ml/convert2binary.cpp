@@ -0,0 +1,51 @@
+/*
+ * convert2binary.cpp
+ *
+ * Converts a libsvm file to the binary matrix format that hilbert maps
+ * directly into memory (--fileformat 4 or 5).
+ */
+
+
+#include <string>
+#include <skylark.hpp>
+#include <boost/mpi.hpp>
+#include <elemental.hpp>
+#include <cstdlib>
+
+
+int main (int argc, char** argv) {
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+
+    if (argc!=5)
+    {
+        std::cout << "convert2binary inputfile binaryfile mode[0:dense,1:sparse] min_d" << std::endl;
+        exit(1);
+    }
+
+    std::string inputfile = argv[1];
+    std::string binaryfile = argv[2];
+    int mode = atoi(argv[3]);
+    int min_d  = atoi(argv[4]);
+
+    boost::mpi::environment env (argc, argv);
+
+    // get communicator
+    boost::mpi::communicator comm;
+    int rank = comm.rank();
+
+    elem::Initialize (argc, argv);
+
+    if (rank == 0)
+        std::cout << "input: " << inputfile << " binaryfile:" << binaryfile << " mode:" <<  mode << " min_d:" << min_d << std::endl;
+
+    boost::mpi::timer timer;
+    skylark::utility::io::LIBSVMToBinary<double>(comm, inputfile, binaryfile,
+        mode != 0, min_d);
+
+    if (rank == 0)
+        std::cout << "Converted in " << timer.elapsed() << " secs" << std::endl;
+
+    elem::Finalize();
+    return 0;
+}
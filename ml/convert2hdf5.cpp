@@ -49,11 +49,9 @@ int main (int argc, char** argv) {
     	read_libsvm(comm, inputfile, X, Y, min_d);
         write_hdf5(comm, hdf5file, X,Y);
     } else {
-    	sparse_matrix_t X;
-    	LocalMatrixType Y;
-    	read_libsvm(comm, inputfile, X, Y, min_d);
-    	if(rank==0)
-    		write_hdf5(hdf5file, X,Y);
+        // Every rank parses and writes its own block of examples.
+        skylark::utility::io::LIBSVMToHDF5<double>(comm, inputfile, hdf5file,
+            min_d);
     }
 
 }
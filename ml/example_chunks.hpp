@@ -0,0 +1,396 @@
+#ifndef SKYLARK_EXAMPLE_CHUNKS_HPP
+#define SKYLARK_EXAMPLE_CHUNKS_HPP
+
+#include <boost/mpi.hpp>
+#include <algorithm>
+#include <fstream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <elemental.hpp>
+#include "../base/sparse_matrix.hpp"
+#include "../base/exception.hpp"
+#include "../utility/io/libsvm_io.hpp"
+#include "options.hpp"
+
+#ifdef SKYLARK_HAVE_HDF5
+#include <H5Cpp.h>
+#endif
+
+/**
+ * Training examples of this rank, kept on disk and read back one chunk (a
+ * fixed number of consecutive examples) at a time. The chunks of the file
+ * are dealt to the ranks in contiguous ranges, and each rank reads only its
+ * own chunks, so no rank ever holds more than one chunk of X. Only the
+ * labels (one double per example) are resident.
+ *
+ * Columns of the chunks are examples, rows are features, as for the
+ * in-memory readers in io.hpp.
+ */
+template<typename InputType>
+class example_chunks_t {
+
+public:
+    typedef elem::Matrix<double> label_matrix_type;
+
+    example_chunks_t(const boost::mpi::communicator &comm, int fileformat,
+        const std::string& fName, int chunksize, int min_d = 0);
+
+    /** Number of features. */
+    int height() const { return _d; }
+
+    /** Number of examples on this rank. */
+    int width() const { return _starts.back(); }
+
+    int num_chunks() const { return _starts.size() - 1; }
+
+    /** Local index of the first example in chunk c. */
+    int chunk_start(int c) const { return _starts[c]; }
+
+    int chunk_width(int c) const { return _starts[c + 1] - _starts[c]; }
+
+    /** Labels of the local examples (width() x 1). */
+    label_matrix_type& labels() { return _Y; }
+
+    /** Reads chunk c into X (height() x chunk_width(c)). */
+    void read(int c, InputType& X) const;
+
+private:
+    typedef skylark::base::sparse_matrix_t<double> sparse_type;
+    typedef skylark::utility::io::internal::libsvm_data_t<double>
+    libsvm_data_type;
+
+    int _fileformat;
+    std::string _fName;
+    int _chunksize;
+    int _n, _d;
+    int _first;                      // global index of first local example
+    std::vector<int> _starts;        // local chunk boundaries
+    std::vector<long long> _offsets; // libsvm: byte offset of each chunk,
+                                     // and of the end of the last one
+    std::vector<int> _indptr;        // hdf5 sparse: local part of indptr
+
+    label_matrix_type _Y;
+
+    void _deal(const boost::mpi::communicator &comm);
+
+    void _init_libsvm(const boost::mpi::communicator &comm, int min_d);
+    void _read_libsvm(int c, libsvm_data_type& data) const;
+
+#ifdef SKYLARK_HAVE_HDF5
+    void _init_hdf5(const boost::mpi::communicator &comm, int min_d);
+
+    template<typename T>
+    static void _read_dataset(H5::H5File& file, const std::string& name,
+        const H5::PredType& type, T *buf, hsize_t offset, hsize_t count);
+#endif
+
+    // Converters from what was read to the input type.
+
+    static void _convert(int d, int nc, const std::vector<double>& dense,
+        elem::Matrix<double>& X);
+
+    static void _convert(int d, int nc, const std::vector<double>& dense,
+        sparse_type& X);
+
+    template<typename IndexType>
+    static void _convert(int d, int nc, const std::vector<IndexType>& colptr,
+        const std::vector<IndexType>& rows, const std::vector<double>& vals,
+        elem::Matrix<double>& X);
+
+    template<typename IndexType>
+    static void _convert(int d, int nc, const std::vector<IndexType>& colptr,
+        const std::vector<IndexType>& rows, const std::vector<double>& vals,
+        sparse_type& X);
+};
+
+template<typename InputType>
+example_chunks_t<InputType>::example_chunks_t(
+    const boost::mpi::communicator &comm, int fileformat,
+    const std::string& fName, int chunksize, int min_d) :
+    _fileformat(fileformat), _fName(fName), _chunksize(chunksize),
+    _n(0), _d(0), _first(0) {
+
+    if (chunksize <= 0)
+        SKYLARK_THROW_EXCEPTION (
+            skylark::base::io_exception()
+                << skylark::base::error_msg("Chunk size must be positive") );
+
+    boost::mpi::timer timer;
+
+    switch(fileformat) {
+    case LIBSVM_DENSE: case LIBSVM_SPARSE:
+        _init_libsvm(comm, min_d);
+        break;
+
+    case HDF5_DENSE: case HDF5_SPARSE:
+#       ifdef SKYLARK_HAVE_HDF5
+        _init_hdf5(comm, min_d);
+#       else
+        SKYLARK_THROW_EXCEPTION (
+            skylark::base::io_exception()
+                << skylark::base::error_msg("Install HDF5 to read HDF5 files") );
+#       endif
+        break;
+
+    default:
+        SKYLARK_THROW_EXCEPTION (
+            skylark::base::io_exception()
+                << skylark::base::error_msg("Unknown file format") );
+    }
+
+    if (comm.rank() == 0)
+        std::cout << "Indexed " << _n << " examples with " << _d
+                  << " features in chunks of " << _chunksize << " ("
+                  << timer.elapsed() << " secs)" << std::endl;
+}
+
+/**
+ * Deals the chunks of the file to the ranks (a contiguous range each), and
+ * sets the local chunk boundaries.
+ */
+template<typename InputType>
+void example_chunks_t<InputType>::_deal(
+    const boost::mpi::communicator &comm) {
+
+    long long G = (static_cast<long long>(_n) + _chunksize - 1) / _chunksize;
+    long long P = comm.size(), r = comm.rank();
+    int cfirst = static_cast<int>(G * r / P);
+    int clast = static_cast<int>(G * (r + 1) / P);
+
+    _first = std::min(cfirst * _chunksize, _n);
+    _starts.clear();
+    for(int g = cfirst; g < clast; g++)
+        _starts.push_back(g * _chunksize - _first);
+    _starts.push_back(std::min(clast * _chunksize, _n) - _first);
+
+    if (!_offsets.empty())
+        _offsets = std::vector<long long>(_offsets.begin() + cfirst,
+            _offsets.begin() + clast + 1);
+}
+
+template<typename InputType>
+void example_chunks_t<InputType>::_init_libsvm(
+    const boost::mpi::communicator &comm, int min_d) {
+
+    // All ranks index their share of the file in parallel; this gives the
+    // dimensions and the offset of every chunk.
+    skylark::utility::io::internal::index_libsvm_parallel(comm, _fName,
+        _chunksize, min_d, _offsets, _n, _d);
+
+    _deal(comm);
+
+    // Labels are kept in memory, so read them now.
+    elem::Zeros(_Y, width(), 1);
+    libsvm_data_type data;
+    for(int c = 0; c < num_chunks(); c++) {
+        _read_libsvm(c, data);
+        std::copy(data.labels.begin(), data.labels.end(),
+            _Y.Buffer() + _starts[c]);
+    }
+}
+
+/**
+ * Parses chunk c of a libsvm file (the bytes between its offset and the
+ * next one) into data.
+ */
+template<typename InputType>
+void example_chunks_t<InputType>::_read_libsvm(int c,
+    libsvm_data_type& data) const {
+
+    std::vector<char> buf(_offsets[c + 1] - _offsets[c] + 1);
+    std::ifstream file(_fName.c_str(), std::ios::binary);
+    file.seekg(_offsets[c], std::ios::beg);
+    file.read(&buf[0], buf.size() - 1);
+    size_t len = file.gcount();
+    buf[len] = '\0';
+
+    data = libsvm_data_type();
+    data.d = _d;
+    int max_index = 0;
+    const char *b = &buf[0];
+    skylark::utility::io::internal::parse_libsvm_lines(b, b + len, b + len,
+        true, data, max_index);
+
+    if (data.width() != chunk_width(c))
+        SKYLARK_THROW_EXCEPTION (
+            skylark::base::io_exception()
+                << skylark::base::error_msg("Unexpected end of " + _fName) );
+}
+
+#ifdef SKYLARK_HAVE_HDF5
+
+template<typename InputType>
+template<typename T>
+void example_chunks_t<InputType>::_read_dataset(H5::H5File& file,
+    const std::string& name, const H5::PredType& type, T *buf,
+    hsize_t offset, hsize_t count) {
+
+    if (count == 0)
+        return;
+
+    H5::DataSet dataset = file.openDataSet(name);
+    H5::DataSpace filespace = dataset.getSpace();
+    H5::DataSpace mspace(1, &count);
+    filespace.selectHyperslab(H5S_SELECT_SET, &count, &offset);
+    dataset.read(buf, type, mspace, filespace);
+}
+
+template<typename InputType>
+void example_chunks_t<InputType>::_init_hdf5(
+    const boost::mpi::communicator &comm, int min_d) {
+
+    // Every rank reads its own part, so they all need the dimensions.
+    H5::H5File file(_fName, H5F_ACC_RDONLY);
+
+    if (_fileformat == HDF5_DENSE) {
+        H5::DataSpace filespace = file.openDataSet("X").getSpace();
+        hsize_t dims[2];
+        filespace.getSimpleExtentDims(dims);
+        _n = dims[0];
+        _d = dims[1];
+    } else {
+        int dimensions[3];
+        _read_dataset(file, "dimensions", H5::PredType::NATIVE_INT,
+            dimensions, 0, 3);
+        _d = dimensions[0];
+        _n = dimensions[1];
+    }
+    _d = std::max(_d, min_d);
+
+    _deal(comm);
+
+    elem::Zeros(_Y, width(), 1);
+    _read_dataset(file, "Y", H5::PredType::NATIVE_DOUBLE, _Y.Buffer(),
+        _first, width());
+
+    if (_fileformat == HDF5_SPARSE) {
+        _indptr.resize(width() + 1);
+        _read_dataset(file, "indptr", H5::PredType::NATIVE_INT, &_indptr[0],
+            _first, width() + 1);
+    }
+
+    file.close();
+}
+
+#endif
+
+template<typename InputType>
+void example_chunks_t<InputType>::read(int c, InputType& X) const {
+
+    int nc = chunk_width(c);
+
+    if (_fileformat == LIBSVM_DENSE || _fileformat == LIBSVM_SPARSE) {
+        libsvm_data_type data;
+        _read_libsvm(c, data);
+        _convert(_d, nc, data.indptr, data.indices, data.values, X);
+        return;
+    }
+
+#   ifdef SKYLARK_HAVE_HDF5
+    H5::H5File file(_fName, H5F_ACC_RDONLY);
+    hsize_t first = _first + _starts[c];
+
+    if (_fileformat == HDF5_DENSE) {
+        // X is stored with examples as rows, so a chunk is a block of
+        // rows. It may have fewer features than _d (min_d).
+        H5::DataSet dataset = file.openDataSet("X");
+        H5::DataSpace filespace = dataset.getSpace();
+        hsize_t fdims[2];
+        filespace.getSimpleExtentDims(fdims);
+
+        hsize_t offset[2] = {first, 0};
+        hsize_t count[2] = {static_cast<hsize_t>(nc), fdims[1]};
+        std::vector<double> buf(nc * fdims[1]);
+        if (nc > 0) {
+            filespace.selectHyperslab(H5S_SELECT_SET, count, offset);
+            H5::DataSpace mspace(2, count);
+            dataset.read(&buf[0], H5::PredType::NATIVE_DOUBLE, mspace,
+                filespace);
+        }
+
+        std::vector<double> dense(static_cast<size_t>(_d) * nc, 0.0);
+        for(int i = 0; i < nc; i++)
+            std::copy(buf.begin() + i * fdims[1],
+                buf.begin() + (i + 1) * fdims[1],
+                dense.begin() + static_cast<size_t>(i) * _d);
+        _convert(_d, nc, dense, X);
+    } else {
+        int base = _indptr[_starts[c]];
+        int nnz = _indptr[_starts[c] + nc] - base;
+        std::vector<int> colptr(nc + 1), rows(nnz);
+        std::vector<double> vals(nnz);
+        for(int i = 0; i <= nc; i++)
+            colptr[i] = _indptr[_starts[c] + i] - base;
+        if (nnz > 0) {
+            _read_dataset(file, "indices", H5::PredType::NATIVE_INT,
+                &rows[0], base, nnz);
+            _read_dataset(file, "values", H5::PredType::NATIVE_DOUBLE,
+                &vals[0], base, nnz);
+        }
+        _convert(_d, nc, colptr, rows, vals, X);
+    }
+
+    file.close();
+#   endif
+}
+
+template<typename InputType>
+void example_chunks_t<InputType>::_convert(int d, int nc,
+    const std::vector<double>& dense, elem::Matrix<double>& X) {
+
+    elem::Zeros(X, d, nc);
+    for(int i = 0; i < nc; i++)
+        std::copy(dense.begin() + static_cast<size_t>(i) * d,
+            dense.begin() + static_cast<size_t>(i + 1) * d, X.Buffer(0, i));
+}
+
+template<typename InputType>
+void example_chunks_t<InputType>::_convert(int d, int nc,
+    const std::vector<double>& dense, sparse_type& X) {
+
+    std::vector<int> colptr(1, 0), rows;
+    std::vector<double> vals;
+    for(int i = 0; i < nc; i++) {
+        for(int j = 0; j < d; j++)
+            if (dense[static_cast<size_t>(i) * d + j] != 0.0) {
+                rows.push_back(j);
+                vals.push_back(dense[static_cast<size_t>(i) * d + j]);
+            }
+        colptr.push_back(rows.size());
+    }
+    _convert(d, nc, colptr, rows, vals, X);
+}
+
+template<typename InputType>
+template<typename IndexType>
+void example_chunks_t<InputType>::_convert(int d, int nc,
+    const std::vector<IndexType>& colptr, const std::vector<IndexType>& rows,
+    const std::vector<double>& vals, elem::Matrix<double>& X) {
+
+    elem::Zeros(X, d, nc);
+    for(int i = 0; i < nc; i++)
+        for(IndexType idx = colptr[i]; idx < colptr[i + 1]; idx++)
+            X.Set(rows[idx], i, vals[idx]);
+}
+
+template<typename InputType>
+template<typename IndexType>
+void example_chunks_t<InputType>::_convert(int d, int nc,
+    const std::vector<IndexType>& colptr, const std::vector<IndexType>& rows,
+    const std::vector<double>& vals, sparse_type& X) {
+
+    typedef sparse_type::index_type index_type;
+
+    int nnz = vals.size();
+    index_type *indptr = new index_type[nc + 1];
+    index_type *indices = new index_type[nnz];
+    double *values = new double[nnz];
+    std::copy(colptr.begin(), colptr.end(), indptr);
+    std::copy(rows.begin(), rows.end(), indices);
+    std::copy(vals.begin(), vals.end(), values);
+
+    X.attach(indptr, indices, values, nnz, d, nc, true);
+}
+
+#endif /* SKYLARK_EXAMPLE_CHUNKS_HPP */
@@ -0,0 +1,570 @@
+#ifndef SKYLARK_CSR_GRAPH_HPP
+#define SKYLARK_CSR_GRAPH_HPP
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#if SKYLARK_HAVE_OPENMP
+#include <omp.h>
+#endif
+
+namespace skylark { namespace ml {
+
+/**
+ * Binary graph cache file: a header followed by the offsets
+ * (num_vertices + 1, offset_size bytes each), the adjacency lists
+ * (num_edges int32) and the original vertex labels (num_vertices int64),
+ * each section starting at a multiple of 64 bytes. Numbers are stored in
+ * the native byte order of the writer.
+ */
+struct csr_graph_header_t {
+    char magic[8];
+    boost::uint32_t version;
+    boost::uint32_t offset_size;
+    boost::uint64_t num_vertices, num_edges;
+    boost::uint64_t offsets_offset, adjacency_offset, labels_offset;
+    char pad[8];
+};
+
+namespace internal {
+
+static const char csr_graph_magic[8] = {'S', 'K', 'Y', 'L', 'A', 'R', 'K', 'G'};
+
+inline boost::uint64_t csr_graph_layout(csr_graph_header_t& h) {
+    h.offsets_offset = (sizeof(csr_graph_header_t) + 63) / 64 * 64;
+    h.adjacency_offset = (h.offsets_offset +
+        (h.num_vertices + 1) * h.offset_size + 63) / 64 * 64;
+    h.labels_offset = (h.adjacency_offset + h.num_edges * 4 + 63) / 64 * 64;
+    return h.labels_offset + h.num_vertices * 8;
+}
+
+inline void csr_graph_io_fail(const std::string& msg) {
+    SKYLARK_THROW_EXCEPTION (
+        base::io_exception()
+            << base::error_msg(msg + ": " + std::strerror(errno)) );
+}
+
+inline int csr_graph_threads() {
+#   if SKYLARK_HAVE_OPENMP
+    return omp_get_max_threads();
+#   else
+    return 1;
+#   endif
+}
+
+inline int csr_graph_thread() {
+#   if SKYLARK_HAVE_OPENMP
+    return omp_get_thread_num();
+#   else
+    return 0;
+#   endif
+}
+
+inline int csr_graph_team_size() {
+#   if SKYLARK_HAVE_OPENMP
+    return omp_get_num_threads();
+#   else
+    return 1;
+#   endif
+}
+
+/**
+ * Parses the edge list lines that start in [begin, end): two integer
+ * vertex labels separated by blanks or commas, anything after them
+ * (weights) ignored. Comment lines ('#' or '%'), lines without two labels
+ * and self loops are skipped.
+ */
+inline void parse_edge_lines(const char *begin, const char *end,
+    const char *eof, std::vector<boost::int64_t>& labels) {
+
+    const char *p = begin;
+    while (p < end) {
+        boost::int64_t ij[2];
+        int found = 0;
+        while (p < eof && *p != '\n' && found < 2) {
+            char c = *p;
+            if (c == ' ' || c == '\t' || c == ',' || c == '\r') {
+                p++;
+                continue;
+            }
+            if (c == '#' || c == '%')
+                break;
+
+            bool neg = c == '-';
+            if (neg)
+                p++;
+            if (p == eof || *p < '0' || *p > '9')
+                break;
+            boost::int64_t v = 0;
+            while (p < eof && *p >= '0' && *p <= '9')
+                v = 10 * v + (*p++ - '0');
+            ij[found++] = neg ? -v : v;
+        }
+
+        if (found == 2 && ij[0] != ij[1]) {
+            labels.push_back(ij[0]);
+            labels.push_back(ij[1]);
+        }
+
+        p = static_cast<const char *>(std::memchr(p, '\n', eof - p));
+        p = p == NULL ? eof : p + 1;
+    }
+}
+
+} // namespace internal
+
+/**
+ * Unweighted graph in compressed sparse row form, with vertices relabeled
+ * to dense ids 0 .. num_vertices() - 1 (in increasing order of their
+ * original labels). Provides the degree / adjanct interface of the local
+ * graph algorithms (see FindLocalCluster), and label() / vertex() to go
+ * from dense ids to the labels of the input and back.
+ *
+ * The graph is read either from an edge list, parsed by all threads, or
+ * from a binary cache written by save(), which is mapped into memory and
+ * used in place: reloading costs one sequential pass over the offsets and
+ * adjacency lists, to validate them, instead of parsing and building.
+ *
+ * OffsetType is the type of the offsets into the adjacency lists; 32 bits
+ * hold up to 2^31 adjacency entries, use a 64-bit type beyond.
+ */
+template<typename OffsetType = base::sparse_index_t>
+struct csr_graph_t {
+
+    typedef OffsetType index_type;
+
+    /**
+     * Reads the graph in fname, either a binary cache (recognized by its
+     * header) or an edge list. Each line of an edge list adds the edge in
+     * both directions if symmetrize is true, only as given otherwise.
+     */
+    csr_graph_t(const std::string& fname, bool symmetrize = true)
+        : _addr(NULL), _size(0) {
+
+        if (_is_cache(fname))
+            _load(fname);
+        else
+            _read_edge_list(fname, symmetrize);
+    }
+
+    ~csr_graph_t() {
+        if (_addr != NULL)
+            munmap(_addr, _size);
+    }
+
+    int num_vertices() const { return _num_vertices; }
+    index_type num_edges() const { return _num_edges; }
+    int degree(int vertex) const {
+        return _offsets[vertex + 1] - _offsets[vertex];
+    }
+    const int *adjanct(int vertex) const {
+        return _adjacency + _offsets[vertex];
+    }
+
+    /** Label of the vertex in the input. */
+    boost::int64_t label(int vertex) const { return _labels[vertex]; }
+
+    /** Vertex with the given input label, or -1 if there is none. */
+    int vertex(boost::int64_t label) const {
+        const boost::int64_t *it =
+            std::lower_bound(_labels, _labels + _num_vertices, label);
+        return it != _labels + _num_vertices && *it == label ?
+            it - _labels : -1;
+    }
+
+    /** Writes the graph to a binary cache file. */
+    void save(const std::string& fname) const {
+        csr_graph_header_t h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, internal::csr_graph_magic, sizeof(h.magic));
+        h.version = 1;
+        h.offset_size = sizeof(index_type);
+        h.num_vertices = _num_vertices;
+        h.num_edges = _num_edges;
+        boost::uint64_t size = internal::csr_graph_layout(h);
+
+        int fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1 || ftruncate(fd, size) != 0) {
+            if (fd != -1)
+                close(fd);
+            internal::csr_graph_io_fail("cannot create " + fname);
+        }
+
+        bool ok = _write(fd, &h, sizeof(h), 0) &&
+            _write(fd, _offsets, (h.num_vertices + 1) * h.offset_size,
+                h.offsets_offset) &&
+            _write(fd, _adjacency, h.num_edges * 4, h.adjacency_offset) &&
+            _write(fd, _labels, h.num_vertices * 8, h.labels_offset);
+        close(fd);
+        if (!ok)
+            internal::csr_graph_io_fail("cannot write " + fname);
+    }
+
+private:
+    int _num_vertices;
+    index_type _num_edges;
+    const index_type *_offsets;
+    const int *_adjacency;
+    const boost::int64_t *_labels;
+
+    // Storage when built from an edge list, or the mapping of a cache.
+    std::vector<index_type> _offsets_store;
+    std::vector<int> _adjacency_store;
+    std::vector<boost::int64_t> _labels_store;
+    void *_addr;
+    size_t _size;
+
+    csr_graph_t(const csr_graph_t&);
+    csr_graph_t& operator=(const csr_graph_t&);
+
+    static bool _write(int fd, const void *buf, size_t bytes,
+        boost::uint64_t offset) {
+        const char *p = static_cast<const char *>(buf);
+        while (bytes > 0) {
+            ssize_t w = pwrite(fd, p, bytes, offset);
+            if (w <= 0)
+                return false;
+            p += w;
+            bytes -= w;
+            offset += w;
+        }
+        return true;
+    }
+
+    static bool _is_cache(const std::string& fname) {
+        char magic[8];
+        int fd = open(fname.c_str(), O_RDONLY);
+        if (fd == -1)
+            internal::csr_graph_io_fail("cannot open " + fname);
+        bool cache = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+            std::memcmp(magic, internal::csr_graph_magic, sizeof(magic)) == 0;
+        close(fd);
+        return cache;
+    }
+
+    /** Maps the file read-only. Returns NULL for an empty file. */
+    static void *_map(const std::string& fname, size_t& size) {
+        int fd = open(fname.c_str(), O_RDONLY);
+        if (fd == -1)
+            internal::csr_graph_io_fail("cannot open " + fname);
+
+        // close() may clobber errno, which the error message reports.
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            internal::csr_graph_io_fail("cannot stat " + fname);
+        }
+        size = st.st_size;
+        void *addr = size == 0 ? NULL :
+            mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        int err = errno;
+        close(fd);
+        if (addr == MAP_FAILED) {
+            errno = err;
+            internal::csr_graph_io_fail("cannot map " + fname);
+        }
+        return addr;
+    }
+
+    /**
+     * Checks the arrays of a mapped cache: the offsets start at 0, do not
+     * decrease and end at num_edges, the adjacency lists hold vertex ids
+     * and the labels increase (vertex() searches them).
+     */
+    bool _valid() const {
+        int n = _num_vertices;
+        index_type m = _num_edges;
+        if (_offsets[0] != 0 || _offsets[n] != m)
+            return false;
+
+        int bad = 0;
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for reduction(+:bad)
+#       endif
+        for(int v = 0; v < n; v++)
+            if (_offsets[v] > _offsets[v + 1] ||
+                (v > 0 && _labels[v - 1] >= _labels[v]))
+                bad++;
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for reduction(+:bad)
+#       endif
+        for(index_type e = 0; e < m; e++)
+            if (_adjacency[e] < 0 || _adjacency[e] >= n)
+                bad++;
+
+        return bad == 0;
+    }
+
+    void _load(const std::string& fname) {
+        _addr = _map(fname, _size);
+
+        csr_graph_header_t h;
+        std::memset(&h, 0, sizeof(h));
+        if (_size >= sizeof(h))
+            std::memcpy(&h, _addr, sizeof(h));
+        boost::uint64_t num_edges = h.num_edges;
+        if (_size < sizeof(h) || h.version != 1 ||
+            h.offset_size != sizeof(index_type) ||
+            h.num_vertices > INT_MAX ||
+            static_cast<boost::uint64_t>(
+                static_cast<index_type>(num_edges)) != num_edges ||
+            internal::csr_graph_layout(h) > _size) {
+            munmap(_addr, _size);
+            _addr = NULL;
+            SKYLARK_THROW_EXCEPTION (
+                base::io_exception()
+                    << base::error_msg(fname +
+                        " is not a graph cache with offsets of this size") );
+        }
+
+        const char *base = static_cast<const char *>(_addr);
+        _num_vertices = h.num_vertices;
+        _num_edges = h.num_edges;
+        _offsets =
+            reinterpret_cast<const index_type *>(base + h.offsets_offset);
+        _adjacency = reinterpret_cast<const int *>(base + h.adjacency_offset);
+        _labels =
+            reinterpret_cast<const boost::int64_t *>(base + h.labels_offset);
+
+        if (!_valid()) {
+            munmap(_addr, _size);
+            _addr = NULL;
+            SKYLARK_THROW_EXCEPTION (
+                base::io_exception()
+                    << base::error_msg(fname + " is a corrupt graph cache") );
+        }
+    }
+
+    void _read_edge_list(const std::string& fname, bool symmetrize) {
+        size_t size;
+        void *addr = _map(fname, size);
+        const char *text = static_cast<const char *>(addr);
+
+        // The file is split in nt shares, and the lines that start in a
+        // share are parsed into (source, target) label pairs. The team may
+        // have fewer threads than asked for (e.g. when nested), so each
+        // thread loops over the shares.
+        int nt = internal::csr_graph_threads();
+        std::vector<std::vector<boost::int64_t> > edges(nt);
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel num_threads(nt)
+#       endif
+        {
+            int nteam = internal::csr_graph_team_size();
+            for(int s = internal::csr_graph_thread(); s < nt; s += nteam) {
+                const char *begin = text + size / nt * s;
+                const char *end = s == nt - 1 ?
+                    text + size : text + size / nt * (s + 1);
+                if (s > 0 && begin[-1] != '\n') {
+                    const char *nl = static_cast<const char *>(
+                        std::memchr(begin, '\n', text + size - begin));
+                    begin = nl == NULL ? text + size : nl + 1;
+                }
+                if (begin < end)
+                    internal::parse_edge_lines(begin, end, text + size,
+                        edges[s]);
+            }
+        }
+
+        if (addr != NULL)
+            munmap(addr, size);
+
+        boost::int64_t lmin = 0, lmax = -1;
+        size_t nlabels = 0;
+        for(int t = 0; t < nt; t++) {
+            for(size_t e = 0; e < edges[t].size(); e++) {
+                lmin = std::min(lmin, edges[t][e]);
+                lmax = std::max(lmax, edges[t][e]);
+            }
+            nlabels += edges[t].size();
+        }
+
+        // Dense ids, and the edges relabeled in place (ids fit an int).
+        std::vector<std::vector<int> > ids(nt);
+        if (lmin >= 0 && lmax < INT_MAX &&
+            static_cast<size_t>(lmax) < 4 * nlabels + 1024)
+            _relabel_by_table(edges, lmax, ids);
+        else
+            _relabel_by_sorting(edges, ids);
+
+        if (_labels_store.size() > static_cast<size_t>(INT_MAX))
+            SKYLARK_THROW_EXCEPTION (
+                base::io_exception()
+                    << base::error_msg("too many vertices in " + fname) );
+        _num_vertices = _labels_store.size();
+
+        _build(ids, symmetrize);
+
+        _offsets = &_offsets_store[0];
+        _adjacency = _adjacency_store.empty() ? NULL : &_adjacency_store[0];
+        _labels = _labels_store.empty() ? NULL : &_labels_store[0];
+    }
+
+    /** Labels are small non-negative integers: a direct lookup table. */
+    void _relabel_by_table(std::vector<std::vector<boost::int64_t> >& edges,
+        boost::int64_t lmax, std::vector<std::vector<int> >& ids) {
+
+        int nt = edges.size();
+        std::vector<int> table(lmax + 1, 0);
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for num_threads(nt) schedule(static, 1)
+#       endif
+        for(int t = 0; t < nt; t++)
+            for(size_t e = 0; e < edges[t].size(); e++) {
+#               if SKYLARK_HAVE_OPENMP
+#               pragma omp atomic write
+#               endif
+                table[edges[t][e]] = 1;
+            }
+
+        for(boost::int64_t l = 0; l <= lmax; l++)
+            if (table[l]) {
+                table[l] = _labels_store.size();
+                _labels_store.push_back(l);
+            }
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for num_threads(nt) schedule(static, 1)
+#       endif
+        for(int t = 0; t < nt; t++) {
+            ids[t].resize(edges[t].size());
+            for(size_t e = 0; e < edges[t].size(); e++)
+                ids[t][e] = table[edges[t][e]];
+            std::vector<boost::int64_t>().swap(edges[t]);
+        }
+    }
+
+    /** Arbitrary labels: sorted by every thread, then merged. */
+    void _relabel_by_sorting(std::vector<std::vector<boost::int64_t> >& edges,
+        std::vector<std::vector<int> >& ids) {
+
+        int nt = edges.size();
+        std::vector<std::vector<boost::int64_t> > sorted(nt);
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for num_threads(nt) schedule(static, 1)
+#       endif
+        for(int t = 0; t < nt; t++) {
+            sorted[t] = edges[t];
+            std::sort(sorted[t].begin(), sorted[t].end());
+            sorted[t].erase(std::unique(sorted[t].begin(), sorted[t].end()),
+                sorted[t].end());
+        }
+
+        for(int t = 0; t < nt; t++) {
+            std::vector<boost::int64_t> merged;
+            merged.reserve(_labels_store.size() + sorted[t].size());
+            std::merge(_labels_store.begin(), _labels_store.end(),
+                sorted[t].begin(), sorted[t].end(),
+                std::back_inserter(merged));
+            merged.erase(std::unique(merged.begin(), merged.end()),
+                merged.end());
+            _labels_store.swap(merged);
+            std::vector<boost::int64_t>().swap(sorted[t]);
+        }
+
+        const boost::int64_t *lb = _labels_store.empty() ? NULL :
+            &_labels_store[0];
+        const boost::int64_t *le = lb + _labels_store.size();
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for num_threads(nt) schedule(static, 1)
+#       endif
+        for(int t = 0; t < nt; t++) {
+            ids[t].resize(edges[t].size());
+            for(size_t e = 0; e < edges[t].size(); e++)
+                ids[t][e] = std::lower_bound(lb, le, edges[t][e]) - lb;
+            std::vector<boost::int64_t>().swap(edges[t]);
+        }
+    }
+
+    /** Offsets from the degrees, then the adjacency lists, sorted. */
+    void _build(std::vector<std::vector<int> >& ids, bool symmetrize) {
+
+        int nt = ids.size();
+        int n = _num_vertices;
+
+        _offsets_store.assign(n + 1, 0);
+        index_type *counts = &_offsets_store[1];
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for num_threads(nt) schedule(static, 1)
+#       endif
+        for(int t = 0; t < nt; t++)
+            for(size_t e = 0; e < ids[t].size(); e += 2) {
+#               if SKYLARK_HAVE_OPENMP
+#               pragma omp atomic
+#               endif
+                counts[ids[t][e]]++;
+                if (symmetrize) {
+#                   if SKYLARK_HAVE_OPENMP
+#                   pragma omp atomic
+#                   endif
+                    counts[ids[t][e + 1]]++;
+                }
+            }
+
+        for(int v = 0; v < n; v++)
+            _offsets_store[v + 1] += _offsets_store[v];
+        _num_edges = _offsets_store[n];
+        _adjacency_store.resize(_num_edges);
+
+        // Threads claim slots in the lists as they go; the order within a
+        // list is then fixed by sorting it.
+        std::vector<index_type> pos(_offsets_store.begin(),
+            _offsets_store.end() - 1);
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for num_threads(nt) schedule(static, 1)
+#       endif
+        for(int t = 0; t < nt; t++) {
+            for(size_t e = 0; e < ids[t].size(); e += 2) {
+                int i = ids[t][e], j = ids[t][e + 1];
+                index_type p;
+#               if SKYLARK_HAVE_OPENMP
+#               pragma omp atomic capture
+#               endif
+                p = pos[i]++;
+                _adjacency_store[p] = j;
+                if (symmetrize) {
+#                   if SKYLARK_HAVE_OPENMP
+#                   pragma omp atomic capture
+#                   endif
+                    p = pos[j]++;
+                    _adjacency_store[p] = i;
+                }
+            }
+            std::vector<int>().swap(ids[t]);
+        }
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for num_threads(nt) schedule(dynamic, 1024)
+#       endif
+        for(int v = 0; v < n; v++)
+            std::sort(_adjacency_store.begin() + _offsets_store[v],
+                _adjacency_store.begin() + _offsets_store[v + 1]);
+    }
+};
+
+} } // namespace skylark::ml
+
+#endif // SKYLARK_CSR_GRAPH_HPP
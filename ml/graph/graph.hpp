@@ -1,6 +1,9 @@
 #ifndef SKYLARK_GRAPH_HPP
 #define SKYLARK_GRAPH_HPP
 
+/* Graph types. */
+#include "csr_graph.hpp"
+
 /* Algorithms that operate on graphs locally. */
 #include "local_computations.hpp"
 
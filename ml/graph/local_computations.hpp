@@ -14,7 +14,8 @@ void LocalGraphDiffusion(const GraphType& G,
 
     // TODO verify one column in s.
 
-    const int *seeds = s.indices();
+    const typename base::sparse_matrix_t<T>::index_type *seeds =
+        s.indices();
     const double *svalues = s.locked_values();
     int nseeds = s.nonzeros();
 
@@ -62,7 +63,7 @@ void LocalGraphDiffusion(const GraphType& G,
         elem::Scal(-alpha, *r);
 
         int deg = G.degree(node);
-        const int *adjnodes = G.adjanct(node);
+        auto adjnodes = G.adjanct(node);
         for (int l = 0; l < deg; l++) {
             int onode = adjnodes[l];
             int odeg = G.degree(onode);
@@ -81,7 +82,7 @@ void LocalGraphDiffusion(const GraphType& G,
         int seed = seeds[i];
 
         int sdeg = G.degree(seed);
-        const int *sadjnodes = G.adjanct(seed);
+        auto sadjnodes = G.adjanct(seed);
         for(int j = 0; j < sdeg; j++) {
             int node = sadjnodes[j];
             if (res.count(node))
@@ -96,7 +97,7 @@ void LocalGraphDiffusion(const GraphType& G,
                     r->Set(j, 0, 0.0);
 
             int deg = G.degree(node);
-            const int *adjnodes = G.adjanct(node);
+            auto adjnodes = G.adjanct(node);
             for (int l = 0; l < deg; l++) {
                 int onode = adjnodes[l];
                 int odeg = G.degree(onode);
@@ -136,7 +137,7 @@ void LocalGraphDiffusion(const GraphType& G,
 
         // Update residuals
         int deg = G.degree(node);
-        const int *adjnodes = G.adjanct(node);
+        auto adjnodes = G.adjanct(node);
         for (int l = 0; l < deg; l++) {
             int onode = adjnodes[l];
             if (res.count(onode) == 0) {
@@ -201,7 +202,8 @@ double FindLocalCluster(const GraphType& G,
         // y values (normalized by degree).
         std::vector<std::pair<double, int> > vals(y.nonzeros());
         const double *yvalues = y.locked_values();
-        const int *yindices = y.indices();
+        const typename base::sparse_matrix_t<T>::index_type *yindices =
+            y.indices();
         for(int i = 0; i < y.nonzeros(); i++) {
             int idx = yindices[i];
             double val = - yvalues[i] / G.degree(idx);
@@ -210,15 +212,15 @@ double FindLocalCluster(const GraphType& G,
         std::sort(vals.begin(), vals.end());
 
         // Find the best prefix
-        int volS = 0, cutS = 0;
+        long long volS = 0, cutS = 0;
         double bestcond = 1.0;
         int bestprefix = 0;
-        int Gvol = G.num_edges();
+        long long Gvol = G.num_edges();
         std::unordered_set<int> currentset;
         for (int i = 0; i < vals.size(); i++) {
             int node = vals[i].second;
             int deg = G.degree(node);
-            const int *adjnodes = G.adjanct(node);
+            auto adjnodes = G.adjanct(node);
             volS += deg;
             for(int l = 0; l < deg; l++) {
                 int onode = adjnodes[l];
@@ -11,6 +11,7 @@
 #include "FunctionProx.hpp"
 #include "utils.hpp"
 #include "model.hpp"
+#include "predictor.hpp"
 #include "io.hpp"
 #include "BlockADMM.hpp"
 #include "options.hpp"
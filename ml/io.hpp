@@ -9,11 +9,17 @@
 #define IO_HPP_
 
 #include <boost/mpi.hpp>
+#include <boost/shared_ptr.hpp>
+#include <limits>
 #include <sstream>
 #include <cstdlib>
 #include <string>
+#include <vector>
 #include <elemental.hpp>
+#include "../base/exception.hpp"
 #include "../base/sparse_matrix.hpp"
+#include "../utility/io/libsvm_io.hpp"
+#include "../utility/io/binary_io.hpp"
 #include "options.hpp"
 
 namespace bmpi =  boost::mpi;
@@ -138,11 +144,20 @@ int write_hdf5(std::string fName, sparse_matrix_t& X,
 
         std::cout << "Writing to file " << fName << std::endl;
 
+        if (X.nonzeros() > std::numeric_limits<int>::max()) {
+            std::cerr << "Too many non-zeros for the HDF5 layout" << std::endl;
+            return -1;
+        }
+
         int* dimensions = new int[3];
         dimensions[0] = X.height();
         dimensions[1] = X.width();
         dimensions[2] = X.nonzeros();
 
+        // The layout stores indices as int, whatever sparse_index_t is.
+        std::vector<int> indptr(X.indptr(), X.indptr() + X.width() + 1);
+        std::vector<int> indices(X.indices(), X.indices() + X.nonzeros());
+
         H5::Exception::dontPrint();
 
         H5::H5File file( fName, H5F_ACC_TRUNC );
@@ -165,7 +180,7 @@ int write_hdf5(std::string fName, sparse_matrix_t& X,
         	H5::DataSpace dataspace( 1, dim );
         	H5::FloatType datatype( H5::PredType::NATIVE_INT );
         	H5::DataSet dataset = file.createDataSet( "indptr", datatype, dataspace );
-        	dataset.write(X.indptr(), H5::PredType::NATIVE_INT);
+        	dataset.write(&indptr[0], H5::PredType::NATIVE_INT);
         }
 
         // write row_ind
@@ -176,7 +191,8 @@ int write_hdf5(std::string fName, sparse_matrix_t& X,
         	H5::DataSpace dataspace( 1, dim );
         	H5::FloatType datatype( H5::PredType::NATIVE_INT );
         	H5::DataSet dataset = file.createDataSet( "indices", datatype, dataspace );
-        	dataset.write(X.indices(), H5::PredType::NATIVE_INT);
+        	dataset.write(indices.empty() ? NULL : &indices[0],
+        	    H5::PredType::NATIVE_INT);
         }
         // write row_ind
         {
@@ -535,349 +551,124 @@ void read_hdf5(const boost::mpi::communicator &comm, std::string fName,
 }
 #endif
 
+/**
+ * Reads a libsvm file into the local part of a [STAR, VC] X (d x n) and
+ * a [VC, STAR] Y (n x 1): example j goes to VC rank j % P. All ranks
+ * parse a share of the file in parallel.
+ */
 template<typename T>
 void read_libsvm(const boost::mpi::communicator &comm, std::string fName,
 		elem::Matrix<T>& Xlocal, elem::Matrix<T>& Ylocal,
 		int min_d = 0, int blocksize = 10000) {
 
-    elem::Grid grid(comm);
-    elem::DistMatrix<T, elem::STAR, elem::VC> X(grid);
-    elem::DistMatrix<T, elem::VC, elem::STAR> Y(grid);
-
-        int rank = comm.rank();
-	if (rank==0)
-			std::cout << "Reading from file " << fName << std::endl;
-
-        std::ifstream file(fName.c_str());
-	std::string line;
-	std::string token, val, ind;
-	float label;
-	unsigned int start = 0;
-	unsigned int delim, t;
-	int n = 0;
-	int d = 0;
-	int i, j, last;
-	char c;
-
-	bmpi::timer timer;
-
-
-	// make one pass over the data to figure out dimensions - will pay in terms of preallocated storage.
-	if (rank==0) {
-	    while(!file.eof()) {
-	        getline(file, line);
-	        if(line.length()==0)
-	            break;
-	        delim = line.find_last_of(":");
-	        if(delim > line.length())
-	            continue;
-	        n++;
-	        t = delim;
-	        while(line[t]!=' ') {
-	            t--;
-	        }
-	        val = line.substr(t+1, delim - t);
-	        last = atoi(val.c_str());
-	        if (last>d)
-	            d = last;
-	    }
-	    if (min_d > 0)
-	        d = std::max(d, min_d);
-
-	    // prepare for second pass
-	    file.clear();
-	    file.seekg(0, std::ios::beg);
-	}
-
-	boost::mpi::broadcast(comm, n, 0);
-	boost::mpi::broadcast(comm, d, 0);
-
-	int numblocks = ((int) n/ (int) blocksize); // of size blocksize
-	int leftover = n % blocksize;
-	int block = blocksize;
-
-	X.Resize(d, n);
-	Y.Resize(n,1);
-
-	elem::Zeros(Xlocal, X.LocalHeight(), X.LocalWidth());
-	elem::Zeros(Ylocal, Y.LocalHeight(), 1);
-
-	X.Attach(d,n,0,0,Xlocal,elem::DefaultGrid());
-	Y.Attach(n,1,0,0,Ylocal,elem::DefaultGrid());
-
-
-	for(int i=0; i<numblocks+1; i++) {
-
-	            if (i==numblocks)
-	                block = leftover;
-	            if (block==0)
-	                break;
+    namespace io = skylark::utility::io;
 
-	            DistCircMatrixType x(d, block), y(block, 1);
-	            x.SetRoot(0);
-	            y.SetRoot(0);
-	            elem::MakeZeros(x);
-
-                if(rank==0) {
-
-                    std::cout << "Reading and distributing chunk " << i*blocksize << " to " << i*blocksize + block - 1 << " ("<< block << " elements )" << std::endl;
-                    T *Xdata = x.Matrix().Buffer();
-                    T *Ydata = y.Matrix().Buffer();
-
-                    t = 0;
-                    while(!file.eof() && t<block) {
-                        getline(file, line);
-                        if( line.length()==0) {
-                            break;
-                        }
-
-                        std::istringstream tokenstream (line);
-                        tokenstream >> label;
-                        Ydata[t] = label;
-
-                        while (tokenstream >> token)
-                         {
-                            delim  = token.find(':');
-                            ind = token.substr(0, delim);
-                            val = token.substr(delim+1); //.substr(delim+1);
-                            j = atoi(ind.c_str()) - 1;
-                            Xdata[t * d + j] = atof(val.c_str());
-                         }
-
-                        t++;
-                    }
-                 }
-
-                // The calls below should distribute the data to all the nodes.
-               // if (rank==0)
-                //    std::cout << "Distributing Data.." << std::endl;
-
-                elem::DistMatrix<T, elem::STAR, elem::VC> viewX;
-                elem::DistMatrix<T, elem::VC, elem::STAR> viewY;
-
-                elem::View(viewX, X, 0, i*blocksize, x.Height(), x.Width());
-                elem::View(viewY, Y, i*blocksize, 0, x.Width(), 1);
+    int rank = comm.rank();
+    if (rank==0)
+        std::cout << "Reading from file " << fName << std::endl;
 
-                viewX = x;
-                viewY = y;
+    bmpi::timer timer;
 
-//	X = x;
-//	Y = y;
-	}
+    elem::Grid grid(comm);
+    std::vector<int> vcrank;
+    boost::mpi::all_gather(comm, grid.VCRank(), vcrank);
+    std::vector<int> map(comm.size());
+    for(int r = 0; r < comm.size(); r++)
+        map[vcrank[r]] = r;
+
+    io::internal::libsvm_data_t<T> data;
+    io::internal::read_libsvm_parallel(comm, fName, min_d,
+        io::internal::libsvm_cyclic_owner_t(map), data);
+
+    Xlocal.Resize(data.d, data.width());
+    Ylocal.Resize(data.width(), 1);
+    io::internal::copy_to_dense(data, Xlocal.Buffer(), Xlocal.LDim());
+    for(int k = 0; k < data.width(); k++)
+        Ylocal.Set(k, 0, data.labels[k]);
 
-	double readtime = timer.elapsed();
-	if (rank==0) {
-		std::cout << "Read Matrix with dimensions: " << n << " by " << d << " (" << readtime << "secs)" << std::endl;
-		// elem::Print(X,"X",std::cout);
-	}
+    double readtime = timer.elapsed();
+    if (rank==0)
+        std::cout << "Read Matrix with dimensions: " << data.n << " by " << data.d << " (" << readtime << "secs)" << std::endl;
 }
 
+/**
+ * Reads a libsvm file into local sparse matrices: each rank gets a
+ * contiguous block of examples as the columns of X (the first n % P ranks
+ * get one more), and their labels in Y (local number of examples x 1).
+ * All ranks parse a share of the file in parallel.
+ */
 template<typename T>
 void read_libsvm(const boost::mpi::communicator &comm, std::string fName,
     skylark::base::sparse_matrix_t<T>& X, elem::Matrix<T>& Y, int min_d = 0) {
 
-    int rank = comm.rank();
-    int size = comm.size();
+    namespace io = skylark::utility::io;
 
+    int rank = comm.rank();
     if (rank==0)
-            std::cout << "Reading sparse matrix from file " << fName << std::endl;
-
-    std::ifstream file(fName.c_str());
-    std::string line;
-    std::string token, val, ind;
-    float label;
-    unsigned int start = 0;
-    unsigned int delim, t;
-    int n = 0;
-    int d = 0;
-    int i, j, last;
-    char c;
-    int nnz=0;
-    int nz;
+        std::cout << "Reading sparse matrix from file " << fName << std::endl;
 
     bmpi::timer timer;
 
-    // make one pass over the data to figure out dimensions - will pay in terms of preallocated storage.
-        if (rank==0) {
-            while(!file.eof()) {
-                getline(file, line);
-                if(line.length()==0)
-                    break;
-                delim = line.find_last_of(":");
-                if(delim > line.length())
-                    continue;
-                n++;
-                t = delim;
-                while(line[t]!=' ') {
-                    t--;
-                }
-                val = line.substr(t+1, delim - t);
-                last = atoi(val.c_str());
-                if (last>d)
-                    d = last;
-            }
-            if (min_d > 0)
-                d = std::max(d, min_d);
-
-            // prepare for second pass
-            file.clear();
-            file.seekg(0, std::ios::beg);
-        }
-
-
-   boost::mpi::broadcast(comm, n, 0);
-   boost::mpi::broadcast(comm, d, 0);
-
-    // Number of examples per process
-    int* examples_allocation = new int[size];
-    int chunksize = (int) n / size;
-    int leftover = n % size;
-    for(int i=0;i<size;i++)
-        examples_allocation[i] = chunksize;
-    for(int i=0;i<leftover;i++)
-        examples_allocation[i]++;
-
-    comm.barrier();
-
-    // read chunks on rank = 0 and send
-    if(rank==0) {
-
-        std::vector<int> col_ptr;
-        std::vector<int> rowind;
-        std::vector<double> values;
-        std::vector<double> y;
-
-        int process = 0;
-        int nnz_local = 0;
-        int examples_local = 0;
-
-        while(!file.eof()) {
-            getline(file, line);
-            examples_local++;
-            if( line.length()==0) {
-                break;
-            }
-
-            std::istringstream tokenstream (line);
-            tokenstream >> label;
-            y.push_back(label);
-            col_ptr.push_back(nnz_local);
-
-            while (tokenstream >> token)
-            {
-                delim  = token.find(':');
-                ind = token.substr(0, delim);
-                val = token.substr(delim+1); //.substr(delim+1);
-                j = atoi(ind.c_str()) - 1;
-                rowind.push_back(j);
-                values.push_back(atof(val.c_str()));
-                nnz_local++;
-
-            }
-
-            if (examples_local == examples_allocation[process]) {
-                if (process>0) { //send data from rank 0
-                    std::cout << "Sending to " << process << std::endl;
-                    col_ptr.push_back(nnz_local);
-                    comm.send(process, 1, examples_local);
-                    comm.send(process, 2, d);
-                    comm.send(process, 3, nnz_local);
-                    comm.send(process, 4, &col_ptr[0], col_ptr.size());
-                    comm.send(process, 5, &rowind[0], rowind.size());
-                    comm.send(process, 6, &values[0], values.size());
-                    comm.send(process, 7, &y[0], y.size());
-                }
-                else { // rank == 0 - just create the sparse matrix
-
-                    col_ptr.push_back(nnz_local); //last entry of col_ptr should be total number of nonzeros
-
-                    // this is making a copy
-                    double *_values = new double[values.size()];
-                    int *_rowind = new int[rowind.size()];
-                    int *_col_ptr = new int[col_ptr.size()];
-
+    io::internal::libsvm_data_t<T> data;
+    io::internal::read_libsvm_parallel(comm, fName, min_d,
+        io::internal::libsvm_block_owner_t(comm.size()), data);
 
-                    // DO THE ACTUAL COPY!
-                    std::copy(values.begin(), values.end(), _values);
-                    std::copy(rowind.begin(), rowind.end(), _rowind);
-                    std::copy(col_ptr.begin(), col_ptr.end(), _col_ptr);
+    Y.Resize(data.width(), 1);
+    for(int k = 0; k < data.width(); k++)
+        Y.Set(k, 0, data.labels[k]);
+    int n = data.n, d = data.d;
+    io::internal::move_to_sparse(data, X);
 
-                    X.attach(_col_ptr, _rowind, _values, nnz_local, d, examples_local, true);
-
-                    elem::Matrix<T> Y2(examples_local, 1, &y[0], 0);
+    double readtime = timer.elapsed();
+    if (rank==0)
+        std::cout << "Read Matrix with dimensions: " << n << " by " << d << " (" << readtime << "secs)" << std::endl;
+}
 
-                    //  Y.Resize(examples_local,1);
-                    // but this is not!
-                    //Y.Attach(examples_local,1,&y[0],0);
-                    Y = Y2; // copy
 
+/**
+ * Storage that matrices returned by read() may refer to without owning it
+ * (the mapping of a binary file). The caller keeps it for as long as it
+ * uses the matrices; it is empty for the formats that are copied in.
+ */
+typedef boost::shared_ptr<void> input_storage_t;
 
-                    std::cout << "rank=0: Read " << examples_local << " x " << d << " with " << nnz_local << " nonzeros" << std::endl;
-                }
-                process++;
-                nnz_local = 0;
-                examples_local = 0;
-                col_ptr.clear();
-                rowind.clear();
-                values.clear();
-                y.clear();
-            }
-        }
+/**
+ * Maps a binary matrix file (see utility/io/binary_io.hpp) and attaches
+ * this rank's block of examples to X and Y without copying. Returns the
+ * mapping, which must be kept for as long as X and Y are used.
+ */
+template <class InputType>
+boost::shared_ptr< skylark::utility::io::binary_matrix_file_t<double> >
+read_binary(const boost::mpi::communicator &comm, std::string fName,
+    InputType& X, elem::Matrix<double>& Y, int min_d = 0) {
 
+    typedef skylark::utility::io::binary_matrix_file_t<double> file_type;
 
-    } else {
+    int rank = comm.rank();
+    if (rank==0)
+        std::cout << "Mapping binary file " << fName << std::endl;
 
-        for(int r=1; r<size; r++) {
-            if ((rank==r) && examples_allocation[r]>0) {
-                int nnz_local, t, d;
-                comm.recv(0, 1, t);
-                comm.recv(0, 2, d);
-                comm.recv(0, 3, nnz_local);
-
-                double* values = new double[nnz_local];
-                int* rowind = new int[nnz_local];
-                int* col_ptr = new int[t+1];
-
-                comm.recv(0, 4, col_ptr, t+1);
-                comm.recv(0, 5, rowind, nnz_local);
-                comm.recv(0, 6, values, nnz_local);
-
-                //attach currently creates copies so we can delete the rest
-                X.attach(col_ptr, rowind, values, nnz_local, d, t, true);
-               // delete[] col_ptr;
-               // delete[] rowind;
-               // delete[] values;
-
-                // TODO why not resize Y, and then just recive into buffer?
-                double* y = new double[t];
-                comm.recv(0, 7, y, t);
-                elem::Matrix<T> Y2(t, 1, y, 0);
-                Y = Y2; // copy
-                delete[] y;
-
-                //Y.Resize(t,1);
-                //Y.Attach(t,1,y,0);
-
-                std::cout << "rank=" << r << ": Received and read " << t << " x " << d << " with " << nnz_local << " nonzeros" << std::endl;
-            }
-        }
-    }
-    //}
+    bmpi::timer timer;
 
-    delete[] examples_allocation;
+    boost::shared_ptr<file_type> file(new file_type(fName));
+    skylark::utility::io::ReadBinary(comm, *file, X, Y, min_d);
 
     double readtime = timer.elapsed();
     if (rank==0)
-        std::cout << "Read Matrix with dimensions: " << n << " by " << d << " (" << readtime << "secs)" << std::endl;
+        std::cout << "Read Matrix with dimensions: " << file->width() << " by " << std::max(file->height(), min_d) << " (" << readtime << "secs)" << std::endl;
 
-    comm.barrier();
+    return file;
 }
 
-
+/**
+ * Reads X and Y in any of the supported formats. The returned storage must
+ * be kept for as long as X and Y are used (see input_storage_t).
+ */
 template <class InputType, class LabelType>
-void read(const boost::mpi::communicator &comm,
+input_storage_t read(const boost::mpi::communicator &comm,
     int fileformat, std::string filename, InputType& X, LabelType& Y, int d=0) {
 
+    input_storage_t storage;
     switch(fileformat) {
             case LIBSVM_DENSE: case LIBSVM_SPARSE:
             {
@@ -893,8 +684,14 @@ void read(const boost::mpi::communicator &comm,
                 #endif
                 break;
             }
+            case BINARY_DENSE: case BINARY_SPARSE:
+            {
+                storage = read_binary(comm, filename, X, Y, d);
+                break;
+            }
         }
 
+    return storage;
 }
 
 void read_model_file(std::string fName, elem::Matrix<double>& W) {
@@ -211,6 +211,13 @@ public:
     int get_num_outputs() const { return _coef.Width(); }
     int get_input_size() const { return _num_input_features; }
 
+    const coef_type& get_coef() const { return _coef; }
+    const std::vector<const feature_transform_type *>& get_maps() const {
+        return _maps;
+    }
+    bool get_scale_maps() const { return _scale_maps; }
+    int get_map_start(int j) const { return _starts[j]; }
+
 protected:
 
     void build_from_ptree(const boost::property_tree::ptree &pt) {
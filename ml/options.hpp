@@ -23,6 +23,7 @@ namespace po = boost::program_options;
 #define DEFAULT_RF 100
 #define DEFAULT_KERNEL 0
 #define DEFAULT_FILEFORMAT 0
+#define DEFAULT_CHUNKSIZE 0
 
 enum LossType {SQUARED = 0, LAD = 1, HINGE = 2, LOGISTIC = 3};
 std::string Losses[] = {"Squared Loss",
@@ -44,8 +45,10 @@ enum KernelType {LINEAR = 0, GAUSSIAN = 1, POLYNOMIAL = 2,
 std::string Kernels[] = {"Linear", "Gaussian",
                          "Polynomial", "Laplacian", "ExpSemigroup", "Matern"};
 
-enum FileFormatType {LIBSVM_DENSE = 0, LIBSVM_SPARSE = 1, HDF5_DENSE = 2, HDF5_SPARSE = 3};
-std::string FileFormats[] = {"libsvm-dense", "libsvm-sparse", "hdf5_dense", "hdf5_sparse"};
+enum FileFormatType {LIBSVM_DENSE = 0, LIBSVM_SPARSE = 1, HDF5_DENSE = 2, HDF5_SPARSE = 3,
+                     BINARY_DENSE = 4, BINARY_SPARSE = 5};
+std::string FileFormats[] = {"libsvm-dense", "libsvm-sparse", "hdf5_dense", "hdf5_sparse",
+                             "binary_dense", "binary_sparse"};
 
 /**
  * A structure that is used to pass options to the ADMM solver. This structure
@@ -84,6 +87,10 @@ struct hilbert_options_t {
 
     int fileformat;
 
+    /** Out-of-core training options */
+    int chunksize;
+    std::string scratchdir;
+
     /**  IO */
     std::string trainfile;
     std::string modelfile;
@@ -164,7 +171,16 @@ struct hilbert_options_t {
                  "Use this flag to force transform caching if you have enough memory (default: false)")
             ("fileformat",
                 po::value<int>(&fileformat)->default_value(DEFAULT_FILEFORMAT),
-                "Fileformat (default: 0 (libsvm->dense), 1 (libsvm->sparse), 2 (hdf5->dense), 3 (hdf5->sparse)")
+                "Fileformat (default: 0 (libsvm->dense), 1 (libsvm->sparse), 2 (hdf5->dense), 3 (hdf5->sparse), "
+                "4 (binary->dense), 5 (binary->sparse))")
+            ("chunksize",
+                po::value<int>(&chunksize)->default_value(DEFAULT_CHUNKSIZE),
+                "If positive, do not load the training data: stream it from the file "
+                "in chunks of this many examples (default: 0)")
+            ("scratchdir",
+                po::value<std::string>(&scratchdir)->default_value("."),
+                "Directory of the scratch file transforms are spilled to when streaming "
+                "with --cachetransforms (default: .)")
             ("MAXITER,i",
                 po::value<int>(&MAXITER)->default_value(DEFAULT_MAXITER),
                 "Maximum Number of Iterations (default: 100)")
@@ -228,6 +244,8 @@ struct hilbert_options_t {
         regularmap = true;
         seqtype = MONTECARLO;
         fileformat = DEFAULT_FILEFORMAT;
+        chunksize = DEFAULT_CHUNKSIZE;
+        scratchdir = ".";
         MAXITER = DEFAULT_MAXITER;
         valfile = "";
         testfile = "";
@@ -273,6 +291,10 @@ struct hilbert_options_t {
             if (flag == "--fileformat")
                 fileformat =
                     static_cast<FileFormatType>(boost::lexical_cast<int>(value));
+            if (flag == "--chunksize")
+                chunksize = boost::lexical_cast<int>(value);
+            if (flag == "--scratchdir")
+                scratchdir = value;
             if (flag == "--MAXITER" || flag == "-i")
                 MAXITER = boost::lexical_cast<int>(value);
             if (flag == "--trainfile")
@@ -327,6 +349,10 @@ struct hilbert_options_t {
         optionstring << "# Seed = " << seed << std::endl;
         optionstring << "# Random Features = " << randomfeatures << std::endl;
         optionstring << "# Caching Transforms = " << cachetransforms << std::endl;
+        if (chunksize > 0)
+            optionstring << "# Streaming in chunks of = " << chunksize
+                         << " (scratch directory: " << scratchdir << ")"
+                         << std::endl;
         optionstring << "# Slow/Fast feature mapping = " << regularmap  << std::endl;
         optionstring << "# Sequence = " << seqtype  
                      << " (" << Sequences[seqtype] << ")" << std::endl;
@@ -0,0 +1,473 @@
+#ifndef SKYLARK_ML_PREDICTOR_HPP
+#define SKYLARK_ML_PREDICTOR_HPP
+
+#include <elemental.hpp>
+#include <skylark.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "model.hpp"
+
+#ifdef SKYLARK_HAVE_OPENMP
+#include <omp.h>
+#endif
+
+namespace skylark { namespace ml {
+
+/** Result of an online prediction. */
+struct prediction_t {
+    double label;
+    std::vector<double> decision_values;
+};
+
+/** Counters of an online predictor, since construction or reset. */
+struct predictor_stats_t {
+    size_t requests;        /**< Examples predicted */
+    size_t batches;         /**< Batches evaluated */
+    double busy_time;       /**< Seconds spent evaluating batches */
+    double total_latency;   /**< Sum over requests of submit-to-result time */
+    double max_latency;     /**< Largest submit-to-result time */
+
+    predictor_stats_t() : requests(0), batches(0), busy_time(0),
+                          total_latency(0), max_latency(0) {}
+
+    double mean_latency() const {
+        return requests == 0 ? 0.0 : total_latency / requests;
+    }
+
+    double mean_batch_size() const {
+        return batches == 0 ? 0.0 : double(requests) / batches;
+    }
+
+    /** Examples per second of evaluation time. */
+    double throughput() const {
+        return busy_time == 0 ? 0.0 : requests / busy_time;
+    }
+};
+
+/**
+ * Online prediction engine for a model_t, for serving single examples with
+ * low latency.
+ *
+ * Examples are submitted one at a time and queued. A worker thread
+ * evaluates them in micro-batches: a batch is started as soon as
+ * max_batch examples are waiting, or when the oldest one has waited
+ * max_delay seconds. All workspaces (the batch, the transformed features
+ * and per-thread decision values) are allocated once, for max_batch
+ * examples. The feature maps are split across num_threads threads. For
+ * each of its maps a thread applies the map to the whole batch, into its
+ * own workspace, and then adds the contribution of the map with one Gemm
+ * (whose alpha is the map scaling) into its own decision values. These are
+ * summed at the end (no critical section).
+ *
+ * If evaluating a batch throws, the exception is delivered through the
+ * futures of all the examples of the batch.
+ *
+ * The model must outlive the predictor.
+ */
+template <typename InputType, typename OutputType>
+struct online_predictor_t {
+
+    typedef InputType input_type;
+    typedef OutputType output_type;
+    typedef model_t<input_type, output_type> model_type;
+    typedef typename model_type::intermediate_type intermediate_type;
+    typedef typename model_type::coef_type coef_type;
+
+    typedef std::chrono::steady_clock clock_type;
+
+    /**
+     * @param model model to predict with.
+     * @param max_batch largest number of examples evaluated together.
+     * @param max_delay longest time (seconds) an example waits for others
+     *        to join its batch.
+     * @param num_threads number of threads evaluating a batch.
+     */
+    online_predictor_t(const model_type& model, int max_batch = 64,
+        double max_delay = 1e-3, int num_threads = 1) :
+        _model(model), _max_batch(std::max(max_batch, 1)),
+        _max_delay(max_delay), _num_threads(std::max(num_threads, 1)),
+        _d(model.get_input_size()), _k(model.get_num_outputs()),
+        _stop(false) {
+
+        const std::vector<const feature_transform_type *>& maps =
+            model.get_maps();
+        int smax = 0;
+        for(size_t j = 0; j < maps.size(); j++)
+            smax = std::max(smax, maps[j]->get_S());
+
+        int T = std::min<int>(_num_threads, std::max<size_t>(maps.size(), 1));
+        _num_threads = T;
+        _z.resize(T);
+        _acc.resize(T);
+        for(int t = 0; t < T; t++) {
+            _z[t].Resize(smax, _max_batch);
+            _acc[t].Resize(_max_batch, _k);
+        }
+        _DV.Resize(_max_batch, _k);
+        _init_batch(_X);
+
+        _worker = std::thread(&online_predictor_t::_serve, this);
+    }
+
+    ~online_predictor_t() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_all();
+        _worker.join();
+    }
+
+    /**
+     * Queues a dense example (get_input_size() values). The result is
+     * delivered through the future.
+     */
+    std::future<prediction_t> submit(const double *x) {
+        request_t r;
+        r.sparse = false;
+        r.val.assign(x, x + _d);
+        return _enqueue(r);
+    }
+
+    /**
+     * Queues a sparse example: nnz (0-based feature index, value) pairs.
+     * Indices past the input size of the model are ignored; negative ones
+     * are an error.
+     */
+    std::future<prediction_t> submit(const int *idx, const double *val,
+        int nnz) {
+        for(int l = 0; l < nnz; l++)
+            if (idx[l] < 0)
+                SKYLARK_THROW_EXCEPTION (
+                    base::skylark_exception()
+                        << base::error_msg("Negative feature index") );
+
+        request_t r;
+        r.sparse = true;
+        r.idx.assign(idx, idx + nnz);
+        r.val.assign(val, val + nnz);
+        return _enqueue(r);
+    }
+
+    /**
+     * Evaluates examples (columns of X) directly, in batches of at most
+     * max_batch, with the same workspaces. Not to be called concurrently
+     * with submit().
+     */
+    void predict(input_type& X, output_type& PV, output_type& DV) {
+        std::lock_guard<std::mutex> eval(_eval_mutex);
+
+        int n = base::Width(X);
+        DV.Resize(n, _k);
+        PV.Resize(n, 1);
+        for(int first = 0; first < n; first += _max_batch) {
+            int b = std::min(_max_batch, n - first);
+            input_type Xb;
+            _column_view(X, first, b, Xb);
+            _decision_values(Xb, b);
+            for(int i = 0; i < b; i++) {
+                for(int c = 0; c < _k; c++)
+                    DV.Set(first + i, c, _DV.Get(i, c));
+                PV.Set(first + i, 0, _label(i));
+            }
+        }
+    }
+
+    predictor_stats_t stats() const {
+        std::lock_guard<std::mutex> lock(_stats_mutex);
+        return _stats;
+    }
+
+    void reset_stats() {
+        std::lock_guard<std::mutex> lock(_stats_mutex);
+        _stats = predictor_stats_t();
+    }
+
+    int get_max_batch() const { return _max_batch; }
+
+private:
+    typedef typename model_type::feature_transform_type feature_transform_type;
+
+    struct request_t {
+        bool sparse;
+        std::vector<int> idx;       // feature indices of a sparse example
+        std::vector<double> val;
+        clock_type::time_point submitted;
+        std::promise<prediction_t> result;
+    };
+
+    const model_type& _model;
+    int _max_batch;
+    double _max_delay;
+    int _num_threads;
+    int _d, _k;
+
+    // Workspaces, allocated once.
+    input_type _X;
+    std::vector<elem::Matrix<double> > _z, _acc;
+    elem::Matrix<double> _DV;
+    std::vector<base::sparse_index_t> _indptr, _indices;
+    std::vector<double> _values;
+
+    std::deque<request_t> _queue;
+    std::mutex _mutex, _eval_mutex;
+    mutable std::mutex _stats_mutex;
+    std::condition_variable _cv;
+    bool _stop;
+    std::thread _worker;
+    predictor_stats_t _stats;
+
+    // Non-copyable: owns a thread.
+    online_predictor_t(const online_predictor_t&);
+    online_predictor_t& operator=(const online_predictor_t&);
+
+    std::future<prediction_t> _enqueue(request_t& r) {
+        std::future<prediction_t> f = r.result.get_future();
+        r.submitted = clock_type::now();
+        size_t waiting;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queue.push_back(std::move(r));
+            waiting = _queue.size();
+        }
+        // The worker only needs waking for the first example of a batch,
+        // or when the batch is full.
+        if (waiting == 1 || waiting == static_cast<size_t>(_max_batch))
+            _cv.notify_one();
+        return f;
+    }
+
+    /** Worker loop: waits for a full batch or for the delay to expire. */
+    void _serve() {
+        std::vector<request_t> batch;
+        batch.reserve(_max_batch);
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _cv.wait(lock, [this] { return _stop || !_queue.empty(); });
+            if (_queue.empty())
+                break;
+
+            clock_type::time_point deadline = _queue.front().submitted +
+                std::chrono::duration_cast<clock_type::duration>(
+                    std::chrono::duration<double>(_max_delay));
+            _cv.wait_until(lock, deadline, [this] {
+                    return _stop ||
+                        _queue.size() >= static_cast<size_t>(_max_batch);
+                });
+
+            size_t b = std::min(_queue.size(), static_cast<size_t>(_max_batch));
+            for(size_t i = 0; i < b; i++) {
+                batch.push_back(std::move(_queue.front()));
+                _queue.pop_front();
+            }
+
+            lock.unlock();
+            _evaluate(batch);
+            batch.clear();
+            lock.lock();
+        }
+    }
+
+    void _evaluate(std::vector<request_t>& batch) {
+        std::lock_guard<std::mutex> eval(_eval_mutex);
+
+        clock_type::time_point start = clock_type::now();
+        int b = batch.size();
+        try {
+            input_type Xb;
+            _fill_batch(batch, Xb);
+            _decision_values(Xb, b);
+        } catch (...) {
+            for(int i = 0; i < b; i++)
+                batch[i].result.set_exception(std::current_exception());
+            return;
+        }
+
+        clock_type::time_point done = clock_type::now();
+        double total = 0, worst = 0;
+        for(int i = 0; i < b; i++) {
+            prediction_t p;
+            p.label = _label(i);
+            p.decision_values.resize(_k);
+            for(int c = 0; c < _k; c++)
+                p.decision_values[c] = _DV.Get(i, c);
+            batch[i].result.set_value(p);
+
+            double latency = std::chrono::duration<double>(
+                done - batch[i].submitted).count();
+            total += latency;
+            worst = std::max(worst, latency);
+        }
+
+        std::lock_guard<std::mutex> lock(_stats_mutex);
+        _stats.requests += b;
+        _stats.batches++;
+        _stats.busy_time += std::chrono::duration<double>(done - start).count();
+        _stats.total_latency += total;
+        _stats.max_latency = std::max(_stats.max_latency, worst);
+    }
+
+    /**
+     * Decision values of the b examples in X, into the first b rows of _DV.
+     */
+    void _decision_values(input_type& X, int b) {
+        const std::vector<const feature_transform_type *>& maps =
+            _model.get_maps();
+        const coef_type& coef = _model.get_coef();
+
+        elem::Matrix<double> DVb;
+        elem::View(DVb, _DV, 0, 0, b, _k);
+
+        if (maps.size() == 0) {
+            // No maps (linear case)
+            base::Gemm(elem::TRANSPOSE, elem::NORMAL, 1.0, X, coef, 0.0, DVb);
+            return;
+        }
+
+        int T = _num_threads;
+        int d = base::Height(X);
+
+        // Exceptions may not leave the parallel region; the first one is
+        // rethrown after it.
+        std::exception_ptr error;
+
+#       ifdef SKYLARK_HAVE_OPENMP
+#       pragma omp parallel num_threads(T) if(T > 1)
+#       endif
+        {
+#           ifdef SKYLARK_HAVE_OPENMP
+            int t = omp_get_thread_num();
+#           else
+            int t = 0;
+#           endif
+
+            try {
+                elem::Matrix<double> acc, z, Wslice;
+                elem::View(acc, _acc[t], 0, 0, b, _k);
+                elem::MakeZeros(acc);
+
+                for(size_t j = t; j < maps.size(); j += T) {
+                    int sj = maps[j]->get_S();
+                    elem::View(z, _z[t], 0, 0, sj, b);
+                    maps[j]->apply(X, z, sketch::columnwise_tag());
+
+                    double scale = _model.get_scale_maps() ?
+                        std::sqrt(double(sj) / d) : 1.0;
+                    elem::LockedView(Wslice, coef, _model.get_map_start(j),
+                        0, sj, _k);
+                    elem::Gemm(elem::TRANSPOSE, elem::NORMAL, scale, z,
+                        Wslice, 1.0, acc);
+                }
+            } catch (...) {
+#               ifdef SKYLARK_HAVE_OPENMP
+#               pragma omp critical
+#               endif
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+
+        if (error)
+            std::rethrow_exception(error);
+
+        for(int c = 0; c < _k; c++)
+            for(int i = 0; i < b; i++) {
+                double v = 0;
+                for(int t = 0; t < T; t++)
+                    v += _acc[t].Get(i, c);
+                DVb.Set(i, c, v);
+            }
+    }
+
+    /** Same rule as model_t::predict. */
+    double _label(int i) const {
+        double o = _DV.Get(i, 0);
+        double pred = 0;
+        if (_k == 1)
+            pred = (o >= 0) ? +1 : -1;
+        for(int j = 1; j < _k; j++) {
+            double o1 = _DV.Get(i, j);
+            if (o1 > o) {
+                o = o1;
+                pred = j;
+            }
+        }
+        return pred;
+    }
+
+    void _init_batch(elem::Matrix<double>& X) {
+        X.Resize(_d, _max_batch);
+    }
+
+    void _init_batch(base::sparse_matrix_t<double>& X) {
+        _indptr.reserve(_max_batch + 1);
+    }
+
+    void _column_view(elem::Matrix<double>& X, int first, int b,
+        elem::Matrix<double>& Xb) {
+        elem::View(Xb, X, 0, first, X.Height(), b);
+    }
+
+    void _column_view(base::sparse_matrix_t<double>& X, int first, int b,
+        base::sparse_matrix_t<double>& Xb) {
+        const base::sparse_index_t *indptr = X.indptr();
+        base::sparse_index_t start = indptr[first];
+        _indptr.resize(b + 1);
+        for(int j = 0; j <= b; j++)
+            _indptr[j] = indptr[first + j] - start;
+        Xb.attach(_indptr.data(), X.indices() + start,
+            X.values() + start, _indptr[b], X.height(), b);
+    }
+
+    void _fill_batch(std::vector<request_t>& batch, elem::Matrix<double>& Xb) {
+        int b = batch.size();
+        for(int i = 0; i < b; i++) {
+            double *x = _X.Buffer(0, i);
+            const request_t& r = batch[i];
+            if (!r.sparse)
+                std::copy(r.val.begin(), r.val.end(), x);
+            else {
+                std::fill(x, x + _d, 0.0);
+                for(size_t l = 0; l < r.idx.size(); l++)
+                    if (r.idx[l] < _d)
+                        x[r.idx[l]] = r.val[l];
+            }
+        }
+        elem::View(Xb, _X, 0, 0, _d, b);
+    }
+
+    void _fill_batch(std::vector<request_t>& batch,
+        base::sparse_matrix_t<double>& Xb) {
+        int b = batch.size();
+        _indptr.resize(b + 1);
+        _indices.clear();
+        _values.clear();
+        _indptr[0] = 0;
+        for(int i = 0; i < b; i++) {
+            const request_t& r = batch[i];
+            for(size_t l = 0; l < r.val.size(); l++) {
+                int row = r.sparse ? r.idx[l] : l;
+                if (row < _d && r.val[l] != 0) {
+                    _indices.push_back(row);
+                    _values.push_back(r.val[l]);
+                }
+            }
+            _indptr[i + 1] = _indices.size();
+        }
+        Xb.attach(_indptr.data(), _indices.data(), _values.data(),
+            _indptr[b], _d, b);
+    }
+};
+
+} }
+
+#endif /* SKYLARK_ML_PREDICTOR_HPP */
@@ -212,18 +212,77 @@ void ShiftForLogistic(LocalMatrixType& Y) {
 	    	}
 	}
 
+/**
+ * Training without loading the training data: it is streamed from the file
+ * in chunks of options.chunksize examples.
+ */
+template <class InputType, class LabelType>
+int run_streaming(const boost::mpi::communicator& comm,
+    skylark::base::context_t& context, hilbert_options_t& options) {
+
+    int rank = comm.rank();
+
+    input_storage_t Xvstorage;
+    InputType Xv;
+    LabelType Yv;
+
+    example_chunks_t<InputType> chunks(comm, options.fileformat,
+        options.trainfile, options.chunksize);
+    LabelType& Y = chunks.labels();
+    int dimensions = chunks.height();
+    int targets = GetNumTargets<LabelType>(comm, Y);
+    bool shift = false;
+
+    if ((options.lossfunction == LOGISTIC) && (targets == 1)) {
+        ShiftForLogistic(Y);
+        targets = 2;
+        shift = true;
+    }
+
+    BlockADMMSolver<InputType>* Solver =
+        GetSolver<InputType>(context, options, dimensions);
+    Solver->set_scratch_directory(options.scratchdir);
+
+    if(!options.valfile.empty()) {
+        comm.barrier();
+        if(rank == 0) std::cout << "Loading validation data." << std::endl;
+
+        Xvstorage = read(comm, options.fileformat, options.valfile, Xv, Yv,
+            dimensions);
+
+        if ((options.lossfunction == LOGISTIC) && shift)
+            ShiftForLogistic(Yv);
+    }
+
+    skylark::ml::model_t<InputType, LabelType>* model =
+        Solver->train(chunks, Xv, Yv, comm);
+
+    if (comm.rank() == 0)
+        model->save(options.modelfile, options.print());
+
+    delete model;
+    delete Solver;
+
+    return 0;
+}
+
 template <class InputType, class LabelType>
 int run(const boost::mpi::communicator& comm, skylark::base::context_t& context,
     hilbert_options_t& options) {
 
     int rank = comm.rank();
 
+    if(!options.trainfile.empty() && options.chunksize > 0)
+        return run_streaming<InputType, LabelType>(comm, context, options);
+
+    // Declared first, so that it outlives the matrices attached to it.
+    input_storage_t Xstorage, Xvstorage, Xtstorage;
     InputType X, Xv, Xt;
     LabelType Y, Yv, Yt;
 
     if(!options.trainfile.empty()) { //training mode
 
-    	read(comm, options.fileformat, options.trainfile, X, Y);
+    	Xstorage = read(comm, options.fileformat, options.trainfile, X, Y);
     	int dimensions = skylark::base::Height(X);
     	int targets = GetNumTargets<LabelType>(comm, Y);
     	bool shift = false;
@@ -241,7 +300,7 @@ int run(const boost::mpi::communicator& comm, skylark::base::context_t& context,
     		comm.barrier();
     		if(rank == 0) std::cout << "Loading validation data." << std::endl;
 
-    		read(comm, options.fileformat, options.valfile, Xv, Yv,
+    		Xvstorage = read(comm, options.fileformat, options.valfile, Xv, Yv,
     			skylark::base::Height(X));
 
     		if ((options.lossfunction == LOGISTIC) && shift) {
@@ -260,7 +319,7 @@ int run(const boost::mpi::communicator& comm, skylark::base::context_t& context,
 
     	std::cout << "Testing Mode (currently loads test data in memory)" << std::endl;
     	skylark::ml::model_t<InputType, LabelType> model(options.modelfile);
-    	read(comm, options.fileformat, options.testfile, Xt, Yt,
+    	Xtstorage = read(comm, options.fileformat, options.testfile, Xt, Yt,
             model.get_input_size());
     	LabelType DecisionValues(Yt.Height(), model.get_num_outputs());
     	LabelType PredictedLabels(Yt.Height(), 1);
@@ -40,7 +40,8 @@ int main (int argc, char** argv) {
         std::cout << options.print();
 
 
-    bool sparse = (options.fileformat == LIBSVM_SPARSE) || (options.fileformat == HDF5_SPARSE);
+    bool sparse = (options.fileformat == LIBSVM_SPARSE) || (options.fileformat == HDF5_SPARSE) ||
+        (options.fileformat == BINARY_SPARSE);
     int flag = 0;
 
     if (sparse)
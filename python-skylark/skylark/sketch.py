@@ -39,6 +39,9 @@ def initialize(seed=-1):
       _lib.sl_create_sketch_transform.restype     = c_int
       _lib.sl_serialize_sketch_transform.restype  = c_int
       _lib.sl_deserialize_sketch_transform.restype = c_int
+      _lib.sl_bind_sketch_transform.restype       = c_int
+      _lib.sl_apply_bound_sketch_transform.restype = c_int
+      _lib.sl_free_bound_sketch_transform.restype = c_int
       _lib.sl_wrap_raw_matrix.restype             = c_int
       _lib.sl_free_raw_matrix_wrap.restype        = c_int
       _lib.sl_wrap_raw_sp_matrix.restype          = c_int
@@ -47,6 +50,15 @@ def initialize(seed=-1):
       _lib.sl_raw_sp_matrix_struct_updated.restype = c_int
       _lib.sl_raw_sp_matrix_reset_update_flag.restype = c_int
       _lib.sl_raw_sp_matrix_data.restype          = c_int
+      _lib.sl_wrap_raw_sp_matrix64.restype        = c_int
+      _lib.sl_raw_sp_matrix_index_size.restype    = c_int
+      _lib.sl_raw_sp_matrix_release.restype       = c_int
+      _lib.sl_free_raw_sp_matrix_index_buffer.restype = c_int
+      _lib.sl_free_raw_sp_matrix_value_buffer.restype = c_int
+      _lib.sl_raw_sp_matrix_release.argtypes = (c_void_p, POINTER(c_void_p), \
+        POINTER(c_void_p), POINTER(c_void_p), POINTER(ctypes.c_int64))
+      _lib.sl_free_raw_sp_matrix_index_buffer.argtypes = (c_void_p,)
+      _lib.sl_free_raw_sp_matrix_value_buffer.argtypes = (c_void_p,)
       _lib.sl_strerror.restype                    = c_char_p
       _lib.sl_supported_sketch_transforms.restype = c_char_p
       _lib.sl_has_elemental.restype               = c_bool
@@ -199,6 +211,25 @@ class _NumpyAdapter:
     else:
       return numpy.empty((m,n), order='F')
 
+class _OwnedBuffer(object):
+  """
+  A buffer allocated by the lower layers, exposed to numpy (through the array
+  interface) without copying. numpy.asarray(buffer) keeps the buffer alive
+  as the base of the array, and the buffer is freed with the given function
+  when the last array using it goes away.
+  """
+  def __init__(self, ptr, size, typestr, free):
+    self._ptr = ptr
+    self._free = free
+    self.__array_interface__ = {
+      'shape' : (size,),
+      'typestr' : typestr,
+      'data' : (ptr, False),
+      'version' : 3 }
+
+  def __del__(self):
+    _callsl(self._free, self._ptr)
+
 class _ScipyAdapter:
   def __init__(self, A):
 
@@ -212,19 +243,27 @@ class _ScipyAdapter:
 
   def ptr(self):
     data = c_void_p()
-    iptr = self._A.indptr.ctypes.data_as(ctypes.POINTER(ctypes.c_int))
-    cols = self._A.indices.ctypes.data_as(ctypes.POINTER(ctypes.c_int))
+    # scipy uses 64-bit indices for large matrices
+    if self._A.indices.dtype == numpy.int64:
+      wrap = _lib.sl_wrap_raw_sp_matrix64
+      itype = ctypes.c_int64
+    else:
+      wrap = _lib.sl_wrap_raw_sp_matrix
+      itype = ctypes.c_int
+    iptr = self._A.indptr.ctypes.data_as(ctypes.POINTER(itype))
+    cols = self._A.indices.ctypes.data_as(ctypes.POINTER(itype))
     dptr = self._A.data.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+    nnz = itype(len(self._A.indices))
 
     # If the matrix is kept in C ordering we are essentially wrapping the transposed
     # matrix
     if self.getorder() == "F":
-      _callsl(_lib.sl_wrap_raw_sp_matrix, \
-                iptr, cols, dptr, len(self._A.indices), \
+      _callsl(wrap, \
+                iptr, cols, dptr, nnz, \
                 self._A.shape[0], self._A.shape[1] if self._A.ndim > 1 else 1, byref(data))
     else:
-      _callsl(_lib.sl_wrap_raw_sp_matrix, \
-                iptr, cols, dptr, len(self._A.indices), \
+      _callsl(wrap, \
+                iptr, cols, dptr, nnz, \
                 self._A.shape[1] if self._A.ndim > 1 else self._A.shape[0], \
                 self._A.shape[0] if self._A.ndim > 1 else 1 , \
                 byref(data))
@@ -240,16 +279,35 @@ class _ScipyAdapter:
             byref(update_csc))
 
     if(update_csc.value):
-      # first we check the required size of the new structure
-      nnz = c_int()
-      _callsl(_lib.sl_raw_sp_matrix_nnz, self._ptr, byref(nnz))
-
-
       if isinstance(self._A, scipy.sparse.csc_matrix):
         indptrdim = self._A.shape[1] + 1 if self._A.ndim > 1 else 2
       else:
         indptrdim = self._A.shape[0] + 1 if self._A.ndim > 1 else 2
 
+      # take over the buffers the lower layers allocated, if possible
+      iptr, cols, dptr = c_void_p(), c_void_p(), c_void_p()
+      nnz = ctypes.c_int64()
+      _callsl(_lib.sl_raw_sp_matrix_release, self._ptr, \
+              byref(iptr), byref(cols), byref(dptr), byref(nnz))
+
+      if iptr.value is not None:
+        isize = c_int()
+        _callsl(_lib.sl_raw_sp_matrix_index_size, byref(isize))
+        itypestr = numpy.dtype('int%d' % (8 * isize.value)).str
+        ifree = _lib.sl_free_raw_sp_matrix_index_buffer
+
+        self._A.__dict__["indptr"]  = numpy.asarray( \
+          _OwnedBuffer(iptr.value, indptrdim, itypestr, ifree))
+        self._A.__dict__["indices"] = numpy.asarray( \
+          _OwnedBuffer(cols.value, nnz.value, itypestr, ifree))
+        self._A.__dict__["data"]    = numpy.asarray( \
+          _OwnedBuffer(dptr.value, nnz.value, numpy.dtype('float64').str, \
+                         _lib.sl_free_raw_sp_matrix_value_buffer))
+
+        _callsl(_lib.sl_free_raw_sp_matrix_wrap, self._ptr);
+        return
+
+      # otherwise copy
       indptr  = numpy.zeros(indptrdim, dtype='int32')
       indices = numpy.zeros(nnz.value, dtype='int32')
       values  = numpy.zeros(nnz.value)
@@ -503,11 +561,28 @@ class _SketchTransform(object):
     self._s = s
     self._defouttype = defouttype
     self._ppy = _lib is None or forceppy
+    self._bound = {}
 
   def __del__(self):
     if not self._ppy:
+      for bound in self._bound.values():
+        _callsl(_lib.sl_free_bound_sketch_transform, bound)
       _callsl(_lib.sl_free_sketch_transform, self._obj)
 
+  def _getbound(self, intype, outtype):
+    """
+    Returns the handle of the transform bound to the given input and
+    output types, binding it on first use. Bound handles keep the
+    constructed transform, so repeated applies pay only the compute cost.
+    """
+    key = (intype, outtype)
+    if key not in self._bound:
+      bound = c_void_p()
+      _callsl(_lib.sl_bind_sketch_transform, self._obj, \
+                intype, outtype, byref(bound))
+      self._bound[key] = bound.value
+    return self._bound[key]
+
   def serialize(self):
     """
     Returns a dictionary that is the sketch in a serialized for.
@@ -593,8 +668,8 @@ class _SketchTransform(object):
       else:
         cdim = dim
 
-      _callsl(_lib.sl_apply_sketch_transform, self._obj, \
-                A.ctype(), Aobj, SA.ctype(), SAobj, cdim+1)
+      _callsl(_lib.sl_apply_bound_sketch_transform, \
+                self._getbound(A.ctype(), SA.ctype()), Aobj, SAobj, cdim+1)
 
       A.ptrcleaner()
       SA.ptrcleaner()
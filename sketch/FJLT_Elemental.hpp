@@ -5,6 +5,47 @@
 
 namespace skylark { namespace sketch {
 
+namespace internal {
+
+/**
+ * Apply in-place, columnwise, the randomized unitary transform underlying
+ * an FJLT, using the FUT the FJLT was created with.
+ */
+template <typename ValueType,
+          typename IntermediateType,
+          typename ValueDistributionType>
+void fjlt_apply_underlying(fut_type_t fut,
+    const RFUT_data_t<ValueDistributionType>& data, IntermediateType& A) {
+
+    switch (fut) {
+#if SKYLARK_HAVE_FFTW
+    case FUT_DCT: {
+        RFUT_t<IntermediateType,
+               typename fft_futs<ValueType>::DCT_t,
+               ValueDistributionType> underlying(data);
+        underlying.apply(A, A, skylark::sketch::columnwise_tag());
+        break;
+    }
+#endif
+
+    case FUT_WHT: {
+        RFUT_t<IntermediateType,
+               fwht_fut_t<ValueType>,
+               ValueDistributionType> underlying(data);
+        underlying.apply(A, A, skylark::sketch::columnwise_tag());
+        break;
+    }
+
+    default:
+        SKYLARK_THROW_EXCEPTION (
+            base::sketch_exception()
+                << base::error_msg(
+                   "Requested FUT is not available for FJLT in this build"));
+    }
+}
+
+} // namespace internal
+
 
 /**
  * Specialization for distributed [VC/VR, *] input and local matrix output
@@ -25,19 +66,12 @@ struct FJLT_t <
     typedef elem::Matrix<value_type> output_matrix_type;
     typedef elem::DistMatrix<ValueType,
                              elem::STAR, ColDist> intermediate_type;
-    typedef fft_futs<double>::DCT_t transform_type;
     typedef utility::rademacher_distribution_t<value_type>
     underlying_value_distribution_type;
 
     typedef FJLT_data_t data_type;
     typedef data_type::params_t params_t;
 
-protected:
-    typedef RFUT_t<intermediate_type,
-                   transform_type,
-                   underlying_value_distribution_type> underlying_type;
-
-public:
     FJLT_t(int N, int S, base::context_t& context)
         : data_type (N, S, context) {
 
@@ -146,9 +180,8 @@ private:
         inter_A = A;
 
         // Apply the underlying transform
-        underlying_type underlying(*data_type::underlying_data);
-        underlying.apply(inter_A, inter_A,
-            skylark::sketch::columnwise_tag());
+        internal::fjlt_apply_underlying<value_type>(data_type::fut,
+            *data_type::underlying_data, inter_A);
 
         // Create the sampled and scaled matrix -- still in distributed mode
         intermediate_type dist_sketch_A(data_type::_S,
@@ -209,20 +242,12 @@ struct FJLT_t <
     output_matrix_type;
     typedef elem::DistMatrix<ValueType,
                              elem::STAR, ColDist> intermediate_type;
-    typedef fft_futs<double>::DCT_t transform_type;
     typedef utility::rademacher_distribution_t<value_type>
     underlying_value_distribution_type;
 
     typedef FJLT_data_t data_type;
     typedef data_type::params_t params_t;
 
-protected:
-    typedef RFUT_t<intermediate_type,
-                   transform_type,
-                   underlying_value_distribution_type> underlying_type;
-
-public:
-
     FJLT_t(int N, int S, base::context_t& context)
         : data_type (N, S, context) {
 
@@ -331,9 +356,8 @@ private:
         inter_A = A;
 
         // Apply the underlying transform
-        underlying_type underlying(*data_type::underlying_data);
-        underlying.apply(inter_A, inter_A,
-            skylark::sketch::columnwise_tag());
+        internal::fjlt_apply_underlying<value_type>(data_type::fut,
+            *data_type::underlying_data, inter_A);
 
         // Create the sampled and scaled matrix -- still in distributed mode
         intermediate_type dist_sketch_A(data_type::_S,
@@ -387,19 +411,12 @@ struct FJLT_t <
     typedef elem::Matrix<value_type> output_matrix_type;
     typedef elem::DistMatrix<ValueType,
                              elem::STAR, RowDist> intermediate_type;
-    typedef fft_futs<double>::DCT_t transform_type;
     typedef utility::rademacher_distribution_t<value_type>
     underlying_value_distribution_type;
 
     typedef FJLT_data_t data_type;
     typedef data_type::params_t params_t;
 
-protected:
-    typedef RFUT_t<intermediate_type,
-                   transform_type,
-                   underlying_value_distribution_type> underlying_type;
-
-public:
     FJLT_t(int N, int S, base::context_t& context)
         : data_type (N, S, context) {
 
@@ -508,9 +525,8 @@ private:
         inter_A = A;
 
         // Apply the underlying transform
-        underlying_type underlying(*data_type::underlying_data);
-        underlying.apply(inter_A, inter_A,
-            skylark::sketch::columnwise_tag());
+        internal::fjlt_apply_underlying<value_type>(data_type::fut,
+            *data_type::underlying_data, inter_A);
 
         // Create the sampled and scaled matrix -- still in distributed mode
         intermediate_type dist_sketch_A(data_type::_S,
@@ -570,20 +586,12 @@ struct FJLT_t <
     output_matrix_type;
     typedef elem::DistMatrix<ValueType,
                              elem::STAR, RowDist> intermediate_type;
-    typedef fft_futs<double>::DCT_t transform_type;
     typedef utility::rademacher_distribution_t<value_type>
     underlying_value_distribution_type;
 
     typedef FJLT_data_t data_type;
     typedef data_type::params_t params_t;
 
-protected:
-    typedef RFUT_t<intermediate_type,
-                   transform_type,
-                   underlying_value_distribution_type> underlying_type;
-
-public:
-
     FJLT_t(int N, int S, base::context_t& context)
         : data_type (N, S, context) {
 
@@ -692,9 +700,8 @@ private:
         inter_A = A;
 
         // Apply the underlying transform
-        underlying_type underlying(*data_type::underlying_data);
-        underlying.apply(inter_A, inter_A,
-            skylark::sketch::columnwise_tag());
+        internal::fjlt_apply_underlying<value_type>(data_type::fut,
+            *data_type::underlying_data, inter_A);
 
         // Create the sampled and scaled matrix -- still in distributed mode
         intermediate_type dist_sketch_A(data_type::_S,
@@ -750,21 +757,12 @@ struct FJLT_t <
                              elem::STAR, elem::VR>
     intermediate_type;
 
-    typedef fft_futs<double>::DCT_t transform_type;
     typedef utility::rademacher_distribution_t<value_type>
     underlying_value_distribution_type;
 
     typedef FJLT_data_t data_type;
     typedef data_type::params_t params_t;
 
-protected:
-
-    typedef RFUT_t<intermediate_type,
-                   transform_type,
-                   underlying_value_distribution_type> underlying_type;
-
-public:
-
     FJLT_t(int N, int S, base::context_t& context)
         : data_type (N, S, context) {
 
@@ -855,9 +853,8 @@ private:
         inter_A = A;
 
         // Apply the underlying transform
-        underlying_type underlying(*data_type::underlying_data);
-        underlying.apply(inter_A, inter_A,
-            skylark::sketch::columnwise_tag());
+        internal::fjlt_apply_underlying<value_type>(data_type::fut,
+            *data_type::underlying_data, inter_A);
 
         // Create the sampled and scaled matrix -- still in distributed mode
         intermediate_type dist_sketch_A(data_type::_S,
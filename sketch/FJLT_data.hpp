@@ -29,18 +29,23 @@ struct FJLT_data_t : public sketch_transform_data_t {
     /// Params structure
     struct params_t : public sketch_params_t {
 
+        params_t(fut_type_t fut = default_fut()) : fut(fut) {
+
+        }
+
+        const fut_type_t fut; /**< Underlying fast unitary transform */
     };
 
     FJLT_data_t (int N, int S, base::context_t& context)
         : base_t(N, S, context, "FJLT"),
-          samples(base_t::_S) {
+          samples(base_t::_S), fut(default_fut()) {
 
         context = build();
     }
 
     FJLT_data_t (int N, int S, const params_t& params, base::context_t& context)
         : base_t(N, S, context, "FJLT"),
-          samples(base_t::_S) {
+          samples(base_t::_S), fut(params.fut) {
 
         context = build();
     }
@@ -48,7 +53,8 @@ struct FJLT_data_t : public sketch_transform_data_t {
     FJLT_data_t (const boost::property_tree::ptree &pt) :
         base_t(pt.get<int>("N"), pt.get<int>("S"),
             base::context_t(pt.get_child("creation_context")), "FJLT"),
-          samples(base_t::_S) {
+          samples(base_t::_S),
+          fut(static_cast<fut_type_t>(pt.get<int>("fut", default_fut()))) {
 
          build();
     }
@@ -62,15 +68,16 @@ struct FJLT_data_t : public sketch_transform_data_t {
     boost::property_tree::ptree to_ptree() const {
         boost::property_tree::ptree pt;
         sketch_transform_data_t::add_common(pt);
+        pt.put("fut", static_cast<int>(fut));
         return pt;
     }
 
 protected:
 
     FJLT_data_t (int N, int S, const base::context_t& context,
-        std::string type)
+        std::string type, fut_type_t fut = default_fut())
         : base_t(N, S, context, type),
-          samples(base_t::_S) {
+          samples(base_t::_S), fut(fut) {
     }
 
     base::context_t build() {
@@ -86,6 +93,7 @@ protected:
         underlying_data_type;
 
     std::vector<size_t> samples; /**< Vector of samples */
+    fut_type_t fut; /**< Underlying fast unitary transform */
     boost::shared_ptr<underlying_data_type> underlying_data;
     /**< Data of the underlying RFUT transformation */
 };
@@ -1,11 +1,11 @@
 #ifndef SKYLARK_FRFT_ELEMENTAL_HPP
 #define SKYLARK_FRFT_ELEMENTAL_HPP
 
+#include "trig_kernels.hpp"
+
 namespace skylark {
 namespace sketch {
 
-#if SKYLARK_HAVE_FFTW || SKYLARK_HAVE_SPIRALWHT
-
 /**
  * Specialization local input (sparse of dense), local output.
  * InputType should either be elem::Matrix, or base:spare_matrix_t.
@@ -32,7 +32,7 @@ public:
      */
     FastRFT_t(const FastRFT_t<matrix_type,
                       output_matrix_type>& other)
-        : data_type(other), _fut(data_type::_N) {
+        : data_type(other), _fut(data_type::_N, data_type::fut) {
 
     }
 
@@ -40,7 +40,7 @@ public:
      * Constructor from data
      */
     FastRFT_t(const data_type& other_data)
-        : data_type(other_data), _fut(data_type::_N) {
+        : data_type(other_data), _fut(data_type::_N, data_type::fut) {
 
     }
 
@@ -129,28 +129,10 @@ private:
                 elem::DiagonalScale(elem::LEFT, elem::NORMAL, Sm, W);
 
                 double *sac = sa + ldsa * c;
-                for(int l = s; l < e; l++) {
-                    value_type x = w[l - s];
-                    x += data_type::shifts[l];
-
-#                   ifndef SKYLARK_INEXACT_COSINE
-                    x = std::cos(x);
-#                   else
-                    // x = std::cos(x) is slow
-                    // Instead use low-accuracy approximation
-                    if (x < -3.14159265) x += 6.28318531;
-                    else if (x >  3.14159265) x -= 6.28318531;
-                    x += 1.57079632;
-                    if (x >  3.14159265)
-                        x -= 6.28318531;
-                    x = (x < 0) ?
-                        1.27323954 * x + 0.405284735 * x * x :
-                        1.27323954 * x - 0.405284735 * x * x;
-#                   endif
-
-                    x = data_type::scale * x;
-                    sac[l] = x;
-                }
+                std::copy(w, w + (e - s), sac + s);
+                internal::scaled_cosine(sac + s, e - s, 1, ldsa,
+                    (const double *)NULL, data_type::shifts.data() + s, 1,
+                    true, data_type::scale);
             }
         }
 
@@ -164,92 +146,149 @@ private:
     void apply_impl(const matrix_type& A,
         output_matrix_type& sketch_of_A,
         skylark::sketch::rowwise_tag tag) const {
+        apply_rows(A, sketch_of_A);
+    }
 
-        // TODO this version is really bad: it completely densifies the matrix
-        //      on the begining.
-        // TODO this version does not work with _NB and N
-        // TODO this version is not as optimized as the columnwise version.
-
-        // Create a work array W
-        output_matrix_type W(base::Height(A), base::Width(A));
-
-        output_matrix_type B(data_type::_N, 1), G(data_type::_N, 1);
-        output_matrix_type Sm(data_type::_N, 1);
-        for(int i = 0; i < data_type::numblks; i++) {
-            int s = i * data_type::_N;
-            int e = std::min(s + data_type::_N, data_type::_S);
-
-            base::DenseCopy(A, W);
-
-            // Set the local values of B, G and S
-            value_type scal =
-                std::sqrt(data_type::_N) * _fut.scale();
-            for(int j = 0; j < data_type::_N; j++) {
-                B.Set(j, 0, data_type::B[i * data_type::_N + j]);
-                G.Set(j, 0, scal * data_type::G[i * data_type::_N + j]);
-                Sm.Set(j, 0, scal * data_type::Sm[i * data_type::_N + j]);
-            }
+    /**
+     * Copies rows [r, r + len) of a dense matrix into the len x N buffer x
+     * (leading dimension ldx).
+     */
+    struct dense_rows_t {
+        const elem::Matrix<value_type>& A;
+
+        dense_rows_t(const elem::Matrix<value_type>& A) : A(A) {}
+
+        void operator()(int r, int len, value_type *x, int ldx) const {
+            const value_type *a = A.LockedBuffer();
+            int lda = A.LDim();
+            for(int j = 0; j < A.Width(); j++)
+                std::copy(a + static_cast<size_t>(j) * lda + r,
+                    a + static_cast<size_t>(j) * lda + r + len,
+                    x + static_cast<size_t>(j) * ldx);
+        }
+    };
 
-            elem::DiagonalScale(elem::RIGHT, elem::NORMAL, B, W);
+    /**
+     * Same for a sparse matrix, through its CSR view: only the non-zeros
+     * of the rows are touched (x is zeroed by the caller).
+     */
+    struct sparse_rows_t {
+        typedef typename base::sparse_csr_view_t<value_type>::index_type
+        index_type;
 
-            _fut.apply(W, tag);
+        const base::sparse_csr_view_t<value_type> AR;
 
-            double *w = W.Buffer();
-            for(int c = 0; c < base::Height(W); c++)
-                for(int l = 0; l < data_type::_N - 1; l++) {
-                    int idx1 = c + (data_type::_N - 1 - l) * W.LDim();
-                    int idx2 = c  +
-                        (data_type::P[i * (data_type::_N - 1) + l]) * W.LDim();
-                    std::swap(w[idx1], w[idx2]);
+        sparse_rows_t(const base::sparse_matrix_t<value_type>& A) : AR(A) {}
+
+        void operator()(int r, int len, value_type *x, int ldx) const {
+            const index_type *indptr = AR.indptr();
+            const index_type *indices = AR.indices();
+            const value_type *values = AR.locked_values();
+            for(int i = 0; i < len; i++)
+                for(index_type l = indptr[r + i]; l < indptr[r + i + 1]; l++)
+                    x[static_cast<size_t>(indices[l]) * ldx + i] = values[l];
+        }
+    };
+
+    void apply_rows(const elem::Matrix<value_type>& A,
+        output_matrix_type& sketch_of_A) const {
+        apply_rows(dense_rows_t(A), base::Height(A), sketch_of_A);
+    }
+
+    void apply_rows(const base::sparse_matrix_t<value_type>& A,
+        output_matrix_type& sketch_of_A) const {
+        apply_rows(sparse_rows_t(A), base::Height(A), sketch_of_A);
+    }
+
+    /**
+     * Rowwise Fastfood on panels of rows. A panel is loaded once into X
+     * (zero padded to NB columns); each block then works in place on W,
+     * where the FUT runs across the rows of the panel, B, G and Sm scale
+     * whole columns and the permutation swaps whole columns. The output
+     * block is written straight into sketch_of_A.
+     */
+    template <typename RowLoader>
+    void apply_rows(const RowLoader& load, int m,
+        output_matrix_type& sketch_of_A) const {
+
+        const int NB = data_type::_NB;
+        const int hp = std::max(8, std::min(m, _panel_entries / NB));
+        const int npanels = (m + hp - 1) / hp;
+
+        const value_type scal = std::sqrt(NB) * _fut.scale();
+
+        value_type *sa = sketch_of_A.Buffer();
+        int ldsa = sketch_of_A.LDim();
+
+#       ifdef SKYLARK_HAVE_OPENMP
+#       pragma omp parallel if(npanels > 1)
+#       endif
+        {
+        output_matrix_type X(hp, NB), W(hp, NB), Wv;
+        value_type *x = X.Buffer();
+        value_type *w = W.Buffer();
+
+#       ifdef SKYLARK_HAVE_OPENMP
+#       pragma omp for schedule(dynamic)
+#       endif
+        for(int p = 0; p < npanels; p++) {
+            int r = p * hp;
+            int len = std::min(hp, m - r);
+
+            std::fill(x, x + static_cast<size_t>(hp) * NB, value_type(0));
+            load(r, len, x, hp);
+            elem::View(Wv, W, 0, 0, len, NB);
+
+            for(int i = 0; i < data_type::numblks; i++) {
+                int s = i * NB;
+                int e = std::min(s + NB, data_type::_S);
+
+                const double *Bi = data_type::B.data() + s;
+                const double *Gi = data_type::G.data() + s;
+                const double *Smi = data_type::Sm.data() + s;
+                const size_t *Pi = data_type::P.data() + i * (NB - 1);
+
+                for(int j = 0; j < NB; j++)
+                    for(int k = 0; k < len; k++)
+                        w[j * hp + k] = Bi[j] * x[j * hp + k];
+
+                _fut.apply(Wv, rowwise_tag());
+
+                for(int l = 0; l < NB - 1; l++) {
+                    int idx1 = NB - 1 - l;
+                    int idx2 = Pi[l];
+                    if (idx1 != idx2)
+                        std::swap_ranges(w + idx1 * hp, w + idx1 * hp + len,
+                            w + idx2 * hp);
                 }
 
-            elem::DiagonalScale(elem::RIGHT, elem::NORMAL, G, W);
+                for(int j = 0; j < NB; j++)
+                    for(int k = 0; k < len; k++)
+                        w[j * hp + k] *= scal * Gi[j];
 
-            _fut.apply(W, tag);
+                _fut.apply(Wv, rowwise_tag());
 
-            elem::DiagonalScale(elem::RIGHT, elem::NORMAL, Sm, W);
+                value_type *sab = sa + static_cast<size_t>(s) * ldsa + r;
+                for(int j = 0; j < e - s; j++)
+                    for(int k = 0; k < len; k++)
+                        sab[static_cast<size_t>(j) * ldsa + k] =
+                            scal * Smi[j] * w[j * hp + k];
 
-            // Copy that part to the output
-            output_matrix_type view_sketch_of_A;
-            elem::View(view_sketch_of_A, sketch_of_A, 0, s,
-                base::Height(A), e - s);
-            output_matrix_type view_W;
-            elem::View(view_W, W, 0, 0, base::Height(A), e - s);
-            view_sketch_of_A = view_W;
+                internal::scaled_cosine(sab, len, e - s, ldsa,
+                    (const double *)NULL, data_type::shifts.data() + s, 1,
+                    false, data_type::scale);
+            }
         }
 
-        for(int j = 0; j < data_type::_S; j++)
-            for(int i = 0; i < base::Height(A); i++) {
-                value_type x = sketch_of_A.Get(i, j);
-                x += data_type::shifts[j];
-
-#               ifndef SKYLARK_INEXACT_COSINE
-                x = std::cos(x);
-#               else
-                // x = std::cos(x) is slow
-                // Instead use low-accuracy approximation
-                if (x < -3.14159265) x += 6.28318531;
-                else if (x >  3.14159265) x -= 6.28318531;
-                x += 1.57079632;
-                if (x >  3.14159265)
-                    x -= 6.28318531;
-                x = (x < 0) ?
-                    1.27323954 * x + 0.405284735 * x * x :
-                    1.27323954 * x - 0.405284735 * x * x;
-#               endif
-
-                x = data_type::scale * x;
-                sketch_of_A.Set(i, j, x);
-            }
+        }
     }
 
+    /** Target number of entries in the per-thread row panels. */
+    static const int _panel_entries = 1 << 15;
+
 private:
 
-#ifdef SKYLARK_HAVE_FFTW
-    typename fft_futs<ValueType>::DCT_t _fut;
-#elif SKYLARK_HAVE_SPIRALWHT
-    WHT_t<double> _fut;
-#endif
+    selectable_fut_t<ValueType> _fut;
 
 };
 
@@ -569,7 +608,6 @@ private:
     const FastRFT_t<elem::Matrix<value_type>, elem::Matrix<value_type> > _local;
 };
 
-#endif // SKYLARK_HAVE_FFTW || SKYLARK_HAVE_SPIRALWHT
 
 } } /** namespace skylark::sketch */
 
@@ -11,8 +11,6 @@
 
 namespace skylark { namespace sketch {
 
-#if SKYLARK_HAVE_FFTW || SKYLARK_HAVE_SPIRALWHT
-
 namespace bstrand = boost::random;
 
 /**
@@ -31,11 +29,12 @@ struct FastRFT_data_t : public sketch_transform_data_t {
 
     typedef sketch_transform_data_t base_t;
 
-    FastRFT_data_t (int N, int S, skylark::base::context_t& context)
+    FastRFT_data_t (int N, int S, skylark::base::context_t& context,
+        fut_type_t fut = default_fut())
         : base_t(N, S, context, "FastRFT"), _NB(N),
           numblks(1 + ((base_t::_S - 1) / _NB)),
           scale(std::sqrt(2.0 / base_t::_S)),
-          Sm(numblks * _NB)  {
+          Sm(numblks * _NB), fut(fut)  {
 
         context = build();
     }
@@ -46,7 +45,8 @@ struct FastRFT_data_t : public sketch_transform_data_t {
           _NB(base_t::_N),
           numblks(1 + ((base_t::_S - 1) / _NB)),
           scale(std::sqrt(2.0 / base_t::_S)),
-          Sm(numblks * _NB)  {
+          Sm(numblks * _NB),
+          fut(static_cast<fut_type_t>(pt.get<int>("fut", default_fut())))  {
 
          build();
     }
@@ -60,17 +60,18 @@ struct FastRFT_data_t : public sketch_transform_data_t {
     boost::property_tree::ptree to_ptree() const {
         boost::property_tree::ptree pt;
         sketch_transform_data_t::add_common(pt);
+        pt.put("fut", static_cast<int>(fut));
         return pt;
     }
 
 
 protected:
     FastRFT_data_t (int N, int S, const skylark::base::context_t& context,
-        std::string type)
+        std::string type, fut_type_t fut = default_fut())
         : base_t(N, S, context, type), _NB(N),
           numblks(1 + ((base_t::_S - 1) / _NB)),
           scale(std::sqrt(2.0 / base_t::_S)),
-          Sm(numblks * _NB)  {
+          Sm(numblks * _NB), fut(fut)  {
 
     }
 
@@ -83,6 +84,7 @@ protected:
     std::vector<double> G;
     std::vector<size_t> P;
     std::vector<double> shifts; /** Shifts for scaled trigonometric factor */
+    const fut_type_t fut; /** Underlying fast unitary transform */
 
     base::context_t build() {
         base::context_t ctx = base_t::build();
@@ -113,18 +115,6 @@ protected:
         return ctx;
     }
 
-
-    // TODO there is also the issue of type of FUT, which now depends on what
-    //      is installed. For seralization we need to add an indicator on type
-    //      of the underlying FUT.
-    static int block_size(int N) {
-#if SKYLARK_HAVE_FFTW
-        return N;
-#elif SKYLARK_HAVE_SPIRALWHT
-        return (int)std::pow(2, std::ceil(std::log(N)/std::log(2)));
-#endif
-    }
-
 };
 
 struct FastGaussianRFT_data_t :
@@ -135,11 +125,13 @@ struct FastGaussianRFT_data_t :
     /// Params structure
     struct params_t : public sketch_params_t {
 
-        params_t(double sigma) : sigma(sigma) {
+        params_t(double sigma, fut_type_t fut = default_fut()) :
+            sigma(sigma), fut(fut) {
 
         }
 
         const double sigma;
+        const fut_type_t fut; /**< Underlying fast unitary transform */
     };
 
     FastGaussianRFT_data_t(int N, int S, double sigma,
@@ -151,14 +143,16 @@ struct FastGaussianRFT_data_t :
 
     FastGaussianRFT_data_t(int N, int S, const params_t& params,
         skylark::base::context_t& context)
-        : base_t(N, S, context, "FastGaussianRFT"), _sigma(params.sigma) {
+        : base_t(N, S, context, "FastGaussianRFT", params.fut),
+          _sigma(params.sigma) {
 
         context = build();
     }
 
     FastGaussianRFT_data_t(const boost::property_tree::ptree &pt) :
         base_t(pt.get<int>("N"), pt.get<int>("S"),
-            base::context_t(pt.get_child("creation_context")), "FastGaussianRFT"),
+            base::context_t(pt.get_child("creation_context")), "FastGaussianRFT",
+            static_cast<fut_type_t>(pt.get<int>("fut", default_fut()))),
         _sigma(pt.get<double>("sigma")) {
 
         build();
@@ -173,14 +167,16 @@ struct FastGaussianRFT_data_t :
     boost::property_tree::ptree to_ptree() const {
         boost::property_tree::ptree pt;
         sketch_transform_data_t::add_common(pt);
+        pt.put("fut", static_cast<int>(fut));
         pt.put("sigma", _sigma);
         return pt;
     }
 
 protected:
     FastGaussianRFT_data_t(int N, int S, double sigma,
-        const skylark::base::context_t& context, std::string type)
-        : base_t(N, S, context, type), _sigma(sigma) {
+        const skylark::base::context_t& context, std::string type,
+        fut_type_t fut = default_fut())
+        : base_t(N, S, context, type, fut), _sigma(sigma) {
 
     }
 
@@ -204,12 +200,14 @@ struct FastMaternRFT_data_t :
     /// Params structure
     struct params_t : public sketch_params_t {
 
-        params_t(double nu, double l) : nu(nu), l(l) {
+        params_t(double nu, double l, fut_type_t fut = default_fut()) :
+            nu(nu), l(l), fut(fut) {
 
         }
 
         const double nu;
         const double l;
+        const fut_type_t fut; /**< Underlying fast unitary transform */
     };
 
     FastMaternRFT_data_t(int N, int S, double nu, double l,
@@ -221,7 +219,7 @@ struct FastMaternRFT_data_t :
 
     FastMaternRFT_data_t(int N, int S, const params_t& params,
         skylark::base::context_t& context)
-        : base_t(N, S, context, "FastMaternRFT"), 
+        : base_t(N, S, context, "FastMaternRFT", params.fut),
           _nu(params.nu), _l(params.l) {
 
         context = build();
@@ -229,7 +227,8 @@ struct FastMaternRFT_data_t :
 
     FastMaternRFT_data_t(const boost::property_tree::ptree &pt) :
         base_t(pt.get<int>("N"), pt.get<int>("S"),
-            base::context_t(pt.get_child("creation_context")), "FastMaternRFT"),
+            base::context_t(pt.get_child("creation_context")), "FastMaternRFT",
+            static_cast<fut_type_t>(pt.get<int>("fut", default_fut()))),
         _nu(pt.get<double>("nu")), _l(pt.get<double>("l")) {
 
         build();
@@ -244,6 +243,7 @@ struct FastMaternRFT_data_t :
     boost::property_tree::ptree to_ptree() const {
         boost::property_tree::ptree pt;
         sketch_transform_data_t::add_common(pt);
+        pt.put("fut", static_cast<int>(fut));
         pt.put("nu", _nu);
         pt.put("l", _l);
         return pt;
@@ -251,8 +251,9 @@ struct FastMaternRFT_data_t :
 
 protected:
     FastMaternRFT_data_t(int N, int S, double nu, double l,
-        const skylark::base::context_t& context, std::string type)
-        : base_t(N, S, context, type), _nu(nu), _l(l) {
+        const skylark::base::context_t& context, std::string type,
+        fut_type_t fut = default_fut())
+        : base_t(N, S, context, type, fut), _nu(nu), _l(l) {
 
     }
 
@@ -275,5 +276,4 @@ private:
 
 } } /** namespace skylark::sketch */
 
-#endif  // SKYLARK_HAVE_FFTW || SKYLARK_HAVE_SPIRALWHT
 #endif
@@ -5,30 +5,74 @@
 #error "Include top-level sketch.hpp instead of including individuals headers"
 #endif
 
+#include <algorithm>
+#include <cmath>
+
+#include <boost/shared_ptr.hpp>
+
+namespace skylark { namespace sketch {
+
+/**
+ * Underlying fast unitary transform used by FJLT and FastRFT: the DCT
+ * (needs FFTW) or the in-house Walsh-Hadamard transform.
+ */
+enum fut_type_t {
+    FUT_DCT = 0,
+    FUT_WHT = 1
+};
+
+/** Default FUT: the DCT when FFTW is available, the WHT otherwise. */
+inline fut_type_t default_fut() {
+#if SKYLARK_HAVE_FFTW
+    return FUT_DCT;
+#else
+    return FUT_WHT;
+#endif
+}
+
+} } /** namespace skylark::sketch */
+
 #if SKYLARK_HAVE_FFTW
 
 #include <fftw3.h>
 
+#include "fftw_plan_cache.hpp"
+
+#ifdef SKYLARK_HAVE_OPENMP
+#include <omp.h>
+#endif
+
 namespace skylark { namespace sketch {
 
 template < typename ValueType,
            typename PlanType, typename KindType,
            KindType Kind, KindType KindInverse,
            PlanType (*PlanFun)(int, ValueType*, ValueType*, KindType, unsigned),
+           PlanType (*PlanManyFun)(int, const int*, int,
+               ValueType*, const int*, int, int,
+               ValueType*, const int*, int, int,
+               const KindType*, unsigned),
            void (*ExecuteFun)(PlanType, ValueType*, ValueType*),
            void (*DestroyFun)(PlanType),
            int ScaleVal >
 struct fftw_r2r_fut_t {
 
+    typedef internal::fftw_plan_cache_t<PlanType> cache_t;
+    typedef typename cache_t::handle_type plan_handle_t;
+
     fftw_r2r_fut_t<ValueType,
                    PlanType, KindType,
                    Kind, KindInverse,
-                   PlanFun, ExecuteFun, DestroyFun, ScaleVal>(int N) : _N(N) {
-        ValueType *tmp = new ValueType[N];
-        _plan = PlanFun(N, tmp, tmp, Kind, FFTW_UNALIGNED | FFTW_ESTIMATE);
-        _plan_inverse = PlanFun(N, tmp, tmp, KindInverse,
-            FFTW_UNALIGNED | FFTW_ESTIMATE);
-        delete[] tmp;
+                   PlanFun, PlanManyFun,
+                   ExecuteFun, DestroyFun, ScaleVal>(int N) : _N(N) {
+        // Plans are shared through the process-wide cache, so building many
+        // transforms of the same size plans only once.
+        _plan = cache_t::get(
+            internal::fftw_plan_key_t(Kind, N, FFTW_UNALIGNED),
+            planner_t(N, Kind));
+        _plan_inverse = cache_t::get(
+            internal::fftw_plan_key_t(KindInverse, N, FFTW_UNALIGNED),
+            planner_t(N, KindInverse));
 
         // TODO: detect failure to form plans.
     }
@@ -36,9 +80,9 @@ struct fftw_r2r_fut_t {
     virtual ~fftw_r2r_fut_t<ValueType,
                             PlanType, KindType,
                             Kind, KindInverse,
-                            PlanFun, ExecuteFun, DestroyFun, ScaleVal>() {
-        DestroyFun(_plan);
-        DestroyFun(_plan_inverse);
+                            PlanFun, PlanManyFun,
+                            ExecuteFun, DestroyFun, ScaleVal>() {
+        // Plans are released by their handles.
     }
 
 
@@ -60,63 +104,147 @@ private:
 
     void apply_impl(elem::Matrix<ValueType>& A,
                     skylark::sketch::columnwise_tag) const {
-        double* AA = A.Buffer();
-        int j;
-#ifdef SKYLARK_HAVE_OPENMP
-#pragma omp parallel for private(j)
-#endif
-        for (j = 0; j < A.Width(); j++)
-            ExecuteFun(_plan, AA + j * A.LDim(), AA + j * A.LDim());
+        apply_batched(A, Kind, _plan.get(), A.Width(), 1, A.LDim());
     }
 
     void apply_inverse_impl(elem::Matrix<ValueType>& A,
                             skylark::sketch::columnwise_tag) const {
-        double* AA = A.Buffer();
-        int j;
-#ifdef SKYLARK_HAVE_OPENMP
-#pragma omp parallel for private(j)
-#endif
-        for (j = 0; j < A.Width(); j++)
-            ExecuteFun(_plan_inverse, AA + j * A.LDim(), AA + j * A.LDim());
+        apply_batched(A, KindInverse, _plan_inverse.get(), A.Width(), 1,
+            A.LDim());
     }
 
     void apply_impl(elem::Matrix<ValueType>& A,
                     skylark::sketch::rowwise_tag) const {
-        // Using transpositions instead of moving to the advanced interface
-        // of FFTW
-        elem::Matrix<ValueType> matrix;
-        elem::Transpose(A, matrix);
-        double* matrix_buffer = matrix.Buffer();
-        int j;
-#ifdef SKYLARK_HAVE_OPENMP
-#pragma omp parallel for private(j)
-#endif
-        for (j = 0; j < matrix.Width(); j++)
-            ExecuteFun(_plan, matrix_buffer + j * matrix.LDim(),
-                matrix_buffer + j * matrix.LDim());
-        elem::Transpose(matrix, A);
+        apply_batched(A, Kind, _plan.get(), A.Height(), A.LDim(), 1);
     }
 
     void apply_inverse_impl(elem::Matrix<ValueType>& A,
                             skylark::sketch::rowwise_tag) const {
-        // Using transpositions instead of moving to the advanced interface
-        // of FFTW
-        elem::Matrix<ValueType> matrix;
-        elem::Transpose(A, matrix);
-        double* matrix_buffer = matrix.Buffer();
+        apply_batched(A, KindInverse, _plan_inverse.get(), A.Height(),
+            A.LDim(), 1);
+    }
+
+    /**
+     * Transform howmany vectors of A in-place. Vector i starts at
+     * A.Buffer() + i * dist, and its entries are stride apart. The vectors
+     * are split into one contiguous batch per thread, and each batch is
+     * done by a single advanced-interface (plan_many) plan; this handles
+     * rows directly, without transposing A.
+     */
+    void apply_batched(elem::Matrix<ValueType>& A, KindType kind,
+        PlanType plan1d, int howmany, int stride, int dist) const {
+
+        if (howmany == 0)
+            return;
+
+        ValueType* AA = A.Buffer();
+
+        int nthreads = 1;
+#ifdef SKYLARK_HAVE_OPENMP
+        nthreads = std::min(omp_get_max_threads(), howmany);
+#endif
+        int q = howmany / nthreads;
+        int r = howmany % nthreads;
+
+        // At most two batch sizes are needed: q + 1 (first r threads) and q.
+        plan_handle_t big, small;
+        if (r > 0)
+            big = batch_plan(kind, q + 1, stride, dist);
+        if (q > 0)
+            small = batch_plan(kind, q, stride, dist);
+        PlanType plan_big = big.get();
+        PlanType plan_small = small.get();
+
+        if ((r > 0 && plan_big == NULL) || (q > 0 && plan_small == NULL)) {
+            apply_unbatched(A, plan1d, howmany, stride, dist);
+            return;
+        }
+
+        int t;
+#ifdef SKYLARK_HAVE_OPENMP
+#pragma omp parallel for private(t) num_threads(nthreads)
+#endif
+        for (t = 0; t < nthreads; t++) {
+            ValueType* X = AA + (t * q + std::min(t, r)) * dist;
+            ExecuteFun(t < r ? plan_big : plan_small, X, X);
+        }
+    }
+
+    /**
+     * Fallback if FFTW could not form a batched plan: one vector at a time,
+     * transposing first if the vectors are not contiguous.
+     */
+    void apply_unbatched(elem::Matrix<ValueType>& A, PlanType plan1d,
+        int howmany, int stride, int dist) const {
+
+        if (stride != 1) {
+            elem::Matrix<ValueType> matrix;
+            elem::Transpose(A, matrix);
+            apply_unbatched(matrix, plan1d, howmany, 1, matrix.LDim());
+            elem::Transpose(matrix, A);
+            return;
+        }
+
+        ValueType* AA = A.Buffer();
         int j;
 #ifdef SKYLARK_HAVE_OPENMP
 #pragma omp parallel for private(j)
 #endif
-        for (j = 0; j < matrix.Width(); j++)
-            ExecuteFun(_plan_inverse, matrix_buffer + j * matrix.LDim(),
-                matrix_buffer + j * matrix.LDim());
-        elem::Transpose(matrix, A);
+        for (j = 0; j < howmany; j++)
+            ExecuteFun(plan1d, AA + j * dist, AA + j * dist);
+    }
+
+    plan_handle_t batch_plan(KindType kind, int howmany, int stride,
+        int dist) const {
+        return cache_t::get(
+            internal::fftw_plan_key_t(kind, _N, FFTW_UNALIGNED,
+                howmany, stride, dist),
+            many_planner_t(_N, kind, howmany, stride, dist));
     }
 
 private:
+    /** Creates a 1D in-place plan on a scratch buffer. */
+    struct planner_t {
+        int N;
+        KindType kind;
+
+        planner_t(int N, KindType kind) : N(N), kind(kind) {}
+
+        PlanType operator()(unsigned flags) const {
+            ValueType *tmp = new ValueType[N];
+            PlanType plan = PlanFun(N, tmp, tmp, kind, flags);
+            delete[] tmp;
+            return plan;
+        }
+    };
+
+    /** Creates a batched 1D in-place plan on a scratch buffer. */
+    struct many_planner_t {
+        int N;
+        KindType kind;
+        int howmany, stride, dist;
+
+        many_planner_t(int N, KindType kind, int howmany, int stride,
+            int dist) :
+            N(N), kind(kind), howmany(howmany), stride(stride), dist(dist) {}
+
+        PlanType operator()(unsigned flags) const {
+            // With FFTW_ESTIMATE the planner does not touch the arrays, so
+            // there is no need for a scratch buffer as big as the batch.
+            size_t size = (flags & FFTW_ESTIMATE) ? N :
+                static_cast<size_t>(howmany - 1) * dist +
+                static_cast<size_t>(N - 1) * stride + 1;
+            ValueType *tmp = new ValueType[size];
+            PlanType plan = PlanManyFun(1, &N, howmany,
+                tmp, NULL, stride, dist, tmp, NULL, stride, dist,
+                &kind, flags);
+            delete[] tmp;
+            return plan;
+        }
+    };
+
     const int _N;
-    PlanType _plan, _plan_inverse;
+    plan_handle_t _plan, _plan_inverse;
 
 
 };
@@ -130,22 +258,26 @@ template<>
 struct fft_futs<double> {
     typedef fftw_r2r_fut_t <
             double, fftw_plan, fftw_r2r_kind, FFTW_REDFT10, FFTW_REDFT01,
-            fftw_plan_r2r_1d, fftw_execute_r2r, fftw_destroy_plan, 2 > DCT_t;
+            fftw_plan_r2r_1d, fftw_plan_many_r2r,
+            fftw_execute_r2r, fftw_destroy_plan, 2 > DCT_t;
 
     typedef fftw_r2r_fut_t <
             double, fftw_plan, fftw_r2r_kind, FFTW_DHT, FFTW_DHT,
-            fftw_plan_r2r_1d, fftw_execute_r2r, fftw_destroy_plan, 1 > DHT_t;
+            fftw_plan_r2r_1d, fftw_plan_many_r2r,
+            fftw_execute_r2r, fftw_destroy_plan, 1 > DHT_t;
 };
 
 template<>
 struct fft_futs<float> {
     typedef fftw_r2r_fut_t <
             float, fftwf_plan, fftwf_r2r_kind, FFTW_REDFT10, FFTW_REDFT01,
-            fftwf_plan_r2r_1d, fftwf_execute_r2r, fftwf_destroy_plan, 2 > DCT_t;
+            fftwf_plan_r2r_1d, fftwf_plan_many_r2r,
+            fftwf_execute_r2r, fftwf_destroy_plan, 2 > DCT_t;
 
     typedef fftw_r2r_fut_t <
             float, fftwf_plan, fftwf_r2r_kind, FFTW_DHT, FFTW_DHT,
-            fftwf_plan_r2r_1d, fftwf_execute_r2r, fftwf_destroy_plan, 1 > DHT_t;
+            fftwf_plan_r2r_1d, fftwf_plan_many_r2r,
+            fftwf_execute_r2r, fftwf_destroy_plan, 1 > DHT_t;
 };
 
 
@@ -252,4 +384,240 @@ private:
 
 #endif // SKYLARK_HAVE_SPIRALWHT
 
+namespace skylark { namespace sketch {
+
+/**
+ * In-house fast Walsh-Hadamard transform (no external library needed).
+ *
+ * If N is a power of two this is the unnormalized Hadamard transform.
+ * Otherwise, with M the largest power of two below N, it is the normalized
+ * Hadamard transform of the first M entries followed by the normalized
+ * Hadamard transform of the last M entries. The two windows overlap, so
+ * all N entries are mixed. Either way the result is orthogonal after
+ * multiplying by scale().
+ */
+template<typename ValueType>
+struct fwht_fut_t {
+
+    typedef ValueType value_type;
+
+    fwht_fut_t(int N) : _N(N), _M(1) {
+        while (2 * _M <= _N)
+            _M *= 2;
+    }
+
+    template <typename Dimension>
+    void apply(elem::Matrix<value_type>& A, Dimension dimension) const {
+        return apply_impl (A, false, dimension);
+    }
+
+    template <typename Dimension>
+    void apply_inverse(elem::Matrix<value_type>& A, Dimension dimension) const {
+        return apply_impl (A, true, dimension);
+    }
+
+    double scale() const {
+        return _M == _N ? 1 / sqrt((double)_M) : 1.0;
+    }
+
+private:
+
+    /**
+     * Stages that only touch entries within blocks of this size are done
+     * block by block, so that they run in cache.
+     */
+    static const int _block = 1 << 12;
+
+    void apply_impl(elem::Matrix<value_type>& A, bool inverse,
+                    skylark::sketch::columnwise_tag) const {
+        value_type* AA = A.Buffer();
+        int ld = A.LDim();
+        int j;
+#ifdef SKYLARK_HAVE_OPENMP
+#pragma omp parallel for private(j)
+#endif
+        for (j = 0; j < A.Width(); j++)
+            transform(AA + static_cast<size_t>(j) * ld, inverse);
+    }
+
+    void apply_impl(elem::Matrix<value_type>& A, bool inverse,
+                    skylark::sketch::rowwise_tag) const {
+        // Butterflies combine whole columns of a tile of rows, so the
+        // innermost loop runs over contiguous memory.
+        value_type* AA = A.Buffer();
+        int ld = A.LDim();
+        int m = A.Height();
+        int tile = std::max(8, _block / _M);
+        int ntiles = (m + tile - 1) / tile;
+        int t;
+#ifdef SKYLARK_HAVE_OPENMP
+#pragma omp parallel for private(t)
+#endif
+        for (t = 0; t < ntiles; t++) {
+            int r = t * tile;
+            transform_rows(AA + r, ld, std::min(tile, m - r), inverse);
+        }
+    }
+
+    void transform(value_type* x, bool inverse) const {
+        if (_M == _N) {
+            fwht(x);
+            return;
+        }
+
+        value_type* y = x + (_N - _M);
+        value_type s = 1 / sqrt((double)_M);
+        if (inverse)
+            std::swap(x, y);
+        fwht(x);
+        for (int i = 0; i < _M; i++)
+            x[i] *= s;
+        fwht(y);
+        for (int i = 0; i < _M; i++)
+            y[i] *= s;
+    }
+
+    void transform_rows(value_type* x, int ld, int len, bool inverse) const {
+        if (_M == _N) {
+            fwht_rows(x, ld, len);
+            return;
+        }
+
+        value_type* y = x + static_cast<size_t>(_N - _M) * ld;
+        value_type s = 1 / sqrt((double)_M);
+        if (inverse)
+            std::swap(x, y);
+        fwht_rows(x, ld, len);
+        scale_rows(x, ld, len, s);
+        fwht_rows(y, ld, len);
+        scale_rows(y, ld, len, s);
+    }
+
+    void scale_rows(value_type* x, int ld, int len, value_type s) const {
+        for (int j = 0; j < _M; j++)
+            for (int i = 0; i < len; i++)
+                x[static_cast<size_t>(j) * ld + i] *= s;
+    }
+
+    /** Unnormalized in-place WHT of M contiguous entries. */
+    void fwht(value_type* x) const {
+        int B = std::min(_M, _block);
+
+        for (int b = 0; b < _M; b += B) {
+            value_type* xb = x + b;
+            int h = 1;
+
+            // First two stages at once.
+            if (B >= 4) {
+                for (int i = 0; i < B; i += 4) {
+                    value_type a0 = xb[i] + xb[i + 1];
+                    value_type a1 = xb[i] - xb[i + 1];
+                    value_type a2 = xb[i + 2] + xb[i + 3];
+                    value_type a3 = xb[i + 2] - xb[i + 3];
+                    xb[i] = a0 + a2;
+                    xb[i + 1] = a1 + a3;
+                    xb[i + 2] = a0 - a2;
+                    xb[i + 3] = a1 - a3;
+                }
+                h = 4;
+            }
+
+            for (; h < B; h *= 2)
+                for (int i = 0; i < B; i += 2 * h)
+                    butterfly(xb + i, xb + i + h, h);
+        }
+
+        for (int h = B; h < _M; h *= 2)
+            for (int i = 0; i < _M; i += 2 * h)
+                butterfly(x + i, x + i + h, h);
+    }
+
+    /**
+     * Unnormalized in-place WHT of len vectors stored as rows: entry j of
+     * all the vectors is x[j * ld, ..., j * ld + len).
+     */
+    void fwht_rows(value_type* x, int ld, int len) const {
+        for (int h = 1; h < _M; h *= 2)
+            for (int i = 0; i < _M; i += 2 * h)
+                for (int j = i; j < i + h; j++)
+                    butterfly(x + static_cast<size_t>(j) * ld,
+                        x + static_cast<size_t>(j + h) * ld, len);
+    }
+
+    static void butterfly(value_type* a, value_type* b, int len) {
+        for (int k = 0; k < len; k++) {
+            value_type u = a[k];
+            value_type v = b[k];
+            a[k] = u + v;
+            b[k] = u - v;
+        }
+    }
+
+    const int _N;
+    int _M;
+};
+
+/**
+ * FUT chosen at run time (see fut_type_t), for transforms that keep the
+ * choice in their data.
+ */
+template<typename ValueType>
+struct selectable_fut_t {
+
+    typedef ValueType value_type;
+
+    selectable_fut_t(int N, fut_type_t type) : _type(type), _wht(N) {
+#if SKYLARK_HAVE_FFTW
+        if (_type == FUT_DCT)
+            _dct.reset(new dct_type(N));
+#else
+        if (_type == FUT_DCT)
+            SKYLARK_THROW_EXCEPTION (
+                base::sketch_exception()
+                    << base::error_msg("DCT requires FFTW support"));
+#endif
+    }
+
+    template <typename Dimension>
+    void apply(elem::Matrix<value_type>& A, Dimension dimension) const {
+#if SKYLARK_HAVE_FFTW
+        if (_type == FUT_DCT) {
+            _dct->apply(A, dimension);
+            return;
+        }
+#endif
+        _wht.apply(A, dimension);
+    }
+
+    template <typename Dimension>
+    void apply_inverse(elem::Matrix<value_type>& A, Dimension dimension) const {
+#if SKYLARK_HAVE_FFTW
+        if (_type == FUT_DCT) {
+            _dct->apply_inverse(A, dimension);
+            return;
+        }
+#endif
+        _wht.apply_inverse(A, dimension);
+    }
+
+    double scale() const {
+#if SKYLARK_HAVE_FFTW
+        if (_type == FUT_DCT)
+            return _dct->scale();
+#endif
+        return _wht.scale();
+    }
+
+private:
+    fut_type_t _type;
+    fwht_fut_t<value_type> _wht;
+
+#if SKYLARK_HAVE_FFTW
+    typedef typename fft_futs<value_type>::DCT_t dct_type;
+    boost::shared_ptr<dct_type> _dct;
+#endif
+};
+
+} } /** namespace skylark::sketch */
+
 #endif // SKYLARK_FUT_HPP
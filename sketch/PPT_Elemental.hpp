@@ -5,6 +5,11 @@
 
 #include <fftw3.h>
 
+#include <algorithm>
+
+#include "fftw_plan_cache.hpp"
+#include "../utility/aligned_buffer.hpp"
+
 namespace skylark { namespace sketch {
 
 /**
@@ -34,6 +39,12 @@ struct fftw<double> {
     static executeffun_t executeffun;
     typedef void (*executebfun_t)(plan_t, complex_t*, double*);
     static executebfun_t executebfun;
+    typedef plan_t (*fmanyfun_t)(int, const int*, int, double*, const int*,
+        int, int, complex_t*, const int*, int, int, unsigned);
+    static fmanyfun_t fmanyfun;
+    typedef plan_t (*bmanyfun_t)(int, const int*, int, complex_t*,
+        const int*, int, int, double*, const int*, int, int, unsigned);
+    static bmanyfun_t bmanyfun;
 };
 
 fftw<double>::fplanfun_t fftw<double>::fplanfun = fftw_plan_dft_r2c_1d;
@@ -41,6 +52,8 @@ fftw<double>::bplanfun_t fftw<double>::bplanfun = fftw_plan_dft_c2r_1d;
 fftw<double>::destroyfun_t fftw<double>::destroyfun = fftw_destroy_plan;
 fftw<double>::executeffun_t fftw<double>::executeffun = fftw_execute_dft_r2c;
 fftw<double>::executebfun_t fftw<double>::executebfun = fftw_execute_dft_c2r;
+fftw<double>::fmanyfun_t fftw<double>::fmanyfun = fftw_plan_many_dft_r2c;
+fftw<double>::bmanyfun_t fftw<double>::bmanyfun = fftw_plan_many_dft_c2r;
 
 #endif /* SKYLARK_HAVE_FFTW */
 
@@ -61,6 +74,12 @@ struct fftw<float> {
     static executffun_t executeffun;
     typedef void (*executebfun_t)(plan_t, complex_t*, float*);
     static executbfun_t executebfun;
+    typedef plan_t (*fmanyfun_t)(int, const int*, int, float*, const int*,
+        int, int, complex_t*, const int*, int, int, unsigned);
+    static fmanyfun_t fmanyfun;
+    typedef plan_t (*bmanyfun_t)(int, const int*, int, complex_t*,
+        const int*, int, int, float*, const int*, int, int, unsigned);
+    static bmanyfun_t bmanyfun;
 };
 
 fftw<float>::fplanfun_t fftw<float>::fplanfun = fftwf_plan_dft_r2c_1d;
@@ -68,9 +87,180 @@ fftw<float>::bplanfun_t fftw<float>::bplanfun = fftwf_plan_dft_c2r_1d;
 fftw<float>::destroyfun_t fftw<float>::destroyfun = fftwf_destroy_plan;
 fftw<float>::executeffun_t fftw<float>::executeffun = fftwf_execute_dft_r2c;
 fftw<float>::executebfun_t fftw<float>::executebfun = fftwf_execute_dft_c2r;
+fftw<float>::fmanyfun_t fftw<float>::fmanyfun = fftwf_plan_many_dft_r2c;
+fftw<float>::bmanyfun_t fftw<float>::bmanyfun = fftwf_plan_many_dft_c2r;
 
 #endif /* SKYLARK_HAVE_FFTWF */
 
+/**
+ * Creates a batched r2c (forward) or c2r (backward) plan for howmany
+ * contiguous vectors of length S (S / 2 + 1 complex numbers on the other
+ * side), on aligned scratch buffers, for use with fftw_plan_cache_t.
+ */
+template <typename T>
+struct fftw_r2c_planner_t {
+    int S, howmany;
+    bool forward;
+
+    fftw_r2c_planner_t(int S, int howmany, bool forward) :
+        S(S), howmany(howmany), forward(forward) {}
+
+    typename fftw<T>::plan_t operator()(unsigned flags) const {
+        typedef typename fftw<T>::complex_t complex_t;
+
+        int n = S, Sc = S / 2 + 1;
+        utility::aligned_buffer_t<T> rtmp(static_cast<size_t>(S) * howmany);
+        utility::aligned_buffer_t<T> ctmp(2 * static_cast<size_t>(Sc) * howmany);
+        complex_t *c = reinterpret_cast<complex_t*>(ctmp.data());
+        return forward ?
+            fftw<T>::fmanyfun(1, &n, howmany, rtmp.data(), NULL, 1, S,
+                c, NULL, 1, Sc, flags) :
+            fftw<T>::bmanyfun(1, &n, howmany, c, NULL, 1, Sc,
+                rtmp.data(), NULL, 1, S, flags);
+    }
+};
+
+/**
+ * Hashes input vector k of a column-major dense matrix (vectors are
+ * columns if stride = 1, dist = ld and rows if stride = ld, dist = 1).
+ */
+template <typename T>
+struct ppt_dense_scatter_t {
+    const T *A;
+    int stride, dist;
+
+    ppt_dense_scatter_t(const T *A, int stride, int dist) :
+        A(A), stride(stride), dist(dist) {}
+
+    void operator()(const ppt_hashes_t& h, int k, int c, T *w) const {
+        const T *x = A + static_cast<size_t>(k) * dist;
+        const size_t *idx = h.idx[c];
+        const double *val = h.val[c];
+        for(int i = 0; i < h.N; i++)
+            w[idx[i]] += h.sqrt_gamma * val[i] * x[static_cast<size_t>(i) * stride];
+    }
+};
+
+/**
+ * Hashes input vector k of a compressed sparse matrix (vectors are columns
+ * for CSC arrays and rows for CSR arrays).
+ */
+template <typename T, typename IndexType>
+struct ppt_sparse_scatter_t {
+    const IndexType *indptr, *indices;
+    const T *values;
+
+    ppt_sparse_scatter_t(const IndexType *indptr, const IndexType *indices,
+        const T *values) : indptr(indptr), indices(indices), values(values) {}
+
+    void operator()(const ppt_hashes_t& h, int k, int c, T *w) const {
+        const size_t *idx = h.idx[c];
+        const double *val = h.val[c];
+        for(IndexType l = indptr[k]; l < indptr[k + 1]; l++) {
+            IndexType i = indices[l];
+            w[idx[i]] += h.sqrt_gamma * val[i] * values[l];
+        }
+    }
+};
+
+/**
+ * Blocked PPT kernel shared by the local specializations. The n input
+ * vectors are processed in panels of get_ppt_panel_width(): each count
+ * sketch hashes the whole panel into one buffer, the panel goes through a
+ * single batched r2c FFT, and the product of the spectra through a single
+ * batched c2r FFT. Threads work on different panels, each with its own
+ * cache-line aligned workspaces that are reused for all its panels.
+ *
+ * Output vector k is written to out + k * out_dist with stride out_stride.
+ */
+template <typename T, typename Scatter>
+void ppt_apply(const ppt_hashes_t& h, int n, const Scatter& scatter,
+    T *out, int out_stride, int out_dist) {
+
+    typedef typename fftw<T>::complex_t complex_t;
+    typedef typename fftw<T>::plan_t plan_t;
+    typedef fftw_plan_cache_t<plan_t> cache_t;
+
+    if (n <= 0)
+        return;
+
+    const int S = h.S;
+    const int Sc = S / 2 + 1;
+    const int nb = std::max(1, std::min(get_ppt_panel_width(), n));
+    const int npanels = (n + nb - 1) / nb;
+
+    // Workspaces are aligned, so the plans need not be FFTW_UNALIGNED.
+    typename cache_t::handle_type fhandle = cache_t::get(
+        fftw_plan_key_t(fftw_plan_key_t::R2C, S, 0, nb),
+        fftw_r2c_planner_t<T>(S, nb, true));
+    typename cache_t::handle_type bhandle = cache_t::get(
+        fftw_plan_key_t(fftw_plan_key_t::C2R, S, 0, nb),
+        fftw_r2c_planner_t<T>(S, nb, false));
+    plan_t fplan = fhandle.get();
+    plan_t bplan = bhandle.get();
+
+#   ifdef SKYLARK_HAVE_OPENMP
+#   pragma omp parallel if(npanels > 1)
+#   endif
+    {
+    // Spectra are kept as interleaved (re, im) pairs.
+    utility::aligned_buffer_t<T> W(static_cast<size_t>(S) * nb);
+    utility::aligned_buffer_t<T> FW(2 * static_cast<size_t>(Sc) * nb);
+    utility::aligned_buffer_t<T> P(2 * static_cast<size_t>(Sc) * nb);
+
+#   ifdef SKYLARK_HAVE_OPENMP
+#   pragma omp for schedule(dynamic)
+#   endif
+    for(int p = 0; p < npanels; p++) {
+        const int k0 = p * nb;
+        const int nk = std::min(nb, n - k0);
+        const size_t ns = 2 * static_cast<size_t>(Sc) * nk;
+
+        if (h.q == 0)
+            for(size_t j = 0; j < ns; j++)
+                P[j] = (j % 2 == 0) ? 1 : 0;
+
+        for(int c = 0; c < h.q; c++) {
+            // Columns past nk in the last panel stay zero.
+            std::fill(W.data(), W.data() + W.size(), T(0));
+            for(int k = 0; k < nk; k++) {
+                T *w = W.data() + static_cast<size_t>(k) * S;
+                scatter(h, k0 + k, c, w);
+                w[h.hash_idx[c]] += h.sqrt_c * h.hash_val[c];
+            }
+
+            T *F = c == 0 ? P.data() : FW.data();
+            fftw<T>::executeffun(fplan, W.data(),
+                reinterpret_cast<complex_t*>(F));
+
+            if (c > 0)
+                for(size_t j = 0; j < ns; j += 2) {
+                    T re = P[j] * FW[j] - P[j + 1] * FW[j + 1];
+                    T im = P[j] * FW[j + 1] + P[j + 1] * FW[j];
+                    P[j] = re;
+                    P[j + 1] = im;
+                }
+        }
+
+        // In FFTW, both fft and ifft are not scaled.
+        // That is norm(ifft(fft(x)) = norm(x) * #els(x).
+        const T scale = T(1) / S;
+        for(size_t j = 0; j < ns; j++)
+            P[j] *= scale;
+
+        fftw<T>::executebfun(bplan, reinterpret_cast<complex_t*>(P.data()),
+            W.data());
+
+        for(int k = 0; k < nk; k++) {
+            const T *w = W.data() + static_cast<size_t>(k) * S;
+            T *o = out + static_cast<size_t>(k0 + k) * out_dist;
+            for(int i = 0; i < S; i++)
+                o[static_cast<size_t>(i) * out_stride] = w[i];
+        }
+    }
+    }
+}
+
 }  /** namespace skylark::sketch::internal */
 
 /**
@@ -94,18 +284,16 @@ struct PPT_t <
     PPT_t(int N, int S, int q, double c, double gamma, base::context_t& context)
         : data_type (N, S, q, c, gamma, context)  {
 
-        build_internal();
     }
 
     PPT_t(int N, int S, const params_t& params, base::context_t& context)
         : data_type (N, S, params, context)  {
 
-        build_internal();
     }
 
     PPT_t(const boost::property_tree::ptree &pt)
         : data_type(pt) {
-        build_internal();
+
     }
 
     template <typename OtherInputMatrixType,
@@ -113,18 +301,11 @@ struct PPT_t <
     PPT_t(const PPT_t<OtherInputMatrixType, OtherOutputMatrixType>& other)
         : data_type(other) {
 
-        build_internal();
     }
 
     PPT_t(const data_type& other_data)
         : data_type(other_data) {
 
-        build_internal();
-    }
-
-    ~PPT_t() {
-        internal::fftw<value_type>::destroyfun(_fftw_fplan);
-        internal::fftw<value_type>::destroyfun(_fftw_bplan);
     }
 
     /**
@@ -136,57 +317,10 @@ struct PPT_t <
                 columnwise_tag dimension) const {
 
         // TODO verify sizes etc.
-        const int S = data_type::_S;
-        const int N = data_type::_N;
-
-#       ifdef SKYLARK_HAVE_OPENMP
-#       pragma omp parallel
-#       endif
-        {
-        matrix_type W(S, 1);
-        matrix_type SAv;
-        matrix_type Av;
-
-        std::complex<value_type> *FW = new std::complex<value_type>[S];
-        std::complex<value_type> *P = new std::complex<value_type>[S];
-
-#       ifdef SKYLARK_HAVE_OPENMP
-#       pragma omp for
-#       endif
-        for(int i = 0; i < A.Width(); i++) {
-            elem::LockedView(Av, A, 0, i, A.Height(), 1);
-
-            for(int j = 0; j < S; j++)
-                P[j] = 1.0;
-
-            typename std::list<_CWT_t>::const_iterator it;
-            int qc = 0;
-            for(it = _cwts.begin(); it != _cwts.end(); it++, qc++) {
-                const _CWT_t &C = *it;
-                C.apply(Av, W, columnwise_tag());
-                elem::Scal(std::sqrt(data_type::_gamma), W);
-                W.Update(data_type::_hash_idx[qc], 0,
-                    std::sqrt(data_type::_c) * data_type::_hash_val[qc]);
-                internal::fftw<value_type>::executeffun(_fftw_fplan, W.Buffer(),
-                    reinterpret_cast<_fftw_complex_t*>(FW));
-                for(int j = 0; j < S; j++)
-                    P[j] *= FW[j];
-            }
-
-            // In FFTW, both fft and ifft are not scaled.
-            // That is norm(ifft(fft(x)) = norm(x) * #els(x).
-            for(int j = 0; j < S; j++)
-                P[j] /= (value_type)S;
-
-            elem::View(SAv, sketch_of_A, 0, i, A.Height(), 1);
-            internal::fftw<value_type>::executebfun(_fftw_bplan,
-                reinterpret_cast<_fftw_complex_t*>(P), SAv.Buffer());
-        }
-
-        delete[] FW;
-        delete[] P;
-
-        }
+        internal::ppt_apply(data_type::hashes(), A.Width(),
+            internal::ppt_dense_scatter_t<value_type>(A.LockedBuffer(),
+                1, A.LDim()),
+            sketch_of_A.Buffer(), 1, sketch_of_A.LDim());
     }
 
     /**
@@ -196,98 +330,19 @@ struct PPT_t <
     void apply (const matrix_type& A,
                 output_matrix_type& sketch_of_A,
                 rowwise_tag dimension) const {
-        // TODO verify sizes etc.
-        const int S = data_type::_S;
-        const int N = data_type::_N;
-
-#       ifdef SKYLARK_HAVE_OPENMP
-#       pragma omp parallel
-#       endif
-        {
-
-        matrix_type W(S, 1);
-        matrix_type ASv, SATv(S, 1);
-
-        matrix_type Av, ATv;
-
-        std::complex<value_type> *FW = new std::complex<value_type>[S];
-        std::complex<value_type> *P = new std::complex<value_type>[S];
-
-#       ifdef SKYLARK_HAVE_OPENMP
-#       pragma omp for
-#       endif
-        for(int i = 0; i < A.Height(); i++) {
-            elem::LockedView(Av, A, i, 0, 1, A.Width());
-            elem::Transpose(Av, ATv);
-
-            for(int j = 0; j < S; j++)
-                P[j] = 1.0;
-
-            typename std::list<_CWT_t>::const_iterator it;
-            int qc = 0;
-            for(it = _cwts.begin(); it != _cwts.end(); it++, qc++) {
-                const _CWT_t &C = *it;
-                C.apply(ATv, W, columnwise_tag());
-                elem::Scal(std::sqrt(data_type::_gamma), W);
-                W.Update(data_type::_hash_idx[qc], 0,
-                    std::sqrt(data_type::_c) * data_type::_hash_val[qc]);
-                internal::fftw<value_type>::executeffun(_fftw_fplan, W.Buffer(),
-                    reinterpret_cast<_fftw_complex_t*>(FW));
-                for(int j = 0; j < S; j++)
-                    P[j] *= FW[j];
-            }
-
-            // In FFTW, both fft and ifft are not scaled.
-            // That is norm(ifft(fft(x)) = norm(x) * #els(x).
-            for(int j = 0; j < S; j++)
-                P[j] /= (value_type)S;
-
-            internal::fftw<value_type>::executebfun(_fftw_bplan,
-                reinterpret_cast<_fftw_complex_t*>(P), SATv.Buffer());
-            elem::View(ASv, sketch_of_A, i, 0, 1, sketch_of_A.Width());
-            elem::Transpose(SATv, ASv);
-        }
 
-        delete[] FW;
-        delete[] P;
-
-        }
+        // TODO verify sizes etc.
+        // Rows are read in place with stride LDim, no transpose needed.
+        internal::ppt_apply(data_type::hashes(), A.Height(),
+            internal::ppt_dense_scatter_t<value_type>(A.LockedBuffer(),
+                A.LDim(), 1),
+            sketch_of_A.Buffer(), sketch_of_A.LDim(), 1);
     }
 
     int get_N() const { return data_type::_N; } /**< Get input dimesion. */
     int get_S() const { return data_type::_S; } /**< Get output dimesion. */
 
     const sketch_transform_data_t* get_data() const { return this; }
-
-protected:
-
-    typedef CWT_t<matrix_type, output_matrix_type> _CWT_t;
-
-    typedef typename internal::fftw<value_type>::complex_t _fftw_complex_t;
-    typedef typename internal::fftw<value_type>::plan_t _fftw_plan_t;
-
-    _fftw_plan_t _fftw_fplan, _fftw_bplan;
-    std::list<_CWT_t> _cwts;
-
-    void build_internal() {
-        int S = data_type::_S;
-
-        for(typename std::list<CWT_data_t>::iterator it =
-                data_type::_cwts_data.begin();
-            it != data_type::_cwts_data.end(); it++)
-            _cwts.push_back(_CWT_t(*it));
-
-        double *dtmp = new double[S];
-        std::complex<double> *ctmp = new std::complex<double>[S];
-        _fftw_fplan = fftw_plan_dft_r2c_1d(S, dtmp,
-            reinterpret_cast<fftw_complex*>(ctmp),
-            FFTW_UNALIGNED | FFTW_ESTIMATE);
-        _fftw_bplan = fftw_plan_dft_c2r_1d(S,
-            reinterpret_cast<fftw_complex*>(ctmp), dtmp,
-            FFTW_UNALIGNED | FFTW_ESTIMATE);
-        delete[] dtmp;
-        delete[] ctmp;
-    }
 };
 
 /**
@@ -311,19 +366,16 @@ struct PPT_t <
     PPT_t(int N, int S, int q, double c, double gamma, base::context_t& context)
         : data_type (N, S, q, c, gamma, context)  {
 
-        build_internal();
     }
 
     PPT_t(int N, int S, const params_t& params, base::context_t& context)
         : data_type (N, S, params, context)  {
 
-        build_internal();
     }
 
     PPT_t(const boost::property_tree::ptree &pt)
         : data_type(pt) {
 
-        build_internal();
     }
 
     template <typename OtherInputMatrixType,
@@ -331,19 +383,13 @@ struct PPT_t <
     PPT_t(const PPT_t<OtherInputMatrixType, OtherOutputMatrixType>& other)
         : data_type(other) {
 
-        build_internal();
     }
 
     PPT_t(const data_type& other_data)
         : data_type(other_data) {
 
-        build_internal();
     }
 
-    ~PPT_t() {
-        internal::fftw<value_type>::destroyfun(_fftw_fplan);
-        internal::fftw<value_type>::destroyfun(_fftw_bplan);
-    }
     /**
      * Apply columnwise the sketching transform that is described by the
      * the transform with output sketch_of_A.
@@ -353,61 +399,11 @@ struct PPT_t <
                 columnwise_tag dimension) const {
 
         // TODO verify sizes etc.
-        // TODO I am not sure this implementation is the most efficient
-        //      for sparse matrices. Maybe you want to do the CWT right on
-        //      start?
-
-        const int S = data_type::_S;
-        const int N = data_type::_N;
-
-#       ifdef SKYLARK_HAVE_OPENMP
-#       pragma omp parallel
-#       endif
-        {
-
-        output_matrix_type W(S, 1);
-        output_matrix_type SAv;
-
-        std::complex<value_type> *FW = new std::complex<value_type>[S];
-        std::complex<value_type> *P = new std::complex<value_type>[S];
-
-#       ifdef SKYLARK_HAVE_OPENMP
-#       pragma omp for
-#       endif
-        for(int i = 0; i < base::Width(A); i++) {
-            const matrix_type Av = base::ColumnView(A, i, 1);
-
-            for(int j = 0; j < S; j++)
-                P[j] = 1.0;
-
-            typename std::list<_CWT_t>::const_iterator it;
-            int qc = 0;
-            for(it = _cwts.begin(); it != _cwts.end(); it++, qc++) {
-                const _CWT_t &C = *it;
-                C.apply(Av, W, columnwise_tag());
-                elem::Scal(std::sqrt(data_type::_gamma), W);
-                W.Update(data_type::_hash_idx[qc], 0,
-                    std::sqrt(data_type::_c) * data_type::_hash_val[qc]);
-                internal::fftw<value_type>::executeffun(_fftw_fplan, W.Buffer(),
-                    reinterpret_cast<_fftw_complex_t*>(FW));
-                for(int j = 0; j < S; j++)
-                    P[j] *= FW[j];
-            }
-
-            // In FFTW, both fft and ifft are not scaled.
-            // That is norm(ifft(fft(x)) = norm(x) * #els(x).
-            for(int j = 0; j < S; j++)
-                P[j] /= (value_type)S;
-
-            elem::View(SAv, sketch_of_A, 0, i, base::Height(A), 1);
-            internal::fftw<value_type>::executebfun(_fftw_bplan,
-                reinterpret_cast<_fftw_complex_t*>(P), SAv.Buffer());
-        }
-
-        delete[] FW;
-        delete[] P;
-
-        }
+        typedef typename matrix_type::index_type index_type;
+        internal::ppt_apply(data_type::hashes(), base::Width(A),
+            internal::ppt_sparse_scatter_t<value_type, index_type>(
+                A.indptr(), A.indices(), A.locked_values()),
+            sketch_of_A.Buffer(), 1, sketch_of_A.LDim());
     }
 
     /**
@@ -417,48 +413,21 @@ struct PPT_t <
     void apply (const matrix_type& A,
                 output_matrix_type& sketch_of_A,
                 rowwise_tag dimension) const {
-        // TODO perhaps not the best way to do this...
-        matrix_type AT;
-        base::Transpose(A, AT);
-        output_matrix_type SAT(sketch_of_A.Width(), sketch_of_A.Height());
-        apply(AT, SAT, columnwise_tag());
-        elem::Transpose(SAT, sketch_of_A);
+
+        // The CSR view gives row access; the sketch is written directly
+        // into the rows of sketch_of_A.
+        typedef typename matrix_type::index_type index_type;
+        base::sparse_csr_view_t<value_type> AR(A);
+        internal::ppt_apply(data_type::hashes(), AR.height(),
+            internal::ppt_sparse_scatter_t<value_type, index_type>(
+                AR.indptr(), AR.indices(), AR.locked_values()),
+            sketch_of_A.Buffer(), sketch_of_A.LDim(), 1);
     }
 
     int get_N() const { return data_type::_N; } /**< Get input dimesion. */
     int get_S() const { return data_type::_S; } /**< Get output dimesion. */
 
     const sketch_transform_data_t* get_data() const { return this; }
-
-protected:
-
-    typedef CWT_t<matrix_type, output_matrix_type> _CWT_t;
-
-    typedef typename internal::fftw<value_type>::complex_t _fftw_complex_t;
-    typedef typename internal::fftw<value_type>::plan_t _fftw_plan_t;
-
-    _fftw_plan_t _fftw_fplan, _fftw_bplan;
-    std::list<_CWT_t> _cwts;
-
-    void build_internal() {
-        int S = data_type::_S;
-
-        for(typename std::list<CWT_data_t>::iterator it =
-                data_type::_cwts_data.begin();
-            it != data_type::_cwts_data.end(); it++)
-            _cwts.push_back(_CWT_t(*it));
-
-        double *dtmp = new double[S];
-        std::complex<double> *ctmp = new std::complex<double>[S];
-        _fftw_fplan = fftw_plan_dft_r2c_1d(S, dtmp,
-            reinterpret_cast<fftw_complex*>(ctmp),
-            FFTW_UNALIGNED | FFTW_ESTIMATE);
-        _fftw_bplan = fftw_plan_dft_c2r_1d(S,
-            reinterpret_cast<fftw_complex*>(ctmp), dtmp,
-            FFTW_UNALIGNED | FFTW_ESTIMATE);
-        delete[] dtmp;
-        delete[] ctmp;
-    }
 };
 
 /**
@@ -5,12 +5,32 @@
 #error "Include top-level sketch.hpp instead of including individuals headers"
 #endif
 
+#include <cmath>
+#include <list>
 #include <vector>
 
 #include "../utility/distributions.hpp"
 
 namespace skylark { namespace sketch {
 
+namespace internal {
+
+/**
+ * Flat view of the hashing data of a PPT, for the apply kernels: bucket and
+ * sign of every input coordinate for each of the q count sketches, and
+ * bucket and sign of the homogeneous coordinate.
+ */
+struct ppt_hashes_t {
+    int N, S, q;
+    double sqrt_gamma, sqrt_c;
+    std::vector<const size_t *> idx;
+    std::vector<const double *> val;
+    const size_t *hash_idx;
+    const double *hash_val;
+};
+
+} // namespace internal
+
 /**
  * Pham-Pagh Transform aka TensorSketch (data).
  *
@@ -104,6 +124,23 @@ protected:
         return ctx;
     }
 
+    internal::ppt_hashes_t hashes() const {
+        internal::ppt_hashes_t h;
+        h.N = base_t::_N;
+        h.S = base_t::_S;
+        h.q = _q;
+        h.sqrt_gamma = std::sqrt(_gamma);
+        h.sqrt_c = std::sqrt(_c);
+        for(std::list<CWT_data_t>::const_iterator it = _cwts_data.begin();
+            it != _cwts_data.end(); it++) {
+            h.idx.push_back(it->get_row_idx().data());
+            h.val.push_back(it->get_row_value().data());
+        }
+        h.hash_idx = _hash_idx.data();
+        h.hash_val = _hash_val.data();
+        return h;
+    }
+
     const int _q;         /**< Polynomial degree */
     const double _c;
     const double _gamma;
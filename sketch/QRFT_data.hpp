@@ -84,8 +84,10 @@ protected:
                 _sequence, _skip, ctx));
 
         const double pi = boost::math::constants::pi<double>();
+        if (base_t::_S > 0)
+            _sequence.coordinates(_skip, base_t::_S, base_t::_N, &_shifts[0]);
         for(int i = 0; i < base_t::_S; i++)
-            _shifts[i] =  2 * pi * _sequence.coordinate(_skip + i, base_t::_N);
+            _shifts[i] *= 2 * pi;
 
         return ctx;
     }
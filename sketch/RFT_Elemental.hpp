@@ -1,6 +1,8 @@
 #ifndef SKYLARK_RFT_ELEMENTAL_HPP
 #define SKYLARK_RFT_ELEMENTAL_HPP
 
+#include "trig_kernels.hpp"
+
 namespace skylark {
 namespace sketch {
 
@@ -88,33 +90,9 @@ private:
         underlying_t underlying(*data_type::_underlying_data);
         underlying.apply(A, sketch_of_A, tag);
 
-#       if SKYLARK_HAVE_OPENMP
-#       pragma omp parallel for collapse(2)
-#       endif
-        for(int j = 0; j < base::Width(A); j++)
-            for(int i = 0; i < data_type::_S; i++) {
-                value_type x = sketch_of_A.Get(i, j);
-                x *= data_type::_scales[i];
-                x += data_type::_shifts[i];
-
-#               ifndef SKYLARK_INEXACT_COSINE
-                x = std::cos(x);
-#               else
-                // x = std::cos(x) is slow
-                // Instead use low-accuracy approximation
-                if (x < -3.14159265) x += 6.28318531;
-                else if (x >  3.14159265) x -= 6.28318531;
-                x += 1.57079632;
-                if (x >  3.14159265)
-                    x -= 6.28318531;
-                x = (x < 0) ?
-                    1.27323954 * x + 0.405284735 * x * x :
-                    1.27323954 * x - 0.405284735 * x * x;
-#               endif
-
-                x = data_type::_outscale * x;
-                sketch_of_A.Set(i, j, x);
-            }
+        internal::scaled_cosine(sketch_of_A.Buffer(), data_type::_S,
+            base::Width(A), sketch_of_A.LDim(), &data_type::_scales[0],
+            &data_type::_shifts[0], 1, true, data_type::_outscale);
     }
 
     /**
@@ -129,33 +107,9 @@ private:
         underlying_t underlying(*data_type::_underlying_data);
         underlying.apply(A, sketch_of_A, tag);
 
-#       if SKYLARK_HAVE_OPENMP
-#       pragma omp parallel for collapse(2)
-#       endif
-        for(int j = 0; j < data_type::_S; j++)
-            for(int i = 0; i < base::Height(A); i++) {
-                value_type x = sketch_of_A.Get(i, j);
-                x *= data_type::_scales[j];
-                x += data_type::_shifts[j];
-
-#               ifndef SKYLARK_INEXACT_COSINE
-                x = std::cos(x);
-#               else
-                // x = std::cos(x) is slow
-                // Instead use low-accuracy approximation
-                if (x < -3.14159265) x += 6.28318531;
-                else if (x >  3.14159265) x -= 6.28318531;
-                x += 1.57079632;
-                if (x >  3.14159265)
-                    x -= 6.28318531;
-                x = (x < 0) ?
-                    1.27323954 * x + 0.405284735 * x * x :
-                    1.27323954 * x - 0.405284735 * x * x;
-#               endif
-
-                x = data_type::_outscale * x;
-                sketch_of_A.Set(i, j, x);
-            }
+        internal::scaled_cosine(sketch_of_A.Buffer(), base::Height(A),
+            data_type::_S, sketch_of_A.LDim(), &data_type::_scales[0],
+            &data_type::_shifts[0], 1, false, data_type::_outscale);
     }
 };
 
@@ -252,33 +206,10 @@ private:
         size_t col_shift = sketch_of_A.ColShift();
         size_t col_stride = sketch_of_A.ColStride();
 
-#       if SKYLARK_HAVE_OPENMP
-#       pragma omp parallel for collapse(2)
-#       endif
-        for(size_t j = 0; j < base::Width(SAl); j++)
-            for(size_t i = 0; i < base::Height(SAl); i++) {
-                value_type x = SAl.Get(i, j);
-                x *= data_type::_scales[col_shift + i * col_stride];
-                x += data_type::_shifts[col_shift + i * col_stride];
-
-#               ifndef SKYLARK_INEXACT_COSINE
-                x = std::cos(x);
-#               else
-                // x = std::cos(x) is slow
-                // Instead use low-accuracy approximation
-                if (x < -3.14159265) x += 6.28318531;
-                else if (x >  3.14159265) x -= 6.28318531;
-                x += 1.57079632;
-                if (x >  3.14159265)
-                    x -= 6.28318531;
-                x = (x < 0) ?
-                    1.27323954 * x + 0.405284735 * x * x :
-                    1.27323954 * x - 0.405284735 * x * x;
-#               endif
-
-                x = data_type::_outscale * x;
-                SAl.Set(i, j, x);
-            }
+        internal::scaled_cosine(SAl.Buffer(), base::Height(SAl),
+            base::Width(SAl), SAl.LDim(), data_type::_scales.data() + col_shift,
+            data_type::_shifts.data() + col_shift, col_stride, true,
+            data_type::_outscale);
     }
 
     /**
@@ -297,33 +228,10 @@ private:
         size_t row_shift = sketch_of_A.RowShift();
         size_t row_stride = sketch_of_A.RowStride();
 
-#       if SKYLARK_HAVE_OPENMP
-#       pragma omp parallel for collapse(2)
-#       endif
-        for(size_t j = 0; j < base::Width(SAl); j++)
-            for(size_t i = 0; i < base::Height(SAl); i++) {
-                value_type x = SAl.Get(i, j);
-                x *= data_type::_scales[row_shift + j * row_stride];
-                x += data_type::_shifts[row_shift + j * row_stride];
-
-#               ifndef SKYLARK_INEXACT_COSINE
-                x = std::cos(x);
-#               else
-                // x = std::cos(x) is slow
-                // Instead use low-accuracy approximation
-                if (x < -3.14159265) x += 6.28318531;
-                else if (x >  3.14159265) x -= 6.28318531;
-                x += 1.57079632;
-                if (x >  3.14159265)
-                    x -= 6.28318531;
-                x = (x < 0) ?
-                    1.27323954 * x + 0.405284735 * x * x :
-                    1.27323954 * x - 0.405284735 * x * x;
-#               endif
-
-                x = data_type::_outscale * x;
-                SAl.Set(i, j, x);
-            }
+        internal::scaled_cosine(SAl.Buffer(), base::Height(SAl),
+            base::Width(SAl), SAl.LDim(), data_type::_scales.data() + row_shift,
+            data_type::_shifts.data() + row_shift, row_stride, false,
+            data_type::_outscale);
     }
 };
 
@@ -1,4 +1,5 @@
 #include "boost/property_tree/ptree.hpp"
+#include "boost/scoped_ptr.hpp"
 
 #include "sketchc.hpp"
 #include "../../base/exception.hpp"
@@ -297,7 +298,6 @@ SKYLARK_EXTERN_API char *sl_supported_sketch_transforms() {
         SKDEF(MMT, DistSparseMatrix, DistMatrix_VR_STAR)
 #endif
 
-#if SKYLARK_HAVE_FFTW || SKYLARK_HAVE_SPIRALWHT
         SKDEF(FJLT, DistMatrix_VR_STAR, Matrix)
         SKDEF(FJLT, DistMatrix_VC_STAR, Matrix)
         SKDEF(FJLT, DistMatrix_STAR_VR, Matrix)
@@ -323,7 +323,6 @@ SKYLARK_EXTERN_API char *sl_supported_sketch_transforms() {
         SKDEF(FastMaternRFT, DistMatrix_VR_STAR, DistMatrix_VR_STAR)
         SKDEF(FastMaternRFT, DistMatrix_STAR_VC, DistMatrix_STAR_VC)
         SKDEF(FastMaternRFT, DistMatrix_STAR_VR, DistMatrix_STAR_VR)
-#endif
 
 #if SKYLARK_HAVE_FFTW
         SKDEF(PPT, Matrix, Matrix)
@@ -617,29 +616,51 @@ SKYLARK_EXTERN_API
     return 0;
 }
 
-SKYLARK_EXTERN_API int
-    sl_apply_sketch_transform(sketchc::sketch_transform_t *S_,
-                              char *input_, void *A_,
-                              char *output_, void *SA_, int dim) {
+} // extern "C"
+
+/**
+ * A transform constructed for a given input and output type, ready to be
+ * applied. This is what a bound handle owns.
+ */
+template<typename TransformType, typename InputType, typename OutputType>
+struct bound_transform_impl_t : public sketchc::bound_transform_t {
+
+    template<typename DataType>
+    bound_transform_impl_t(sketchc::transform_type_t type,
+        sketchc::matrix_type_t input, sketchc::matrix_type_t output,
+        DataType& data) :
+        sketchc::bound_transform_t(type, input, output), S(data) {
+
+    }
+
+    void apply(void *A_, void *SA_, int dim) {
+        InputType &A = * static_cast<InputType*>(A_);
+        OutputType &SA = * static_cast<OutputType*>(SA_);
+
+        if (dim == SL_COLUMNWISE)
+            S.apply(A, SA, sketch::columnwise_tag());
+        if (dim == SL_ROWWISE)
+            S.apply(A, SA, sketch::rowwise_tag());
+    }
+
+private:
+    TransformType S;
+};
+
+/**
+ * Constructs the transform S for the given input and output types.
+ * Returns NULL if the combination is not supported.
+ */
+static sketchc::bound_transform_t *bind_transform(
+    sketchc::sketch_transform_t *S_,
+    sketchc::matrix_type_t input, sketchc::matrix_type_t output) {
 
     sketchc::transform_type_t type = S_->type;
-    sketchc::matrix_type_t input   = str2matrix_type(input_);
-    sketchc::matrix_type_t output  = str2matrix_type(output_);
 
 # define AUTO_APPLY_DISPATCH(T, I, O, C, IT, OT, CD)                     \
-    if (type == T && input == I && output == O) {                        \
-        C<IT, OT> S(*static_cast<CD*>(S_->transform_obj));               \
-        IT &A = * static_cast<IT*>(A_);                                  \
-        OT &SA = * static_cast<OT*>(SA_);                                \
-                                                                         \
-        SKYLARK_BEGIN_TRY()                                              \
-            if (dim == SL_COLUMNWISE)                                    \
-                S.apply(A, SA, sketch::columnwise_tag());                \
-            if (dim == SL_ROWWISE)                                       \
-            S.apply(A, SA, sketch::rowwise_tag());                       \
-        SKYLARK_END_TRY()                                                \
-        SKYLARK_CATCH_AND_RETURN_ERROR_CODE();                           \
-    }
+    if (type == T && input == I && output == O)                          \
+        return new bound_transform_impl_t< C<IT, OT>, IT, OT >(          \
+            type, input, output, *static_cast<CD*>(S_->transform_obj));
 
     AUTO_APPLY_DISPATCH(sketchc::JLT,
         sketchc::MATRIX, sketchc::MATRIX,
@@ -1294,20 +1315,12 @@ SKYLARK_EXTERN_API int
 
 
 # define AUTO_APPLY_DISPATCH_QUASI(T, I, O, C, IT, OT, CD)               \
-    if (type == T && input == I && output == O) {                        \
-        C<IT, OT, skyutil::leaped_halton_sequence_t>            \
-            S(*static_cast<CD<skyutil::leaped_halton_sequence_t>*>(S_->transform_obj)); \
-        IT &A = * static_cast<IT*>(A_);                                  \
-        OT &SA = * static_cast<OT*>(SA_);                                \
-                                                                         \
-        SKYLARK_BEGIN_TRY()                                              \
-            if (dim == SL_COLUMNWISE)                                    \
-                S.apply(A, SA, sketch::columnwise_tag());                \
-            if (dim == SL_ROWWISE)                                       \
-            S.apply(A, SA, sketch::rowwise_tag());                       \
-        SKYLARK_END_TRY()                                                \
-        SKYLARK_CATCH_AND_RETURN_ERROR_CODE();                           \
-    }
+    if (type == T && input == I && output == O)                          \
+        return new bound_transform_impl_t<                               \
+            C<IT, OT, skyutil::leaped_halton_sequence_t>, IT, OT >(      \
+            type, input, output,                                         \
+            *static_cast<CD<skyutil::leaped_halton_sequence_t>*>(        \
+                S_->transform_obj));
 
    AUTO_APPLY_DISPATCH_QUASI(sketchc::GaussianQRFT,
         sketchc::MATRIX, sketchc::MATRIX,
@@ -1649,8 +1662,6 @@ SKYLARK_EXTERN_API int
         sketch::ExpSemigroupQRLT_t, DistMatrix_STAR_VC, DistMatrix_STAR_VC,
         sketch::ExpSemigroupQRLT_data_t);
 
-#if SKYLARK_HAVE_FFTW || SKYLARK_HAVE_SPIRALWHT
-
     AUTO_APPLY_DISPATCH(sketchc::FJLT,
         sketchc::DIST_MATRIX_VR_STAR, sketchc::MATRIX,
         sketch::FJLT_t, DistMatrix_VR_STAR, Matrix,
@@ -1771,8 +1782,6 @@ SKYLARK_EXTERN_API int
         sketch::FastMaternRFT_t, DistMatrix_STAR_VR, DistMatrix_STAR_VR,
         sketch::FastMaternRFT_data_t);
 
-#endif
-
 #if SKYLARK_HAVE_FFTW
 
     AUTO_APPLY_DISPATCH(sketchc::PPT,
@@ -1886,6 +1895,65 @@ SKYLARK_EXTERN_API int
 
 #endif
 
+    return NULL;
+}
+
+extern "C" {
+
+SKYLARK_EXTERN_API int
+    sl_apply_sketch_transform(sketchc::sketch_transform_t *S_,
+                              char *input_, void *A_,
+                              char *output_, void *SA_, int dim) {
+
+    sketchc::matrix_type_t input   = str2matrix_type(input_);
+    sketchc::matrix_type_t output  = str2matrix_type(output_);
+
+    SKYLARK_BEGIN_TRY()
+        boost::scoped_ptr<sketchc::bound_transform_t>
+            B(bind_transform(S_, input, output));
+        if (B)
+            B->apply(A_, SA_, dim);
+    SKYLARK_END_TRY()
+    SKYLARK_CATCH_AND_RETURN_ERROR_CODE();
+
+    return 0;
+}
+
+SKYLARK_EXTERN_API int sl_bind_sketch_transform(
+    sketchc::sketch_transform_t *S_, char *input_, char *output_,
+    sketchc::bound_transform_t **B) {
+
+    sketchc::matrix_type_t input   = str2matrix_type(input_);
+    sketchc::matrix_type_t output  = str2matrix_type(output_);
+
+    SKYLARK_BEGIN_TRY()
+        *B = bind_transform(S_, input, output);
+        if (*B == NULL)
+            SKYLARK_THROW_EXCEPTION (
+                base::sketch_exception()
+                    << base::error_msg(
+                        "Unsupported transform-input-output combination") );
+    SKYLARK_END_TRY()
+    SKYLARK_CATCH_AND_RETURN_ERROR_CODE();
+
+    return 0;
+}
+
+SKYLARK_EXTERN_API int sl_apply_bound_sketch_transform(
+    sketchc::bound_transform_t *B, void *A_, void *SA_, int dim) {
+
+    SKYLARK_BEGIN_TRY()
+        B->apply(A_, SA_, dim);
+    SKYLARK_END_TRY()
+    SKYLARK_CATCH_AND_RETURN_ERROR_CODE();
+
+    return 0;
+}
+
+SKYLARK_EXTERN_API int sl_free_bound_sketch_transform(
+    sketchc::bound_transform_t *B) {
+
+    delete B;
     return 0;
 }
 
@@ -1912,6 +1980,15 @@ SKYLARK_EXTERN_API int sl_wrap_raw_sp_matrix(int *indptr, int *ind, double *data
     return 0;
 }
 
+SKYLARK_EXTERN_API int sl_wrap_raw_sp_matrix64(int64_t *indptr, int64_t *ind,
+    double *data, int64_t nnz, int n_rows, int n_cols, void **A)
+{
+    SparseMatrix *tmp = new SparseMatrix();
+    tmp->attach(indptr, ind, data, nnz, n_rows, n_cols);
+    *A = tmp;
+    return 0;
+}
+
 SKYLARK_EXTERN_API int sl_free_raw_sp_matrix_wrap(void *A_) {
     delete static_cast<SparseMatrix *>(A_);
     return 0;
@@ -1939,4 +2016,38 @@ SKYLARK_EXTERN_API int sl_raw_sp_matrix_data(void *A_, int32_t *indptr,
     return 0;
 }
 
+SKYLARK_EXTERN_API int sl_raw_sp_matrix_index_size(int *size) {
+    *size = sizeof(SparseMatrix::index_type);
+    return 0;
+}
+
+SKYLARK_EXTERN_API int sl_raw_sp_matrix_release(void *A_, void **indptr,
+        void **indices, double **values, int64_t *nnz) {
+    SparseMatrix *A = static_cast<SparseMatrix *>(A_);
+    const SparseMatrix::index_type *p, *i;
+    double *v;
+
+    if (A->release(&p, &i, &v)) {
+        *indptr = const_cast<SparseMatrix::index_type *>(p);
+        *indices = const_cast<SparseMatrix::index_type *>(i);
+        *values = v;
+    } else {
+        *indptr = NULL;
+        *indices = NULL;
+        *values = NULL;
+    }
+    *nnz = A->nonzeros();
+    return 0;
+}
+
+SKYLARK_EXTERN_API int sl_free_raw_sp_matrix_index_buffer(void *buf) {
+    delete[] static_cast<SparseMatrix::index_type *>(buf);
+    return 0;
+}
+
+SKYLARK_EXTERN_API int sl_free_raw_sp_matrix_value_buffer(double *buf) {
+    delete[] buf;
+    return 0;
+}
+
 } // extern "C"
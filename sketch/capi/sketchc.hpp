@@ -62,6 +62,25 @@ struct sketch_transform_t {
         : type(type), transform_obj(transform_obj) {}
 };
 
+/**
+ * A sketch transform bound to an input and output matrix type: the transform
+ * object is constructed once (including FFT plans and the like) and then
+ * applied any number of times. It holds its own copy of the transform data.
+ */
+struct bound_transform_t {
+    const transform_type_t type;
+    const matrix_type_t input;
+    const matrix_type_t output;
+
+    bound_transform_t(transform_type_t type,
+        matrix_type_t input, matrix_type_t output)
+        : type(type), input(input), output(output) {}
+
+    virtual ~bound_transform_t() {}
+
+    virtual void apply(void *A, void *SA, int dim) = 0;
+};
+
 } // namespace c
 } // namespace sketch
 } // namespace skylark
@@ -158,6 +177,34 @@ SKYLARK_EXTERN_API int sl_apply_sketch_transform(
         char *input_type, void *A,
         char *output_type, void *SA, int dim);
 
+/** Bind the sketch transformation to an input and output matrix type.
+ *  Repeated applies through the handle avoid resolving the types and
+ *  constructing the transform on every call.
+ *  @param S sketch transform
+ *  @param input_type input matrix type
+ *  @param output_type output matrix type
+ *  @param B the bound transform
+ */
+SKYLARK_EXTERN_API int sl_bind_sketch_transform(
+        sketchc::sketch_transform_t *S,
+        char *input_type, char *output_type,
+        sketchc::bound_transform_t **B);
+
+/** Apply a bound sketch transformation to a matrix.
+ *  @param B bound sketch transform
+ *  @param A input matrix (of the input type B was bound to)
+ *  @param SA sketched matrix (of the output type B was bound to)
+ *  @param dim dimension on which to sketch (SL_COLUMNWISE/ROWWISE)
+ */
+SKYLARK_EXTERN_API int sl_apply_bound_sketch_transform(
+        sketchc::bound_transform_t *B, void *A, void *SA, int dim);
+
+/** Free resources hold by a bound sketch transformation.
+ *  @param B bound sketch transform
+ */
+SKYLARK_EXTERN_API int sl_free_bound_sketch_transform(
+        sketchc::bound_transform_t *B);
+
 // Helper functions to allow wrapping of object
 
 SKYLARK_EXTERN_API int sl_wrap_raw_matrix(double *data, int m, int n, void **A);
@@ -167,6 +214,12 @@ SKYLARK_EXTERN_API int sl_free_raw_matrix_wrap(void *A_);
 SKYLARK_EXTERN_API int sl_wrap_raw_sp_matrix(int *indptr, int *ind,
     double *data, int nnz, int n_rows, int n_cols, void **A);
 
+/** Same as sl_wrap_raw_sp_matrix, for 64-bit indices (as used by scipy for
+ *  large matrices). Indices are converted if the library uses 32-bit ones.
+ */
+SKYLARK_EXTERN_API int sl_wrap_raw_sp_matrix64(int64_t *indptr, int64_t *ind,
+    double *data, int64_t nnz, int n_rows, int n_cols, void **A);
+
 SKYLARK_EXTERN_API int sl_free_raw_sp_matrix_wrap(void *A_);
 
 SKYLARK_EXTERN_API int sl_raw_sp_matrix_struct_updated(void *A_,
@@ -179,6 +232,28 @@ SKYLARK_EXTERN_API int sl_raw_sp_matrix_nnz(void *A_, int *nnz);
 SKYLARK_EXTERN_API int sl_raw_sp_matrix_data(void *A_, int32_t *indptr,
         int32_t *indices, double *values);
 
+/** Size in bytes of the index type of sparse matrices (4 or 8).
+ */
+SKYLARK_EXTERN_API int sl_raw_sp_matrix_index_size(int *size);
+
+/** Hand the buffers of a wrapped sparse matrix over to the caller, without
+ *  copying them. The buffers are set to NULL if the matrix does not own them
+ *  (e.g. they are still the ones it was wrapped around).
+ *  Index buffers must be freed with sl_free_raw_sp_matrix_index_buffer and
+ *  values with sl_free_raw_sp_matrix_value_buffer.
+ *  @param A_ wrapped sparse matrix
+ *  @param indptr column pointers (width + 1 entries of the index type)
+ *  @param indices row indices (nnz entries of the index type)
+ *  @param values values (nnz entries)
+ *  @param nnz number of non-zeros
+ */
+SKYLARK_EXTERN_API int sl_raw_sp_matrix_release(void *A_, void **indptr,
+        void **indices, double **values, int64_t *nnz);
+
+SKYLARK_EXTERN_API int sl_free_raw_sp_matrix_index_buffer(void *buf);
+
+SKYLARK_EXTERN_API int sl_free_raw_sp_matrix_value_buffer(double *buf);
+
 } // extern "C"
 
 #endif // SKYLARK_SKETCHC_HPP
@@ -76,40 +76,221 @@ struct dense_transform_t <
 
 private:
 
-    // TODO: Block-by-block mode
+    /**
+     * Width of the panels of the random matrix that are realized at once.
+     * The user set blocksize takes precedence; otherwise the panel is
+     * bounded by max_panel_entries.
+     */
+    int panel_width() const {
+        int N = data_type::_N;
+        int S = data_type::_S;
+        int b = get_blocksize();
+        if (b == 0) {
+            size_t max_entries = get_max_panel_entries();
+            if (max_entries == 0 || S == 0)
+                return N;
+            b = static_cast<int>(std::min(static_cast<size_t>(N),
+                    std::max(static_cast<size_t>(1), max_entries / S)));
+        }
+        return std::min(b, N);
+    }
+
     void apply_impl_local (const matrix_type& A,
                           output_matrix_type& sketch_of_A,
                           skylark::sketch::rowwise_tag tag) const {
 
+        int N = data_type::_N;
+        int b = panel_width();
+
         output_matrix_type R;
-        data_type::realize_matrix_view(R);
 
-        base::Gemm (elem::NORMAL,
-                    elem::TRANSPOSE,
-                    value_type(1),
-                    A,
-                    R,
-                    value_type(0),
-                    sketch_of_A);
+        if (b >= N) {
+            data_type::realize_matrix_view(R);
+
+            base::Gemm (elem::NORMAL,
+                        elem::TRANSPOSE,
+                        value_type(1),
+                        A,
+                        R,
+                        value_type(0),
+                        sketch_of_A);
+            return;
+        }
+
+        // Block-by-block mode: stream column panels of R and accumulate.
+        elem::Zero(sketch_of_A);
+        for(int offset = 0; offset < N; offset += b) {
+            int width = std::min(b, N - offset);
+            data_type::realize_matrix_view(R, 0, offset,
+                data_type::_S, width);
+            panel_gemm(A, R, offset, sketch_of_A, tag);
+        }
     }
 
 
-    // TODO: Block-by-block mode
     void apply_impl_local (const matrix_type& A,
                           output_matrix_type& sketch_of_A,
                           skylark::sketch::columnwise_tag tag) const {
 
+        int N = data_type::_N;
+        int b = panel_width();
+
         output_matrix_type R;
-        data_type::realize_matrix_view(R);
 
+        if (b >= N) {
+            data_type::realize_matrix_view(R);
+
+            base::Gemm (elem::NORMAL,
+                        elem::NORMAL,
+                        value_type(1),
+                        R,
+                        A,
+                        value_type(0),
+                        sketch_of_A);
+            return;
+        }
+
+        // Block-by-block mode: stream column panels of R and accumulate.
+        // A panel multiplies a range of rows of A; in a sparse A they are
+        // found by binary search, so the rows have to be sorted.
+        base::sparse_matrix_t<value_type> sorted;
+        const matrix_type& As = panel_input(A, sorted);
+        elem::Zero(sketch_of_A);
+        for(int offset = 0; offset < N; offset += b) {
+            int width = std::min(b, N - offset);
+            data_type::realize_matrix_view(R, 0, offset,
+                data_type::_S, width);
+            panel_gemm(As, R, offset, sketch_of_A, tag);
+        }
+    }
+
+    static const elem::Matrix<value_type>& panel_input(
+        const elem::Matrix<value_type>& A,
+        base::sparse_matrix_t<value_type>& sorted) {
+        return A;
+    }
+
+    /** A itself if its rows are sorted, otherwise a sorted copy. */
+    static const base::sparse_matrix_t<value_type>& panel_input(
+        const base::sparse_matrix_t<value_type>& A,
+        base::sparse_matrix_t<value_type>& sorted) {
+        if (A.sorted())
+            return A;
+        sorted.attach(A.indptr(), A.indices(),
+            const_cast<value_type *>(A.locked_values()), A.nonzeros(),
+            A.height(), A.width());
+        sorted.sort_indices();
+        return sorted;
+    }
+
+    /**
+     * Panel updates: sketch_of_A += contribution of columns
+     * [offset, offset + R.Width()) of the random matrix.
+     */
+    void panel_gemm(const elem::Matrix<value_type>& A,
+                    const output_matrix_type& R, int offset,
+                    output_matrix_type& sketch_of_A,
+                    skylark::sketch::rowwise_tag tag) const {
+
+        elem::Matrix<value_type> A1;
+        elem::LockedView(A1, A, 0, offset, A.Height(), R.Width());
+        base::Gemm (elem::NORMAL,
+                    elem::TRANSPOSE,
+                    value_type(1),
+                    A1,
+                    R,
+                    value_type(1),
+                    sketch_of_A);
+    }
+
+    void panel_gemm(const elem::Matrix<value_type>& A,
+                    const output_matrix_type& R, int offset,
+                    output_matrix_type& sketch_of_A,
+                    skylark::sketch::columnwise_tag tag) const {
+
+        elem::Matrix<value_type> A1;
+        elem::LockedView(A1, A, offset, 0, R.Width(), A.Width());
         base::Gemm (elem::NORMAL,
                     elem::NORMAL,
                     value_type(1),
                     R,
-                    A,
-                    value_type(0),
+                    A1,
+                    value_type(1),
                     sketch_of_A);
     }
+
+    void panel_gemm(const base::sparse_matrix_t<value_type>& A,
+                    const output_matrix_type& R, int offset,
+                    output_matrix_type& sketch_of_A,
+                    skylark::sketch::rowwise_tag tag) const {
+
+        typedef typename base::sparse_matrix_t<value_type>::index_type
+            sp_index_type;
+        const sp_index_type* indptr = A.indptr();
+        const sp_index_type* indices = A.indices();
+        const value_type* values = A.locked_values();
+
+        const value_type* r = R.LockedBuffer();
+        int ldr = R.LDim();
+        int width = R.Width();
+
+        value_type* sa = sketch_of_A.Buffer();
+        int ldsa = sketch_of_A.LDim();
+
+        // Each thread owns a set of columns of the sketch: no races.
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for
+#       endif
+        for(int s = 0; s < R.Height(); s++) {
+            value_type* c = sa + s * ldsa;
+            for(int col = 0; col < width; col++) {
+                value_type rv = r[col * ldr + s];
+                for(sp_index_type l = indptr[offset + col];
+                    l < indptr[offset + col + 1]; l++)
+                    c[indices[l]] += values[l] * rv;
+            }
+        }
+    }
+
+    void panel_gemm(const base::sparse_matrix_t<value_type>& A,
+                    const output_matrix_type& R, int offset,
+                    output_matrix_type& sketch_of_A,
+                    skylark::sketch::columnwise_tag tag) const {
+
+        typedef typename base::sparse_matrix_t<value_type>::index_type
+            sp_index_type;
+        const sp_index_type* indptr = A.indptr();
+        const sp_index_type* indices = A.indices();
+        const value_type* values = A.locked_values();
+
+        const value_type* r = R.LockedBuffer();
+        int ldr = R.LDim();
+        int S = R.Height();
+        int width = R.Width();
+
+        value_type* sa = sketch_of_A.Buffer();
+        int ldsa = sketch_of_A.LDim();
+
+        // Rows are sorted (see panel_input): the entries of the panel are
+        // a contiguous range of the column.
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for
+#       endif
+        for(int col = 0; col < A.width(); col++) {
+            value_type* c = sa + col * ldsa;
+            const sp_index_type* first = std::lower_bound(indices + indptr[col],
+                indices + indptr[col + 1], static_cast<sp_index_type>(offset));
+            for(sp_index_type l = first - indices; l < indptr[col + 1]; l++) {
+                sp_index_type row = indices[l] - offset;
+                if (row >= width)
+                    break;
+                value_type v = values[l];
+                const value_type* rc = r + row * ldr;
+                for(int i = 0; i < S; i++)
+                    c[i] += v * rc[i];
+            }
+        }
+    }
 };
 
 } } /** namespace skylark::sketch */
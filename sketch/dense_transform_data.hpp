@@ -76,19 +76,16 @@ struct dense_transform_data_t : public sketch_transform_data_t {
         A.Resize(height, width);
         value_type *data = A.Buffer();
 
+        // Column segments (strided for distributed views): in bulk.
 #ifdef SKYLARK_HAVE_OPENMP
 #pragma omp parallel for
 #endif
         for(size_t j_loc = 0; j_loc < width; j_loc++) {
             size_t j_glob = j + j_loc * row_stride;
-            for (size_t i_loc = 0; i_loc < height; i_loc++) {
-                size_t i_glob = i + i_loc * col_stride;
-                size_t tmp = j_glob * _S;
-                tmp += i_glob;
-                value_type sample = entries[tmp];
-                tmp = j_loc * height;
-                data[tmp + i_loc] = scale * sample;
-            }
+            value_type *col = data + j_loc * height;
+            entries.fill(j_glob * _S + i, height, col, col_stride);
+            for (size_t i_loc = 0; i_loc < height; i_loc++)
+                col[i_loc] *= scale;
         }
     }
 
@@ -0,0 +1,254 @@
+#ifndef SKYLARK_FFTW_PLAN_CACHE_HPP
+#define SKYLARK_FFTW_PLAN_CACHE_HPP
+
+#if SKYLARK_HAVE_FFTW || SKYLARK_HAVE_FFTWF
+
+#include <fftw3.h>
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/type_traits/remove_pointer.hpp>
+
+#include "sketch_params.hpp"
+
+namespace skylark { namespace sketch {
+
+namespace internal {
+
+/**
+ * FFTW's planner (and wisdom functions) are not thread-safe, so every call
+ * into them goes through this lock. Executing an existing plan is safe.
+ */
+inline std::mutex& fftw_planner_mutex() {
+    static std::mutex m;
+    return m;
+}
+
+/** FFTW planner flags matching the current fft_planning setting. */
+inline unsigned fftw_planning_flags() {
+    switch (get_fft_planning()) {
+    case FFT_PLANNING_MEASURE:
+        return FFTW_MEASURE;
+    case FFT_PLANNING_PATIENT:
+        return FFTW_PATIENT;
+    default:
+        return FFTW_ESTIMATE;
+    }
+}
+
+/**
+ * Key of a cached plan. kind is the r2r kind, or one of the negative
+ * values below for complex transforms. Batched (advanced interface) plans
+ * also record the number of transforms and their layout; a plain 1D plan
+ * has howmany = 1, stride = 1, dist = N.
+ */
+struct fftw_plan_key_t {
+
+    enum {
+        R2C = -1,
+        C2R = -2
+    };
+
+    int kind, N, howmany, stride, dist;
+    unsigned flags;
+
+    fftw_plan_key_t(int kind, int N, unsigned flags,
+        int howmany = 1, int stride = 1, int dist = -1) :
+        kind(kind), N(N), howmany(howmany), stride(stride),
+        dist(dist == -1 ? N : dist), flags(flags) {
+
+    }
+
+    bool operator<(const fftw_plan_key_t& o) const {
+        if (kind != o.kind) return kind < o.kind;
+        if (N != o.N) return N < o.N;
+        if (howmany != o.howmany) return howmany < o.howmany;
+        if (stride != o.stride) return stride < o.stride;
+        if (dist != o.dist) return dist < o.dist;
+        return flags < o.flags;
+    }
+};
+
+/**
+ * How to destroy a plan of each precision (only called, hence only needs
+ * the library, for precisions that are used).
+ */
+template<typename PlanType>
+struct fftw_plan_destroyer_t {
+
+};
+
+template<>
+struct fftw_plan_destroyer_t<fftw_plan> {
+    static void destroy(fftw_plan plan) { fftw_destroy_plan(plan); }
+};
+
+template<>
+struct fftw_plan_destroyer_t<fftwf_plan> {
+    static void destroy(fftwf_plan plan) { fftwf_destroy_plan(plan); }
+};
+
+/**
+ * Process-wide cache of FFTW plans. There is one cache per plan type, so
+ * the precision is part of the key implicitly. Plans are created on first
+ * request (with the planner flags in effect at that time, on scratch
+ * buffers) and then shared by all transforms.
+ *
+ * The cache holds at most get_fft_plan_cache_size() plans and drops the
+ * least recently used one beyond that. Plans are handed out reference
+ * counted, so a dropped plan lives on until the last transform holding it
+ * lets go, and is destroyed (under the planner lock) then.
+ */
+template<typename PlanType>
+struct fftw_plan_cache_t {
+
+    typedef PlanType plan_type;
+    typedef boost::shared_ptr<typename boost::remove_pointer<plan_type>::type>
+    handle_type;
+
+    /**
+     * Returns the plan for key, calling planner(flags) to create it if it
+     * is not in the cache yet. The alignment flag (FFTW_UNALIGNED) is part
+     * of key.flags; the rigor flag is added here. The handle is empty if
+     * FFTW could not form the plan.
+     */
+    template<typename Planner>
+    static handle_type get(fftw_plan_key_t key, Planner planner) {
+        // Plans dropped here are released after the lock (their deleter
+        // takes it too).
+        std::vector<handle_type> dropped;
+        std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+
+        key.flags |= fftw_planning_flags();
+        typename map_type::iterator it = _plans().find(key);
+        if (it != _plans().end()) {
+            _order().splice(_order().begin(), _order(), it->second.second);
+            return it->second.first;
+        }
+
+        plan_type plan = planner(key.flags);
+        if (plan == NULL)
+            return handle_type();
+
+        handle_type handle(plan, deleter_t());
+        _order().push_front(key);
+        _plans()[key] = std::make_pair(handle, _order().begin());
+
+        size_t capacity = std::max<size_t>(get_fft_plan_cache_size(), 1);
+        while (_plans().size() > capacity) {
+            typename map_type::iterator last = _plans().find(_order().back());
+            dropped.push_back(last->second.first);
+            _plans().erase(last);
+            _order().pop_back();
+        }
+
+        return handle;
+    }
+
+    /**
+     * Drops all cached plans. Plans still held by transforms are destroyed
+     * when those are done with them.
+     */
+    static void clear() {
+        map_type dropped;
+        std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+
+        dropped.swap(_plans());
+        _order().clear();
+    }
+
+private:
+    typedef std::list<fftw_plan_key_t> order_type;
+    typedef std::map<fftw_plan_key_t,
+                     std::pair<handle_type, typename order_type::iterator> >
+    map_type;
+
+    struct deleter_t {
+        void operator()(plan_type plan) const {
+            std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+            fftw_plan_destroyer_t<plan_type>::destroy(plan);
+        }
+    };
+
+    /** Keys, most recently used first. */
+    static order_type& _order() {
+        static order_type order;
+        return order;
+    }
+
+    static map_type& _plans() {
+        static map_type plans;
+        return plans;
+    }
+};
+
+} // namespace internal
+
+/**
+ * Wisdom import/export. Importing wisdom before the first transforms are
+ * built lets MEASURE/PATIENT plans be reused across runs without paying the
+ * planning cost again. Return true on success.
+ */
+template<typename ValueType>
+bool import_fftw_wisdom(const std::string& filename);
+
+template<typename ValueType>
+bool export_fftw_wisdom(const std::string& filename);
+
+/** Drops all cached plans of the given precision. */
+template<typename ValueType>
+void clear_fftw_plan_cache();
+
+#ifdef SKYLARK_HAVE_FFTW
+
+template<>
+inline bool import_fftw_wisdom<double>(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(internal::fftw_planner_mutex());
+    return fftw_import_wisdom_from_filename(filename.c_str()) != 0;
+}
+
+template<>
+inline bool export_fftw_wisdom<double>(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(internal::fftw_planner_mutex());
+    return fftw_export_wisdom_to_filename(filename.c_str()) != 0;
+}
+
+template<>
+inline void clear_fftw_plan_cache<double>() {
+    internal::fftw_plan_cache_t<fftw_plan>::clear();
+}
+
+#endif // SKYLARK_HAVE_FFTW
+
+#ifdef SKYLARK_HAVE_FFTWF
+
+template<>
+inline bool import_fftw_wisdom<float>(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(internal::fftw_planner_mutex());
+    return fftwf_import_wisdom_from_filename(filename.c_str()) != 0;
+}
+
+template<>
+inline bool export_fftw_wisdom<float>(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(internal::fftw_planner_mutex());
+    return fftwf_export_wisdom_to_filename(filename.c_str()) != 0;
+}
+
+template<>
+inline void clear_fftw_plan_cache<float>() {
+    internal::fftw_plan_cache_t<fftwf_plan>::clear();
+}
+
+#endif // SKYLARK_HAVE_FFTWF
+
+} } /** namespace skylark::sketch */
+
+#endif // SKYLARK_HAVE_FFTW || SKYLARK_HAVE_FFTWF
+
+#endif // SKYLARK_FFTW_PLAN_CACHE_HPP
@@ -76,6 +76,7 @@ struct hash_transform_t :
 #include "hash_transform_Elemental.hpp"
 
 #if SKYLARK_HAVE_COMBBLAS
+#include "hash_transform_exchange.hpp"
 #include "hash_transform_Mixed.hpp"
 #include "hash_transform_CombBLAS.hpp"
 #endif
@@ -234,6 +234,12 @@ private:
         const size_t my_row_offset = utility::cb_my_row_offset(A);
         const size_t my_col_offset = utility::cb_my_col_offset(A);
 
+        if (get_sparse_exchange() == SPARSE_EXCHANGE_ALLTOALL) {
+            apply_impl_alltoall(A, sketch_of_A, ncols, my_row_offset,
+                my_col_offset, dist);
+            return;
+        }
+
         size_t comm_size = A.getcommgrid()->GetSize();
         std::vector< std::set<size_t> > proc_set(comm_size);
 
@@ -319,6 +325,8 @@ private:
 
         MPI_Info_free(&info);
 
+        size_t bytes_moved = 0;
+
         // Synchronize epoch, no subsequent put operations (read only) and no
         // preceding fence calls.
         MPI_Win_fence(MPI_MODE_NOPUT | MPI_MODE_NOPRECEDE, start_offset_win);
@@ -364,6 +372,10 @@ private:
             MPI_Win_fence(MPI_MODE_NOPUT, idx_win);
             MPI_Win_fence(MPI_MODE_NOPUT, val_win);
 
+            if (p != rank)
+                bytes_moved += num_values *
+                    (sizeof(index_type) + sizeof(value_type));
+
             // finally, add data to local CombBLAS buffer (if we have any).
             //XXX: We cannot have duplicated (row/col) pairs in sketch_data.
             //     Check again with CombBLAS if there is a more suitable way
@@ -408,9 +420,86 @@ private:
         MPI_Win_free(&start_offset_win);
         MPI_Win_free(&idx_win);
         MPI_Win_free(&val_win);
+
+        exchange_bytes = bytes_moved;
     }
 
 
+    /**
+     * Same as apply_impl, but moves the non-zeros with a single
+     * MPI_Alltoallv instead of one-sided gets. Local data is traversed once
+     * and entries with the same target position are combined before
+     * sending.
+     */
+    template <typename Dimension>
+    void apply_impl_alltoall (matrix_type &A,
+        output_matrix_type &sketch_of_A, size_t ncols,
+        size_t my_row_offset, size_t my_col_offset,
+        Dimension dist) const {
+
+        col_t &data = A.seq();
+
+        size_t comm_size = A.getcommgrid()->GetSize();
+        std::vector< boost::unordered_map<index_type, value_type> >
+            outgoing(comm_size);
+
+        for(typename col_t::SpColIter col = data.begcol();
+            col != data.endcol(); col++) {
+            for(typename col_t::SpColIter::NzIter nz = data.begnz(col);
+                nz != data.endnz(col); nz++) {
+
+                const index_type rowid = nz.rowid()  + my_row_offset;
+                const index_type colid = col.colid() + my_col_offset;
+                const size_t pos       = getPos(rowid, colid, ncols, dist);
+
+                const size_t proc = utility::owner(
+                        sketch_of_A, pos / ncols, pos % ncols);
+
+                outgoing[proc][pos] +=
+                    nz.value() * data_type::getValue(rowid, colid, dist);
+            }
+        }
+
+        std::vector<index_type> in_idx;
+        std::vector<value_type> in_val;
+        exchange_bytes = internal::sparse_alltoall(
+            A.getcommgrid()->GetWorld(), outgoing, in_idx, in_val);
+
+        // Received entries can still share a position (from different
+        // ranks); combine them while building the local tuples.
+        std::vector< tuple< index_type, index_type, value_type > > sketch_data;
+
+        std::map<index_type, size_t> tuple_idx;
+        typedef typename std::map<index_type, size_t>::iterator itr_t;
+
+        const size_t res_row_offset = utility::cb_my_row_offset(sketch_of_A);
+        const size_t res_col_offset = utility::cb_my_col_offset(sketch_of_A);
+
+        for(size_t i = 0; i < in_idx.size(); ++i) {
+
+            index_type lrow = in_idx[i] / ncols - res_row_offset;
+            index_type lcol = in_idx[i] % ncols - res_col_offset;
+
+            itr_t itr = tuple_idx.find(in_idx[i]);
+            if(itr == tuple_idx.end()) {
+                tuple_idx.insert(std::make_pair(in_idx[i], sketch_data.size()));
+                sketch_data.push_back(make_tuple(lrow, lcol, in_val[i]));
+            } else {
+                get<2>(sketch_data[itr->second]) += in_val[i];
+            }
+        }
+
+        // this pointer will be freed in the destructor of col_t (see below).
+        SpTuples<index_type, value_type> *tmp_tpl =
+            new SpTuples<index_type, value_type> (
+                sketch_data.size(), sketch_of_A.getlocalrows(),
+                sketch_of_A.getlocalcols(), &sketch_data[0]);
+
+        col_t *sp_data = new col_t(*tmp_tpl, false);
+
+        sketch_of_A = output_matrix_type(sp_data, sketch_of_A.getcommgrid());
+    }
+
     inline index_type getPos(index_type rowid, index_type colid, size_t ncols,
         columnwise_tag) const {
         return colid + ncols * data_type::row_idx[rowid];
@@ -207,16 +207,18 @@ private:
         double *SA = sketch_of_A.Buffer();
         int ld = sketch_of_A.LDim();
 
-        const int* indptr = A.indptr();
-        const int* indices = A.indices();
+        typedef typename base::sparse_matrix_t<value_type>::index_type
+            sp_index_type;
+        const sp_index_type* indptr = A.indptr();
+        const sp_index_type* indices = A.indices();
         const value_type* values = A.locked_values();
 
 #       if SKYLARK_HAVE_OPENMP
 #       pragma omp parallel for
 #       endif
         for(int col = 0; col < A.width(); col++) {
-            for (int j = indptr[col]; j < indptr[col + 1]; j++) {
-                int row = indices[j];
+            for (sp_index_type j = indptr[col]; j < indptr[col + 1]; j++) {
+                sp_index_type row = indices[j];
                 value_type val = values[j];
                 SA[col * ld + data_type::row_idx[row]] +=
                     data_type::row_value[row] * val;
@@ -237,16 +239,18 @@ private:
         double *SA = sketch_of_A.Buffer();
         int ld = sketch_of_A.LDim();
 
-        const int* indptr = A.indptr();
-        const int* indices = A.indices();
+        typedef typename base::sparse_matrix_t<value_type>::index_type
+            sp_index_type;
+        const sp_index_type* indptr = A.indptr();
+        const sp_index_type* indices = A.indices();
         const value_type* values = A.locked_values();
 
         for(int col = 0; col < A.width(); col++) {
 #           if SKYLARK_HAVE_OPENMP
 #           pragma omp parallel for
 #           endif
-            for (int j = indptr[col]; j < indptr[col + 1]; j++) {
-                int row = indices[j];
+            for (sp_index_type j = indptr[col]; j < indptr[col + 1]; j++) {
+                sp_index_type row = indices[j];
                 value_type val = values[j];
                 SA[data_type::row_idx[col] * ld + row] +=
                     data_type::row_value[col] * val;
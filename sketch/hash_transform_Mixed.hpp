@@ -117,6 +117,12 @@ private:
         const size_t my_row_offset = utility::cb_my_row_offset(A);
         const size_t my_col_offset = utility::cb_my_col_offset(A);
 
+        if (get_sparse_exchange() == SPARSE_EXCHANGE_ALLTOALL) {
+            apply_impl_alltoall(A, sketch_of_A, ncols, my_row_offset,
+                my_col_offset, dist);
+            return;
+        }
+
         size_t comm_size = A.getcommgrid()->GetSize();
         std::vector< std::set<size_t> > proc_set(comm_size);
 
@@ -203,6 +209,8 @@ private:
 
         MPI_Info_free(&info);
 
+        size_t bytes_moved = 0;
+
         // Synchronize epoch, no subsequent put operations (read only) and no
         // preceding fence calls.
         MPI_Win_fence(MPI_MODE_NOPUT | MPI_MODE_NOPRECEDE, start_offset_win);
@@ -238,6 +246,10 @@ private:
             MPI_Win_fence(MPI_MODE_NOPUT, idx_win);
             MPI_Win_fence(MPI_MODE_NOPUT, val_win);
 
+            if (p != rank)
+                bytes_moved += num_values *
+                    (sizeof(index_type) + sizeof(value_type));
+
             // finally, set data in local buffer
             for(size_t i = 0; i < num_values; ++i) {
                 index_type lrow = sketch_of_A.LocalRow(add_idx[i] / ncols);
@@ -253,6 +265,55 @@ private:
         MPI_Win_free(&start_offset_win);
         MPI_Win_free(&idx_win);
         MPI_Win_free(&val_win);
+
+        exchange_bytes = bytes_moved;
+    }
+
+    /**
+     * Same as apply_impl, but moves the non-zeros with a single
+     * MPI_Alltoallv instead of one-sided gets. Local data is traversed once
+     * and entries with the same target position are combined before
+     * sending.
+     */
+    template <typename Dimension>
+    void apply_impl_alltoall (matrix_type &A,
+        output_matrix_type &sketch_of_A, size_t ncols,
+        size_t my_row_offset, size_t my_col_offset,
+        Dimension dist) const {
+
+        col_t &data = A.seq();
+
+        size_t comm_size = A.getcommgrid()->GetSize();
+        std::vector< boost::unordered_map<index_type, value_type> >
+            outgoing(comm_size);
+
+        for(typename col_t::SpColIter col = data.begcol();
+            col != data.endcol(); col++) {
+            for(typename col_t::SpColIter::NzIter nz = data.begnz(col);
+                nz != data.endnz(col); nz++) {
+
+                const index_type rowid = nz.rowid()  + my_row_offset;
+                const index_type colid = col.colid() + my_col_offset;
+                const size_t pos       = getPos(rowid, colid, ncols, dist);
+
+                const size_t proc = utility::owner(
+                        sketch_of_A, pos / ncols, pos % ncols);
+
+                outgoing[proc][pos] +=
+                    nz.value() * data_type::getValue(rowid, colid, dist);
+            }
+        }
+
+        std::vector<index_type> in_idx;
+        std::vector<value_type> in_val;
+        exchange_bytes = internal::sparse_alltoall(
+            A.getcommgrid()->GetWorld(), outgoing, in_idx, in_val);
+
+        for(size_t i = 0; i < in_idx.size(); ++i) {
+            index_type lrow = sketch_of_A.LocalRow(in_idx[i] / ncols);
+            index_type lcol = sketch_of_A.LocalCol(in_idx[i] % ncols);
+            sketch_of_A.UpdateLocal(lrow, lcol, in_val[i]);
+        }
     }
 
     inline index_type getPos(index_type rowid, index_type colid, size_t ncols,
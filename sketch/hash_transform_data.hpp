@@ -45,6 +45,12 @@ struct hash_transform_data_t : public sketch_transform_data_t {
         return boost::property_tree::ptree();
     }
 
+    /** Bucket of each input coordinate. */
+    const std::vector<size_t>& get_row_idx() const { return row_idx; }
+
+    /** Scaling factor of each input coordinate. */
+    const std::vector<double>& get_row_value() const { return row_value; }
+
 protected:
 
     hash_transform_data_t (int N, int S, const base::context_t& context,
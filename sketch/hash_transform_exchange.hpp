@@ -0,0 +1,81 @@
+#ifndef SKYLARK_HASH_TRANSFORM_EXCHANGE_HPP
+#define SKYLARK_HASH_TRANSFORM_EXCHANGE_HPP
+
+#include <vector>
+#include <boost/mpi.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "sketch_params.hpp"
+
+namespace skylark { namespace sketch { namespace internal {
+
+/**
+ * Exchange (position, value) pairs between all ranks of comm with two
+ * collectives (one MPI_Alltoall for the counts, MPI_Alltoallv for the data).
+ *
+ * @param comm communicator.
+ * @param outgoing outgoing[p] holds the pairs destined for rank p. Pairs
+ *        are keyed by position, so duplicates are already combined.
+ * @param in_idx positions received (grouped by source rank).
+ * @param in_val values received.
+ * @return number of bytes of pairs received by this rank from the others
+ *         (the same quantity the one-sided exchange reports).
+ */
+template<typename IndexType, typename ValueType>
+size_t sparse_alltoall(MPI_Comm comm,
+    const std::vector< boost::unordered_map<IndexType, ValueType> >& outgoing,
+    std::vector<IndexType>& in_idx, std::vector<ValueType>& in_val) {
+
+    typedef typename boost::unordered_map<IndexType, ValueType>::const_iterator
+        itr_t;
+
+    int comm_size, rank;
+    MPI_Comm_size(comm, &comm_size);
+    MPI_Comm_rank(comm, &rank);
+
+    std::vector<int> send_counts(comm_size), recv_counts(comm_size);
+    std::vector<int> send_displ(comm_size + 1, 0), recv_displ(comm_size + 1, 0);
+
+    for(int p = 0; p < comm_size; ++p) {
+        send_counts[p] = outgoing[p].size();
+        send_displ[p + 1] = send_displ[p] + send_counts[p];
+    }
+
+    MPI_Alltoall(&send_counts[0], 1, MPI_INT, &recv_counts[0], 1, MPI_INT,
+        comm);
+
+    for(int p = 0; p < comm_size; ++p)
+        recv_displ[p + 1] = recv_displ[p] + recv_counts[p];
+
+    std::vector<IndexType> out_idx(send_displ[comm_size]);
+    std::vector<ValueType> out_val(send_displ[comm_size]);
+    for(int p = 0; p < comm_size; ++p) {
+        size_t pos = send_displ[p];
+        for(itr_t itr = outgoing[p].begin(); itr != outgoing[p].end(); itr++) {
+            out_idx[pos] = itr->first;
+            out_val[pos] = itr->second;
+            pos++;
+        }
+    }
+
+    in_idx.resize(recv_displ[comm_size]);
+    in_val.resize(recv_displ[comm_size]);
+
+    // vectors may be empty, so avoid taking &v[0].
+    MPI_Alltoallv(out_idx.data(), &send_counts[0], &send_displ[0],
+        boost::mpi::get_mpi_datatype<IndexType>(),
+        in_idx.data(), &recv_counts[0], &recv_displ[0],
+        boost::mpi::get_mpi_datatype<IndexType>(), comm);
+
+    MPI_Alltoallv(out_val.data(), &send_counts[0], &send_displ[0],
+        boost::mpi::get_mpi_datatype<ValueType>(),
+        in_val.data(), &recv_counts[0], &recv_displ[0],
+        boost::mpi::get_mpi_datatype<ValueType>(), comm);
+
+    size_t received = recv_displ[comm_size] - recv_counts[rank];
+    return received * (sizeof(IndexType) + sizeof(ValueType));
+}
+
+} } } /** namespace skylark::sketch::internal */
+
+#endif // SKYLARK_HASH_TRANSFORM_EXCHANGE_HPP
@@ -1,7 +1,15 @@
 #ifndef SKYLARK_HASH_TRANSFORM_LOCAL_SPARSE_HPP
 #define SKYLARK_HASH_TRANSFORM_LOCAL_SPARSE_HPP
 
+#include <algorithm>
+#include <utility>
+
 #include <boost/dynamic_bitset.hpp>
+#include <boost/unordered_map.hpp>
+
+#if SKYLARK_HAVE_OPENMP
+#include <omp.h>
+#endif
 
 namespace skylark { namespace sketch {
 
@@ -19,6 +27,7 @@ struct hash_transform_t <
     typedef size_t index_type;
     typedef ValueType value_type;
     typedef base::sparse_matrix_t<ValueType> matrix_type;
+    typedef typename matrix_type::index_type sp_index_type;
     typedef base::sparse_matrix_t<ValueType> output_matrix_type;
     typedef IdxDistributionType<index_type> idx_distribution_type;
     typedef ValueDistribution<value_type> value_distribution_type;
@@ -89,59 +98,69 @@ private:
                      output_matrix_type &sketch_of_A,
                      columnwise_tag) const {
 
-        index_type col_idx = 0;
-
-        const int* indptr  = A.indptr();
-        const int* indices = A.indices();
+        const sp_index_type* indptr  = A.indptr();
+        const sp_index_type* indices = A.indices();
         const value_type* values = A.locked_values();
 
         index_type n_rows = data_type::_S;
         index_type n_cols = A.width();
 
-        int nnz = 0;
-        int *indptr_new = new int[n_cols + 1];
-        std::vector<int> final_rows(A.nonzeros());
-        std::vector<value_type> final_vals(A.nonzeros());
-
+        sp_index_type *indptr_new = new sp_index_type[n_cols + 1];
         indptr_new[0] = 0;
-        std::vector<index_type> idx_map(n_rows, -1);
 
-        for(index_type col = 0; col < A.width(); col++) {
-
-
-            for(index_type idx = indptr[col]; idx < indptr[col + 1]; idx++) {
+        // Columns are split so that every thread gets the same number of
+        // non-zeros; each thread compresses its columns into private buffers.
+        int nthreads = _num_threads();
+        std::vector<int> bounds;
+        _partition(indptr, n_cols, nthreads, bounds);
+
+        std::vector< std::vector<sp_index_type> > final_rows(nthreads);
+        std::vector< std::vector<value_type> > final_vals(nthreads);
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel num_threads(nthreads)
+#       endif
+        {
+            std::vector<sp_index_type> idx_map(n_rows, -1);
+
+            // The team can be smaller than asked for, so every thread takes
+            // all the shares congruent to its id.
+            for(int t = _thread_id(); t < nthreads; t += _team_size()) {
+                std::vector<sp_index_type>& rows = final_rows[t];
+                std::vector<value_type>& vals = final_vals[t];
+
+                for(int col = bounds[t]; col < bounds[t + 1]; col++) {
+                    size_t col_start = rows.size();
+
+                    for(sp_index_type idx = indptr[col];
+                        idx < indptr[col + 1]; idx++) {
+
+                        sp_index_type row = indices[idx];
+                        value_type val =
+                            values[idx] * data_type::row_value[row];
+                        row = data_type::row_idx[row];
+
+                        //XXX: I think we should get rid of the if here...
+                        if(idx_map[row] == -1) {
+                            idx_map[row] = rows.size();
+                            rows.push_back(row);
+                            vals.push_back(val);
+                        } else {
+                            vals[idx_map[row]] += val;
+                        }
+                    }
 
-                index_type row = indices[idx];
-                value_type val = values[idx] * data_type::row_value[row];
-                row            = data_type::row_idx[row];
+                    indptr_new[col + 1] = rows.size() - col_start;
 
-                //XXX: I think we should get rid of the if here...
-                if(idx_map[row] == -1) {
-                    idx_map[row] = nnz;
-                    final_rows[nnz] = row;
-                    final_vals[nnz] = val;
-                    nnz++;
-                } else {
-                    final_vals[idx_map[row]] += val;
+                    // reset idx_map
+                    for(size_t i = col_start; i < rows.size(); ++i)
+                        idx_map[rows[i]] = -1;
                 }
             }
-
-            indptr_new[col + 1] = nnz;
-
-            // reset idx_map
-            for(int i = indptr_new[col]; i < nnz; ++i)
-                idx_map[final_rows[i]] = -1;
         }
 
-        int *indices_new = new int[nnz];
-        std::copy(final_rows.begin(), final_rows.begin() + nnz, indices_new);
-
-        double *values_new = new double[nnz];
-        std::copy(final_vals.begin(), final_vals.begin() + nnz, values_new);
-
-        // let the sparse structure take ownership of the data
-        sketch_of_A.attach(indptr_new, indices_new, values_new,
-                           nnz, n_rows, n_cols, true);
+        _finalize(indptr_new, n_rows, n_cols, bounds, final_rows, final_vals,
+            sketch_of_A);
     }
 
 
@@ -153,73 +172,282 @@ private:
                      output_matrix_type &sketch_of_A,
                      rowwise_tag) const {
 
-        index_type col_idx = 0;
-
-        const int* indptr = A.indptr();
-        const int* indices = A.indices();
+        const sp_index_type* indptr = A.indptr();
+        const sp_index_type* indices = A.indices();
         const value_type* values = A.locked_values();
 
         // target size
         index_type n_rows = A.height();
         index_type n_cols = data_type::_S;
 
-        int nnz = 0;
-        int *indptr_new = new int[n_cols + 1];
-        std::vector<int> final_rows(A.nonzeros());
-        std::vector<value_type> final_vals(A.nonzeros());
-
+        sp_index_type *indptr_new = new sp_index_type[n_cols + 1];
         indptr_new[0] = 0;
 
         // we adapt transversal order for this case
         //XXX: or transpose A (maybe better for cache)
         std::vector< std::vector<int> > inv_mapping(data_type::_S);
-        for(int idx = 0; idx < data_type::row_idx.size(); ++idx) {
+        for(size_t idx = 0; idx < data_type::row_idx.size(); ++idx) {
             inv_mapping[data_type::row_idx[idx]].push_back(idx);
         }
 
-        std::vector<index_type> idx_map(n_rows, -1);
+        // Work of a target column is the number of non-zeros hashed into it.
+        std::vector<sp_index_type> work(n_cols + 1, 0);
+        for(index_type target_col = 0; target_col < n_cols; ++target_col) {
+            sp_index_type w = 0;
+            for(size_t i = 0; i < inv_mapping[target_col].size(); i++) {
+                int col = inv_mapping[target_col][i];
+                w += indptr[col + 1] - indptr[col];
+            }
+            work[target_col + 1] = work[target_col] + w;
+        }
 
-        for(index_type target_col = 0; target_col < data_type::_S;
-            ++target_col) {
+        int nthreads = _num_threads();
+        std::vector<int> bounds;
+        _partition(&work[0], n_cols, nthreads, bounds);
+
+        std::vector< std::vector<sp_index_type> > final_rows(nthreads);
+        std::vector< std::vector<value_type> > final_vals(nthreads);
+
+        // Output rows are rows of A. If A has sorted columns, the columns
+        // hashed into a target column are merged, and the output is sorted
+        // too. Otherwise positions within the current target column are
+        // kept in a dense map per thread, or, if those would take too much
+        // memory, in a hash map that only grows to the column's size.
+        bool merge = A.sorted();
+        bool dense = !merge && static_cast<size_t>(n_rows) * nthreads *
+            sizeof(sp_index_type) <= _max_dense_map_bytes;
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel num_threads(nthreads)
+#       endif
+        {
+            std::vector<sp_index_type> idx_map(dense ? n_rows : 0, -1);
+            boost::unordered_map<sp_index_type, sp_index_type> idx_hash;
+            typedef typename boost::unordered_map<sp_index_type,
+                                                  sp_index_type>::iterator
+                idx_hash_iterator;
+
+            std::vector<_merge_cursor> heap;
+
+            // The team can be smaller than asked for, so every thread takes
+            // all the shares congruent to its id.
+            for(int t = _thread_id(); t < nthreads; t += _team_size()) {
+                std::vector<sp_index_type>& rows = final_rows[t];
+                std::vector<value_type>& vals = final_vals[t];
+
+                for(int target_col = bounds[t]; target_col < bounds[t + 1];
+                    ++target_col) {
+                    size_t col_start = rows.size();
+                    const std::vector<int>& cols = inv_mapping[target_col];
+
+                    if(merge) {
+                        _merge_columns(indptr, indices, values, cols, heap,
+                            rows, vals);
+                    } else {
+                        for(size_t i = 0; i < cols.size(); i++) {
+                            int col = cols[i];
+
+                            for(sp_index_type idx = indptr[col];
+                                idx < indptr[col + 1]; idx++) {
+
+                                sp_index_type row = indices[idx];
+                                value_type val =
+                                    values[idx] * data_type::row_value[col];
+
+                                if(dense) {
+                                    if(idx_map[row] == -1) {
+                                        idx_map[row] = rows.size();
+                                        rows.push_back(row);
+                                        vals.push_back(val);
+                                    } else {
+                                        vals[idx_map[row]] += val;
+                                    }
+                                    continue;
+                                }
+
+                                std::pair<idx_hash_iterator, bool> pos =
+                                    idx_hash.insert(std::make_pair(row,
+                                            static_cast<sp_index_type>(
+                                                rows.size())));
+                                if(pos.second) {
+                                    rows.push_back(row);
+                                    vals.push_back(val);
+                                } else {
+                                    vals[pos.first->second] += val;
+                                }
+                            }
+                        }
+
+                        // reset idx_map / idx_hash
+                        if(dense)
+                            for(size_t i = col_start; i < rows.size(); ++i)
+                                idx_map[rows[i]] = -1;
+                        else
+                            idx_hash.clear();
+                    }
 
-            std::vector<int>::iterator itr;
-            for(itr = inv_mapping[target_col].begin();
-                itr != inv_mapping[target_col].end(); itr++) {
+                    indptr_new[target_col + 1] = rows.size() - col_start;
+                }
+            }
+        }
 
-                int col = *itr;
+        _finalize(indptr_new, n_rows, n_cols, bounds, final_rows, final_vals,
+            sketch_of_A, merge);
+    }
 
-                for(index_type idx = indptr[col]; idx < indptr[col + 1]; idx++) {
+    /**
+     * Largest total size of the per-thread dense maps of the rowwise apply
+     * (n_rows entries per thread); above it a hash map is used instead.
+     */
+    static const size_t _max_dense_map_bytes = size_t(1) << 27;
 
-                    index_type row = indices[idx];
-                    value_type val = values[idx] * data_type::row_value[col];
+    /** Position in a source column of the rowwise merge. */
+    struct _merge_cursor {
+        sp_index_type row, pos, end;
+        int col;
+    };
 
-                    //XXX: I think we should get rid of the if here...
-                    if(idx_map[row] == -1) {
-                        idx_map[row] = nnz;
-                        final_rows[nnz] = row;
-                        final_vals[nnz] = val;
-                        nnz++;
-                    } else {
-                        final_vals[idx_map[row]] += val;
-                    }
-                }
+    /**
+     * Appends to rows and vals the target column that the (sorted) source
+     * columns cols are hashed into, in increasing row order, by merging
+     * them through a min-heap of cursors keyed on the current row. The
+     * cursor on top is advanced in place and sifted down, so every non-zero
+     * costs a single sift.
+     */
+    void _merge_columns(const sp_index_type *indptr,
+        const sp_index_type *indices, const value_type *values,
+        const std::vector<int>& cols, std::vector<_merge_cursor>& heap,
+        std::vector<sp_index_type>& rows,
+        std::vector<value_type>& vals) const {
+
+        size_t col_start = rows.size();
+
+        heap.clear();
+        for(size_t i = 0; i < cols.size(); i++) {
+            _merge_cursor c;
+            c.pos = indptr[cols[i]];
+            c.end = indptr[cols[i] + 1];
+            c.col = cols[i];
+            if(c.pos < c.end) {
+                c.row = indices[c.pos];
+                heap.push_back(c);
+            }
+        }
+        size_t size = heap.size();
+        for(size_t i = size / 2; i > 0; i--)
+            _sift_down(&heap[0], size, i - 1);
+
+        while(size > 0) {
+            _merge_cursor& top = heap[0];
+            value_type val = values[top.pos] * data_type::row_value[top.col];
+            if(rows.size() > col_start && rows.back() == top.row)
+                vals.back() += val;
+            else {
+                rows.push_back(top.row);
+                vals.push_back(val);
             }
 
-            indptr_new[target_col + 1] = nnz;
+            if(++top.pos < top.end)
+                top.row = indices[top.pos];
+            else if(--size > 0)
+                top = heap[size];
+            else
+                break;
+            _sift_down(&heap[0], size, 0);
+        }
+    }
 
-            // reset idx_map
-            for(int i = indptr_new[target_col]; i < nnz; ++i)
-                idx_map[final_rows[i]] = -1;
+    static void _sift_down(_merge_cursor *heap, size_t size, size_t i) {
+        _merge_cursor c = heap[i];
+        for(size_t child = 2 * i + 1; child < size; child = 2 * i + 1) {
+            if(child + 1 < size)
+                child += heap[child + 1].row < heap[child].row;
+            if(!(heap[child].row < c.row))
+                break;
+            heap[i] = heap[child];
+            i = child;
         }
+        heap[i] = c;
+    }
+
+    static int _num_threads() {
+#       if SKYLARK_HAVE_OPENMP
+        return omp_get_max_threads();
+#       else
+        return 1;
+#       endif
+    }
 
-        int *indices_new = new int[nnz];
-        std::copy(final_rows.begin(), final_rows.begin() + nnz, indices_new);
+    static int _thread_id() {
+#       if SKYLARK_HAVE_OPENMP
+        return omp_get_thread_num();
+#       else
+        return 0;
+#       endif
+    }
+
+    static int _team_size() {
+#       if SKYLARK_HAVE_OPENMP
+        return omp_get_num_threads();
+#       else
+        return 1;
+#       endif
+    }
+
+    /**
+     * Split [0, n) into nthreads contiguous ranges of (roughly) equal work,
+     * where prefix[i + 1] - prefix[i] is the work of item i.
+     */
+    static void _partition(const sp_index_type *prefix, int n, int nthreads,
+        std::vector<int>& bounds) {
+
+        bounds.resize(nthreads + 1);
+        bounds[0] = 0;
+        sp_index_type total = prefix[n] - prefix[0];
+        int i = 0;
+        for(int t = 1; t < nthreads; t++) {
+            sp_index_type target = prefix[0] + (total * t) / nthreads;
+            while(i < n && prefix[i] < target)
+                i++;
+            bounds[t] = i;
+        }
+        bounds[nthreads] = n;
+    }
 
-        double *values_new = new double[nnz];
-        std::copy(final_vals.begin(), final_vals.begin() + nnz, values_new);
+    /**
+     * Turn per-column counts in indptr_new into offsets and gather the
+     * per-thread buffers into the final structure (owned by sketch_of_A),
+     * which is marked sorted if the caller says the columns are.
+     */
+    static void _finalize(sp_index_type *indptr_new,
+        index_type n_rows, index_type n_cols, const std::vector<int>& bounds,
+        const std::vector< std::vector<sp_index_type> >& final_rows,
+        const std::vector< std::vector<value_type> >& final_vals,
+        output_matrix_type &sketch_of_A, bool sorted = false) {
+
+        for(index_type col = 0; col < n_cols; col++)
+            indptr_new[col + 1] += indptr_new[col];
+        sp_index_type nnz = indptr_new[n_cols];
+
+        sp_index_type *indices_new = new sp_index_type[nnz];
+        value_type *values_new = new value_type[nnz];
+
+        int nthreads = static_cast<int>(final_rows.size());
+
+#       if SKYLARK_HAVE_OPENMP
+#       pragma omp parallel for num_threads(nthreads)
+#       endif
+        for(int t = 0; t < nthreads; t++) {
+            sp_index_type offset = indptr_new[bounds[t]];
+            std::copy(final_rows[t].begin(), final_rows[t].end(),
+                indices_new + offset);
+            std::copy(final_vals[t].begin(), final_vals[t].end(),
+                values_new + offset);
+        }
 
+        // let the sparse structure take ownership of the data
         sketch_of_A.attach(indptr_new, indices_new, values_new,
-                           nnz, n_rows, n_cols, true);
+                           nnz, n_rows, n_cols, true, true, true, sorted);
     }
 };
 
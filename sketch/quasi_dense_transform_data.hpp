@@ -63,6 +63,29 @@ public:
         return boost::math::quantile(_distribution, baseval);
     }
 
+    /**
+     * Bulk generation of samples begin, begin + stride, ... (same values as
+     * operator[]). With stride 1 the sequence generates the base values a
+     * coordinate at a time.
+     */
+    template <typename OutputType>
+    void fill(size_t begin, size_t count, OutputType *out,
+        size_t stride = 1) const {
+        if (stride != 1) {
+            for(size_t i = 0; i < count; i++)
+                out[i] = static_cast<OutputType>((*this)[begin + i * stride]);
+            return;
+        }
+
+        std::vector<value_type> baseval(count);
+        if (count > 0)
+            _sequence.fill(_skip + begin / _d, begin % _d, _d, count,
+                &baseval[0]);
+        for(size_t i = 0; i < count; i++)
+            out[i] = static_cast<OutputType>(
+                boost::math::quantile(_distribution, baseval[i]));
+    }
+
 private:
     size_t _d;
     size_t _N;
@@ -40,9 +40,7 @@ sketch_transform_data_t::from_ptree(const boost::property_tree::ptree& pt) {
     AUTO_LOAD_DISPATCH(FastGaussianRFT, FastGaussianRFT_data_t);
     AUTO_LOAD_DISPATCH(FastMaternnRFT, FastMaternRFT_data_t);
 
-#if SKYLARK_HAVE_FFTW
     AUTO_LOAD_DISPATCH(FJLT, FJLT_data_t);
-#endif
 
 #undef AUTO_LOAD_DISPATCH
 
@@ -85,9 +83,7 @@ sketch_transform_t<IT, OT>::from_ptree(const boost::property_tree::ptree& pt) {
     AUTO_LOAD_DISPATCH(FastGaussianRFT, FastGaussianRFT_t);
     AUTO_LOAD_DISPATCH(FastMaternRFT, FastMaternRFT_t);
 
-#if SKYLARK_HAVE_FFTW
     AUTO_LOAD_DISPATCH(FJLT, FJLT_t);
-#endif
 
 #undef AUTO_LOAD_DISPATCH
 
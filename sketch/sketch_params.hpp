@@ -11,6 +11,66 @@ int blocksize = 0;
 
 double factor = 20.;
 
+/** Upper bound on the number of entries of the random matrix that local
+ *  dense transforms realize at once when blocksize is not set
+ *  (0 means no bound, i.e. the whole matrix is realized).
+*/
+size_t max_panel_entries = 1 << 24;
+
+/** Engine used by distributed sparse hash transforms to move non-zeros to
+ *  their owners: one-sided MPI_Get from windows, or MPI_Alltoallv.
+*/
+enum sparse_exchange_t {
+    SPARSE_EXCHANGE_ONESIDED = 0,
+    SPARSE_EXCHANGE_ALLTOALL = 1
+};
+
+sparse_exchange_t sparse_exchange = SPARSE_EXCHANGE_ONESIDED;
+
+/** Bytes of non-zeros this rank received from other ranks in the last
+ *  sparse exchange (either engine; offsets and counts are not included).
+*/
+size_t exchange_bytes = 0;
+
+/** Planner rigor for FFT plans. Plans are cached process-wide, so the
+ *  cost of MEASURE/PATIENT planning is paid once per transform size.
+*/
+enum fft_planning_t {
+    FFT_PLANNING_ESTIMATE = 0,
+    FFT_PLANNING_MEASURE = 1,
+    FFT_PLANNING_PATIENT = 2
+};
+
+fft_planning_t fft_planning = FFT_PLANNING_ESTIMATE;
+
+/** Most FFT plans kept in the process-wide cache (per precision). The
+ *  least recently used plan is dropped beyond that; transforms still
+ *  holding it keep it alive until they are done.
+*/
+size_t fft_plan_cache_size = 64;
+
+/** Accuracy of the cosine evaluated by random features transforms:
+ *  std::cos, a branch-free polynomial (about 1e-15 absolute error) that
+ *  vectorizes, or a crude (about 0.06 absolute error) approximation.
+ *  Building with SKYLARK_INEXACT_COSINE makes the latter the default.
+*/
+enum cosine_accuracy_t {
+    COSINE_EXACT = 0,
+    COSINE_POLYNOMIAL = 1,
+    COSINE_LOW = 2
+};
+
+#ifndef SKYLARK_INEXACT_COSINE
+cosine_accuracy_t cosine_accuracy = COSINE_EXACT;
+#else
+cosine_accuracy_t cosine_accuracy = COSINE_LOW;
+#endif
+
+/** Number of columns (or rows) that PPT hashes and transforms together
+ *  with batched FFTs.
+*/
+int ppt_panel_width = 32;
+
 void set_blocksize(int blocksize) {
     skylark::sketch::blocksize = blocksize;
 }
@@ -27,6 +87,58 @@ double get_factor() {
     return skylark::sketch::factor;
 }
 
+void set_max_panel_entries(size_t max_panel_entries) {
+    skylark::sketch::max_panel_entries = max_panel_entries;
+}
+
+size_t get_max_panel_entries() {
+    return skylark::sketch::max_panel_entries;
+}
+
+void set_sparse_exchange(sparse_exchange_t sparse_exchange) {
+    skylark::sketch::sparse_exchange = sparse_exchange;
+}
+
+sparse_exchange_t get_sparse_exchange() {
+    return skylark::sketch::sparse_exchange;
+}
+
+size_t get_exchange_bytes() {
+    return skylark::sketch::exchange_bytes;
+}
+
+void set_fft_planning(fft_planning_t fft_planning) {
+    skylark::sketch::fft_planning = fft_planning;
+}
+
+fft_planning_t get_fft_planning() {
+    return skylark::sketch::fft_planning;
+}
+
+void set_fft_plan_cache_size(size_t fft_plan_cache_size) {
+    skylark::sketch::fft_plan_cache_size = fft_plan_cache_size;
+}
+
+size_t get_fft_plan_cache_size() {
+    return skylark::sketch::fft_plan_cache_size;
+}
+
+void set_cosine_accuracy(cosine_accuracy_t cosine_accuracy) {
+    skylark::sketch::cosine_accuracy = cosine_accuracy;
+}
+
+cosine_accuracy_t get_cosine_accuracy() {
+    return skylark::sketch::cosine_accuracy;
+}
+
+void set_ppt_panel_width(int ppt_panel_width) {
+    skylark::sketch::ppt_panel_width = ppt_panel_width;
+}
+
+int get_ppt_panel_width() {
+    return skylark::sketch::ppt_panel_width;
+}
+
 } } /** namespace skylark::sketch */
 
 #endif // SKYLARK_SKETCH_PARAMS_HPP
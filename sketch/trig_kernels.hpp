@@ -0,0 +1,142 @@
+#ifndef SKYLARK_TRIG_KERNELS_HPP
+#define SKYLARK_TRIG_KERNELS_HPP
+
+#include <cmath>
+#include <cstddef>
+
+#include "sketch_params.hpp"
+
+namespace skylark { namespace sketch {
+
+namespace internal {
+
+/** Exact cosine. */
+struct exact_cos_t {
+    double operator()(double x) const {
+        return std::cos(x);
+    }
+};
+
+/**
+ * Round to nearest integer for |y| < 2^51, using only an add and a
+ * subtract (std::floor does not vectorize unless -fno-trapping-math).
+ * Not valid under -ffast-math or with x87 extended precision.
+ */
+inline double round_nearest(double y) {
+    const double magic = 6755399441055744.0; // 1.5 * 2^52
+    return (y + magic) - magic;
+}
+
+/**
+ * Cosine by reduction to [-pi/4, pi/4] and polynomials for sin and cos on
+ * that interval. There are no branches, so loops calling it vectorize.
+ * The absolute error is about 1e-15 for |x| < 1e6.
+ */
+struct polynomial_cos_t {
+    double operator()(double x) const {
+        const double two_over_pi = 6.36619772367581382433e-01;
+        const double pio2_1 = 1.57079632673412561417e+00;  // 33 bits of pi/2
+        const double pio2_1t = 6.07710050650619224932e-11; // pi/2 - pio2_1
+
+        double k = round_nearest(x * two_over_pi);
+        double r = (x - k * pio2_1) - k * pio2_1t;
+        double r2 = r * r;
+
+        double c = 1.0 + r2 * (-1.0 / 2 + r2 * (1.0 / 24 +
+            r2 * (-1.0 / 720 + r2 * (1.0 / 40320 + r2 * (-1.0 / 3628800 +
+            r2 * (1.0 / 479001600 + r2 * (-1.0 / 87178291200.0)))))));
+        double s = r * (1.0 + r2 * (-1.0 / 6 + r2 * (1.0 / 120 +
+            r2 * (-1.0 / 5040 + r2 * (1.0 / 362880 + r2 * (-1.0 / 39916800 +
+            r2 * (1.0 / 6227020800.0 + r2 * (-1.0 / 1307674368000.0))))))));
+
+        // cos(x) is c, -s, -c, s in quadrants q = 0, 1, 2, 3. The quadrant
+        // is picked arithmetically (no branches) so that loops vectorize.
+        double q = k - 4.0 * round_nearest(k * 0.25 - 0.375);
+        double half = round_nearest(q * 0.5 - 0.25);
+        double odd = q - 2.0 * half;
+        double sign = 1.0 - 2.0 * (half + odd - 2.0 * half * odd);
+        return sign * (c * (1.0 - odd) + s * odd);
+    }
+};
+
+/**
+ * Low-accuracy cosine (absolute error up to about 0.06): reduction to
+ * [-pi, pi] and a parabola fit of sin(x + pi/2). This is what
+ * SKYLARK_INEXACT_COSINE used to select.
+ */
+struct low_cos_t {
+    double operator()(double x) const {
+        x -= 6.28318531 * round_nearest(x * 0.159154943);
+        x += 1.57079632;
+        if (x >  3.14159265)
+            x -= 6.28318531;
+        return (x < 0) ?
+            1.27323954 * x + 0.405284735 * x * x :
+            1.27323954 * x - 0.405284735 * x * x;
+    }
+};
+
+template<typename T, typename CosineType>
+void scaled_cosine_impl(T* A, int m, int n, int ld,
+    const double* scales, const double* shifts, int stride, bool by_row,
+    double outscale, CosineType cosine) {
+
+#   if SKYLARK_HAVE_OPENMP
+#   pragma omp parallel for if(n > 1)
+#   endif
+    for(int j = 0; j < n; j++) {
+        T* a = A + static_cast<size_t>(j) * ld;
+        if (by_row) {
+            if (scales == NULL)
+                for(int i = 0; i < m; i++)
+                    a[i] = outscale * cosine(a[i] + shifts[i * stride]);
+            else
+                for(int i = 0; i < m; i++)
+                    a[i] = outscale * cosine(scales[i * stride] * a[i] +
+                        shifts[i * stride]);
+        } else {
+            double sc = scales == NULL ? 1.0 : scales[j * stride];
+            double sh = shifts[j * stride];
+            for(int i = 0; i < m; i++)
+                a[i] = outscale * cosine(sc * a[i] + sh);
+        }
+    }
+}
+
+/**
+ * Fused post-processing of random features, in-place on the column-major
+ * m x n buffer A with leading dimension ld:
+ *
+ *     A(i, j) <- outscale * cos(scale * A(i, j) + shift)
+ *
+ * where scale and shift are scales[i * stride] and shifts[i * stride] if
+ * by_row (features along the columns), and are indexed by j otherwise.
+ * scales may be NULL (all ones).
+ */
+template<typename T>
+void scaled_cosine(T* A, int m, int n, int ld,
+    const double* scales, const double* shifts, int stride, bool by_row,
+    double outscale, cosine_accuracy_t accuracy = get_cosine_accuracy()) {
+
+    switch (accuracy) {
+    case COSINE_POLYNOMIAL:
+        scaled_cosine_impl(A, m, n, ld, scales, shifts, stride, by_row,
+            outscale, polynomial_cos_t());
+        break;
+
+    case COSINE_LOW:
+        scaled_cosine_impl(A, m, n, ld, scales, shifts, stride, by_row,
+            outscale, low_cos_t());
+        break;
+
+    default:
+        scaled_cosine_impl(A, m, n, ld, scales, shifts, stride, by_row,
+            outscale, exact_cos_t());
+    }
+}
+
+} // namespace internal
+
+} } /** namespace skylark::sketch */
+
+#endif // SKYLARK_TRIG_KERNELS_HPP
@@ -0,0 +1,87 @@
+#include <vector>
+#include <cmath>
+
+#include <boost/mpi.hpp>
+#include <boost/test/minimal.hpp>
+
+#include <elemental.hpp>
+#include <skylark.hpp>
+
+#include "../../base/dist_sparse_matrix.hpp"
+#include "../../algorithms/asynch/DistAsyRGS.hpp"
+#include "dist_laplacian.hpp"
+
+typedef elem::DistMatrix<double, elem::VC, elem::STAR> DistMatrixVCSType;
+
+static const int N = 40;
+
+/** ||B - A X||_F / ||B||_F, computed explicitly. */
+double relres(const skylark::base::dist_sparse_matrix_t<double> &A,
+    const DistMatrixVCSType &B, const DistMatrixVCSType &X) {
+
+    DistMatrixVCSType R(B);
+    skylark::base::Gemm(elem::TRANSPOSE, elem::NORMAL, -1.0, A, X, 1.0, R);
+
+    double local[2] = {0.0, 0.0}, total[2];
+    for(int il = 0; il < B.LocalHeight(); il++)
+        for(int r = 0; r < B.Width(); r++) {
+            local[0] += R.GetLocal(il, r) * R.GetLocal(il, r);
+            local[1] += B.GetLocal(il, r) * B.GetLocal(il, r);
+        }
+    boost::mpi::all_reduce(A.comm(), local, 2, total, std::plus<double>());
+    return std::sqrt(total[0] / total[1]);
+}
+
+int test_main(int argc, char *argv[]) {
+
+    namespace mpi = boost::mpi;
+    namespace skyalg = skylark::algorithms;
+
+    mpi::environment env (argc, argv);
+    mpi::communicator world;
+
+    elem::Initialize (argc, argv);
+
+    // With more than two ranks, rank 1 owns no rows.
+    dist_laplacian_t L(world, N, 0.2);
+    skylark::base::dist_sparse_matrix_t<double> A(world, L.local);
+
+    skylark::base::context_t context(38734);
+
+    for(int k = 1; k <= 3; k += 2) {
+        DistMatrixVCSType B(L.n, k);
+        for(int il = 0; il < B.LocalHeight(); il++) {
+            int i = B.ColShift() + B.ColStride() * il;
+            for(int r = 0; r < k; r++)
+                B.SetLocal(il, r, std::sin(0.3 * i + r));
+        }
+
+        //////////////////////////////////////////////////////////////////////
+        //[> To a tolerance, checked exactly <]
+
+        DistMatrixVCSType X(L.n, k);
+        elem::MakeZeros(X);
+        skyalg::asy_iter_params_t params(1e-8, 5, 400);
+        int ret = skyalg::AsyRGS(A, B, X, context, params);
+        double res = relres(A, B, X);
+        if (world.rank() == 0)
+            std::cout << "k = " << k << ": ret = " << ret
+                      << ", relres = " << res << std::endl;
+        BOOST_REQUIRE(ret == -1);
+        BOOST_REQUIRE(res < 1e-8);
+
+        //////////////////////////////////////////////////////////////////////
+        //[> A fixed number of sweeps, without synchronization <]
+
+        DistMatrixVCSType X0(L.n, k);
+        elem::MakeZeros(X0);
+        skyalg::asy_iter_params_t fixed(0, 0, 30);
+        ret = skyalg::AsyRGS(A, B, X0, context, fixed);
+        res = relres(A, B, X0);
+        BOOST_REQUIRE(ret == -6);
+        BOOST_REQUIRE(res < 0.05);
+    }
+
+    elem::Finalize();
+    return 0;
+}
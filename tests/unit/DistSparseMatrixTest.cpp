@@ -0,0 +1,128 @@
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <boost/mpi.hpp>
+#include <boost/test/minimal.hpp>
+
+#include <elemental.hpp>
+#include <skylark.hpp>
+
+#include "../../base/dist_sparse_matrix.hpp"
+#include "dist_laplacian.hpp"
+
+typedef elem::DistMatrix<double, elem::VC, elem::STAR> DistMatrixVCSType;
+
+static const int N = 12;
+static const int k = 3;
+
+/** Entries of the test matrix X, by global index. */
+double x_entry(int i, int r) {
+    return i + 0.25 * r;
+}
+
+int test_main(int argc, char *argv[]) {
+
+    namespace mpi = boost::mpi;
+    namespace skybase = skylark::base;
+
+    mpi::environment env (argc, argv);
+    mpi::communicator world;
+
+    elem::Initialize (argc, argv);
+
+    dist_laplacian_t L(world, N, 0.2);
+    skybase::dist_sparse_matrix_t<double> A(world, L.local);
+
+    int first = A.first();
+    int nloc = A.local_width();
+    BOOST_REQUIRE(A.height() == L.n && A.width() == L.n);
+    BOOST_REQUIRE(first == L.starts[world.rank()]);
+    BOOST_REQUIRE(nloc == L.starts[world.rank() + 1] - first);
+
+    //////////////////////////////////////////////////////////////////////////
+    //[> Halo: ghosts and local numbering <]
+
+    const std::vector<int> &ghosts = A.ghosts();
+    for(size_t g = 0; g < ghosts.size(); g++) {
+        BOOST_REQUIRE(ghosts[g] < first || ghosts[g] >= first + nloc);
+        BOOST_REQUIRE(g == 0 || ghosts[g - 1] < ghosts[g]);
+        BOOST_REQUIRE(A.owner(ghosts[g]) != world.rank());
+    }
+
+    const skybase::sparse_index_t *lindices = A.local_indices();
+    for(size_t l = 0; l < L.indices.size(); l++) {
+        int i = L.indices[l];
+        int li = lindices[l];
+        if (i >= first && i < first + nloc)
+            BOOST_REQUIRE(li == i - first);
+        else
+            BOOST_REQUIRE(li >= nloc && ghosts[li - nloc] == i);
+    }
+
+    // Every rank sends exactly the rows the others hold as ghosts.
+    int nsent = A.send_rows().size(), nghosts = ghosts.size();
+    int total_sent, total_ghosts;
+    mpi::all_reduce(world, nsent, total_sent, std::plus<int>());
+    mpi::all_reduce(world, nghosts, total_ghosts, std::plus<int>());
+    BOOST_REQUIRE(total_sent == total_ghosts);
+
+    //////////////////////////////////////////////////////////////////////////
+    //[> to_blocks, exchange_ghosts and from_blocks <]
+
+    DistMatrixVCSType X(L.n, k);
+    for(int il = 0; il < X.LocalHeight(); il++)
+        for(int r = 0; r < k; r++)
+            X.SetLocal(il, r, x_entry(X.ColShift() + X.ColStride() * il, r));
+
+    // A padded row stride, as the solvers use.
+    int ks = k + 1;
+    std::vector<double> rows(std::max(ks * (nloc + nghosts), 1), -1.0);
+    A.to_blocks(X, &rows[0], ks);
+    for(int j = 0; j < nloc; j++)
+        for(int r = 0; r < k; r++)
+            if (rows[j * ks + r] != x_entry(first + j, r))
+                BOOST_FAIL("to_blocks misplaced an owned row");
+
+    A.exchange_ghosts(&rows[0], k, ks);
+    for(int g = 0; g < nghosts; g++)
+        for(int r = 0; r < k; r++)
+            if (rows[(nloc + g) * ks + r] != x_entry(ghosts[g], r))
+                BOOST_FAIL("exchange_ghosts filled a ghost row wrong");
+
+    DistMatrixVCSType Y(L.n, k);
+    elem::MakeZeros(Y);
+    A.from_blocks(&rows[0], ks, Y);
+    for(int il = 0; il < Y.LocalHeight(); il++)
+        for(int r = 0; r < k; r++)
+            if (Y.GetLocal(il, r) != X.GetLocal(il, r))
+                BOOST_FAIL("from_blocks does not invert to_blocks");
+
+    //////////////////////////////////////////////////////////////////////////
+    //[> Gemm <]
+
+    DistMatrixVCSType Z(L.n, k);
+    elem::MakeZeros(Z);
+    skybase::Gemm(elem::TRANSPOSE, elem::NORMAL, 2.0, A, X, 0.0, Z);
+    skybase::Gemm(elem::TRANSPOSE, elem::NORMAL, -1.0, A, X, 1.0, Z);
+    for(int il = 0; il < Z.LocalHeight(); il++) {
+        int i = Z.ColShift() + Z.ColStride() * il;
+        for(int r = 0; r < k; r++) {
+            double expected = L.apply(i,
+                [r](int j) { return x_entry(j, r); });
+            if (std::abs(Z.GetLocal(il, r) - expected) > 1e-10)
+                BOOST_FAIL("Result of Gemm is wrong");
+        }
+    }
+
+    bool thrown = false;
+    try {
+        skybase::Gemm(elem::NORMAL, elem::NORMAL, 1.0, A, X, 0.0, Z);
+    } catch (skybase::unsupported_base_operation &) {
+        thrown = true;
+    }
+    BOOST_REQUIRE(thrown);
+
+    elem::Finalize();
+    return 0;
+}
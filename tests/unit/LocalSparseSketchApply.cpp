@@ -86,12 +86,13 @@ int test_main(int argc, char *argv[]) {
     A.attach(&colsf[0], &rowsf[0], &valsf[0], matrix_full, n, m, false);
 
     count = 1;
-    const int* indptr = A.indptr();
-    const int* indices = A.indices();
+    const Matrix_t::index_type* indptr = A.indptr();
+    const Matrix_t::index_type* indices = A.indices();
     const double* values = A.locked_values();
 
     for(int col = 0; col < A.width(); col++) {
-        for(int idx = indptr[col]; idx < indptr[col + 1]; idx++) {
+        for(Matrix_t::index_type idx = indptr[col]; idx < indptr[col + 1];
+            idx++) {
             BOOST_REQUIRE( values[idx] == count );
             count++;
         }
@@ -118,12 +119,43 @@ int test_main(int argc, char *argv[]) {
     values = A_coord.locked_values();
 
     for(int col = 0; col < A_coord.width(); col++) {
-        for(int idx = indptr[col]; idx < indptr[col + 1]; idx++) {
+        for(Matrix_t::index_type idx = indptr[col]; idx < indptr[col + 1];
+            idx++) {
             BOOST_REQUIRE( values[idx] == count );
             count++;
         }
     }
 
+    //////////////////////////////////////////////////////////////////////////
+    //[> Test sorted invariant <]
+    BOOST_REQUIRE( A_coord.sorted() );
+    BOOST_REQUIRE( !A.sorted() );
+
+    std::vector<int> rowsr(matrix_full);
+    std::vector<double> valsr(matrix_full);
+    for(size_t i = 0; i < matrix_full; ++i) {
+        rowsr[i] = n - 1 - rowsf[i];
+        valsr[i] = valsf[i];
+    }
+
+    Matrix_t A_rev;
+    A_rev.attach(&colsf[0], &rowsr[0], &valsr[0], matrix_full, n, m, false);
+    A_rev.sort_indices();
+    BOOST_REQUIRE( A_rev.sorted() );
+
+    // attached buffers are left untouched
+    BOOST_REQUIRE( rowsr[0] == n - 1 );
+
+    indptr = A_rev.indptr();
+    indices = A_rev.indices();
+    values = A_rev.locked_values();
+    for(int col = 0; col < A_rev.width(); col++)
+        for(Matrix_t::index_type idx = indptr[col]; idx < indptr[col + 1];
+            idx++) {
+            BOOST_REQUIRE( indices[idx] == idx - indptr[col] );
+            BOOST_REQUIRE( values[idx] == (col + 1) * n - (idx - indptr[col]) );
+        }
+
     //////////////////////////////////////////////////////////////////////////
     //[> Column wise application <]
 
@@ -162,7 +194,8 @@ int test_main(int argc, char *argv[]) {
     //   col_idx * n + row_idx + 1.
     // See creation of A.
     for(int col = 0; col < pi_sketch.width(); col++) {
-        for(int idx = indptr[col]; idx < indptr[col + 1]; idx++) {
+        for(Matrix_t::index_type idx = indptr[col]; idx < indptr[col + 1];
+            idx++) {
             for(int ccol = 0; ccol < m; ++ccol) {
                 typename Matrix_t::coord_tuple_t new_entry(indices[idx], ccol,
                     values[idx] * (ccol * n + col + 1));
@@ -216,7 +249,8 @@ int test_main(int argc, char *argv[]) {
     //   col_idx * n + row_idx + 1.
     // See creation of A.
     for(int col = 0; col < pi_sketch_row.width(); col++) {
-        for(int idx = indptr[col]; idx < indptr[col + 1]; idx++) {
+        for(Matrix_t::index_type idx = indptr[col]; idx < indptr[col + 1];
+            idx++) {
             for(int row = 0; row < n; ++row) {
                 typename Matrix_t::coord_tuple_t new_entry(row, col,
                     values[idx] * (indices[idx] * n + row + 1));
@@ -0,0 +1,148 @@
+#include <vector>
+#include <cmath>
+#include <future>
+
+#include <boost/mpi.hpp>
+#include <boost/test/minimal.hpp>
+
+#include <elemental.hpp>
+#include <skylark.hpp>
+
+#include "../../ml/kernels.hpp"
+#include "../../ml/model.hpp"
+#include "../../ml/predictor.hpp"
+
+typedef elem::Matrix<double> MatrixType;
+typedef skylark::ml::model_t<MatrixType, MatrixType> ModelType;
+typedef skylark::ml::online_predictor_t<MatrixType, MatrixType> PredictorType;
+
+static const int d = 20;
+static const int n = 300;
+static const int k = 3;
+static const double tol = 1e-10;
+
+void check_result(const skylark::ml::prediction_t &p, const MatrixType &PV,
+    const MatrixType &DV, int i, const std::string error) {
+
+    for(int c = 0; c < k; c++)
+        if (std::abs(p.decision_values[c] - DV.Get(i, c)) > tol) {
+            std::cout << p.decision_values[c] << " != " << DV.Get(i, c)
+                      << " at example " << i << std::endl;
+            BOOST_FAIL(error.c_str());
+        }
+    BOOST_REQUIRE(p.label == PV.Get(i, 0));
+}
+
+int test_main(int argc, char *argv[]) {
+
+    namespace mpi = boost::mpi;
+    namespace ml = skylark::ml;
+
+    mpi::environment env (argc, argv);
+    mpi::communicator world;
+
+    elem::Initialize (argc, argv);
+
+    skylark::base::context_t context(23234);
+
+    ml::kernels::gaussian_t kernel(d, 2.0);
+    std::vector<const ModelType::feature_transform_type *> maps;
+    for(int j = 0; j < 5; j++)
+        maps.push_back(kernel.template create_rft<MatrixType, MatrixType>(
+                10 + 3 * j, ml::regular_feature_transform_tag(), context));
+
+    ModelType model(maps, true, 10 * 5 + 3 * 10, k);
+    MatrixType &W = model.get_coef();
+    for(int j = 0; j < k; j++)
+        for(int i = 0; i < W.Height(); i++)
+            W.Set(i, j, std::sin(3.0 * i + j));
+
+    MatrixType X;
+    elem::Uniform(X, d, n);
+
+    // Reference: the batch prediction of the model itself.
+    MatrixType PV, DV;
+    model.predict(X, PV, DV);
+
+    for(int T = 1; T <= 3; T += 2) {
+        PredictorType predictor(model, 16, 1e-3, T);
+
+        //////////////////////////////////////////////////////////////////////
+        //[> Direct evaluation <]
+
+        MatrixType PVp, DVp;
+        predictor.predict(X, PVp, DVp);
+        for(int i = 0; i < n; i++)
+            for(int c = 0; c < k; c++)
+                if (std::abs(DVp.Get(i, c) - DV.Get(i, c)) > tol)
+                    BOOST_FAIL("Result of predict does not match the model");
+
+        //////////////////////////////////////////////////////////////////////
+        //[> Dense and sparse submits <]
+
+        std::vector<std::future<ml::prediction_t> > dense, sparse;
+        std::vector<std::vector<int> > idx(n);
+        std::vector<std::vector<double> > val(n);
+        for(int i = 0; i < n; i++) {
+            dense.push_back(predictor.submit(X.LockedBuffer(0, i)));
+
+            // Only the odd features, the rest are passed as zeros.
+            for(int l = 1; l < d; l += 2) {
+                idx[i].push_back(l);
+                val[i].push_back(X.Get(l, i));
+            }
+            sparse.push_back(predictor.submit(idx[i].data(), val[i].data(),
+                    idx[i].size()));
+        }
+
+        MatrixType Xodd(X);
+        for(int i = 0; i < n; i++)
+            for(int l = 0; l < d; l += 2)
+                Xodd.Set(l, i, 0.0);
+        MatrixType PVodd, DVodd;
+        model.predict(Xodd, PVodd, DVodd);
+
+        for(int i = 0; i < n; i++) {
+            check_result(dense[i].get(), PV, DV, i,
+                "Result of dense submit does not match the model");
+            check_result(sparse[i].get(), PVodd, DVodd, i,
+                "Result of sparse submit does not match the model");
+        }
+
+        //////////////////////////////////////////////////////////////////////
+        //[> An empty sparse example is the zero example <]
+
+        std::vector<double> zero(d, 0.0);
+        std::future<ml::prediction_t> fz = predictor.submit(zero.data());
+        std::future<ml::prediction_t> fe =
+            predictor.submit(static_cast<const int *>(NULL),
+                static_cast<const double *>(NULL), 0);
+        ml::prediction_t pz = fz.get(), pe = fe.get();
+        for(int c = 0; c < k; c++)
+            BOOST_REQUIRE(std::abs(pz.decision_values[c] -
+                    pe.decision_values[c]) <= tol);
+
+        //////////////////////////////////////////////////////////////////////
+        //[> Negative feature indices are rejected <]
+
+        int bad_idx = -1;
+        double bad_val = 1.0;
+        bool thrown = false;
+        try {
+            predictor.submit(&bad_idx, &bad_val, 1);
+        } catch (skylark::base::skylark_exception &) {
+            thrown = true;
+        }
+        BOOST_REQUIRE(thrown);
+
+        ml::predictor_stats_t stats = predictor.stats();
+        BOOST_REQUIRE(stats.requests == 2 * n + 2);
+        BOOST_REQUIRE(stats.batches >= (2 * n + 2) / 16);
+    }
+
+    for(size_t j = 0; j < maps.size(); j++)
+        delete maps[j];
+
+    elem::Finalize();
+    return 0;
+}
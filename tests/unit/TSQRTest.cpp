@@ -0,0 +1,180 @@
+#include <vector>
+#include <cmath>
+
+#include <boost/mpi.hpp>
+#include <boost/test/minimal.hpp>
+
+#include <elemental.hpp>
+#include <skylark.hpp>
+
+#include "../../base/QR.hpp"
+#include "../../algorithms/regression/regression_problem.hpp"
+#include "../../algorithms/regression/sketched_regression_solver.hpp"
+
+typedef elem::Matrix<double> MatrixType;
+typedef elem::DistMatrix<double, elem::VC, elem::STAR> DistMatrixVCSType;
+typedef elem::DistMatrix<double, elem::STAR, elem::STAR> DistMatrixSSType;
+
+static const int m = 400;
+static const int n = 6;
+static const double tol = 1e-8;
+
+/** Entries of the test matrix and of the exact solution, by global index. */
+double a_entry(int i, int j) {
+    return std::cos(0.37 * i * (j + 1) + j) + (i % n == j ? 2.0 : 0.0);
+}
+
+double x_entry(int j) {
+    return 1.0 + 0.5 * j;
+}
+
+/** Rows [start, start + height) of A, and of b = A x (+ noise). */
+void fill_rows(int start, int height, MatrixType &A, MatrixType &b,
+    bool noise) {
+
+    A.Resize(height, n);
+    b.Resize(height, 1);
+    for(int i = 0; i < height; i++) {
+        double bi = noise ? 0.1 * std::sin(3.1 * (start + i)) : 0.0;
+        for(int j = 0; j < n; j++) {
+            A.Set(i, j, a_entry(start + i, j));
+            bi += a_entry(start + i, j) * x_entry(j);
+        }
+        b.Set(i, 0, bi);
+    }
+}
+
+/**
+ * Factors A with TSQR over comm, one block per rank (with uneven heights,
+ * rank 1 having none), and checks R^T R = A^T A and the least-squares
+ * solution of a consistent system.
+ */
+void check_tsqr(const boost::mpi::communicator &comm) {
+
+    int P = comm.size();
+    int rank = comm.rank();
+
+    // Block heights: rank 1 owns no rows, the others share the rest.
+    std::vector<int> heights(P, 0), starts(P + 1, 0);
+    int owners = P > 1 ? P - 1 : 1;
+    for(int q = 0, o = 0; q < P; q++) {
+        if (q == 1)
+            continue;
+        heights[q] = m / owners + (o < m % owners ? 1 : 0);
+        o++;
+    }
+    for(int q = 0; q < P; q++)
+        starts[q + 1] = starts[q] + heights[q];
+
+    MatrixType A, b;
+    fill_rows(starts[rank], heights[rank], A, b, false);
+
+    skylark::base::qr::tsqr_t<double> tsqr(comm);
+    tsqr.factor(A);
+    const MatrixType &R = tsqr.R();
+    BOOST_REQUIRE(R.Height() == n && R.Width() == n);
+
+    // R^T R against A^T A, accumulated over all rows.
+    for(int j = 0; j < n; j++)
+        for(int l = 0; l < n; l++) {
+            double rr = 0.0, aa = 0.0;
+            for(int t = 0; t < n; t++)
+                rr += R.Get(t, j) * R.Get(t, l);
+            for(int i = 0; i < m; i++)
+                aa += a_entry(i, j) * a_entry(i, l);
+            if (std::abs(rr - aa) > tol * std::abs(aa) + tol)
+                BOOST_FAIL("R^T R does not match A^T A");
+        }
+
+    // Q^T b, then R x = Q^T b, recovers the solution.
+    MatrixType C;
+    tsqr.apply_adjoint_Q(b, C);
+    elem::Trsm(elem::LEFT, elem::UPPER, elem::NORMAL, elem::NON_UNIT,
+        1.0, R, C, true);
+    for(int j = 0; j < n; j++)
+        if (std::abs(C.Get(j, 0) - x_entry(j)) > tol)
+            BOOST_FAIL("TSQR least-squares solution is wrong");
+}
+
+/** ||A x - b|| for the global A, b (noisy) and a replicated x. */
+double residual(const DistMatrixSSType &x) {
+    double r = 0.0;
+    for(int i = 0; i < m; i++) {
+        double bi = 0.1 * std::sin(3.1 * i);
+        for(int j = 0; j < n; j++)
+            bi += a_entry(i, j) * x_entry(j);
+        for(int j = 0; j < n; j++)
+            bi -= a_entry(i, j) * x.GetLocal(j, 0);
+        r += bi * bi;
+    }
+    return std::sqrt(r);
+}
+
+int test_main(int argc, char *argv[]) {
+
+    namespace mpi = boost::mpi;
+    namespace skyalg = skylark::algorithms;
+
+    mpi::environment env (argc, argv);
+    mpi::communicator world;
+
+    elem::Initialize (argc, argv);
+
+    //////////////////////////////////////////////////////////////////////////
+    //[> base::qr::tsqr_t, on all ranks and on a non power of two <]
+
+    check_tsqr(world);
+
+    mpi::communicator sub = world.split(world.rank() < 3 ? 0 : 1);
+    if (world.rank() < 3)
+        check_tsqr(sub);
+
+    //////////////////////////////////////////////////////////////////////////
+    //[> Sketch-and-solve with the TSQR solver <]
+
+    DistMatrixVCSType A(m, n), b(m, 1);
+    for(int il = 0; il < A.LocalHeight(); il++) {
+        int i = A.ColShift() + A.ColStride() * il;
+        double bi = 0.1 * std::sin(3.1 * i);
+        for(int j = 0; j < n; j++) {
+            A.SetLocal(il, j, a_entry(i, j));
+            bi += a_entry(i, j) * x_entry(j);
+        }
+        b.SetLocal(il, 0, bi);
+    }
+
+    typedef skyalg::regression_problem_t<DistMatrixVCSType,
+                                         skyalg::linear_tag,
+                                         skyalg::l2_tag,
+                                         skyalg::no_reg_tag> ptype;
+    ptype problem(m, n, A);
+
+    typedef skyalg::sketched_regression_solver_t<
+        ptype, DistMatrixVCSType, DistMatrixSSType, skyalg::linear_tag,
+        MatrixType, MatrixType, skylark::sketch::JLT_t,
+        skyalg::tsqr_l2_solver_tag> solver_type;
+
+    skylark::base::context_t context(2718);
+
+    // A sketch size of at least the local heights solves exactly.
+    DistMatrixSSType x_exact;
+    solver_type exact(problem, m, context);
+    exact.solve(b, x_exact);
+    double r_exact = residual(x_exact);
+
+    // Every rank sketches its rows down to 4n.
+    DistMatrixSSType x_sketched;
+    solver_type sketched(problem, 4 * n, context);
+    sketched.solve(b, x_sketched);
+    double r_sketched = residual(x_sketched);
+
+    if (world.rank() == 0)
+        std::cout << "Residual: exact " << r_exact
+                  << ", sketched " << r_sketched << std::endl;
+
+    BOOST_REQUIRE(r_sketched >= r_exact * (1 - tol));
+    BOOST_REQUIRE(r_sketched <= 2 * r_exact);
+
+    elem::Finalize();
+    return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef DIST_LAPLACIAN_HPP
+#define DIST_LAPLACIAN_HPP
+
+#include <vector>
+
+#include <boost/mpi.hpp>
+
+#include "../../base/sparse_matrix.hpp"
+
+/**
+ * Block of columns of the shifted 2D Laplacian (N x N grid, diagonal
+ * shift + 4) owned by this rank, for testing distributed sparse matrices.
+ * Blocks are uneven, and with more than two ranks rank 1 owns no columns.
+ * The arrays hold the storage the local matrix is attached to.
+ */
+struct dist_laplacian_t {
+
+    typedef skylark::base::sparse_index_t index_type;
+
+    dist_laplacian_t(const boost::mpi::communicator& comm, int N,
+        double shift) : N(N), n(N * N), shift(shift) {
+
+        int P = comm.size();
+        starts.resize(P + 1);
+        for(int q = 0; q <= P; q++)
+            starts[q] = static_cast<int>(
+                static_cast<long>(n) * q * q / (static_cast<long>(P) * P));
+        if (P > 2)
+            starts[2] = starts[1];
+
+        int first = starts[comm.rank()];
+        int last = starts[comm.rank() + 1];
+        indptr.push_back(0);
+        for(int c = first; c < last; c++) {
+            int x = c % N, y = c / N;
+            if (y > 0)
+                add(c - N, -1.0);
+            if (x > 0)
+                add(c - 1, -1.0);
+            add(c, 4.0 + shift);
+            if (x < N - 1)
+                add(c + 1, -1.0);
+            if (y < N - 1)
+                add(c + N, -1.0);
+            indptr.push_back(indices.size());
+        }
+
+        local.attach(&indptr[0], indices.empty() ? NULL : &indices[0],
+            values.empty() ? NULL : &values[0], indices.size(), n,
+            last - first);
+    }
+
+    /** Row i of A * x, for x given by a function of the global index. */
+    template<typename F>
+    double apply(int i, F x) const {
+        int cx = i % N, cy = i / N;
+        double y = (4.0 + shift) * x(i);
+        if (cy > 0)
+            y -= x(i - N);
+        if (cx > 0)
+            y -= x(i - 1);
+        if (cx < N - 1)
+            y -= x(i + 1);
+        if (cy < N - 1)
+            y -= x(i + N);
+        return y;
+    }
+
+    const int N, n;
+    const double shift;
+    std::vector<int> starts;
+    std::vector<index_type> indptr, indices;
+    std::vector<double> values;
+    skylark::base::sparse_matrix_t<double> local;
+
+private:
+    void add(int i, double v) {
+        indices.push_back(i);
+        values.push_back(v);
+    }
+};
+
+#endif // DIST_LAPLACIAN_HPP
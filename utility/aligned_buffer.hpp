@@ -0,0 +1,67 @@
+#ifndef SKYLARK_ALIGNED_BUFFER_HPP
+#define SKYLARK_ALIGNED_BUFFER_HPP
+
+#include <cstdlib>
+#include <new>
+
+namespace skylark { namespace utility {
+
+/**
+ * Uninitialized buffer aligned to a cache line (64 bytes by default), for
+ * scratch space that is reused across many calls, e.g. per-thread
+ * workspaces. Aligned buffers also let FFTW use its SIMD codelets.
+ */
+template<typename T, size_t Alignment = 64>
+struct aligned_buffer_t {
+
+    typedef T value_type;
+
+    aligned_buffer_t() : _size(0), _data(NULL) {
+
+    }
+
+    explicit aligned_buffer_t(size_t size) : _size(0), _data(NULL) {
+        resize(size);
+    }
+
+    ~aligned_buffer_t() {
+        std::free(_data);
+    }
+
+    /** Resizes the buffer. The contents are not preserved. */
+    void resize(size_t size) {
+        if (size == _size)
+            return;
+        std::free(_data);
+        _data = NULL;
+        _size = 0;
+        if (size == 0)
+            return;
+
+        void *p;
+        if (posix_memalign(&p, Alignment, size * sizeof(value_type)) != 0)
+            throw std::bad_alloc();
+        _data = static_cast<value_type *>(p);
+        _size = size;
+    }
+
+    size_t size() const { return _size; }
+
+    value_type *data() { return _data; }
+    const value_type *data() const { return _data; }
+
+    value_type& operator[](size_t i) { return _data[i]; }
+    const value_type& operator[](size_t i) const { return _data[i]; }
+
+private:
+    size_t _size;
+    value_type *_data;
+
+    // Non-copyable: the memory is owned.
+    aligned_buffer_t(const aligned_buffer_t&);
+    aligned_buffer_t& operator=(const aligned_buffer_t&);
+};
+
+} } // namespace skylark::utility
+
+#endif // SKYLARK_ALIGNED_BUFFER_HPP
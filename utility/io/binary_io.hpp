@@ -0,0 +1,450 @@
+#ifndef SKYLARK_BINARY_IO_HPP
+#define SKYLARK_BINARY_IO_HPP
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/mpi.hpp>
+
+namespace skylark { namespace utility { namespace io {
+
+/**
+ * Binary matrix file format: a header followed by sections that each start
+ * at a multiple of 64 bytes. Examples are columns, as everywhere in io.
+ *
+ *   labels   width values
+ *   dense:   X column-major, leading dimension height
+ *   sparse:  indptr (width + 1 int64, global offsets), indices
+ *            (nnz, index_size bytes each) and values (nnz)
+ *
+ * Numbers are stored in the native byte order of the writer.
+ */
+struct binary_header_t {
+    char magic[8];
+    boost::uint32_t version;
+    boost::uint32_t sparse;
+    boost::uint32_t value_size;
+    boost::uint32_t index_size;
+    boost::uint64_t height, width, nnz;
+    boost::uint64_t labels_offset, data_offset;
+    boost::uint64_t indices_offset, values_offset;
+    char pad[48];
+};
+
+namespace internal {
+
+static const char binary_magic[8] = {'S', 'K', 'Y', 'L', 'A', 'R', 'K', 'B'};
+
+inline boost::uint64_t align64(boost::uint64_t offset) {
+    return (offset + 63) / 64 * 64;
+}
+
+/** Fills the section offsets of h from its sizes. Returns the file size. */
+inline boost::uint64_t binary_layout(binary_header_t& h) {
+    h.labels_offset = align64(sizeof(binary_header_t));
+    h.data_offset = align64(h.labels_offset + h.width * h.value_size);
+    if (!h.sparse) {
+        h.indices_offset = h.values_offset = 0;
+        return h.data_offset + h.height * h.width * h.value_size;
+    }
+    h.indices_offset = align64(h.data_offset + (h.width + 1) * 8);
+    h.values_offset = align64(h.indices_offset + h.nnz * h.index_size);
+    return h.values_offset + h.nnz * h.value_size;
+}
+
+inline void binary_io_fail(const std::string& msg) {
+    SKYLARK_THROW_EXCEPTION (
+        base::io_exception()
+            << base::error_msg(msg + ": " + std::strerror(errno)) );
+}
+
+inline void binary_pwrite(int fd, const void *buf, size_t bytes,
+    boost::uint64_t offset) {
+    const char *p = static_cast<const char *>(buf);
+    while (bytes > 0) {
+        ssize_t w = pwrite(fd, p, bytes, offset);
+        if (w <= 0)
+            binary_io_fail("cannot write binary matrix file");
+        p += w;
+        bytes -= w;
+        offset += w;
+    }
+}
+
+/**
+ * Collective part of writing: gathers the sizes of the local blocks of
+ * columns, lets rank 0 create the file and write the header, and returns
+ * the header with the offsets of this rank's first column and non-zero.
+ */
+template<typename T>
+binary_header_t binary_begin_write(const boost::mpi::communicator& comm,
+    const std::string& fname, bool sparse, int height, int nlocal,
+    boost::uint64_t nnzlocal, boost::uint64_t& first,
+    boost::uint64_t& nzfirst) {
+
+    std::vector<int> ns;
+    std::vector<boost::uint64_t> nnzs;
+    boost::mpi::all_gather(comm, nlocal, ns);
+    boost::mpi::all_gather(comm, nnzlocal, nnzs);
+
+    binary_header_t h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, binary_magic, sizeof(h.magic));
+    h.version = 1;
+    h.sparse = sparse;
+    h.value_size = sizeof(T);
+    h.index_size = sizeof(base::sparse_index_t);
+    h.height = boost::mpi::all_reduce(comm, height,
+        boost::mpi::maximum<int>());
+    for(int p = 0; p < comm.size(); p++) {
+        if (p == comm.rank()) {
+            first = h.width;
+            nzfirst = h.nnz;
+        }
+        h.width += ns[p];
+        h.nnz += nnzs[p];
+    }
+    boost::uint64_t size = binary_layout(h);
+
+    int ok = 1;
+    if (comm.rank() == 0) {
+        int fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ok = fd != -1 && ftruncate(fd, size) == 0 &&
+            pwrite(fd, &h, sizeof(h), 0) == sizeof(h);
+        if (fd != -1)
+            close(fd);
+    }
+    boost::mpi::broadcast(comm, ok, 0);
+    if (!ok)
+        binary_io_fail("cannot create " + fname);
+
+    return h;
+}
+
+} // namespace internal
+
+/**
+ * Writes a dense matrix distributed by blocks of columns (rank r holds the
+ * columns that follow those of rank r - 1), and its labels, to a binary
+ * matrix file. All ranks write their blocks at the same time.
+ *
+ * @param comm communicator (all ranks must call).
+ * @param fname output file name.
+ * @param X local block of columns.
+ * @param Y local labels (a row or column vector).
+ */
+template<typename T>
+void WriteBinary(const boost::mpi::communicator& comm, const std::string& fname,
+    const elem::Matrix<T>& X, const elem::Matrix<T>& Y) {
+
+    boost::uint64_t first, nzfirst;
+    binary_header_t h = internal::binary_begin_write<T>(comm, fname, false,
+        X.Height(), X.Width(), 0, first, nzfirst);
+
+    int fd = open(fname.c_str(), O_WRONLY);
+    if (fd == -1)
+        internal::binary_io_fail("cannot open " + fname);
+
+    std::vector<T> y(X.Width());
+    for(int j = 0; j < X.Width(); j++)
+        y[j] = Y.Height() == 1 ? Y.Get(0, j) : Y.Get(j, 0);
+    internal::binary_pwrite(fd, y.data(), y.size() * sizeof(T),
+        h.labels_offset + first * sizeof(T));
+
+    // Columns are padded with zeros up to the global height.
+    std::vector<T> x(h.height, T(0));
+    for(int j = 0; j < X.Width(); j++) {
+        std::copy(X.LockedBuffer(0, j), X.LockedBuffer(0, j) + X.Height(),
+            x.begin());
+        internal::binary_pwrite(fd, x.data(), h.height * sizeof(T),
+            h.data_offset + (first + j) * h.height * sizeof(T));
+    }
+
+    close(fd);
+    comm.barrier();
+}
+
+/**
+ * Same as above, with X a local sparse matrix.
+ */
+template<typename T>
+void WriteBinary(const boost::mpi::communicator& comm, const std::string& fname,
+    const base::sparse_matrix_t<T>& X, const elem::Matrix<T>& Y) {
+
+    boost::uint64_t first, nzfirst;
+    binary_header_t h = internal::binary_begin_write<T>(comm, fname, true,
+        X.height(), X.width(), X.nonzeros(), first, nzfirst);
+
+    int fd = open(fname.c_str(), O_WRONLY);
+    if (fd == -1)
+        internal::binary_io_fail("cannot open " + fname);
+
+    std::vector<T> y(X.width());
+    for(int j = 0; j < X.width(); j++)
+        y[j] = Y.Height() == 1 ? Y.Get(0, j) : Y.Get(j, 0);
+    internal::binary_pwrite(fd, y.data(), y.size() * sizeof(T),
+        h.labels_offset + first * sizeof(T));
+
+    // The last rank also writes the closing entry of indptr.
+    int count = X.width() + (comm.rank() == comm.size() - 1 ? 1 : 0);
+    std::vector<boost::int64_t> indptr(count);
+    for(int j = 0; j < count; j++)
+        indptr[j] = nzfirst + X.indptr()[j];
+    internal::binary_pwrite(fd, indptr.data(), count * sizeof(boost::int64_t),
+        h.data_offset + first * sizeof(boost::int64_t));
+
+    internal::binary_pwrite(fd, X.indices(),
+        X.nonzeros() * sizeof(base::sparse_index_t),
+        h.indices_offset + nzfirst * sizeof(base::sparse_index_t));
+    internal::binary_pwrite(fd, X.locked_values(), X.nonzeros() * sizeof(T),
+        h.values_offset + nzfirst * sizeof(T));
+
+    close(fd);
+    comm.barrier();
+}
+
+/**
+ * A binary matrix file mapped into memory. Slices of columns are attached
+ * to Elemental and Skylark matrices without copying the data, so loading
+ * costs only the page faults of the data actually touched. The mapping is
+ * private: writes to attached matrices are not carried to the file.
+ *
+ * The object must outlive the matrices attached to it.
+ */
+template<typename T>
+struct binary_matrix_file_t {
+
+    typedef T value_type;
+    typedef base::sparse_index_t index_type;
+
+    binary_matrix_file_t(const std::string& fname) : _addr(NULL), _size(0) {
+        int fd = open(fname.c_str(), O_RDONLY);
+        if (fd == -1)
+            internal::binary_io_fail("cannot open " + fname);
+
+        struct stat st;
+        fstat(fd, &st);
+        _size = st.st_size;
+        if (_size < sizeof(binary_header_t)) {
+            close(fd);
+            _invalid(fname);
+        }
+
+        _addr = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (_addr == MAP_FAILED) {
+            _addr = NULL;
+            internal::binary_io_fail("cannot map " + fname);
+        }
+
+        std::memcpy(&_header, _addr, sizeof(_header));
+        binary_header_t h = _header;
+        if (std::memcmp(h.magic, internal::binary_magic, sizeof(h.magic)) != 0 ||
+            h.version != 1 || h.value_size != sizeof(value_type) ||
+            internal::binary_layout(h) > _size ||
+            (h.sparse && h.index_size != 4 && h.index_size != 8)) {
+            munmap(_addr, _size);
+            _addr = NULL;
+            _invalid(fname);
+        }
+    }
+
+    ~binary_matrix_file_t() {
+        if (_addr != NULL)
+            munmap(_addr, _size);
+    }
+
+    int height() const { return _header.height; }
+    int width() const { return _header.width; }
+    boost::uint64_t nonzeros() const { return _header.nnz; }
+    bool is_sparse() const { return _header.sparse; }
+
+    /**
+     * Attaches columns [first, first + count) to X (height x count, or
+     * min_height rows if more) and their labels to Y (count x 1). X is
+     * copied only if it has to be padded to min_height rows.
+     */
+    void attach(int first, int count, elem::Matrix<value_type>& X,
+        elem::Matrix<value_type>& Y, int min_height = 0) {
+        if (is_sparse())
+            SKYLARK_THROW_EXCEPTION (
+                base::io_exception()
+                    << base::error_msg("binary matrix file is sparse") );
+
+        int d = height();
+        value_type *data = _section(_header.data_offset) +
+            static_cast<size_t>(first) * d;
+        _prefetch(data, static_cast<size_t>(count) * d);
+        if (min_height <= d)
+            X.Attach(d, count, data, std::max(d, 1));
+        else {
+            X.Resize(min_height, count);
+            for(int j = 0; j < count; j++) {
+                value_type *x = X.Buffer(0, j);
+                std::copy(data + static_cast<size_t>(j) * d,
+                    data + static_cast<size_t>(j + 1) * d, x);
+                std::fill(x + d, x + min_height, value_type(0));
+            }
+        }
+
+        _attach_labels(first, count, Y);
+    }
+
+    /**
+     * Attaches columns [first, first + count) to the sparse X and their
+     * labels to Y (count x 1). Only the column pointers, rebased to the
+     * slice, are copied (and the row indices if they were written with a
+     * different index type).
+     */
+    void attach(int first, int count, base::sparse_matrix_t<value_type>& X,
+        elem::Matrix<value_type>& Y, int min_height = 0) {
+        if (!is_sparse())
+            SKYLARK_THROW_EXCEPTION (
+                base::io_exception()
+                    << base::error_msg("binary matrix file is dense") );
+
+        const boost::int64_t *gindptr =
+            reinterpret_cast<const boost::int64_t *>(
+                _bytes() + _header.data_offset) + first;
+        boost::int64_t start = gindptr[0];
+        index_type nnz = gindptr[count] - start;
+
+        _indptrs.push_back(std::vector<index_type>(count + 1));
+        std::vector<index_type>& indptr = _indptrs.back();
+        for(int j = 0; j <= count; j++)
+            indptr[j] = gindptr[j] - start;
+
+        const index_type *indices;
+        const char *gindices = _bytes() + _header.indices_offset +
+            start * _header.index_size;
+        if (_header.index_size == sizeof(index_type)) {
+            indices = reinterpret_cast<const index_type *>(gindices);
+            _prefetch(indices, nnz);
+        } else {
+            _indices.push_back(std::vector<index_type>(nnz));
+            std::vector<index_type>& copy = _indices.back();
+            if (_header.index_size == 4)
+                std::copy(reinterpret_cast<const boost::int32_t *>(gindices),
+                    reinterpret_cast<const boost::int32_t *>(gindices) + nnz,
+                    copy.begin());
+            else
+                std::copy(reinterpret_cast<const boost::int64_t *>(gindices),
+                    reinterpret_cast<const boost::int64_t *>(gindices) + nnz,
+                    copy.begin());
+            indices = copy.data();
+        }
+
+        value_type *values = _section(_header.values_offset) + start;
+        _prefetch(values, nnz);
+
+        X.attach(indptr.data(), indices, values, nnz,
+            std::max(height(), min_height), count, false);
+
+        _attach_labels(first, count, Y);
+    }
+
+private:
+    void *_addr;
+    size_t _size;
+    binary_header_t _header;
+
+    // Column pointers (and converted indices) of the attached slices.
+    std::list< std::vector<index_type> > _indptrs, _indices;
+
+    // Non-copyable: the mapping is owned.
+    binary_matrix_file_t(const binary_matrix_file_t&);
+    binary_matrix_file_t& operator=(const binary_matrix_file_t&);
+
+    char *_bytes() const { return static_cast<char *>(_addr); }
+
+    value_type *_section(boost::uint64_t offset) const {
+        return reinterpret_cast<value_type *>(_bytes() + offset);
+    }
+
+    void _attach_labels(int first, int count, elem::Matrix<value_type>& Y) {
+        value_type *labels = _section(_header.labels_offset) + first;
+        Y.Attach(count, 1, labels, std::max(count, 1));
+    }
+
+    /** Asks the kernel to start reading [p, p + count) in. */
+    template<typename U>
+    void _prefetch(const U *p, size_t count) const {
+        if (count == 0)
+            return;
+        size_t page = sysconf(_SC_PAGESIZE);
+        const char *begin = reinterpret_cast<const char *>(p);
+        const char *end = reinterpret_cast<const char *>(p + count);
+        char *aligned = _bytes() + (begin - _bytes()) / page * page;
+        madvise(aligned, end - aligned, MADV_WILLNEED);
+    }
+
+    void _invalid(const std::string& fname) {
+        SKYLARK_THROW_EXCEPTION (
+            base::io_exception()
+                << base::error_msg(fname + " is not a binary matrix file "
+                    "of this value type") );
+    }
+};
+
+/**
+ * Attaches this rank's block of columns of a binary matrix file to X and Y
+ * (the first n % P ranks get one more column), as the parallel ReadLIBSVM
+ * distributes examples.
+ *
+ * @param comm communicator.
+ * @param file mapped file; must outlive X and Y.
+ * @param X output X (local examples).
+ * @param Y output Y (local labels, local number of examples x 1).
+ * @param min_d minimum number of rows in the matrix.
+ */
+template<typename T, typename InputType>
+void ReadBinary(const boost::mpi::communicator& comm,
+    binary_matrix_file_t<T>& file, InputType& X, elem::Matrix<T>& Y,
+    int min_d = 0) {
+
+    int n = file.width(), P = comm.size(), r = comm.rank();
+    int q = n / P, rem = n % P;
+    int first = r * q + std::min(r, rem);
+    int count = q + (r < rem ? 1 : 0);
+    file.attach(first, count, X, Y, min_d);
+}
+
+/**
+ * Converts a libsvm file to a binary matrix file, dense or sparse. The
+ * libsvm file is parsed in parallel.
+ *
+ * @param comm communicator (all ranks must call).
+ * @param libsvm_fname input file name.
+ * @param binary_fname output file name.
+ * @param sparse write the sparse (CSC) layout.
+ * @param min_d minimum number of rows in the matrix.
+ */
+template<typename T>
+void LIBSVMToBinary(const boost::mpi::communicator& comm,
+    const std::string& libsvm_fname, const std::string& binary_fname,
+    bool sparse, int min_d = 0) {
+
+    elem::Matrix<T> Y;
+    if (sparse) {
+        base::sparse_matrix_t<T> X;
+        ReadLIBSVM(comm, libsvm_fname, X, Y, min_d);
+        WriteBinary(comm, binary_fname, X, Y);
+    } else {
+        elem::Matrix<T> X;
+        ReadLIBSVM(comm, libsvm_fname, X, Y, min_d);
+        WriteBinary(comm, binary_fname, X, Y);
+    }
+}
+
+} } } // namespace skylark::utility::io
+#endif
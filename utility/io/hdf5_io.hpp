@@ -3,6 +3,11 @@
 
 #include <H5Cpp.h>
 
+#include <string>
+#include <vector>
+
+#include <boost/mpi.hpp>
+
 namespace skylark { namespace utility { namespace io {
 
 namespace internal {
@@ -36,6 +41,22 @@ public:
     }
 };
 
+/**
+ * Writes count entries of buf to the 1D dataset name, starting at offset.
+ */
+template<typename T>
+void write_hdf5_part(H5::H5File& out, const std::string& name,
+    const T *buf, hsize_t offset, hsize_t count) {
+    if (count == 0)
+        return;
+    H5::DataSet ds = out.openDataSet(name);
+    H5::DataSpace fs = ds.getSpace();
+    fs.selectHyperslab(H5S_SELECT_SET, &count, &offset);
+    H5::DataSpace ms(1, &count);
+    ds.write(buf, hdf5_type_mapper_t<T>::get_type(), ms, fs);
+    ds.close();
+}
+
 } // namspace internal
 
 /**
@@ -121,5 +142,110 @@ void ReadHDF5(H5::H5File& in, const std::string& name,
     X.attach(colptr, indices, values, nnz, m, n, true);
 }
 
+/**
+ * Writes a sparse matrix distributed by blocks of columns, and its labels,
+ * to an HDF5 file in the layout read by hilbert (ml/io.hpp read_hdf5):
+ * datasets "dimensions" (d, n, nnz), "indptr", "indices", "values" and "Y".
+ * Rank r holds columns (examples) that follow those of rank r - 1, as the
+ * parallel ReadLIBSVM delivers them. Ranks write their parts in turn, so
+ * a serial HDF5 library is enough.
+ *
+ * @param comm communicator (all ranks must call).
+ * @param fname output file name.
+ * @param X local block of columns.
+ * @param Y local labels (a row or column vector).
+ */
+template<typename T>
+void WriteHDF5(const boost::mpi::communicator& comm, const std::string& fname,
+    const base::sparse_matrix_t<T>& X, const elem::Matrix<T>& Y) {
+
+    int nlocal = X.width();
+    int nnzlocal = X.nonzeros();
+    std::vector<int> ns, nnzs;
+    boost::mpi::all_gather(comm, nlocal, ns);
+    boost::mpi::all_gather(comm, nnzlocal, nnzs);
+    int d = boost::mpi::all_reduce(comm, X.height(),
+        boost::mpi::maximum<int>());
+
+    int n = 0, nnz = 0, offset = 0, nnzoffset = 0;
+    for(int p = 0; p < comm.size(); p++) {
+        if (p == comm.rank()) {
+            offset = n;
+            nnzoffset = nnz;
+        }
+        n += ns[p];
+        nnz += nnzs[p];
+    }
+
+    // hilbert stores indices as int, with global column pointers.
+    std::vector<int> indptr(nlocal + 1), indices(nnzlocal);
+    for(int j = 0; j <= nlocal; j++)
+        indptr[j] = X.indptr()[j] + nnzoffset;
+    std::copy(X.indices(), X.indices() + nnzlocal, indices.begin());
+    std::vector<T> y(nlocal);
+    for(int j = 0; j < nlocal; j++)
+        y[j] = Y.Height() == 1 ? Y.Get(0, j) : Y.Get(j, 0);
+
+    if (comm.rank() == 0) {
+        H5::H5File out(fname, H5F_ACC_TRUNC);
+        int dimensions[3] = {d, n, nnz};
+        hsize_t sz = 3;
+        H5::DataSet ds = out.createDataSet("dimensions",
+            internal::hdf5_type_mapper_t<int>::get_type(), H5::DataSpace(1, &sz));
+        ds.write(dimensions, internal::hdf5_type_mapper_t<int>::get_type());
+
+        sz = n + 1;
+        out.createDataSet("indptr",
+            internal::hdf5_type_mapper_t<int>::get_type(), H5::DataSpace(1, &sz));
+        sz = nnz;
+        out.createDataSet("indices",
+            internal::hdf5_type_mapper_t<int>::get_type(), H5::DataSpace(1, &sz));
+        out.createDataSet("values",
+            internal::hdf5_type_mapper_t<T>::get_type(), H5::DataSpace(1, &sz));
+        sz = n;
+        out.createDataSet("Y",
+            internal::hdf5_type_mapper_t<T>::get_type(), H5::DataSpace(1, &sz));
+        out.close();
+    }
+
+    for(int p = 0; p < comm.size(); p++) {
+        comm.barrier();
+        if (p != comm.rank())
+            continue;
+
+        H5::H5File out(fname, H5F_ACC_RDWR);
+        // The last rank also writes the closing entry of indptr.
+        internal::write_hdf5_part(out, "indptr", &indptr[0],
+            offset, nlocal + (p == comm.size() - 1 ? 1 : 0));
+        internal::write_hdf5_part(out, "indices", indices.data(),
+            nnzoffset, nnzlocal);
+        internal::write_hdf5_part(out, "values", X.locked_values(),
+            nnzoffset, nnzlocal);
+        internal::write_hdf5_part(out, "Y", y.data(), offset, nlocal);
+        out.close();
+    }
+    comm.barrier();
+}
+
+/**
+ * Converts a libsvm file to the hilbert HDF5 sparse layout (see WriteHDF5
+ * above). The file is parsed in parallel and never densified.
+ *
+ * @param comm communicator (all ranks must call).
+ * @param libsvm_fname input file name.
+ * @param hdf5_fname output file name.
+ * @param min_d minimum number of rows in the matrix.
+ */
+template<typename T>
+void LIBSVMToHDF5(const boost::mpi::communicator& comm,
+    const std::string& libsvm_fname, const std::string& hdf5_fname,
+    int min_d = 0) {
+
+    base::sparse_matrix_t<T> X;
+    elem::Matrix<T> Y;
+    ReadLIBSVM(comm, libsvm_fname, X, Y, min_d);
+    WriteHDF5(comm, hdf5_fname, X, Y);
+}
+
 } } } // namespace skylark::utility::io
 #endif
@@ -2,6 +2,7 @@
 #define SKYLARK_IO_HPP
 
 #include "libsvm_io.hpp"
+#include "binary_io.hpp"
 
 #ifdef SKYLARK_HAVE_HDF5
 #include "hdf5_io.hpp"
@@ -1,213 +1,728 @@
 #ifndef SKYLARK_LIBSVM_IO_HPP
 #define SKYLARK_LIBSVM_IO_HPP
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/mpi.hpp>
+
 namespace skylark { namespace utility { namespace io {
 
+namespace internal {
+
 /**
- * Reads X and Y from a file in libsvm format.
- * X and Y are Elemental dense matrices.
- *
- * IMPORTANT: output is in column-major format (the rows are features).
- *
- * @param fname input file name.
- * @param X output X
- * @param Y output Y
- * @param min_d minimum number of rows in the matrix.
+ * Hand-rolled parsers for libsvm files. Each parses a number at p and
+ * returns the position right after it (p itself if there is none).
  */
-template<typename T>
-void ReadLIBSVM(const std::string& fname,
-    elem::Matrix<T>& X, elem::Matrix<T>& Y,
-    int min_d = 0) {
+inline const char *parse_long(const char *p, long long& v) {
+    const char *q = p;
+    bool neg = false;
+    if (*q == '-' || *q == '+')
+        neg = *q++ == '-';
+    if (*q < '0' || *q > '9')
+        return p;
+    long long r = 0;
+    for(; *q >= '0' && *q <= '9'; q++)
+        r = 10 * r + (*q - '0');
+    v = neg ? -r : r;
+    return q;
+}
 
-    std::string line;
-    std::string token, val, ind;
-    float label;
-    unsigned int start = 0;
-    unsigned int delim, t;
-    int n = 0;
-    int d = 0;
-    int i, j, last;
-    char c;
-
-    std::ifstream in(fname);
-
-    // make one pass over the data to figure out dimensions - 
-    // will pay in terms of preallocated storage.
-    while(!in.eof()) {
-        getline(in, line);
-        if(line.length()==0)
-            break;
-        delim = line.find_last_of(":");
-        if(delim > line.length())
-            continue;
-        n++;
-        t = delim;
-        while(line[t]!=' ') {
-            t--;
+/**
+ * Decimal numbers with at most 19 digits and a small exponent are built as
+ * an integer and scaled once by an exact power of ten, which is correctly
+ * rounded; everything else (long mantissas, large exponents, inf, nan)
+ * goes through strtod.
+ */
+inline const char *parse_double(const char *p, double& v) {
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+        1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+        1e19, 1e20, 1e21, 1e22 };
+
+    const char *q = p;
+    bool neg = false;
+    if (*q == '-' || *q == '+')
+        neg = *q++ == '-';
+
+    unsigned long long m = 0;
+    int ndigits = 0, e = 0;
+    for(; *q >= '0' && *q <= '9'; q++, ndigits++)
+        m = 10 * m + (*q - '0');
+    if (*q == '.')
+        for(q++; *q >= '0' && *q <= '9'; q++, ndigits++, e--)
+            m = 10 * m + (*q - '0');
+
+    bool fast = ndigits > 0 && ndigits <= 19;
+    if (fast && (*q == 'e' || *q == 'E')) {
+        long long x;
+        const char *r = parse_long(q + 1, x);
+        if (r == q + 1 || x < -22 || x > 22)
+            fast = false;
+        else {
+            e += x;
+            q = r;
         }
-        val = line.substr(t+1, delim - t);
-        last = atoi(val.c_str());
-        if (last>d)
-            d = last;
     }
-    if (min_d > 0)
-        d = std::max(d, min_d);
 
-    // prepare for second pass
-    in.clear();
-    in.seekg(0, std::ios::beg);
+    if (fast && m <= (1ULL << 53) && e >= -22 && e <= 22) {
+        double r = static_cast<double>(m);
+        r = e < 0 ? r / pow10[-e] : r * pow10[e];
+        v = neg ? -r : r;
+        return q;
+    }
 
-    X.Resize(d, n);
-    Y.Resize(1, n);
+    // strtod would skip whitespace, and with it the end of the line.
+    const char *s = (*p == '-' || *p == '+') ? p + 1 : p;
+    if (*s == '\0' || std::isspace(static_cast<unsigned char>(*s)))
+        return p;
+
+    char *end;
+    double r = std::strtod(p, &end);
+    if (end == p)
+        return p;
+    v = r;
+    return end;
+}
 
-    T *Xdata = X.Buffer();
-    T *Ydata = Y.Buffer();
-    int ldX = X.LDim();
+/**
+ * Examples read from a libsvm file, as the columns of a CSC matrix with
+ * 0-based feature indices.
+ */
+template<typename T>
+struct libsvm_data_t {
+    int n, d;   /**< Global number of examples and features */
+    std::vector<base::sparse_index_t> indptr, indices;
+    std::vector<T> values, labels;
 
-    for (t = 0; t < n; t++) {
-        getline(in, line);
-        if( line.length()==0)
-            break;
+    libsvm_data_t() : n(0), d(0), indptr(1, 0) {}
+
+    int width() const { return labels.size(); }
+};
+
+/**
+ * Parses the lines that start in [p, stop), reading no further than end,
+ * and appends them to data. Blank lines are skipped. Returns the position
+ * after the last line parsed; with partial = true the last line may end at
+ * end without a newline, otherwise it is left for the next call.
+ */
+template<typename T>
+const char *parse_libsvm_lines(const char *p, const char *end,
+    const char *stop, bool partial, libsvm_data_t<T>& data, int& max_index) {
+
+    while (p < end && p < stop) {
+        const char *eol = static_cast<const char *>(
+            std::memchr(p, '\n', end - p));
+        if (eol == NULL) {
+            if (!partial)
+                break;
+            eol = end;
+        }
+
+        const char *q = p;
+        while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r'))
+            q++;
+        if (q < eol) {
+            double label = 0;
+            q = parse_double(q, label);
+            data.labels.push_back(label);
+
+            while (q < eol) {
+                while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r'))
+                    q++;
+                if (q == eol)
+                    break;
 
-        std::istringstream tokenstream (line);
-        tokenstream >> label;
-        Ydata[t] = label;
+                long long j = 0;
+                double val;
+                const char *r = parse_long(q, j);
+                if (r != q && *r == ':') {
+                    const char *v = parse_double(r + 1, val);
+                    // Dimensions are ints, whatever the index type.
+                    if (j > std::numeric_limits<int>::max())
+                        SKYLARK_THROW_EXCEPTION (
+                            base::io_exception()
+                                << base::error_msg(
+                                    "libsvm feature index out of range") );
+                    if (v != r + 1 && j >= 1) {
+                        data.indices.push_back(j - 1);
+                        data.values.push_back(val);
+                        if (j > max_index)
+                            max_index = j;
+                    }
+                    r = v;
+                }
 
-        while (tokenstream >> token) {
-            delim  = token.find(':');
-            ind = token.substr(0, delim);
-            val = token.substr(delim+1); //.substr(delim+1);
-            j = atoi(ind.c_str()) - 1;
-            Xdata[t * ldX + j] = atof(val.c_str());
+                // Skip the rest of the token (nothing if well formed).
+                q = r > q ? r : q;
+                while (q < eol && *q != ' ' && *q != '\t' && *q != '\r')
+                    q++;
+            }
+            data.indptr.push_back(data.indices.size());
         }
+
+        p = eol + 1;
     }
+
+    return p;
 }
 
 /**
- * Reads X and Y from a file in libsvm format.
- * X and Y are Elemental distributed matrices.
- *
- * IMPORTANT: output is in column-major format (the rows are features).
+ * Reserves storage for the examples in bytes bytes of file, extrapolating
+ * from the number of lines and ':' in the sample buf[0, len).
+ */
+template<typename T>
+void reserve_libsvm(const char *buf, size_t len, size_t bytes,
+    libsvm_data_t<T>& data) {
+    if (bytes <= len)
+        return;
+    size_t lines = 0, nz = 0;
+    for(size_t i = 0; i < len; i++) {
+        lines += buf[i] == '\n';
+        nz += buf[i] == ':';
+    }
+    double scale = 1.05 * bytes / len;
+    data.labels.reserve(scale * lines + 1);
+    data.indptr.reserve(scale * lines + 2);
+    data.indices.reserve(scale * nz + 1);
+    data.values.reserve(scale * nz + 1);
+}
+
+/** Throws an io_exception for what was being done to fname, with errno. */
+inline void throw_libsvm_error(const std::string& what,
+    const std::string& fname) {
+    SKYLARK_THROW_EXCEPTION (
+        base::io_exception()
+            << base::error_msg(what + " " + fname + ": " +
+                std::strerror(errno)) );
+}
+
+/** scan_libsvm_range (below) on the open file fd. */
+template<typename Scanner>
+size_t scan_libsvm_fd(int fd, const std::string& fname, int rank,
+    int nparts, Scanner& scan, size_t blocksize) {
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        throw_libsvm_error("cannot stat", fname);
+    size_t size = st.st_size;
+    size_t begin = size / nparts * rank +
+        std::min<size_t>(rank, size % nparts);
+    size_t stop = begin + size / nparts +
+        (static_cast<size_t>(rank) < size % nparts ? 1 : 0);
+
+    std::vector<char> buf(blocksize + 1);
+
+    // A line belongs to the rank whose range holds its first byte, so
+    // start after the first newline at or after begin - 1.
+    size_t off = begin;
+    if (begin > 0) {
+        off = begin - 1;
+        bool found = false;
+        while (!found && off < stop) {
+            ssize_t r = pread(fd, &buf[0], blocksize, off);
+            if (r < 0)
+                throw_libsvm_error("cannot read", fname);
+            if (r == 0)
+                break;
+            const char *nl = static_cast<const char *>(
+                std::memchr(&buf[0], '\n', r));
+            if (nl != NULL) {
+                off += nl - &buf[0] + 1;
+                found = true;
+            } else
+                off += r;
+        }
+        if (!found)
+            off = stop;
+    }
+
+    posix_fadvise(fd, off, 0, POSIX_FADV_SEQUENTIAL);
+
+    size_t carry = 0;
+    while (off < stop || carry > 0) {
+        if (carry == buf.size() - 1)
+            buf.resize(2 * buf.size());     // a line longer than the buffer
+
+        size_t want = buf.size() - 1 - carry;
+        ssize_t r = pread(fd, &buf[carry], want, off);
+        if (r < 0)
+            throw_libsvm_error("cannot read", fname);
+        posix_fadvise(fd, off + r, want, POSIX_FADV_WILLNEED);
+
+        bool eof = r == 0;
+        size_t avail = carry + r;
+        buf[avail] = '\0';
+
+        // Offset of buf[0] in the file.
+        size_t base = off - carry;
+        off += r;
+        const char *b = &buf[0];
+        const char *limit = stop > base ? b + (stop - base) : b;
+        const char *q = scan(b, b + avail, limit, eof, base);
+
+        if (eof || q >= limit)
+            break;
+
+        carry = b + avail - q;
+        std::memmove(&buf[0], q, carry);
+    }
+
+    return size;
+}
+
+/**
+ * Reads the bytes of part rank of nparts (equal shares of the bytes of the
+ * file) in blocks, and hands them to scan, which consumes the lines that
+ * start in the part. While a block is scanned the kernel is already
+ * reading the next one (posix_fadvise), so I/O and parsing overlap.
  *
- * @param fname input file name.
- * @param X output X
- * @param Y output Y
- * @param min_d minimum number of rows in the matrix.
- * @param blocksize blocksize for blocking of read.
+ * scan(b, end, limit, eof, base) gets the bytes [b, end) (end is '\0'
+ * terminated), which start at file offset base, and must consume the lines
+ * that start before limit, the last one only if eof. It returns the
+ * position after the last line consumed. Returns the size of the file.
  */
-template<typename T, elem::Distribution UX, elem::Distribution VX,
-         elem::Distribution UY, elem::Distribution VY>
-void ReadLIBSVM(const std::string& fname,
-    elem::DistMatrix<T, UX, VX>& X, elem::DistMatrix<T, UY, VY>& Y,
-    int min_d = 0, int blocksize = 10000) {
+template<typename Scanner>
+size_t scan_libsvm_range(const std::string& fname, int rank, int nparts,
+    Scanner& scan, size_t blocksize = 1 << 24) {
+
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw_libsvm_error("cannot open", fname);
+
+    size_t size;
+    try {
+        size = scan_libsvm_fd(fd, fname, rank, nparts, scan, blocksize);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
 
+    close(fd);
+    return size;
+}
 
-    std::string line;
-    std::string token, val, ind;
-    float label;
-    unsigned int start = 0;
-    unsigned int delim, t;
-    int n = 0;
-    int d = 0;
-    int i, j, last;
-    char c;
+/**
+ * Runs scan_libsvm_range with the share of every rank of comm. The ranks
+ * then agree on whether they all succeeded, so that a failure on some of
+ * them (say, the file cannot be opened there) throws on all of them
+ * instead of leaving the others waiting in the collectives that follow.
+ */
+template<typename Scanner>
+size_t scan_libsvm_parallel(const boost::mpi::communicator& comm,
+    const std::string& fname, Scanner& scan) {
+
+    size_t size = 0;
+    std::exception_ptr error;
+    try {
+        size = scan_libsvm_range(fname, comm.rank(), comm.size(), scan);
+    } catch (...) {
+        error = std::current_exception();
+    }
 
-    std::ifstream in(fname);
+    int failed = error ? 1 : 0, any_failed = 0;
+    boost::mpi::all_reduce(comm, failed, any_failed,
+        boost::mpi::maximum<int>());
+    if (error)
+        std::rethrow_exception(error);
+    if (any_failed)
+        SKYLARK_THROW_EXCEPTION (
+            base::io_exception()
+                << base::error_msg("reading " + fname +
+                    " failed on another rank") );
+    return size;
+}
 
-    // TODO check that X and Y have the same grid.
-    boost::mpi::communicator comm = skylark::utility::get_communicator(X);
-    int rank = X.Grid().Rank();
-
-    // make one pass over the data to figure out dimensions - 
-    // will pay in terms of preallocated storage.
-    if (rank==0) {
-        while(!in.eof()) {
-            getline(in, line);
-            if(line.length()==0)
-                break;
-            delim = line.find_last_of(":");
-            if(delim > line.length())
-                continue;
-            n++;
-            t = delim;
-            while(line[t]!=' ') {
-                t--;
-            }
-            val = line.substr(t+1, delim - t);
-            last = atoi(val.c_str());
-            if (last>d)
-                d = last;
+/**
+ * Scanner that parses the lines into data. Storage is reserved up front
+ * from the density of examples and non-zeros in the first block.
+ */
+template<typename T>
+struct libsvm_parser_t {
+    libsvm_data_t<T>& data;
+    int max_index;
+    bool reserved;
+
+    libsvm_parser_t(libsvm_data_t<T>& data) :
+        data(data), max_index(0), reserved(false) {}
+
+    const char *operator()(const char *b, const char *end, const char *limit,
+        bool eof, size_t base) {
+        if (!reserved && end > b) {
+            reserve_libsvm(b, end - b, limit - b, data);
+            reserved = true;
         }
-        if (min_d > 0)
-            d = std::max(d, min_d);
+        return parse_libsvm_lines(b, end, limit, eof, data, max_index);
+    }
+};
 
-        // prepare for second pass
-        in.clear();
-        in.seekg(0, std::ios::beg);
+/**
+ * Scanner that only records the file offset of every example (the start of
+ * its line) and the largest feature index, keeping no features.
+ */
+struct libsvm_indexer_t {
+    std::vector<long long> starts;
+    int max_index;
+
+    libsvm_indexer_t() : max_index(0) {}
+
+    const char *operator()(const char *b, const char *end, const char *limit,
+        bool eof, size_t base) {
+        const char *p = b;
+        while (p < limit) {
+            // One line at a time, to know where each example starts.
+            const char *q = parse_libsvm_lines(p, end, p + 1, eof, _line,
+                max_index);
+            if (q == p)
+                break;
+            if (_line.width() > 0)
+                starts.push_back(base + (p - b));
+            _line.labels.clear();
+            _line.indptr.resize(1);
+            _line.indices.clear();
+            _line.values.clear();
+            p = q;
+        }
+        return p;
     }
 
-    boost::mpi::broadcast(comm, n, 0);
-    boost::mpi::broadcast(comm, d, 0);
+private:
+    libsvm_data_t<double> _line;
+};
+
+/**
+ * Parses the lines that start in part rank of nparts (see
+ * scan_libsvm_range) and appends them to data. Returns the largest feature
+ * index seen.
+ */
+template<typename T>
+int parse_libsvm_range(const std::string& fname, int rank, int nparts,
+    libsvm_data_t<T>& data, size_t blocksize = 1 << 24) {
 
-    int numblocks = ((int) n/ (int) blocksize); // of size blocksize
-    int leftover = n % blocksize;
-    int block = blocksize;
+    libsvm_parser_t<T> parser(data);
+    scan_libsvm_range(fname, rank, nparts, parser, blocksize);
+    return parser.max_index;
+}
 
-    X.Resize(d, n);
-    Y.Resize(1, n);
+/**
+ * Every rank of comm parses its share of a libsvm file (see
+ * parse_libsvm_range). The global dimensions are then found with a single
+ * collective (every rank contributes its number of examples and largest
+ * feature index) and stored in local.n and local.d. Returns the global
+ * index of the first local example: ranks hold consecutive examples.
+ */
+template<typename T>
+int parse_libsvm_parallel(const boost::mpi::communicator& comm,
+    const std::string& fname, int min_d, libsvm_data_t<T>& local) {
+
+    libsvm_parser_t<T> parser(local);
+    scan_libsvm_parallel(comm, fname, parser);
+    int max_index = parser.max_index;
+
+    int P = comm.size();
+    std::vector<int> mine(2), all(2 * P);
+    mine[0] = local.width();
+    mine[1] = max_index;
+    boost::mpi::all_gather(comm, &mine[0], 2, &all[0]);
+
+    int offset = 0;
+    local.n = 0;
+    local.d = min_d;
+    for(int p = 0; p < P; p++) {
+        if (p == comm.rank())
+            offset = local.n;
+        local.n += all[2 * p];
+        local.d = std::max(local.d, all[2 * p + 1]);
+    }
 
-    elem::DistMatrix<T, elem::CIRC, elem::CIRC> XB(X.Grid()), YB(Y.Grid());
-    elem::DistMatrix<T, UX, VX> Xv(X.Grid());
-    elem::DistMatrix<T, UY, VY> Yv(Y.Grid());
-    for(int i=0; i<numblocks+1; i++) {
-        if (i==numblocks)
-            block = leftover;
-        if (block==0)
-            break;
+    return offset;
+}
 
-        elem::Zeros(XB, d, block);
-        elem::Zeros(YB, 1, block);
+/**
+ * Indexes a libsvm file in chunks of chunksize consecutive examples, in
+ * parallel and without keeping any example: every rank scans its share of
+ * the file (see scan_libsvm_range) and the ranks then agree on the byte
+ * offsets where the chunks start. offsets gets one entry per chunk, plus
+ * the size of the file, so chunk c is the bytes [offsets[c], offsets[c +
+ * 1]). The global dimensions go to n and d (at least min_d).
+ */
+inline void index_libsvm_parallel(const boost::mpi::communicator& comm,
+    const std::string& fname, int chunksize, int min_d,
+    std::vector<long long>& offsets, int& n, int& d) {
+
+    libsvm_indexer_t indexer;
+    long long size = scan_libsvm_parallel(comm, fname, indexer);
+
+    int P = comm.size();
+    std::vector<int> mine(2), all(2 * P);
+    mine[0] = indexer.starts.size();
+    mine[1] = indexer.max_index;
+    boost::mpi::all_gather(comm, &mine[0], 2, &all[0]);
+
+    int first = 0;
+    n = 0;
+    d = min_d;
+    for(int p = 0; p < P; p++) {
+        if (p == comm.rank())
+            first = n;
+        n += all[2 * p];
+        d = std::max(d, all[2 * p + 1]);
+    }
 
-        if(rank==0) {
-            T *Xdata = XB.Matrix().Buffer();
-            T *Ydata = YB.Matrix().Buffer();
-            int ldX = XB.Matrix().LDim();
+    // Every chunk start is known to exactly one rank.
+    int G = (static_cast<long long>(n) + chunksize - 1) / chunksize;
+    std::vector<long long> known(G + 1, 0);
+    for(size_t k = 0; k < indexer.starts.size(); k++) {
+        long long j = first + static_cast<long long>(k);
+        if (j % chunksize == 0)
+            known[j / chunksize] = indexer.starts[k];
+    }
+    known[G] = size;
 
-            t = 0;
-            while(!in.eof() && t<block) {
-                getline(in, line);
-                if( line.length()==0)
-                    break;
+    offsets.resize(G + 1);
+    boost::mpi::all_reduce(comm, &known[0], G + 1, &offsets[0],
+        boost::mpi::maximum<long long>());
+}
 
-                std::istringstream tokenstream (line);
-                tokenstream >> label;
-                Ydata[t] = label;
+/**
+ * Reads a libsvm file in parallel and delivers example j (in file order)
+ * to rank owner(j, n). Ranks receive their examples in file order; the
+ * examples are moved with MPI_Alltoallv.
+ */
+template<typename T, typename Owner>
+void read_libsvm_parallel(const boost::mpi::communicator& comm,
+    const std::string& fname, int min_d, const Owner& owner,
+    libsvm_data_t<T>& out) {
+
+    typedef base::sparse_index_t index_type;
+    MPI_Datatype index_mpi_type = boost::mpi::get_mpi_datatype<index_type>();
+    MPI_Datatype value_mpi_type = boost::mpi::get_mpi_datatype<T>();
+
+    libsvm_data_t<T> local;
+    int offset = parse_libsvm_parallel(comm, fname, min_d, local);
+    int n = local.n, d = local.d, P = comm.size();
+
+    // Pack examples by destination.
+    std::vector<int> send_ex(P, 0), send_nz(P, 0);
+    std::vector<int> dest(local.width());
+    for(int k = 0; k < local.width(); k++) {
+        dest[k] = owner(offset + k, n);
+        send_ex[dest[k]]++;
+        send_nz[dest[k]] += local.indptr[k + 1] - local.indptr[k];
+    }
 
-                while (tokenstream >> token) {
-                    delim  = token.find(':');
-                    ind = token.substr(0, delim);
-                    val = token.substr(delim+1); //.substr(delim+1);
-                    j = atoi(ind.c_str()) - 1;
-                    Xdata[t * ldX + j] = atof(val.c_str());
-                }
+    std::vector<int> ex_displ(P + 1, 0), nz_displ(P + 1, 0);
+    for(int p = 0; p < P; p++) {
+        ex_displ[p + 1] = ex_displ[p] + send_ex[p];
+        nz_displ[p + 1] = nz_displ[p] + send_nz[p];
+    }
 
-                t++;
-            }
+    std::vector<T> slabels(local.width());
+    std::vector<index_type> scounts(local.width()), sindices(local.indices.size());
+    std::vector<T> svalues(local.values.size());
+    {
+        std::vector<int> ex_pos(ex_displ.begin(), ex_displ.end() - 1);
+        std::vector<int> nz_pos(nz_displ.begin(), nz_displ.end() - 1);
+        for(int k = 0; k < local.width(); k++) {
+            int p = dest[k];
+            index_type s = local.indptr[k], e = local.indptr[k + 1];
+            slabels[ex_pos[p]] = local.labels[k];
+            scounts[ex_pos[p]] = e - s;
+            ex_pos[p]++;
+            std::copy(local.indices.begin() + s, local.indices.begin() + e,
+                sindices.begin() + nz_pos[p]);
+            std::copy(local.values.begin() + s, local.values.begin() + e,
+                svalues.begin() + nz_pos[p]);
+            nz_pos[p] += e - s;
         }
+    }
+    local = libsvm_data_t<T>();
+
+    std::vector<int> recv_ex(P), recv_nz(P);
+    MPI_Alltoall(&send_ex[0], 1, MPI_INT, &recv_ex[0], 1, MPI_INT, comm);
+    MPI_Alltoall(&send_nz[0], 1, MPI_INT, &recv_nz[0], 1, MPI_INT, comm);
+
+    std::vector<int> rex_displ(P + 1, 0), rnz_displ(P + 1, 0);
+    for(int p = 0; p < P; p++) {
+        rex_displ[p + 1] = rex_displ[p] + recv_ex[p];
+        rnz_displ[p + 1] = rnz_displ[p] + recv_nz[p];
+    }
+
+    std::vector<index_type> rcounts(rex_displ[P]);
+    out.n = n;
+    out.d = d;
+    out.labels.resize(rex_displ[P]);
+    out.indices.resize(rnz_displ[P]);
+    out.values.resize(rnz_displ[P]);
+
+    // Vectors may be empty, so avoid taking &v[0].
+    MPI_Alltoallv(slabels.data(), &send_ex[0], &ex_displ[0], value_mpi_type,
+        out.labels.data(), &recv_ex[0], &rex_displ[0], value_mpi_type, comm);
+    MPI_Alltoallv(scounts.data(), &send_ex[0], &ex_displ[0], index_mpi_type,
+        rcounts.data(), &recv_ex[0], &rex_displ[0], index_mpi_type, comm);
+    MPI_Alltoallv(sindices.data(), &send_nz[0], &nz_displ[0], index_mpi_type,
+        out.indices.data(), &recv_nz[0], &rnz_displ[0], index_mpi_type, comm);
+    MPI_Alltoallv(svalues.data(), &send_nz[0], &nz_displ[0], value_mpi_type,
+        out.values.data(), &recv_nz[0], &rnz_displ[0], value_mpi_type, comm);
+
+    out.indptr.resize(rcounts.size() + 1);
+    out.indptr[0] = 0;
+    for(size_t k = 0; k < rcounts.size(); k++)
+        out.indptr[k + 1] = out.indptr[k] + rcounts[k];
+}
+
+/** Examples in contiguous blocks; the first n % P ranks get one more. */
+struct libsvm_block_owner_t {
+    int P;
 
-        // The calls below should distribute the data to all the nodes.
-        elem::View(Xv, X, 0, i*blocksize, d, block);
-        elem::View(Yv, Y, 0, i*blocksize, 1, block);
+    libsvm_block_owner_t(int P) : P(P) {}
 
-        Xv = XB;
-        Yv = YB;
+    int operator()(int j, int n) const {
+        int q = n / P, r = n % P;
+        return j < r * (q + 1) ? j / (q + 1) : r + (j - r * (q + 1)) / q;
     }
+};
+
+/** Examples dealt cyclically, example j to rank map[j % P]. */
+struct libsvm_cyclic_owner_t {
+    std::vector<int> map;
+
+    libsvm_cyclic_owner_t(const std::vector<int>& map) : map(map) {}
+
+    int operator()(int j, int n) const {
+        return map[j % map.size()];
+    }
+};
+
+/** Writes the examples as the columns of the dense d x width matrix X. */
+template<typename T>
+void copy_to_dense(const libsvm_data_t<T>& data, T *X, int ldX) {
+    for(int k = 0; k < data.width(); k++) {
+        T *x = X + static_cast<size_t>(k) * ldX;
+        std::fill(x, x + data.d, T(0));
+        for(base::sparse_index_t l = data.indptr[k];
+            l < data.indptr[k + 1]; l++)
+            x[data.indices[l]] = data.values[l];
+    }
+}
+
+/** Moves the examples into the columns of the local sparse matrix X. */
+template<typename T>
+void move_to_sparse(libsvm_data_t<T>& data, base::sparse_matrix_t<T>& X) {
+    typedef base::sparse_index_t index_type;
+
+    index_type nnz = data.indices.size();
+    index_type *indptr = new index_type[data.width() + 1];
+    index_type *indices = new index_type[nnz];
+    T *values = new T[nnz];
+    std::copy(data.indptr.begin(), data.indptr.end(), indptr);
+    std::copy(data.indices.begin(), data.indices.end(), indices);
+    std::copy(data.values.begin(), data.values.end(), values);
+    std::vector<index_type>().swap(data.indices);
+    std::vector<T>().swap(data.values);
+
+    X.attach(indptr, indices, values, nnz, data.d, data.width(), true);
+}
+
+} // namespace internal
+
+/**
+ * Reads X and Y from a file in libsvm format.
+ * X and Y are Elemental dense matrices.
+ *
+ * The file is read in a single pass with the same parser as the parallel
+ * readers; entries not in the file are zero.
+ *
+ * IMPORTANT: output is in column-major format (the rows are features).
+ *
+ * @param fname input file name.
+ * @param X output X
+ * @param Y output Y
+ * @param min_d minimum number of rows in the matrix.
+ */
+template<typename T>
+void ReadLIBSVM(const std::string& fname,
+    elem::Matrix<T>& X, elem::Matrix<T>& Y,
+    int min_d = 0) {
+
+    internal::libsvm_data_t<T> data;
+    data.d = std::max(internal::parse_libsvm_range(fname, 0, 1, data), min_d);
+    data.n = data.width();
+
+    X.Resize(data.d, data.n);
+    Y.Resize(1, data.n);
+    internal::copy_to_dense(data, X.Buffer(), X.LDim());
+    for(int k = 0; k < data.n; k++)
+        Y.Set(0, k, data.labels[k]);
+}
+
+/**
+ * Reads X and Y from a file in libsvm format.
+ * X and Y are Elemental distributed matrices.
+ *
+ * All ranks of the grid parse a share of the file in parallel (see the
+ * parallel ReadLIBSVM below); the examples are dealt to a [STAR, VC]
+ * layout and then redistributed to the layout of X and Y.
+ *
+ * IMPORTANT: output is in column-major format (the rows are features).
+ *
+ * @param fname input file name.
+ * @param X output X
+ * @param Y output Y
+ * @param min_d minimum number of rows in the matrix.
+ * @param blocksize unused (the file is no longer read in blocks on rank 0).
+ */
+template<typename T, elem::Distribution UX, elem::Distribution VX,
+         elem::Distribution UY, elem::Distribution VY>
+void ReadLIBSVM(const std::string& fname,
+    elem::DistMatrix<T, UX, VX>& X, elem::DistMatrix<T, UY, VY>& Y,
+    int min_d = 0, int blocksize = 10000) {
+
+    // TODO check that X and Y have the same grid.
+    const elem::Grid& grid = X.Grid();
+    boost::mpi::communicator comm(grid.Comm(), boost::mpi::comm_attach);
+
+    // Column j of a [STAR, VC] matrix lives on VC rank j % P.
+    std::vector<int> vcrank;
+    boost::mpi::all_gather(comm, grid.VCRank(), vcrank);
+    std::vector<int> map(comm.size());
+    for(int r = 0; r < comm.size(); r++)
+        map[vcrank[r]] = r;
+
+    internal::libsvm_data_t<T> data;
+    internal::read_libsvm_parallel(comm, fname, min_d,
+        internal::libsvm_cyclic_owner_t(map), data);
+
+    elem::DistMatrix<T, elem::STAR, elem::VC> XS(data.d, data.n, grid);
+    elem::DistMatrix<T, elem::STAR, elem::VC> YS(1, data.n, grid);
+    internal::copy_to_dense(data, XS.Matrix().Buffer(), XS.Matrix().LDim());
+    for(int k = 0; k < data.width(); k++)
+        YS.Matrix().Set(0, k, data.labels[k]);
+
+    X = XS;
+    Y = YS;
 }
 
 /**
  * Reads X and Y from a file in libsvm format.
  * X is a Skylark local sparse matrix, and Y is Elemental dense matrices.
  *
+ * The file is read in a single pass; storage is reserved from an estimate of
+ * the number of non-zeros (taken from the first block of the file), so X is
+ * never formed densely.
+ *
  * IMPORTANT: output is in column-major format (the rows are features).
  *
  * @param fname input file name
@@ -219,81 +734,219 @@ template<typename T>
 void ReadLIBSVM(const std::string& fname,
     base::sparse_matrix_t<T>& X, elem::Matrix<T>& Y, int min_d = 0) {
 
-    std::string line;
-    std::string token, val, ind;
-    float label;
-    unsigned int start = 0;
-    unsigned int delim, t;
-    int n = 0;
-    int d = 0;
-    int i, j, last;
-    char c;
-    int nnz=0;
-    int nz;
-
-    std::ifstream in(fname);
-
-    // make one pass over the data to figure out dimensions and nnz
-    // will pay in terms of preallocated storage.
-    while(!in.eof()) {
-        getline(in, line);
-        if(line.length()==0)
-            break;
+    internal::libsvm_data_t<T> data;
+    data.d = std::max(internal::parse_libsvm_range(fname, 0, 1, data), min_d);
+    data.n = data.width();
 
-        delim = line.find_last_of(":");
-        if(delim > line.length())
-            continue;
-        n++;
-        t = delim;
-        while(line[t]!=' ')
-            t--;
-
-        val = line.substr(t+1, delim - t);
-        last = atoi(val.c_str());
-        if (last>d)
-            d = last;
-
-        std::istringstream tokenstream (line);
-        tokenstream >> label;
-        while (tokenstream >> token)
-            nnz++;
-    }
+    Y.Resize(1, data.n);
+    for(int k = 0; k < data.n; k++)
+        Y.Set(0, k, data.labels[k]);
+    internal::move_to_sparse(data, X);
+}
 
-    T *values = new T[nnz];
-    int *rowind = new int[nnz];
-    int *col_ptr = new int[n + 1];
+/**
+ * Reads X and Y from a file in libsvm format, in parallel: every rank of
+ * comm parses the lines that start in its share of the bytes of the file,
+ * with a hand-rolled number parser, and the examples are then exchanged so
+ * that each rank holds a contiguous block of them (the first n % P ranks
+ * get one more). X is a local sparse matrix holding the local examples as
+ * columns, and Y is 1 x (local number of examples).
+ *
+ * @param comm communicator (all ranks must call).
+ * @param fname input file name.
+ * @param X output X (local examples).
+ * @param Y output Y (local labels).
+ * @param min_d minimum number of rows in the matrix.
+ */
+template<typename T>
+void ReadLIBSVM(const boost::mpi::communicator& comm, const std::string& fname,
+    base::sparse_matrix_t<T>& X, elem::Matrix<T>& Y, int min_d = 0) {
 
-    Y.Resize(1, n);
-    T *Ydata = Y.Buffer();
+    internal::libsvm_data_t<T> data;
+    internal::read_libsvm_parallel(comm, fname, min_d,
+        internal::libsvm_block_owner_t(comm.size()), data);
 
-    // prepare for second pass
-    in.clear();
-    in.seekg(0, std::ios::beg);
-    nnz = 0;
+    Y.Resize(1, data.width());
+    for(int k = 0; k < data.width(); k++)
+        Y.Set(0, k, data.labels[k]);
+    internal::move_to_sparse(data, X);
+}
 
-    for (t = 0; t < n; t++) {
-        getline(in, line);
-        if( line.length()==0)
-            break;
+/**
+ * Same as above, with X a local dense matrix (d x local number of
+ * examples).
+ */
+template<typename T>
+void ReadLIBSVM(const boost::mpi::communicator& comm, const std::string& fname,
+    elem::Matrix<T>& X, elem::Matrix<T>& Y, int min_d = 0) {
+
+    internal::libsvm_data_t<T> data;
+    internal::read_libsvm_parallel(comm, fname, min_d,
+        internal::libsvm_block_owner_t(comm.size()), data);
+
+    X.Resize(data.d, data.width());
+    Y.Resize(1, data.width());
+    internal::copy_to_dense(data, X.Buffer(), X.LDim());
+    for(int k = 0; k < data.width(); k++)
+        Y.Set(0, k, data.labels[k]);
+}
+
+#if SKYLARK_HAVE_COMBBLAS
+
+/**
+ * Reads X and Y from a file in libsvm format, in parallel, directly into a
+ * CombBLAS sparse matrix: every rank parses its share of the file (see the
+ * parallel ReadLIBSVM above) and sends each non-zero to the rank owning it
+ * on the 2D grid of X. No dense or replicated copy is formed.
+ *
+ * IMPORTANT: output is in column-major format (the rows are features).
+ *
+ * @param fname input file name.
+ * @param X output X (d x n). Its grid is used for the output.
+ * @param Y output Y (length n), on the same grid.
+ * @param min_d minimum number of rows in the matrix.
+ */
+template<typename IndexType, typename ValueType>
+void ReadLIBSVM(const std::string& fname,
+    SpParMat<IndexType, ValueType, SpDCCols<IndexType, ValueType> >& X,
+    FullyDistVec<IndexType, ValueType>& Y, int min_d = 0) {
+
+    typedef IndexType index_type;
+    typedef ValueType value_type;
+    typedef SpDCCols<index_type, value_type> col_t;
+    typedef SpParMat<index_type, value_type, col_t> matrix_type;
+
+    boost::mpi::communicator comm = get_communicator(X);
+    MPI_Datatype index_mpi_type = boost::mpi::get_mpi_datatype<index_type>();
+    MPI_Datatype value_mpi_type = boost::mpi::get_mpi_datatype<value_type>();
+
+    internal::libsvm_data_t<value_type> local;
+    int offset = internal::parse_libsvm_parallel(comm, fname, min_d, local);
+    const index_type d = local.d, n = local.n;
+
+    // Same layout as utility::owner: equal blocks of rows and columns, the
+    // last grid row (column) takes the remainder.
+    const size_t grows = X.getcommgrid()->GetGridRows();
+    const size_t gcols = X.getcommgrid()->GetGridCols();
+    const size_t rows_per_proc = d / grows;
+    const size_t cols_per_proc = n / gcols;
+
+    int P = comm.size();
+    std::vector<int> send_nz(P, 0);
+    std::vector<int> dest(local.indices.size());
+    for(int k = 0; k < local.width(); k++) {
+        size_t j = offset + k;
+        size_t pcol = cols_per_proc == 0 ? gcols - 1 :
+            std::min(j / cols_per_proc, gcols - 1);
+        for(base::sparse_index_t l = local.indptr[k];
+            l < local.indptr[k + 1]; l++) {
+            size_t i = local.indices[l];
+            size_t prow = rows_per_proc == 0 ? grows - 1 :
+                std::min(i / rows_per_proc, grows - 1);
+            dest[l] = X.getcommgrid()->GetRank(prow, pcol);
+            send_nz[dest[l]]++;
+        }
+    }
 
-        std::istringstream tokenstream (line);
-        tokenstream >> Ydata[t];
-
-        col_ptr[t] = nnz;
-        while (tokenstream >> token) {
-            delim  = token.find(':');
-            ind = token.substr(0, delim);
-            val = token.substr(delim+1); //.substr(delim+1);
-            j = atoi(ind.c_str()) - 1;
-            rowind[nnz] = j;
-            values[nnz] = atof(val.c_str());
-            nnz++;
+    std::vector<int> displ(P + 1, 0);
+    for(int p = 0; p < P; p++)
+        displ[p + 1] = displ[p] + send_nz[p];
+
+    // Entries are sent with global (row, column) and localized on arrival.
+    std::vector<index_type> srows(displ[P]), scols(displ[P]);
+    std::vector<value_type> svalues(displ[P]);
+    {
+        std::vector<int> pos(displ.begin(), displ.end() - 1);
+        for(int k = 0; k < local.width(); k++)
+            for(base::sparse_index_t l = local.indptr[k];
+                l < local.indptr[k + 1]; l++) {
+                int q = pos[dest[l]]++;
+                srows[q] = local.indices[l];
+                scols[q] = offset + k;
+                svalues[q] = local.values[l];
+            }
+    }
+
+    // Labels go to the owners of their entries in Y.
+    Y = FullyDistVec<index_type, value_type>(X.getcommgrid(), n, 0);
+    std::vector<int> send_ex(P, 0), ex_displ(P + 1, 0);
+    std::vector<int> ex_dest(local.width());
+    for(int k = 0; k < local.width(); k++) {
+        index_type lind;
+        ex_dest[k] = Y.Owner(offset + k, lind);
+        send_ex[ex_dest[k]]++;
+    }
+    for(int p = 0; p < P; p++)
+        ex_displ[p + 1] = ex_displ[p] + send_ex[p];
+
+    std::vector<index_type> sidx(local.width());
+    std::vector<value_type> slabels(local.width());
+    {
+        std::vector<int> pos(ex_displ.begin(), ex_displ.end() - 1);
+        for(int k = 0; k < local.width(); k++) {
+            int q = pos[ex_dest[k]]++;
+            sidx[q] = offset + k;
+            slabels[q] = local.labels[k];
         }
     }
-    col_ptr[n] = nnz; // last entry (total number of nnz)
+    local = internal::libsvm_data_t<value_type>();
+
+    std::vector<int> recv_nz(P), recv_ex(P);
+    MPI_Alltoall(&send_nz[0], 1, MPI_INT, &recv_nz[0], 1, MPI_INT, comm);
+    MPI_Alltoall(&send_ex[0], 1, MPI_INT, &recv_ex[0], 1, MPI_INT, comm);
+
+    std::vector<int> rdispl(P + 1, 0), rex_displ(P + 1, 0);
+    for(int p = 0; p < P; p++) {
+        rdispl[p + 1] = rdispl[p] + recv_nz[p];
+        rex_displ[p + 1] = rex_displ[p] + recv_ex[p];
+    }
 
-    X.attach(col_ptr, rowind, values, nnz, d, n, true);
+    std::vector<index_type> rrows(rdispl[P]), rcols(rdispl[P]);
+    std::vector<value_type> rvalues(rdispl[P]);
+    MPI_Alltoallv(srows.data(), &send_nz[0], &displ[0], index_mpi_type,
+        rrows.data(), &recv_nz[0], &rdispl[0], index_mpi_type, comm);
+    MPI_Alltoallv(scols.data(), &send_nz[0], &displ[0], index_mpi_type,
+        rcols.data(), &recv_nz[0], &rdispl[0], index_mpi_type, comm);
+    MPI_Alltoallv(svalues.data(), &send_nz[0], &displ[0], value_mpi_type,
+        rvalues.data(), &recv_nz[0], &rdispl[0], value_mpi_type, comm);
+
+    std::vector<index_type> ridx(rex_displ[P]);
+    std::vector<value_type> rlabels(rex_displ[P]);
+    MPI_Alltoallv(sidx.data(), &send_ex[0], &ex_displ[0], index_mpi_type,
+        ridx.data(), &recv_ex[0], &rex_displ[0], index_mpi_type, comm);
+    MPI_Alltoallv(slabels.data(), &send_ex[0], &ex_displ[0], value_mpi_type,
+        rlabels.data(), &recv_ex[0], &rex_displ[0], value_mpi_type, comm);
+
+    for(size_t k = 0; k < ridx.size(); k++)
+        Y.SetElement(ridx[k], rlabels[k]);
+
+    // Local block of X.
+    const size_t myrow = X.getcommgrid()->GetRankInProcCol();
+    const size_t mycol = X.getcommgrid()->GetRankInProcRow();
+    const index_type row_offset = rows_per_proc * myrow;
+    const index_type col_offset = cols_per_proc * mycol;
+    const index_type local_rows =
+        myrow == grows - 1 ? d - row_offset : rows_per_proc;
+    const index_type local_cols =
+        mycol == gcols - 1 ? n - col_offset : cols_per_proc;
+
+    std::vector< tuple< index_type, index_type, value_type > > tuples;
+    tuples.reserve(rrows.size());
+    for(size_t k = 0; k < rrows.size(); k++)
+        tuples.push_back(make_tuple(rrows[k] - row_offset,
+                rcols[k] - col_offset, rvalues[k]));
+
+    // this pointer will be freed in the destructor of col_t (see below).
+    SpTuples<index_type, value_type> *tmp_tpl =
+        new SpTuples<index_type, value_type> (
+            tuples.size(), local_rows, local_cols, tuples.data());
+    tmp_tpl->SortColBased();
+
+    col_t *sp_data = new col_t(*tmp_tpl, false);
+    X = matrix_type(sp_data, X.getcommgrid());
 }
 
+#endif // SKYLARK_HAVE_COMBBLAS
+
 } } } // namespace skylark::utility::io
 #endif
@@ -1,6 +1,11 @@
 #ifndef SKYLARK_QUASIRAND_HPP
 #define SKYLARK_QUASIRAND_HPP
 
+#include <vector>
+
+#include "boost/cstdint.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/random/mersenne_twister.hpp"
 #include "boost/property_tree/ptree.hpp"
 #include "boost/math/special_functions/prime.hpp"
 
@@ -19,6 +24,87 @@ inline double RadialInverseFunction(int base, size_t idx)
     return r;
 }
 
+namespace internal {
+
+/**
+ * Walks the radical inverses of n, n + step, n + 2 step, ... in base b.
+ *
+ * The digits of the argument are kept in a vector, and the radical inverse
+ * as the integer R with the digits reversed on K places (the largest K with
+ * b^K <= 2^64), so phi_b(n) = R / b^K. Moving to the next argument adds the
+ * digits of step with carry and patches R for the digits that changed:
+ * there are no divisions after the setup, and no rounding accumulates.
+ * Arguments must stay below b^K (at least 2^64 / b).
+ */
+struct radical_inverse_walker_t {
+
+    radical_inverse_walker_t(size_t base, size_t n, size_t step) :
+        _base(base), _K(0), _L(0), _R(0) {
+
+        // b^(K - 1), ..., b, 1; _pow[k] multiplies digit k after reversal.
+        boost::uint64_t bK = 1, pow[64];
+        while (bK <= ~boost::uint64_t(0) / base) {
+            pow[_K++] = bK;
+            bK *= base;
+        }
+        for(int k = 0; k < _K; k++)
+            _pow[k] = pow[_K - 1 - k];
+        _scale = 1.0 / (static_cast<double>(_pow[0]) * base);
+
+        for(int k = 0; k < _K; k++)
+            _digits[k] = 0;
+        for(int k = 0; n > 0 && k < _K; k++, n /= base) {
+            _digits[k] = n % base;
+            _R += _digits[k] * _pow[k];
+        }
+
+        for(; step > 0 && _L < _K; step /= base)
+            _step[_L++] = step % base;
+    }
+
+    double value() const {
+        return static_cast<double>(_R) * _scale;
+    }
+
+    void next() {
+        size_t carry = 0;
+        for(int k = 0; k < _K && (k < _L || carry != 0); k++) {
+            size_t s = _digits[k] + carry + (k < _L ? _step[k] : 0);
+            carry = s >= _base;
+            if (carry)
+                s -= _base;
+            // Unsigned wrap-around makes the subtraction come out right.
+            _R += (static_cast<boost::uint64_t>(s) - _digits[k]) * _pow[k];
+            _digits[k] = s;
+        }
+    }
+
+private:
+    size_t _base;
+    int _K, _L;
+    boost::uint64_t _R;
+    double _scale;
+    boost::uint64_t _pow[64];
+    size_t _digits[64];
+    size_t _step[64];
+};
+
+/** Bit reversal of a 32-bit word (base 2 radical inverse times 2^32). */
+inline boost::uint32_t reverse_bits(boost::uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+/** Maps a 32-bit fraction to the midpoint of its cell, so never 0 or 1. */
+inline double fraction32(boost::uint32_t x) {
+    return (static_cast<double>(x) + 0.5) * (1.0 / 4294967296.0);
+}
+
+} // namespace internal
+
 template<typename ValueType>
 struct qmc_sequence_t {
     typedef ValueType value_type;
@@ -26,6 +112,34 @@ struct qmc_sequence_t {
     virtual value_type coordinate(size_t idx, size_t i) const = 0;
     virtual boost::property_tree::ptree to_ptree() const  = 0;
 
+    /**
+     * Coordinate i of count consecutive points starting at idx:
+     * out[k * stride] = coordinate(idx + k, i). Sequences override this when
+     * consecutive points can be generated incrementally.
+     */
+    virtual void coordinates(size_t idx, size_t count, size_t i,
+        value_type *out, size_t stride = 1) const {
+        for(size_t k = 0; k < count; k++)
+            out[k * stride] = coordinate(idx + k, i);
+    }
+
+    /**
+     * Fills out with count consecutive entries of the row-major array whose
+     * rows are the first d coordinates of points idx, idx + 1, ..., starting
+     * at coordinate i of point idx. Generation goes coordinate by coordinate
+     * through coordinates().
+     */
+    void fill(size_t idx, size_t i, size_t d, size_t count,
+        value_type *out) const {
+        for(size_t c = 0; c < d; c++) {
+            size_t offset = c >= i ? c - i : d - i + c;
+            if (offset >= count)
+                continue;
+            size_t n = (count - offset + d - 1) / d;
+            coordinates(c >= i ? idx : idx + 1, n, c, out + offset, d);
+        }
+    }
+
     virtual ~qmc_sequence_t() {
 
     }
@@ -43,22 +157,41 @@ struct leaped_halton_sequence_t : public qmc_sequence_t<ValueType> {
     leaped_halton_sequence_t(size_t d, size_t leap = -1) :
         _d(d),
         _leap(leap == -1 ? boost::math::prime(d) : leap) {
-
+        _build();
     }
 
     leaped_halton_sequence_t (const boost::property_tree::ptree& json) {
         _d = json.get<int>("d");
         _leap = json.get<size_t>("leap");
+        _build();
     }
 
     leaped_halton_sequence_t& operator=(const leaped_halton_sequence_t& other) {
         _d = other._d;
         _leap = other._leap;
+        _primes = other._primes;
         return *this;
     }
 
     inline value_type coordinate(size_t idx, size_t i) const {
-        return RadialInverseFunction(boost::math::prime(i), idx * _leap);
+        internal::radical_inverse_walker_t
+            w(_prime(i), idx * _leap + 1, 0);
+        return w.value();
+    }
+
+    /**
+     * Along consecutive points the arguments of the radical inverse grow by
+     * the leap, so the digits are updated in place instead of being
+     * recomputed with divisions.
+     */
+    void coordinates(size_t idx, size_t count, size_t i,
+        value_type *out, size_t stride = 1) const {
+        if (count == 0)
+            return;
+        internal::radical_inverse_walker_t
+            w(_prime(i), idx * _leap + 1, _leap);
+        for(size_t k = 0; k < count; k++, w.next())
+            out[k * stride] = w.value();
     }
 
     boost::property_tree::ptree to_ptree() const {
@@ -74,6 +207,293 @@ struct leaped_halton_sequence_t : public qmc_sequence_t<ValueType> {
 private:
     size_t _d;
     size_t _leap;
+
+    /** Base of each coordinate: the i-th prime. */
+    std::vector<size_t> _primes;
+
+    void _build() {
+        _primes.resize(_d);
+        for(size_t i = 0; i < _d; i++)
+            _primes[i] = boost::math::prime(i);
+    }
+
+    size_t _prime(size_t i) const {
+        return i < _primes.size() ? _primes[i] : boost::math::prime(i);
+    }
+};
+
+/**
+ * Sobol sequence in base 2 with 32 digits (so at most 2^32 points), with
+ * random linear (Matousek) scrambling and a random digital shift.
+ *
+ * Coordinate 0 is the van der Corput sequence; coordinate j > 0 uses the
+ * j-th primitive polynomial over GF(2), in order of degree. The initial
+ * direction numbers are drawn at random from the seed instead of being read
+ * from a table, so any dimension is supported. Points are in Gray code order,
+ * so consecutive points differ by a single XOR.
+ */
+template<typename ValueType>
+struct sobol_sequence_t : public qmc_sequence_t<ValueType> {
+
+    typedef ValueType value_type;
+
+    sobol_sequence_t() :
+        _d(0), _seed(0) {
+    }
+
+    sobol_sequence_t(size_t d, int seed) :
+        _d(d), _seed(seed) {
+        _build();
+    }
+
+    sobol_sequence_t (const boost::property_tree::ptree& json) {
+        _d = json.get<size_t>("d");
+        _seed = json.get<int>("seed");
+        _build();
+    }
+
+    inline value_type coordinate(size_t idx, size_t i) const {
+        const boost::uint32_t *v = &(*_directions)[i * 33];
+        boost::uint32_t x = v[32];
+        boost::uint32_t g = static_cast<boost::uint32_t>(idx ^ (idx >> 1));
+        for(int k = 0; g != 0; k++, g >>= 1)
+            if (g & 1)
+                x ^= v[k];
+        return internal::fraction32(x);
+    }
+
+    void coordinates(size_t idx, size_t count, size_t i,
+        value_type *out, size_t stride = 1) const {
+        if (count == 0)
+            return;
+        const boost::uint32_t *v = &(*_directions)[i * 33];
+        boost::uint32_t x = v[32];
+        boost::uint32_t g = static_cast<boost::uint32_t>(idx ^ (idx >> 1));
+        for(int k = 0; g != 0; k++, g >>= 1)
+            if (g & 1)
+                x ^= v[k];
+
+        for(size_t k = 0; k < count; k++) {
+            out[k * stride] = internal::fraction32(x);
+            // Gray code of n + 1 flips the lowest zero bit of n.
+            boost::uint32_t n = static_cast<boost::uint32_t>(idx + k);
+            int c = 0;
+            for(; n & 1; n >>= 1)
+                c++;
+            x ^= v[c & 31];
+        }
+    }
+
+    boost::property_tree::ptree to_ptree() const {
+        boost::property_tree::ptree pt;
+        pt.put("skylark_object_type", "qmc_sequence");
+        pt.put("skylark_version", VERSION);
+        pt.put("sequence_type", "sobol");
+        pt.put("d", _d);
+        pt.put("seed", _seed);
+        return pt;
+    }
+
+private:
+    size_t _d;
+    int _seed;
+
+    /**
+     * 33 words per coordinate: the 32 scrambled direction numbers
+     * (most significant digit first) followed by the digital shift.
+     * Shared between copies.
+     */
+    boost::shared_ptr<const std::vector<boost::uint32_t> > _directions;
+
+    /** x^e mod p over GF(2); polynomials are bit masks, deg p <= 31. */
+    static boost::uint64_t _powmod(boost::uint64_t e, boost::uint64_t p,
+        int deg) {
+        // x reduced mod p (x = 1 mod x + 1).
+        boost::uint64_t r = 1, b = deg > 1 ? 2 : 1;
+        while (e > 0) {
+            if (e & 1)
+                r = _mulmod(r, b, p, deg);
+            b = _mulmod(b, b, p, deg);
+            e >>= 1;
+        }
+        return r;
+    }
+
+    static boost::uint64_t _mulmod(boost::uint64_t a, boost::uint64_t b,
+        boost::uint64_t p, int deg) {
+        boost::uint64_t r = 0;
+        for(; b != 0; b >>= 1) {
+            if (b & 1)
+                r ^= a;
+            a <<= 1;
+            if (a & (boost::uint64_t(1) << deg))
+                a ^= p;
+        }
+        return r;
+    }
+
+    /** Whether p (with degree deg) is primitive: x has order 2^deg - 1. */
+    static bool _primitive(boost::uint64_t p, int deg) {
+        if (!(p & 1))
+            return false;
+        boost::uint64_t order = (boost::uint64_t(1) << deg) - 1;
+        if (_powmod(order, p, deg) != 1)
+            return false;
+        boost::uint64_t m = order;
+        for(boost::uint64_t q = 2; q * q <= m; q++) {
+            if (m % q != 0)
+                continue;
+            if (_powmod(order / q, p, deg) == 1)
+                return false;
+            while (m % q == 0)
+                m /= q;
+        }
+        return m == 1 || _powmod(order / m, p, deg) != 1;
+    }
+
+    void _build() {
+        std::vector<boost::uint32_t> *dirs =
+            new std::vector<boost::uint32_t>(_d * 33);
+        _directions.reset(dirs);
+
+        boost::random::mt19937 gen(_seed);
+        boost::uint64_t poly = 1;
+        int deg = 0;
+
+        for(size_t j = 0; j < _d; j++) {
+            boost::uint32_t m[33];
+            if (j == 0)
+                for(int k = 1; k <= 32; k++)
+                    m[k] = 1;
+            else {
+                // Next primitive polynomial.
+                do {
+                    poly++;
+                    if (poly >> (deg + 1)) {
+                        deg++;
+                        poly = (boost::uint64_t(1) << deg) | 1;
+                    }
+                } while (!_primitive(poly, deg));
+
+                // Random odd m_k < 2^k for k <= deg, then the recurrence
+                // m_k = 2 a_1 m_{k-1} ^ ... ^ 2^deg m_{k-deg} ^ m_{k-deg}.
+                for(int k = 1; k <= 32; k++) {
+                    if (k <= deg) {
+                        m[k] = (gen() & ((boost::uint32_t(1) << k) - 1)) | 1;
+                        continue;
+                    }
+                    boost::uint32_t r = m[k - deg] ^ (m[k - deg] << deg);
+                    for(int l = 1; l < deg; l++)
+                        if ((poly >> (deg - l)) & 1)
+                            r ^= m[k - l] << l;
+                    m[k] = r;
+                }
+            }
+
+            // Random nonsingular lower triangular scramble: digit r (from
+            // the top) gets its own value plus random more significant ones.
+            boost::uint32_t L[32];
+            for(int r = 0; r < 32; r++) {
+                boost::uint64_t own = boost::uint64_t(1) << (31 - r);
+                L[r] = static_cast<boost::uint32_t>(
+                    own | (gen() & ~((own << 1) - 1)));
+            }
+
+            boost::uint32_t *v = &(*dirs)[j * 33];
+            for(int k = 1; k <= 32; k++) {
+                boost::uint32_t u = m[k] << (32 - k), w = 0;
+                for(int r = 0; r < 32; r++) {
+                    boost::uint32_t b = L[r] & u;
+                    b ^= b >> 16; b ^= b >> 8; b ^= b >> 4;
+                    b ^= b >> 2; b ^= b >> 1;
+                    w |= (b & 1) << (31 - r);
+                }
+                v[k - 1] = w;
+            }
+            v[32] = gen();
+        }
+    }
+};
+
+/**
+ * Randomly shifted rank-1 lattice, extensible in base 2: point n is
+ *
+ *     x_n = frac(phi_2(n) z + shift)
+ *
+ * with phi_2 the van der Corput radical inverse (so the first 2^m points
+ * form a full lattice for every m) and the Korobov generating vector
+ * z_i = a^i mod 2^32. The default multiplier is the classic LCG multiplier
+ * 1664525, chosen for its spectral test (which measures exactly the quality
+ * of this lattice). The shift is drawn from the seed. All arithmetic is on
+ * 32-bit integers, so values are exact.
+ */
+template<typename ValueType>
+struct lattice_sequence_t : public qmc_sequence_t<ValueType> {
+
+    typedef ValueType value_type;
+
+    lattice_sequence_t() :
+        _d(0), _seed(0), _multiplier(0) {
+    }
+
+    lattice_sequence_t(size_t d, int seed,
+        boost::uint32_t multiplier = 1664525u) :
+        _d(d), _seed(seed), _multiplier(multiplier) {
+        _build();
+    }
+
+    lattice_sequence_t (const boost::property_tree::ptree& json) {
+        _d = json.get<size_t>("d");
+        _seed = json.get<int>("seed");
+        _multiplier = json.get<boost::uint32_t>("multiplier");
+        _build();
+    }
+
+    inline value_type coordinate(size_t idx, size_t i) const {
+        boost::uint32_t r =
+            internal::reverse_bits(static_cast<boost::uint32_t>(idx));
+        return internal::fraction32(r * _z[i] + _shift[i]);
+    }
+
+    void coordinates(size_t idx, size_t count, size_t i,
+        value_type *out, size_t stride = 1) const {
+        boost::uint32_t z = _z[i], s = _shift[i];
+        for(size_t k = 0; k < count; k++) {
+            boost::uint32_t r =
+                internal::reverse_bits(static_cast<boost::uint32_t>(idx + k));
+            out[k * stride] = internal::fraction32(r * z + s);
+        }
+    }
+
+    boost::property_tree::ptree to_ptree() const {
+        boost::property_tree::ptree pt;
+        pt.put("skylark_object_type", "qmc_sequence");
+        pt.put("skylark_version", VERSION);
+        pt.put("sequence_type", "lattice");
+        pt.put("d", _d);
+        pt.put("seed", _seed);
+        pt.put("multiplier", _multiplier);
+        return pt;
+    }
+
+private:
+    size_t _d;
+    int _seed;
+    boost::uint32_t _multiplier;
+    std::vector<boost::uint32_t> _z;
+    std::vector<boost::uint32_t> _shift;
+
+    void _build() {
+        boost::random::mt19937 gen(_seed);
+        _z.resize(_d);
+        _shift.resize(_d);
+        boost::uint32_t z = 1;
+        for(size_t i = 0; i < _d; i++) {
+            _z[i] = z;
+            z *= _multiplier;
+            _shift[i] = gen();
+        }
+    }
 };
 
 template<typename ValueType>
@@ -85,6 +505,12 @@ struct qmc_sequence_container_t : public qmc_sequence_t<ValueType> {
         if (sequence_type == "leaped halton")
             _sequence = boost::shared_ptr<qmc_sequence_t<value_type> >(new
                 leaped_halton_sequence_t<value_type>(json));
+        else if (sequence_type == "sobol")
+            _sequence = boost::shared_ptr<qmc_sequence_t<value_type> >(new
+                sobol_sequence_t<value_type>(json));
+        else if (sequence_type == "lattice")
+            _sequence = boost::shared_ptr<qmc_sequence_t<value_type> >(new
+                lattice_sequence_t<value_type>(json));
         else 
             SKYLARK_THROW_EXCEPTION(base::skylark_exception() <<
                 base::error_msg("Unknown QMC sequence type"));
@@ -99,6 +525,11 @@ struct qmc_sequence_container_t : public qmc_sequence_t<ValueType> {
         return _sequence->coordinate(idx, i);
     }
 
+    virtual void coordinates(size_t idx, size_t count, size_t i,
+        value_type *out, size_t stride = 1) const {
+        _sequence->coordinates(idx, count, i, out, stride);
+    }
+
     virtual boost::property_tree::ptree to_ptree() const {
         return _sequence->to_ptree();
     }
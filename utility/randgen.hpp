@@ -1,13 +1,298 @@
 #ifndef SKYLARK_RANDGEN_HPP
 #define SKYLARK_RANDGEN_HPP
 
+#include <cmath>
+#include <cstring>
 #include <sstream>
 
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/math/constants/constants.hpp>
+#include <boost/random/cauchy_distribution.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
 #include <Random123/threefry.h>
 #include <Random123/MicroURNG.hpp>
 
 namespace skylark { namespace utility {
 
+namespace internal {
+
+/// Counters run through Threefry together in random_samples_array_t::fill.
+const int threefry_lanes = 32;
+
+typedef boost::uint64_t threefry_word_t;
+
+/**
+ * Threefry-2x64 with 13 rounds (as r123::Threefry2x64_R<13>) of the L
+ * counters (c[l], 0), l < L, under one key: lane l of the blocks is
+ * (x0[l], x1[l]). The lanes are independent and stored apart, and all
+ * rotations are constants, so every round is a few vector instructions.
+ */
+template<int L>
+struct threefry_lanes_t {
+
+    threefry_word_t x0[L], x1[L];
+
+    threefry_lanes_t(const threefry_word_t *c, threefry_word_t k0,
+        threefry_word_t k1) {
+
+        ks[0] = k0;
+        ks[1] = k1;
+        ks[2] = k0 ^ k1 ^ 0x1BD11BDAA9FC1A22ULL;
+
+        for(int l = 0; l < L; l++) {
+            x0[l] = c[l] + ks[0];
+            x1[l] = ks[1];
+        }
+
+        round<16>(); round<42>(); round<12>(); round<31>(); inject<1>();
+        round<16>(); round<32>(); round<24>(); round<21>(); inject<2>();
+        round<16>(); round<42>(); round<12>(); round<31>(); inject<3>();
+        round<16>();
+    }
+
+private:
+    threefry_word_t ks[3];
+
+    template<int R>
+    void round() {
+        for(int l = 0; l < L; l++) {
+            x0[l] += x1[l];
+            x1[l] = (x1[l] << R) | (x1[l] >> (64 - R));
+            x1[l] ^= x0[l];
+        }
+    }
+
+    /** Key injection S, after every four rounds. */
+    template<int S>
+    void inject() {
+        for(int l = 0; l < L; l++) {
+            x0[l] += ks[S % 3];
+            x1[l] += ks[(S + 1) % 3] + S;
+        }
+    }
+};
+
+inline double word_bits_to_double(threefry_word_t w) {
+    double d;
+    std::memcpy(&d, &w, sizeof(d));
+    return d;
+}
+
+inline threefry_word_t double_to_word_bits(double d) {
+    threefry_word_t w;
+    std::memcpy(&w, &d, sizeof(w));
+    return w;
+}
+
+/**
+ * d < 0 ? a : b, by a mask from the sign bit of d: a select the compiler
+ * can neither turn into a branch (it would, around floating-point
+ * operations that might trap) nor fail to vectorize for want of 64-bit
+ * compares, so the lane loops below vectorize even on plain SSE2.
+ */
+inline double select_negative(double d, double a, double b) {
+    threefry_word_t mask = -(double_to_word_bits(d) >> 63);
+    return word_bits_to_double((double_to_word_bits(a) & mask) |
+        (double_to_word_bits(b) & ~mask));
+}
+
+/**
+ * 52 random bits as a double in [0, 1), through the mantissa of a double
+ * in [1, 2): unlike a conversion of a 64-bit integer, this vectorizes.
+ */
+inline double word_to_closed_open(threefry_word_t w) {
+    return word_bits_to_double((w >> 12) | 0x3FF0000000000000ULL) - 1.0;
+}
+
+/** 52 random bits as a double in (0, 1), midpoints of the above. */
+inline double word_to_open(threefry_word_t w) {
+    return word_to_closed_open(w) + 0.5 / 4503599627370496.0;
+}
+
+/*
+ * Elementary functions on L lanes, for the arguments the samplers below
+ * pass, with only arithmetic, bit operations and selects, so that each
+ * loop vectorizes whether or not it is inlined (loops calling std::log and
+ * the like do not). All are accurate to a few ulps.
+ */
+
+/**
+ * x[l] = log x[l], for positive normal x[l]: x = 2^e m with m in
+ * [sqrt(1/2), sqrt(2)), and log m = 2 atanh(f), f = (m - 1) / (m + 1), by
+ * its series.
+ */
+template<int L>
+inline void log_lanes(double *x) {
+    for(int l = 0; l < L; l++) {
+        threefry_word_t bits = double_to_word_bits(x[l]);
+
+        // Exponent as a double: its bits put in the mantissa of 2^52.
+        double e = word_bits_to_double((bits >> 52) | 0x4330000000000000ULL) -
+            (4503599627370496.0 + 1023.0);
+        double m = word_bits_to_double(
+            (bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL);
+
+        double big = 1.4142135623730951 - m;    // negative iff m > sqrt(2)
+        m = select_negative(big, 0.5 * m, m);
+        e = select_negative(big, e + 1.0, e);
+
+        double f = (m - 1.0) / (m + 1.0);
+        double s = f * f;
+        double p = 1.0 / 21;
+        p = p * s + 1.0 / 19;
+        p = p * s + 1.0 / 17;
+        p = p * s + 1.0 / 15;
+        p = p * s + 1.0 / 13;
+        p = p * s + 1.0 / 11;
+        p = p * s + 1.0 / 9;
+        p = p * s + 1.0 / 7;
+        p = p * s + 1.0 / 5;
+        p = p * s + 1.0 / 3;
+        p = p * s + 1.0;
+        x[l] = e * 0.6931471805599453 + 2.0 * f * p;
+    }
+}
+
+/**
+ * x[l] = sqrt x[l], for positive normal x[l] (std::sqrt keeps a call for
+ * errno): x times 1/sqrt(x), the latter by Newton iterations from an
+ * estimate by the exponent bits.
+ */
+template<int L>
+inline void sqrt_lanes(double *x) {
+    for(int l = 0; l < L; l++) {
+        double y = word_bits_to_double(
+            0x5FE6EB50C7B537A9ULL - (double_to_word_bits(x[l]) >> 1));
+        for(int it = 0; it < 4; it++)
+            y *= 1.5 - 0.5 * x[l] * y * y;
+        x[l] *= y;
+    }
+}
+
+/**
+ * c[l] = cos(2 pi t[l]) and s[l] = sin(2 pi t[l]), for t[l] in [0, 1):
+ * reduced by symmetry to cos and sin of an angle in [0, pi/4], by their
+ * Taylor series.
+ */
+template<int L>
+inline void sincos_two_pi_lanes(const double *t, double *c, double *s) {
+    for(int l = 0; l < L; l++) {
+        double r = select_negative(0.5 - t[l], t[l] - 1.0, t[l]);
+        double a = std::abs(r);                           // [0, 1/2]
+        double flip = 0.25 - a;
+        a = select_negative(flip, 0.5 - a, a);            // [0, 1/4]
+        double swap = 0.125 - a;
+        double x = 6.283185307179586 * select_negative(swap, 0.25 - a, a);
+        double x2 = x * x;
+
+        double cx = 1.0 / 6402373705728000;               // 1/18!
+        cx = cx * -x2 + 1.0 / 20922789888000;
+        cx = cx * -x2 + 1.0 / 87178291200;
+        cx = cx * -x2 + 1.0 / 479001600;
+        cx = cx * -x2 + 1.0 / 3628800;
+        cx = cx * -x2 + 1.0 / 40320;
+        cx = cx * -x2 + 1.0 / 720;
+        cx = cx * -x2 + 1.0 / 24;
+        cx = cx * -x2 + 1.0 / 2;
+        cx = cx * -x2 + 1.0;
+
+        double sx = 1.0 / 355687428096000;                // 1/17!
+        sx = sx * -x2 + 1.0 / 1307674368000;
+        sx = sx * -x2 + 1.0 / 6227020800;
+        sx = sx * -x2 + 1.0 / 39916800;
+        sx = sx * -x2 + 1.0 / 362880;
+        sx = sx * -x2 + 1.0 / 5040;
+        sx = sx * -x2 + 1.0 / 120;
+        sx = sx * -x2 + 1.0 / 6;
+        sx = sx * -x2 + 1.0;
+        sx *= x;
+
+        double cl = select_negative(swap, sx, cx);
+        double sl = select_negative(swap, cx, sx);
+        c[l] = select_negative(flip, -cl, cl);
+        s[l] = select_negative(r, -sl, sl);
+    }
+}
+
+/**
+ * How samples of a distribution are formed from Threefry blocks. The
+ * distributions listed below take two samples, v0 and v1, from the two
+ * words of each block by closed forms, for L blocks at a time: sample i is
+ * v0 (i even) or v1 (i odd) of the block of counter i / 2. Any other
+ * distribution draws sample i from a MicroURNG over counter i.
+ */
+template<typename Distribution>
+struct block_sampler_t {
+    static const bool direct = false;
+};
+
+template<typename RealType>
+struct block_sampler_t<boost::random::uniform_real_distribution<RealType> > {
+    static const bool direct = true;
+
+    template<int L>
+    static void sample(
+        const boost::random::uniform_real_distribution<RealType>& d,
+        const threefry_lanes_t<L>& block, RealType *v0, RealType *v1) {
+        for(int l = 0; l < L; l++) {
+            v0[l] = d.a() + (d.b() - d.a()) * word_to_closed_open(block.x0[l]);
+            v1[l] = d.a() + (d.b() - d.a()) * word_to_closed_open(block.x1[l]);
+        }
+    }
+};
+
+/** Box-Muller: the cosine and sine branches give the two samples. */
+template<typename RealType>
+struct block_sampler_t<boost::random::normal_distribution<RealType> > {
+    static const bool direct = true;
+
+    template<int L>
+    static void sample(
+        const boost::random::normal_distribution<RealType>& d,
+        const threefry_lanes_t<L>& block, RealType *v0, RealType *v1) {
+        double r[L], t[L], c[L], s[L];
+        for(int l = 0; l < L; l++) {
+            r[l] = word_to_open(block.x0[l]);
+            t[l] = word_to_closed_open(block.x1[l]);
+        }
+
+        log_lanes<L>(r);
+        for(int l = 0; l < L; l++)
+            r[l] *= -2.0;
+        sqrt_lanes<L>(r);
+        sincos_two_pi_lanes<L>(t, c, s);
+
+        for(int l = 0; l < L; l++) {
+            v0[l] = d.mean() + d.sigma() * (r[l] * c[l]);
+            v1[l] = d.mean() + d.sigma() * (r[l] * s[l]);
+        }
+    }
+};
+
+/** Inverse CDF on each word of the block. */
+template<typename RealType>
+struct block_sampler_t<boost::random::cauchy_distribution<RealType> > {
+    static const bool direct = true;
+
+    template<int L>
+    static void sample(
+        const boost::random::cauchy_distribution<RealType>& d,
+        const threefry_lanes_t<L>& block, RealType *v0, RealType *v1) {
+        const double pi = boost::math::constants::pi<double>();
+        for(int l = 0; l < L; l++) {
+            v0[l] = d.median() + d.sigma() *
+                std::tan(pi * (word_to_open(block.x0[l]) - 0.5));
+            v1[l] = d.median() + d.sigma() *
+                std::tan(pi * (word_to_open(block.x1[l]) - 0.5));
+        }
+    }
+};
+
+} // namespace internal
+
 
 /**
  * Random-access array of samples drawn from a distribution.
@@ -94,6 +379,10 @@ public:
      * state between successive invocations of the passed in generator object.
      * (e.g. normal distribution). So the reason for copying is the
      * const-correctness.
+     *
+     * Uniform, normal and Cauchy samples are instead formed directly from
+     * Threefry blocks, two samples per block (see internal::block_sampler_t),
+     * as fill() forms them.
      */
     value_type operator[](size_t index) const {
         // Could be more specific exception std::out_of_range
@@ -106,15 +395,126 @@ public:
                 base::random123_exception()
                 << base::error_msg(msg.str()) );
         }
+        return _sample(_base + index, is_direct());
+    }
+
+    /**
+     * Bulk generation of samples: begin, begin + stride, ...
+     * @param[in] begin Index of the first sample to generate.
+     * @param[in] count Number of samples to generate.
+     * @param[out] out Output buffer (at least count entries).
+     * @param[in] stride Distance between the indices of consecutive samples.
+     *
+     * @internal Produces exactly the same values as calling operator[] on
+     * begin, ..., begin + (count - 1) * stride. For the distributions
+     * sampled directly from Threefry blocks, the counters are run through
+     * Threefry internal::threefry_lanes at a time and the blocks are turned
+     * into samples by a loop over the lanes, both of which vectorize; only
+     * the tail (and an odd first sample, with stride 1) is done one at a
+     * time. With stride 1 each block gives two samples. Other distributions
+     * draw every sample through its own MicroURNG, as operator[] does.
+     */
+    template <typename OutputType>
+    void fill(size_t begin, size_t count, OutputType *out,
+        size_t stride = 1) const {
+        if (count == 0)
+            return;
+
+        if (begin >= _size || count - 1 > (_size - 1 - begin) / stride) {
+            std::ostringstream msg;
+            msg << "Index is out of bounds:\n";
+            msg << "indices " << begin << " + k * " << stride;
+            msg << ", k < " << count << ", ";
+            msg << "not in expected [0, " << _size << ") range\n";
+            SKYLARK_THROW_EXCEPTION (
+                base::random123_exception()
+                << base::error_msg(msg.str()) );
+        }
+
+        _fill(_base + begin, count, stride, out, is_direct());
+    }
+
+private:
+    typedef internal::block_sampler_t<distribution_type> sampler_type;
+    typedef boost::integral_constant<bool, sampler_type::direct> is_direct;
+
+    /** Sample at global position i, half of the Threefry block i / 2. */
+    value_type _sample(size_t i, boost::true_type) const {
+        internal::threefry_word_t c = i / 2;
+        internal::threefry_lanes_t<1> block(&c, _key.v[0], _key.v[1]);
+        value_type v0, v1;
+        sampler_type::template sample<1>(_distribution, block, &v0, &v1);
+        return i % 2 == 0 ? v0 : v1;
+    }
+
+    /** Sample at global position i, drawn through a MicroURNG. */
+    value_type _sample(size_t i, boost::false_type) const {
         ctr_t ctr;
-        ctr.v[0] = static_cast<ctr_t::value_type>(_base + index);
+        ctr.v[0] = static_cast<ctr_t::value_type>(i);
         ctr.v[1] = static_cast<ctr_t::value_type>(0);
-	URNG_t urng(ctr, _key);
+        URNG_t urng(ctr, _key);
         distribution_type cloned_distribution = _distribution;
         return cloned_distribution(urng);
     }
 
-private:
+    template<typename OutputType>
+    void _fill(size_t start, size_t count, size_t stride, OutputType *out,
+        boost::true_type) const {
+
+        const int L = internal::threefry_lanes;
+        internal::threefry_word_t c[L];
+        value_type v0[L], v1[L];
+
+        if (stride != 1) {
+            // A block per sample, keeping the half the sample falls on.
+            size_t full = count - count % L;
+            for(size_t i = 0; i < full; i += L) {
+                for(int l = 0; l < L; l++)
+                    c[l] = (start + (i + l) * stride) / 2;
+                internal::threefry_lanes_t<L> block(c, _key.v[0], _key.v[1]);
+                sampler_type::template sample<L>(_distribution, block, v0, v1);
+                for(int l = 0; l < L; l++)
+                    out[i + l] = static_cast<OutputType>(
+                        (start + (i + l) * stride) % 2 == 0 ? v0[l] : v1[l]);
+            }
+
+            for(size_t i = full; i < count; i++)
+                out[i] = static_cast<OutputType>(
+                    _sample(start + i * stride, boost::true_type()));
+            return;
+        }
+
+        // An odd start is the second half of a block.
+        size_t i = start % 2;
+        if (i == 1)
+            out[0] = static_cast<OutputType>(
+                _sample(start, boost::true_type()));
+
+        size_t full = i + (count - i) / (2 * L) * (2 * L);
+        for(; i < full; i += 2 * L) {
+            for(int l = 0; l < L; l++)
+                c[l] = (start + i) / 2 + l;
+            internal::threefry_lanes_t<L> block(c, _key.v[0], _key.v[1]);
+            sampler_type::template sample<L>(_distribution, block, v0, v1);
+            for(int l = 0; l < L; l++) {
+                out[i + 2 * l] = static_cast<OutputType>(v0[l]);
+                out[i + 2 * l + 1] = static_cast<OutputType>(v1[l]);
+            }
+        }
+
+        for(; i < count; i++)
+            out[i] = static_cast<OutputType>(
+                _sample(start + i, boost::true_type()));
+    }
+
+    template<typename OutputType>
+    void _fill(size_t start, size_t count, size_t stride, OutputType *out,
+        boost::false_type) const {
+        for(size_t i = 0; i < count; i++)
+            out[i] = static_cast<OutputType>(
+                _sample(start + i * stride, boost::false_type()));
+    }
+
     size_t _base;
     size_t _size;
     key_t _key;
@@ -0,0 +1,121 @@
+#ifndef SKYLARK_SCRATCH_FILE_HPP
+#define SKYLARK_SCRATCH_FILE_HPP
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../base/exception.hpp"
+
+namespace skylark { namespace utility {
+
+/**
+ * Anonymous scratch file mapped into memory. The file is created in the given
+ * directory and unlinked right away, so it goes away with the process (or the
+ * object). Pages are backed by the file rather than by swap, so the kernel can
+ * write them out and drop them under memory pressure: this is how buffers
+ * larger than physical memory are spilled to disk.
+ */
+template<typename T>
+struct scratch_file_t {
+
+    typedef T value_type;
+
+    /**
+     * Creates and maps a file holding size elements in directory dir.
+     */
+    scratch_file_t(const std::string& dir, size_t size) :
+        _fd(-1), _size(size), _data(NULL) {
+
+        std::string templ = (dir.empty() ? std::string(".") : dir) +
+            "/skylark_scratch_XXXXXX";
+        std::vector<char> path(templ.begin(), templ.end());
+        path.push_back('\0');
+
+        _fd = mkstemp(&path[0]);
+        if (_fd == -1)
+            _fail("cannot create scratch file in " + dir);
+        unlink(&path[0]);
+
+        size_t bytes = _size * sizeof(value_type);
+        if (bytes == 0)
+            return;
+
+        if (ftruncate(_fd, bytes) != 0)
+            _fail("cannot resize scratch file");
+
+        void *addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+            _fd, 0);
+        if (addr == MAP_FAILED)
+            _fail("cannot map scratch file");
+        _data = static_cast<value_type *>(addr);
+    }
+
+    ~scratch_file_t() {
+        if (_data != NULL)
+            munmap(_data, _size * sizeof(value_type));
+        if (_fd != -1)
+            close(_fd);
+    }
+
+    size_t size() const { return _size; }
+
+    value_type *data() { return _data; }
+    const value_type *data() const { return _data; }
+
+    /**
+     * Hint that [offset, offset + count) will be read soon, so the kernel can
+     * start paging it in while the current block is being processed.
+     */
+    void prefetch(size_t offset, size_t count) const {
+        _advise(offset, count, MADV_WILLNEED);
+    }
+
+    /**
+     * Hint that [offset, offset + count) will not be needed for a while.
+     */
+    void release(size_t offset, size_t count) const {
+        _advise(offset, count, MADV_DONTNEED);
+    }
+
+private:
+    int _fd;
+    size_t _size;
+    value_type *_data;
+
+    // Non-copyable: the mapping is owned.
+    scratch_file_t(const scratch_file_t&);
+    scratch_file_t& operator=(const scratch_file_t&);
+
+    void _advise(size_t offset, size_t count, int advice) const {
+        if (_data == NULL || count == 0)
+            return;
+
+        // madvise wants a page-aligned start.
+        size_t page = sysconf(_SC_PAGESIZE);
+        char *begin = reinterpret_cast<char *>(_data + offset);
+        char *end = reinterpret_cast<char *>(_data + offset + count);
+        char *aligned = reinterpret_cast<char *>(
+            reinterpret_cast<size_t>(begin) / page * page);
+        madvise(aligned, end - aligned, advice);
+    }
+
+    void _fail(const std::string& what) {
+        std::string msg = what + ": " + std::strerror(errno);
+        if (_fd != -1)
+            close(_fd);
+        _fd = -1;
+        SKYLARK_THROW_EXCEPTION (
+            base::io_exception()
+                << base::error_msg(msg) );
+    }
+};
+
+} } // namespace skylark::utility
+
+#endif // SKYLARK_SCRATCH_FILE_HPP
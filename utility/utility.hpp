@@ -8,6 +8,8 @@
 #include "get_communicator.hpp"
 #include "typer.hpp"
 #include "elem_extender.hpp"
+#include "scratch_file.hpp"
+#include "aligned_buffer.hpp"
 #include "io/io.hpp"
 
 /**